@@ -65,6 +65,10 @@ else()
                 mcjit
                 Support
                 nativecodegen
+                Linker
+                BitReader
+                BitWriter
+                ipo
         )
 
         # # Provide LLVM variables to the main CMakeLists.txt
@@ -16,6 +16,10 @@ else()
             mcjit
             Support
             nativecodegen
+            Linker
+            BitReader
+            BitWriter
+            ipo
     )
 endif()
 
@@ -1,10 +1,16 @@
 #include <filesystem>
 #include <cstdint>
 #include <iostream>
+#include <set>
 #include <string>
 #include <unistd.h>
 #include <fstream>
 #include <array>
+#include <algorithm>
+#include <sstream>
+#include <chrono>
+#include <cctype>
+#include <cmath>
 
 #include <bpf/libbpf.h>
 
@@ -18,9 +24,115 @@
 #include "src/helpers/helper.h"
 #include "src/include/helpers_impl.h"
 #include "src/jit/passthrough_section.h"
+#include "src/elf/elf_reader.h"
+#include "src/jit/frozen_map.h"
 
 #define XDP_SECT "xdp"
 
+// Output of --single-object
+#define SINGLE_OBJECT_NAME "bpf_progs.o"
+
+// Options of the build subcommand
+typedef struct build_options {
+    std::filesystem::path output;
+    bool emit_llvm_ir;
+
+    // <name>.bc instead of <name>.o, linked with the runtime by a link time optimizer
+    bool emit_bitcode;
+    std::string lto_caller;
+
+    // NAME=FILE snapshots of the ARRAY maps to freeze
+    std::vector<std::string> frozen_maps;
+
+    ebpf_llvm_jit::jit::intrinsics_config intrinsics;
+
+    bool hot_cold_splitting;
+
+    // Profile guided optimization
+    bool instrument;
+    std::string profile_use;
+
+    bool batch;
+    unsigned batch_prefetch_distance;
+    bool spmd;
+
+    // Memory operations
+    bool rvv;
+    bool reroll;
+
+    // Atomics
+    unsigned harts;
+    std::vector<std::string> exclusive_maps;
+
+    // Sandbox data window size (0 = unchecked)
+    uint64_t sandbox_window;
+
+    // Tail calls: NAME=SLOT:PROG[,SLOT:PROG...] slots of the prog arrays known at build time
+    std::vector<std::string> prog_arrays;
+    std::string entry;
+
+    // Export the verdict memoization key of stateless programs
+    bool memo;
+
+    // All the programs in one object
+    bool single_object;
+
+    // NAME[:ACTION+ACTION...] programs fused into bpf_main, in order
+    std::vector<std::string> chain;
+
+    // Template backend instead of LLVM (falls back to LLVM for what it does not cover)
+    bool fast_backend;
+
+    // LLVM triple of the native objects
+    std::string target;
+
+    // Static bound of the cycles of each program, checked against --max-cycles
+    ebpf_llvm_jit::jit::wcet_config wcet;
+
+    // DWARF line tables mapping the code to the eBPF pcs and the C source
+    bool debug_info;
+
+    // <name>.json code quality manifest, compared with the one of the baseline directory (if any)
+    bool manifest;
+    std::filesystem::path regression_baseline;
+    double regression_tolerance;
+
+    // <name>.ld linker script fragment with the memory needs of each program
+    bool layout;
+
+    // Variants of bpf_main for other RISC-V extensions, in order of preference
+    std::vector<ebpf_llvm_jit::jit::isa_variant> isa_variants;
+
+    // Dominant packet shape, bpf_main gets a fast path for it
+    std::optional<ebpf_llvm_jit::jit::packet_shape> shape;
+
+    // Code generator level, features added to the target, full unroll trip count
+    unsigned opt_level;
+    std::string target_features;
+    unsigned unroll;
+
+    // <name>.tune profiles written by tune, overriding the options not given on the command line
+    bool use_tune;
+    std::filesystem::path tune_dir;
+    std::set<std::string> explicit_tune_keys;
+
+    // Build only this program of the ELF (empty = all)
+    std::string only_program;
+} build_options;
+
+// Options of the tune subcommand
+typedef struct tune_options {
+    // Directory of the <name>.tune profiles, scratch directory of the variants
+    std::filesystem::path output;
+    std::filesystem::path work_dir;
+
+    // Program to tune (empty = all)
+    std::string program;
+
+    ebpf_llvm_jit::jit::tune_runner runner;
+    ebpf_llvm_jit::jit::tune_space space;
+} tune_options;
+
 using namespace llvm::object;
 using namespace llvm;
 
@@ -38,6 +150,49 @@ uint64_t _bpf_helper_ext_0006(const void *fmt, uint64_t fmt_size, ...)
     va_end(args);
     return 0;
 }
+// Unsigned number (decimal, 0x hexadecimal or 0 octal) up to max, false if value is not entirely one
+static bool parse_unsigned(const std::string &value, uint64_t max, uint64_t &result)
+{
+    // stoull would skip leading spaces and wrap negative numbers
+    if (value.empty() || !std::isdigit((unsigned char)value[0])) {
+        return false;
+    }
+
+    try {
+        size_t end;
+        result = std::stoull(value, &end, 0);
+        return end == value.size() && result <= max;
+    } catch (const std::exception &) {
+        return false;
+    }
+}
+// Value of the numeric option name of command, exits if it is not a number in [min, max]
+static uint64_t unsigned_option(argparse::ArgumentParser &command, const std::string &name, uint64_t min, uint64_t max)
+{
+    auto value = command.get<std::string>(name);
+    uint64_t result;
+    if (!parse_unsigned(value, max, result) || result < min) {
+        std::cerr << "Invalid --" << name << " \"" << value << "\", expected a number in [" << min << ", " << max << "]" << std::endl;
+        std::exit(1);
+    }
+    return result;
+}
+// Value of the non negative decimal option name of command, exits if it is not one
+static double non_negative_option(argparse::ArgumentParser &command, const std::string &name)
+{
+    auto value = command.get<std::string>(name);
+    try {
+        size_t end;
+        double result = std::stod(value, &end);
+        if (!value.empty() && std::isdigit((unsigned char)value[0]) && end == value.size() && std::isfinite(result)) {
+            return result;
+        }
+    } catch (const std::exception &) {
+    }
+
+    std::cerr << "Invalid --" << name << " \"" << value << "\", expected a non negative number" << std::endl;
+    std::exit(1);
+}
 uint64_t empty_helper()
 {
     std::cerr << "Empty helper called" << std::endl;
@@ -70,54 +225,299 @@ static int add_all_helpers(ebpf_llvm_jit::jit::CompilerXDP *ctx)
     return 0;
 }
 
-// Assume this is called to load and access the eBPF object file
-std::string loadSection(const std::string &sourceFile, const std::string& sectionNameString) {
+// Maps of the global data sections (.rodata, .data, .bss) created by libbpf
+static void register_internal_maps(bpf_object *obj, ebpf_llvm_jit::jit::CompilerXDP *ctx, const std::vector<ebpf_llvm_jit::jit::passthrough_section> &sections)
+{
+    bpf_map *map;
+    uint32_t idx = 0;
+
+    bpf_object__for_each_map(map, obj)
+    {
+        // libbpf names them <obj name prefix><section>
+        std::string map_name = bpf_map__name(map);
+
+        for (const auto &section : sections) {
+            if (map_name.size() >= section.source.size() &&
+                map_name.compare(map_name.size() - section.source.size(), section.source.size(), section.source) == 0) {
+
+                SPDLOG_DEBUG("Map {} ({}) backed by section {}", idx, map_name, section.source);
+                ctx->register_map_section(idx, section.source);
+                break;
+            }
+        }
+
+        idx++;
+    }
+}
+// Internal maps (global data sections) accessed by a single hart
+static int register_exclusive_maps(bpf_object *obj, ebpf_llvm_jit::jit::CompilerXDP *ctx, const std::vector<std::string> &names)
+{
+    for (const auto &name : names) {
+        bpf_map *map;
+        uint32_t idx = 0;
+        bool found = false;
+
+        bpf_object__for_each_map(map, obj)
+        {
+            if (name == bpf_map__name(map)) {
+                found = true;
+                break;
+            }
+            idx++;
+        }
+
+        if (!found) {
+            SPDLOG_ERROR("Map {} not found", name);
+            return -ENOENT;
+        }
+
+        if (ctx->set_exclusive_map(idx) < 0) {
+            SPDLOG_ERROR("Map {} cannot be exclusive: {}", name, ctx->get_error_message());
+            return -EINVAL;
+        }
+    }
+
+    return 0;
+}
+// Reads the snapshots of the maps to freeze, the content of a snapshot is the raw value array of the map
+// (max_entries * value_size bytes, shorter files are zero padded)
+static int load_frozen_maps(bpf_object *obj, const std::vector<std::string> &specs, std::vector<ebpf_llvm_jit::jit::frozen_map> &frozen)
+{
+    for (const auto &spec : specs) {
+        auto eq = spec.find('=');
+        if (eq == std::string::npos) {
+            SPDLOG_ERROR("Invalid frozen map \"{}\", expected NAME=FILE", spec);
+            return -EINVAL;
+        }
+
+        std::string map_name = spec.substr(0, eq);
+        std::string path = spec.substr(eq + 1);
+
+        bpf_map *map = bpf_object__find_map_by_name(obj, map_name.c_str());
+        if (!map) {
+            SPDLOG_ERROR("Map {} not found", map_name);
+            return -ENOENT;
+        }
+
+        if (bpf_map__type(map) != BPF_MAP_TYPE_ARRAY || bpf_map__key_size(map) != 4) {
+            SPDLOG_ERROR("Map {} is not an ARRAY map, only ARRAY maps can be frozen", map_name);
+            return -EINVAL;
+        }
+
+        ebpf_llvm_jit::jit::frozen_map fm;
+        fm.name = map_name;
+        fm.value_size = bpf_map__value_size(map);
+        fm.max_entries = bpf_map__max_entries(map);
+
+        std::ifstream ifs(path, std::ios::binary);
+        if (!ifs) {
+            SPDLOG_ERROR("Unable to open snapshot {} of map {}", path, map_name);
+            return -ENOENT;
+        }
+        fm.content.assign(std::istreambuf_iterator<char>(ifs), std::istreambuf_iterator<char>());
+
+        uint64_t expected = (uint64_t)fm.value_size * fm.max_entries;
+        if (fm.content.size() > expected) {
+            SPDLOG_ERROR("Snapshot {} is larger than map {} ({} > {} bytes)", path, map_name, fm.content.size(), expected);
+            return -EINVAL;
+        }
+        fm.content.resize(expected, '\0');
+
+        SPDLOG_INFO("Freezing map {} from {}", map_name, path);
+        frozen.push_back(fm);
+    }
+
+    return 0;
+}
+// Maps of the .maps section given storage in the native ELF (all but the frozen, internal and PROG_ARRAY ones)
+static void load_static_maps(bpf_object *obj, const std::vector<ebpf_llvm_jit::jit::frozen_map> &frozen, std::vector<ebpf_llvm_jit::jit::static_map> &maps)
+{
+    bpf_map *map;
+    bpf_object__for_each_map(map, obj)
+    {
+        std::string map_name = bpf_map__name(map);
+        auto type = bpf_map__type(map);
+
+        if (bpf_map__is_internal(map) || type == BPF_MAP_TYPE_PROG_ARRAY ||
+            std::any_of(frozen.begin(), frozen.end(), [&](const auto &f) { return f.name == map_name; })) {
+            continue;
+        }
 
-    // Load the source object file
-    Expected<OwningBinary<ObjectFile>> binaryOrErr = ObjectFile::createObjectFile(sourceFile);
-    if (!binaryOrErr) {
-        llvm::errs() << "Failed to open source file\n";
-        SPDLOG_ERROR("Failed to open source file {}\n", sourceFile);
-        return "";
+        if (type != BPF_MAP_TYPE_ARRAY && type != BPF_MAP_TYPE_HASH && type != BPF_MAP_TYPE_LRU_HASH) {
+            SPDLOG_WARN("Map {} has type {}, only ARRAY, HASH and LRU_HASH maps get storage", map_name, type);
+            continue;
+        }
+
+        maps.push_back({ map_name, (uint32_t)type, bpf_map__key_size(map), bpf_map__value_size(map), bpf_map__max_entries(map) });
     }
-    if (auto E = binaryOrErr.takeError()) {
-        SPDLOG_ERROR("Failed to open source file error: {}\n", toString(std::move(E)));
-        return "";
+}
+// PROG_ARRAY maps shared by the programs of the object, filled with the slots given on the command line
+static int load_prog_arrays(bpf_object *obj, const std::vector<std::string> &specs, std::vector<ebpf_llvm_jit::jit::prog_array> &arrays)
+{
+    bpf_map *map;
+    bpf_object__for_each_map(map, obj)
+    {
+        if (bpf_map__type(map) == BPF_MAP_TYPE_PROG_ARRAY) {
+            arrays.push_back({ bpf_map__name(map), bpf_map__max_entries(map), {} });
+        }
     }
 
-    ObjectFile &srcObj = *binaryOrErr->getBinary();
+    for (const auto &spec : specs) {
+        auto eq = spec.find('=');
+        if (eq == std::string::npos) {
+            SPDLOG_ERROR("Invalid prog array \"{}\", expected NAME=SLOT:PROG[,SLOT:PROG...]", spec);
+            return -EINVAL;
+        }
+
+        std::string map_name = spec.substr(0, eq);
+        auto array = std::find_if(arrays.begin(), arrays.end(), [&](const auto &a) { return a.name == map_name; });
+        if (array == arrays.end()) {
+            SPDLOG_ERROR("Map {} not found or not a PROG_ARRAY map", map_name);
+            return -ENOENT;
+        }
 
-    // Find the section
-    for (const SectionRef &section : srcObj.sections()) {
-        auto sectionName = section.getName();
+        std::stringstream slots(spec.substr(eq + 1));
+        std::string slot;
+        while (std::getline(slots, slot, ',')) {
+            auto colon = slot.find(':');
+            if (colon == std::string::npos) {
+                SPDLOG_ERROR("Invalid slot \"{}\" of prog array {}, expected SLOT:PROG", slot, map_name);
+                return -EINVAL;
+            }
 
-        if (auto E = sectionName.takeError()) {
-            SPDLOG_ERROR("Failed to open source file error: {}\n", toString(std::move(E)));
-            return "";
+            std::string prog_name = slot.substr(colon + 1);
+            if (!bpf_object__find_program_by_name(obj, prog_name.c_str())) {
+                SPDLOG_ERROR("Program {} of prog array {} not found", prog_name, map_name);
+                return -ENOENT;
+            }
+
+            uint64_t index;
+            if (!parse_unsigned(slot.substr(0, colon), UINT32_MAX, index)) {
+                SPDLOG_ERROR("Invalid slot \"{}\" of prog array {}, expected SLOT:PROG", slot, map_name);
+                return -EINVAL;
+            }
+
+            array->slots[index] = prog_name;
         }
+    }
+
+    return 0;
+}
+// Parses the --chain stages, NAME[:ACTION+ACTION...] with the verdicts running the next stage
+static int load_chain(bpf_object *obj, const std::vector<std::string> &specs, std::vector<ebpf_llvm_jit::jit::chain_stage> &chain)
+{
+    static const char *action_names[] = XDP_ACTION_NAMES;
+
+    for (const auto &spec : specs) {
+        auto colon = spec.find(':');
+        ebpf_llvm_jit::jit::chain_stage stage = { spec.substr(0, colon), CHAIN_DEFAULT_ACTIONS };
 
-        SPDLOG_DEBUG("Found Section {}", sectionName->str());
+        if (!bpf_object__find_program_by_name(obj, stage.name.c_str())) {
+            SPDLOG_ERROR("Program {} of the chain not found", stage.name);
+            return -ENOENT;
+        }
 
-        if (sectionName->str() == sectionNameString) {
-            // Retrieve the contents of the .rodata section (string literals)
-            auto content = section.getContents();
+        if (colon != std::string::npos) {
+            stage.continue_actions = 0;
 
-            if (auto E = content.takeError()) {
-                SPDLOG_ERROR("Failed to get content of {} {}\n", sectionNameString, toString(std::move(E)));
-                return "";
+            std::stringstream actions(spec.substr(colon + 1));
+            std::string action;
+            while (std::getline(actions, action, '+')) {
+                auto it = std::find(std::begin(action_names), std::end(action_names), action);
+                if (it == std::end(action_names)) {
+                    SPDLOG_ERROR("Invalid action \"{}\" of stage {}, expected aborted, drop, pass, tx or redirect", action, stage.name);
+                    return -EINVAL;
+                }
+                stage.continue_actions |= 1u << (it - std::begin(action_names));
             }
+        }
+
+        chain.push_back(stage);
+    }
+
+    return 0;
+}
+static int parse_helper_costs(const std::vector<std::string> &specs, std::map<int32_t, uint64_t> &costs)
+{
+    for (const auto &spec : specs) {
+        auto eq = spec.find('=');
+        if (eq == std::string::npos || eq == 0 || eq + 1 == spec.size()) {
+            SPDLOG_ERROR("Invalid helper cost \"{}\", expected ID=CYCLES", spec);
+            return -EINVAL;
+        }
 
-            return content->str(); // Return the rodata content as a string
+        uint64_t id, cycles;
+        if (!parse_unsigned(spec.substr(0, eq), INT32_MAX, id) || !parse_unsigned(spec.substr(eq + 1), UINT64_MAX, cycles)) {
+            SPDLOG_ERROR("Invalid helper cost \"{}\", expected ID=CYCLES", spec);
+            return -EINVAL;
         }
+        costs[(int32_t)id] = cycles;
     }
 
-    SPDLOG_INFO("{} section not found", sectionNameString);
-    return "";
+    return 0;
 }
-static int build_xdp(bpf_program *prog, const char *name, const std::filesystem::path &output, bool emit_llvm_ir, std::vector<ebpf_llvm_jit::jit::passthrough_section> &sections)
+static int write_manifest(const ebpf_llvm_jit::jit::program_manifest &manifest, const build_options &opts)
+{
+    auto path = opts.output / (manifest.program + ".json");
+    std::ofstream ofs(path);
+    ofs << ebpf_llvm_jit::jit::manifestToJson(manifest);
+    SPDLOG_INFO("Manifest of program {} written to {}", manifest.program, path.c_str());
+
+    if (opts.regression_baseline.empty()) {
+        return 0;
+    }
+
+    auto baseline_path = opts.regression_baseline / (manifest.program + ".json");
+    std::ifstream ifs(baseline_path);
+    if (!ifs) {
+        SPDLOG_WARN("No baseline manifest {} for program {}", baseline_path.c_str(), manifest.program);
+        return 0;
+    }
+    std::stringstream baseline;
+    baseline << ifs.rdbuf();
+
+    auto regressions = ebpf_llvm_jit::jit::findRegressions(manifest, baseline.str(), opts.regression_tolerance);
+    for (const auto &regression : regressions) {
+        SPDLOG_ERROR("Program {} regressed against {}: {}", manifest.program, baseline_path.c_str(), regression);
+    }
+
+    return regressions.empty() ? 0 : 1;
+}
+static void write_layout(const ebpf_llvm_jit::jit::memory_layout &layout, const build_options &opts)
+{
+    auto path = opts.output / (layout.program + ".ld");
+    std::ofstream ofs(path);
+    ofs << ebpf_llvm_jit::jit::layoutToLinkerScript(layout);
+    SPDLOG_INFO("Layout of program {} written to {} [stack: {} bytes, data: {} bytes, align: {}]",
+                layout.program, path.c_str(), layout.stack_size, layout.data_size, layout.alignment);
+}
+static int build_xdp(bpf_object *obj, bpf_program *prog, const char *name, const std::string &ebpf_elf, const build_options &opts, std::vector<ebpf_llvm_jit::jit::passthrough_section> &sections, const std::vector<ebpf_llvm_jit::jit::frozen_map> &frozen, const std::vector<ebpf_llvm_jit::jit::static_map> &static_maps, const std::vector<ebpf_llvm_jit::jit::prog_array> &prog_arrays, bool entry, std::vector<ebpf_llvm_jit::jit::linked_program> &linked)
 {
     ebpf_llvm_jit::jit::CompilerXDP ctx;
 
+    if (ctx.set_target(opts.target) < 0) {
+        SPDLOG_ERROR("Invalid target {}: {}", opts.target, ctx.get_error_message());
+        return 1;
+    }
+
+    ebpf_llvm_jit::jit::tune_config tuning = { opts.opt_level, opts.target_features, opts.unroll,
+                                               opts.hot_cold_splitting, opts.reroll };
+    auto tune_path = opts.tune_dir / (std::string(name) + TUNE_PROFILE_EXT);
+    if (opts.use_tune && std::filesystem::exists(tune_path)) {
+        std::string error;
+        if (!ebpf_llvm_jit::jit::readTuneProfile(tune_path, tuning, opts.explicit_tune_keys, error)) {
+            SPDLOG_ERROR("Invalid tune profile {}: {}", tune_path.c_str(), error);
+            return 1;
+        }
+        SPDLOG_INFO("Program {} tuned by {} [{}]", name, tune_path.c_str(), ebpf_llvm_jit::jit::tuneConfigToString(tuning));
+    }
+
+    if (ctx.set_codegen(tuning.opt_level, tuning.target_features) < 0) {
+        SPDLOG_ERROR("Invalid code generator options: {}", ctx.get_error_message());
+        return 1;
+    }
+    ctx.set_unroll(tuning.unroll);
+
     if (const int err = add_all_helpers(&ctx)) {
         SPDLOG_ERROR("error while loading helpers: {}", err);
         return 1;
@@ -133,18 +533,149 @@ static int build_xdp(bpf_program *prog, const char *name, const std::filesystem:
         return 1;
     }
 
+    // libbpf has not relocated the instructions yet: references to global data
+    // are resolved against the injected sections
+    auto relocations = ebpf_llvm_jit::elf::loadProgramRelocations(ebpf_elf, bpf_program__section_name(prog), name);
+    if (ctx.load_relocations(relocations) < 0) {
+        SPDLOG_ERROR("Unable to load relocations of program {}: {}", name, ctx.get_error_message());
+        return 1;
+    }
+    register_internal_maps(obj, &ctx, sections);
+
+    if (ctx.set_sandbox(opts.sandbox_window) < 0) {
+        SPDLOG_ERROR("Invalid sandbox configuration: {}", ctx.get_error_message());
+        return 1;
+    }
+
+    ctx.set_harts(opts.harts);
+    if (register_exclusive_maps(obj, &ctx, opts.exclusive_maps) < 0) {
+        return 1;
+    }
+
+    if (ctx.set_intrinsics(opts.intrinsics) < 0) {
+        SPDLOG_ERROR("Invalid intrinsics configuration: {}", ctx.get_error_message());
+        return 1;
+    }
+
+    ctx.set_hot_cold_splitting(tuning.hot_cold_splitting);
+    ctx.set_instrumentation(opts.instrument);
+
+    if (!opts.profile_use.empty()) {
+        auto key = ebpf_llvm_jit::jit::make_profile_key(name, (const ebpf_inst *)bpf_program__insns(prog),
+                                                        bpf_program__insn_cnt(prog));
+        auto profile = ebpf_llvm_jit::jit::read_profile(opts.profile_use, key);
+        if (!profile) {
+            return 1;
+        }
+        ctx.set_profile(*profile);
+    }
+
+    ctx.set_batch(opts.batch);
+    if (ctx.set_batch_prefetch_distance(opts.batch_prefetch_distance) < 0) {
+        SPDLOG_ERROR("Invalid batch configuration: {}", ctx.get_error_message());
+        return 1;
+    }
+
+    ctx.set_spmd(opts.spmd);
+    ctx.set_vector(opts.rvv);
+    ctx.set_reroll(tuning.reroll);
+    ctx.set_memoization(opts.memo);
+    ctx.set_wcet(opts.wcet);
+
+    ctx.set_manifest(opts.manifest);
+    ctx.set_layout(opts.layout);
+    if (ctx.set_isa_variants(opts.isa_variants) < 0) {
+        SPDLOG_ERROR("Invalid ISA variants: {}", ctx.get_error_message());
+        return 1;
+    }
+    ctx.set_packet_shape(opts.shape);
+    if (opts.debug_info) {
+        ctx.set_debug_info(true, ebpf_llvm_jit::elf::loadProgramLineInfo(ebpf_elf, bpf_program__section_name(prog), name));
+    }
+
+    for (const auto &map : frozen) {
+        if (ctx.freeze_map(map) < 0) {
+            SPDLOG_ERROR("Unable to freeze map {}: {}", map.name, ctx.get_error_message());
+            return 1;
+        }
+    }
+
+    for (const auto &map : static_maps) {
+        if (ctx.register_static_map(map) < 0) {
+            SPDLOG_ERROR("Unable to allocate map {}: {}", map.name, ctx.get_error_message());
+            return 1;
+        }
+    }
+
+    ctx.set_program(name, entry);
+    ctx.set_single_object(opts.single_object);
+    for (const auto &array : prog_arrays) {
+        if (ctx.register_prog_array(array) < 0) {
+            SPDLOG_ERROR("Invalid prog array {}: {}", array.name, ctx.get_error_message());
+            return 1;
+        }
+    }
+
+    // linked with the other programs by build_ebpf_program
+    if (opts.single_object) {
+        linked.push_back({ name, ctx.do_aot_compile_bitcode(sections) });
+        return 0;
+    }
+
+    if (opts.emit_bitcode) {
+        if (!opts.lto_caller.empty() && ctx.set_lto_caller(opts.lto_caller) < 0) {
+            SPDLOG_ERROR("Invalid --lto-caller: {}", ctx.get_error_message());
+            return 1;
+        }
+
+        auto bc_path = opts.output / (std::string(name) + ".bc");
+        auto bitcode = ctx.do_lto_bitcode(opts.emit_llvm_ir, sections);
+        if (bitcode.empty()) {
+            SPDLOG_ERROR("Program {}: {}", name, ctx.get_error_message());
+            return 1;
+        }
+        std::ofstream ofs(bc_path, std::ios::binary);
+        ofs.write((const char *)bitcode.data(), bitcode.size());
+
+        SPDLOG_INFO("Program {} written to {}", name, bc_path.c_str());
+        return 0;
+    }
+
     // write result to file
-    auto result = ctx.do_aot_compile(emit_llvm_ir, sections);
+    auto start = std::chrono::steady_clock::now();
+    std::vector<uint8_t> result;
+    if (opts.fast_backend) {
+        result = ctx.do_fast_compile(sections);
+        if (result.empty()) {
+            SPDLOG_WARN("Program {} not supported by the fast backend ({}), using LLVM", name, ctx.get_error_message());
+        }
+    }
+    if (result.empty()) {
+        result = ctx.do_aot_compile(opts.emit_llvm_ir, sections);
+        if (result.empty()) {
+            SPDLOG_ERROR("Program {}: {}", name, ctx.get_error_message());
+            return 1;
+        }
+    }
+    auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+    SPDLOG_INFO("Program {} compiled in {} us", name, elapsed.count());
 
-    auto out_path = output / (std::string(name) + ".o");
+    auto out_path = opts.output / (std::string(name) + ".o");
     std::ofstream ofs(out_path, std::ios::binary);
     ofs.write((const char *)result.data(), result.size());
 
     SPDLOG_INFO("Program {} written to {}", name, out_path.c_str());
 
+    if (opts.layout) {
+        write_layout(*ctx.get_layout(), opts);
+    }
+    if (opts.manifest) {
+        return write_manifest(*ctx.get_manifest(), opts);
+    }
+
     return 0;
 }
-static int build_ebpf_program(const std::string &ebpf_elf, const std::filesystem::path &output, bool emit_llvm_ir)
+static int build_ebpf_program(const std::string &ebpf_elf, const build_options &opts)
 {
     bpf_object *obj = bpf_object__open(ebpf_elf.c_str());
     if (!obj) {
@@ -154,31 +685,65 @@ static int build_ebpf_program(const std::string &ebpf_elf, const std::filesystem
     std::unique_ptr<bpf_object, decltype(&bpf_object__close)> elf(obj, bpf_object__close);
     bpf_program *prog;
 
-    std::vector<ebpf_llvm_jit::jit::passthrough_section> sections = {
-            {
-                    ".rodata.bpf",
-                    loadSection(ebpf_elf, ".rodata")
-            },
-            {
-                    ".rodata.str1.1",
-                    loadSection(ebpf_elf, ".rodata.str1.1")
-            },
-            {
-                    ".bss.bpf",
-                    loadSection(ebpf_elf, ".bss")
-            }
+    // section of the eBPF ELF -> section of the native ELF
+    const std::vector<std::pair<std::string, std::string>> data_sections = {
+            {".rodata", ".rodata.bpf"},
+            {".rodata.str1.1", ".rodata.str1.1"},
+            {".data", ".data.bpf"},
+            {".bss", ".bss.bpf"},
     };
 
+    std::vector<ebpf_llvm_jit::jit::passthrough_section> sections;
+    for (const auto &[src, dst] : data_sections) {
+        if (auto section = ebpf_llvm_jit::elf::loadDataSection(ebpf_elf, src, dst); section) {
+            sections.push_back(*section);
+        }
+    }
+
+    std::vector<ebpf_llvm_jit::jit::frozen_map> frozen;
+    if (load_frozen_maps(elf.get(), opts.frozen_maps, frozen) < 0) {
+        return 1;
+    }
+
+    std::vector<ebpf_llvm_jit::jit::static_map> static_maps;
+    load_static_maps(elf.get(), frozen, static_maps);
+
+    std::vector<ebpf_llvm_jit::jit::prog_array> prog_arrays;
+    if (load_prog_arrays(elf.get(), opts.prog_arrays, prog_arrays) < 0) {
+        return 1;
+    }
+
+    // With tail calls the programs are linked together, only the entry one exports bpf_main
+    std::string entry = opts.entry;
+    if (entry.empty()) {
+        if (auto first = bpf_object__next_program(elf.get(), nullptr)) {
+            entry = bpf_program__name(first);
+        }
+    } else if (!bpf_object__find_program_by_name(elf.get(), entry.c_str())) {
+        SPDLOG_ERROR("Entry program {} not found", entry);
+        return 1;
+    }
+
+    std::vector<ebpf_llvm_jit::jit::chain_stage> chain;
+    if (load_chain(elf.get(), opts.chain, chain) < 0) {
+        return 1;
+    }
+
+    std::vector<ebpf_llvm_jit::jit::linked_program> linked;
+
     bpf_object__for_each_program(prog, elf.get())
     {
         auto name = bpf_program__name(prog);
         auto sect = bpf_program__section_name(prog);
+        if (!opts.only_program.empty() && opts.only_program != name) {
+            continue;
+        }
         SPDLOG_INFO("Processing program {}", name);
 
         int err = 0;
 
         if (strcmp(sect, "xdp") == 0) {
-            err = build_xdp(prog, name, output, emit_llvm_ir, sections);
+            err = build_xdp(elf.get(), prog, name, ebpf_elf, opts, sections, frozen, static_maps, prog_arrays, entry == name, linked);
         } else {
             SPDLOG_ERROR("BPF section type \"{}\" is unsupported", sect);
         }
@@ -189,10 +754,155 @@ static int build_ebpf_program(const std::string &ebpf_elf, const std::filesystem
         }
     }
 
+    if (opts.single_object) {
+        ebpf_llvm_jit::jit::CompilerXDP ctx;
+        if (ctx.set_target(opts.target) < 0) {
+            SPDLOG_ERROR("Invalid target {}: {}", opts.target, ctx.get_error_message());
+            return 1;
+        }
+        if (ctx.set_codegen(opts.opt_level, opts.target_features) < 0) {
+            SPDLOG_ERROR("Invalid code generator options: {}", ctx.get_error_message());
+            return 1;
+        }
+        ctx.set_vector(opts.rvv);
+        ctx.set_spmd(opts.spmd);
+        ctx.set_batch(opts.batch);
+
+        if (ctx.set_batch_prefetch_distance(opts.batch_prefetch_distance) < 0 || ctx.set_chain(chain) < 0) {
+            SPDLOG_ERROR("Invalid chain configuration: {}", ctx.get_error_message());
+            return 1;
+        }
+
+        auto result = ctx.link_programs(linked, entry, opts.emit_llvm_ir);
+
+        auto out_path = opts.output / SINGLE_OBJECT_NAME;
+        std::ofstream ofs(out_path, std::ios::binary);
+        ofs.write((const char *)result.data(), result.size());
+
+        SPDLOG_INFO("{} programs written to {}", linked.size(), out_path.c_str());
+    }
+
     return 0;
 }
 
 
+// Options of a build with the defaults of the command line, as the variants of tune are built
+static build_options default_build_options()
+{
+    build_options opts = {};
+    opts.output = ".";
+    opts.hot_cold_splitting = true;
+    opts.batch_prefetch_distance = BATCH_DEFAULT_PREFETCH_DISTANCE;
+    opts.reroll = true;
+    opts.target = AOT_DEFAULT_TRIPLE;
+    opts.opt_level = 2;
+    opts.use_tune = false;
+    return opts;
+}
+// Builds every variant of the search space of each program, measures it in QEMU and writes the fastest one
+// giving the verdicts of the default build to <output>/<name>.tune
+static int tune_ebpf_program(const std::string &ebpf_elf, const tune_options &topts)
+{
+    std::vector<std::string> names;
+    {
+        bpf_object *obj = bpf_object__open(ebpf_elf.c_str());
+        if (!obj) {
+            SPDLOG_CRITICAL("Unable to open BPF elf: {}", errno);
+            return 1;
+        }
+        std::unique_ptr<bpf_object, decltype(&bpf_object__close)> elf(obj, bpf_object__close);
+
+        bpf_program *prog;
+        bpf_object__for_each_program(prog, elf.get())
+        {
+            if (strcmp(bpf_program__section_name(prog), XDP_SECT) == 0 &&
+                (topts.program.empty() || topts.program == bpf_program__name(prog))) {
+                names.emplace_back(bpf_program__name(prog));
+            }
+        }
+    }
+    if (names.empty()) {
+        SPDLOG_ERROR("No XDP program {}found in {}", topts.program.empty() ? "" : topts.program + " ", ebpf_elf);
+        return 1;
+    }
+
+    auto configs = ebpf_llvm_jit::jit::expandTuneSpace(topts.space);
+    SPDLOG_INFO("Tuning {} programs, {} variants each", names.size(), configs.size());
+
+    for (const auto &name : names) {
+        std::optional<ebpf_llvm_jit::jit::tune_result> baseline;
+        size_t best = 0;
+        double best_per_packet = 0;
+
+        for (size_t i = 0; i < configs.size(); i++) {
+            const auto &config = configs[i];
+            auto variant = ebpf_llvm_jit::jit::tuneConfigToString(config);
+
+            build_options opts = default_build_options();
+            opts.output = topts.work_dir / name / std::to_string(i);
+            opts.only_program = name;
+            opts.entry = name;
+            opts.opt_level = config.opt_level;
+            opts.target_features = config.target_features;
+            opts.unroll = config.unroll;
+            opts.hot_cold_splitting = config.hot_cold_splitting;
+            opts.reroll = config.reroll;
+            std::filesystem::create_directories(opts.output);
+
+            // the log of each build would bury the results
+            auto level = spdlog::get_level();
+            spdlog::set_level(spdlog::level::warn);
+            int err = build_ebpf_program(ebpf_elf, opts);
+            spdlog::set_level(level);
+
+            std::string error;
+            std::optional<ebpf_llvm_jit::jit::tune_result> result;
+            if (err == 0) {
+                result = ebpf_llvm_jit::jit::measureObject(topts.runner, opts.output / (name + ".o"),
+                                                           opts.output / (name + ".elf"), error);
+            } else {
+                error = "build failed";
+            }
+
+            if (!result) {
+                if (i == 0) {
+                    SPDLOG_ERROR("Program {}: default build cannot be measured: {}", name, error);
+                    return 1;
+                }
+                SPDLOG_WARN("Program {} [{}]: {}", name, variant, error);
+                continue;
+            }
+
+            if (!baseline) {
+                baseline = result;
+            } else if (result->verdict_hash != baseline->verdict_hash || result->packets != baseline->packets) {
+                SPDLOG_WARN("Program {} [{}]: verdicts differ from the default build, rejected", name, variant);
+                continue;
+            }
+
+            SPDLOG_INFO("Program {} [{}]: {:.1f} instructions per packet", name, variant, result->per_packet());
+            if (i == 0 || result->per_packet() < best_per_packet) {
+                best = i;
+                best_per_packet = result->per_packet();
+            }
+        }
+
+        auto comment = fmt::format("ebpf_llvm_jit tune: {:.1f} instructions per packet over {} packets of {} (default: {:.1f})",
+                                   best_per_packet, baseline->packets, topts.runner.trace, baseline->per_packet());
+        auto path = topts.output / (name + TUNE_PROFILE_EXT);
+        if (!ebpf_llvm_jit::jit::writeTuneProfile(path, configs[best], comment)) {
+            SPDLOG_ERROR("Unable to write {}", path.c_str());
+            return 1;
+        }
+
+        SPDLOG_INFO("Program {}: best [{}], {:.1f} instructions per packet ({:.1f}% of the default), written to {}",
+                    name, ebpf_llvm_jit::jit::tuneConfigToString(configs[best]), best_per_packet,
+                    100 * best_per_packet / baseline->per_packet(), path.c_str());
+    }
+
+    return 0;
+}
+
 int main(int argc, const char **argv)
 {
 
@@ -214,10 +924,196 @@ int main(int argc, const char **argv)
         .default_value(false)
         .implicit_value(true)
         .help("Emit LLVM IR for the eBPF program");
+    build_command.add_argument("--emit-bitcode")
+        .default_value(false)
+        .implicit_value(true)
+        .help("Write the optimized module of each program as <name>.bc instead of <name>.o, for a LTO link with the runtime (ld.lld)");
+    build_command.add_argument("--lto-caller")
+        .default_value(std::string(""))
+        .help("FILE: bitcode object of the runtime calling bpf_main (clang -flto), its CPU and features are given to the program so that LTO can inline it (implies --emit-bitcode)");
+    build_command.add_argument("-m", "--freeze-map")
+        .default_value(std::vector<std::string>{})
+        .append()
+        .help("NAME=FILE: treat the ARRAY map NAME as constant, using the raw value array in FILE (can be repeated)");
+    build_command.add_argument("--no-intrinsics")
+        .default_value(false)
+        .implicit_value(true)
+        .help("Call ktime/prandom/processor id/numa node helpers out of line instead of lowering them inline");
+    build_command.add_argument("--timebase-hz")
+        .default_value(std::string("10000000"))
+        .help("Frequency of the RISC-V time counter, used to convert rdtime to ns");
+    build_command.add_argument("--hartid-from-tp")
+        .default_value(false)
+        .implicit_value(true)
+        .help("Read the hart id from tp instead of mhartid (programs not running in M-mode)");
+    build_command.add_argument("--no-hot-cold")
+        .default_value(false)
+        .implicit_value(true)
+        .help("Do not move cold blocks (failed bounds checks, bpf_printk) to .text.unlikely");
+    build_command.add_argument("--instrument")
+        .default_value(false)
+        .implicit_value(true)
+        .help("Count the executions of each block, counters are dumped by bpf_prof_dump() of the runtime");
+    build_command.add_argument("--profile-use")
+        .default_value(std::string(""))
+        .help("Optimize using the block counts dumped by an --instrument build (e.g. the QEMU serial log)");
+    build_command.add_argument("--prefetch-batch")
+        .default_value(false)
+        .implicit_value(true)
+        .help("Also emit bpf_main_batch(), running bpf_main over n packets one at a time and prefetching the next ones");
+    build_command.add_argument("--prefetch-distance")
+        .default_value(std::string("2"))
+        .help("Packets loaded ahead of the running one by bpf_main_batch() (0 = no prefetch, requires --prefetch-batch)");
+    build_command.add_argument("--spmd")
+        .default_value(false)
+        .implicit_value(true)
+        .help("Experimental: also emit bpf_main_spmd(), running VLEN/32 packets at a time with RVV (requires V)");
+    build_command.add_argument("--rvv")
+        .default_value(false)
+        .implicit_value(true)
+        .help("Target has the V extension: lower memcpy/memset/memcmp runs to RVV loads/stores");
+    build_command.add_argument("--no-reroll")
+        .default_value(false)
+        .implicit_value(true)
+        .help("Keep the memcpy/memset/memcmp unrolled by clang as individual loads/stores");
+    build_command.add_argument("--harts")
+        .default_value(std::string("0"))
+        .help("Harts running the programs (0 = unknown, at most 8: the per-hart state has 8 slots): with 1, atomics are compiled as plain read-modify-write");
+    build_command.add_argument("--exclusive-map")
+        .default_value(std::vector<std::string>{})
+        .append()
+        .help("NAME: the global data map NAME (e.g. main_bpf.bss) is only accessed by one hart, its atomics are plain read-modify-write (can be repeated)");
+    build_command.add_argument("--sandbox")
+        .default_value(false)
+        .implicit_value(true)
+        .help("Confine the memory accesses to the stack, ctx, data sections and the data window by address masking");
+    build_command.add_argument("--sandbox-window")
+        .default_value(std::string("0x100000"))
+        .help("Size of the data window holding packets and maps (power of two, must match the linker script)");
+    build_command.add_argument("--memo")
+        .default_value(false)
+        .implicit_value(true)
+        .help("If the verdict is a pure function of a few packet bytes, export bpf_main_memo and bpf_main_memo_key() for the verdict cache of the runtime");
+    build_command.add_argument("--prog-array")
+        .default_value(std::vector<std::string>{})
+        .append()
+        .help("NAME=SLOT:PROG[,SLOT:PROG...]: programs of the PROG_ARRAY map NAME known at build time, tail calls are resolved at link time (can be repeated)");
+    build_command.add_argument("--entry")
+        .default_value(std::string(""))
+        .help("Program exporting bpf_main when the programs of an object with PROG_ARRAY maps are linked together (default: the first one)");
+    build_command.add_argument("--single-object")
+        .default_value(false)
+        .implicit_value(true)
+        .help("Build all the programs into " SINGLE_OBJECT_NAME ", exporting bpf_prog_<name> and the bpf_progs[] table (bpf_main is the --entry program)");
+    build_command.add_argument("--chain")
+        .default_value(std::string(""))
+        .help("NAME[:ACTION+ACTION...][,NAME...]: programs fused into bpf_main of " SINGLE_OBJECT_NAME ", each runs the next one on the given verdicts (default: pass), implies --single-object");
+    build_command.add_argument("--backend")
+        .default_value(std::string("llvm"))
+        .help("llvm: optimizing backend, fast: one template per eBPF instruction, compiles in microseconds (falls back to llvm for .maps maps)");
+    build_command.add_argument("--target")
+        .default_value(std::string(AOT_DEFAULT_TRIPLE))
+        .help("LLVM triple of the native objects (64-bit ELF, e.g. x86_64-linux-gnu, aarch64-linux-gnu); outside RISC-V the ktime/prandom/processor id helpers are called out of line");
+    build_command.add_argument("-g", "--debug-info")
+        .default_value(false)
+        .implicit_value(true)
+        .help("Emit a DWARF line table mapping the code to the eBPF pcs, and to the C source lines when the ELF has BTF line info (clang -g)");
+    build_command.add_argument("--manifest")
+        .default_value(false)
+        .implicit_value(true)
+        .help("Write <name>.json next to each object: instruction counts, native instructions by eBPF class, spills, reloads, stack frame, helpers and sections");
+    build_command.add_argument("--fail-on-regression")
+        .default_value(std::string(""))
+        .help("DIR: fail the build of a program whose native instructions, text size, spills, reloads or stack frame grew over DIR/<name>.json (implies --manifest)");
+    build_command.add_argument("--regression-tolerance")
+        .default_value(std::string("0"))
+        .help("Growth allowed by --fail-on-regression, in percent of the baseline");
+    build_command.add_argument("--layout")
+        .default_value(false)
+        .implicit_value(true)
+        .help("Write <name>.ld next to each object: linker script fragment with the stack, data, alignment and harts the program needs, for baremetal.ld");
+    build_command.add_argument("--isa-variant")
+        .default_value(std::vector<std::string>{})
+        .append()
+        .help("EXT,...: also compile bpf_main with these RISC-V extensions (e.g. zbb,v), the runtime runs at boot the first variant the hart supports (can be repeated, best first)");
+    build_command.add_argument("--shape")
+        .default_value(std::string(""))
+        .help("FIELD=N,...: also compile bpf_main for the packets with these headers (vlan, ethertype, ihl, proto), checked before running it, e.g. vlan=0,ethertype=0x0800,ihl=5,proto=6");
+    build_command.add_argument("--opt-level")
+        .default_value(std::string("2"))
+        .help("Optimization level of the code generator (0-3, as llc -O)");
+    build_command.add_argument("--target-features")
+        .default_value(std::string(""))
+        .help("+FEATURE,...: LLVM features added to the ones of the target (e.g. +zbb,+c)");
+    build_command.add_argument("--unroll")
+        .default_value(std::string("0"))
+        .help("Fully unroll the loops running at most this many iterations (0 = loops are kept)");
+    build_command.add_argument("--tune-dir")
+        .default_value(std::string(""))
+        .help("DIR: read the <name>.tune profiles written by tune from DIR (default: the directory of the eBPF ELF)");
+    build_command.add_argument("--no-tune")
+        .default_value(false)
+        .implicit_value(true)
+        .help("Ignore the <name>.tune profiles");
+    build_command.add_argument("--wcet")
+        .default_value(false)
+        .implicit_value(true)
+        .help("Bound the cycles of one run of each program from its machine code and the scheduling model, and report the worst path");
+    build_command.add_argument("--max-cycles")
+        .default_value(std::string("0"))
+        .help("Fail the build of a program whose WCET is over this many cycles (implies --wcet, 0 = no budget)");
+    build_command.add_argument("--helper-cost")
+        .default_value(std::vector<std::string>{})
+        .append()
+        .help("ID=CYCLES: cost of a call to the helper ID for --wcet, helpers without a cost fail a --max-cycles build (can be repeated)");
+    build_command.add_argument("--wcet-loop-bound")
+        .default_value(std::string("0"))
+        .help("Iterations of every loop for --wcet (0 = programs with loops cannot be bounded)");
+    build_command.add_argument("--wcet-cpu")
+        .default_value(std::string(""))
+        .help("CPU whose scheduling model costs the instructions for --wcet (e.g. sifive-u74, default: the CPU of the target)");
     build_command.add_argument("EBPF_ELF")
             .help("Path to an eBPF ELF executable");
 
+    argparse::ArgumentParser tune_command("tune");
+
+    tune_command.add_description(
+            "Measure builds of each program with different options on a packet trace in QEMU, and write the fastest "
+            "one to <name>.tune, used by build");
+    tune_command.add_argument("-o", "--output")
+            .default_value(std::string(""))
+            .help("Directory of the <name>.tune profiles (default: the directory of the eBPF ELF)");
+    tune_command.add_argument("--program")
+            .default_value(std::string(""))
+            .help("Program to tune (default: all the XDP programs)");
+    tune_command.add_argument("--runtime")
+            .required()
+            .help("DIR: rv64_baremetal_runtime, built (make), its harness bpf_tune.o runs the trace");
+    tune_command.add_argument("--trace")
+            .required()
+            .help("FILE: object with the packets between pkts_start and pkts_end (pkts.S of the examples)");
+    tune_command.add_argument("--space")
+            .default_value(std::vector<std::string>{})
+            .append()
+            .help("KEY=V1|V2|...: values tried for opt-level (default 1|2|3), target-features (default none), "
+                  "unroll (0|4|16), hot-cold (0|1) or reroll (0|1) (can be repeated)");
+    tune_command.add_argument("--work-dir")
+            .default_value(std::string("tune.work"))
+            .help("DIR: objects and images of the variants");
+    tune_command.add_argument("--ld")
+            .default_value(std::string("riscv64-unknown-elf-ld"))
+            .help("Linker of the images, split on whitespace and run without a shell");
+    tune_command.add_argument("--qemu")
+            .default_value(std::string("qemu-system-riscv64 -nographic -machine virt"))
+            .help("QEMU command line, split on whitespace and run without a shell, -icount shift=0 -bios IMAGE is appended");
+    tune_command.add_argument("--timeout")
+            .default_value(std::string("60"))
+            .help("Seconds before a QEMU run is killed");
+    tune_command.add_argument("EBPF_ELF")
+            .help("Path to an eBPF ELF executable");
+
     program.add_subparser(build_command);
+    program.add_subparser(tune_command);
 
     try {
         program.parse_args(argc, argv);
@@ -232,11 +1128,187 @@ int main(int argc, const char **argv)
     }
 
     if (program.is_subcommand_used(build_command)) {
-        return build_ebpf_program(
-            build_command.get<std::string>("EBPF_ELF"),
-            build_command.get<std::string>("output"),
-            build_command.get<bool>("emit_llvm")
-        );
+        build_options opts;
+        opts.output = build_command.get<std::string>("output");
+        opts.emit_llvm_ir = build_command.get<bool>("emit_llvm");
+        opts.lto_caller = build_command.get<std::string>("lto-caller");
+        opts.emit_bitcode = build_command.get<bool>("emit-bitcode") || !opts.lto_caller.empty();
+        opts.frozen_maps = build_command.get<std::vector<std::string>>("freeze-map");
+        opts.intrinsics.enabled = !build_command.get<bool>("no-intrinsics");
+        opts.intrinsics.timebase_hz = unsigned_option(build_command, "timebase-hz", 1, 1000000000);
+        opts.intrinsics.hartid_from_tp = build_command.get<bool>("hartid-from-tp");
+        opts.hot_cold_splitting = !build_command.get<bool>("no-hot-cold");
+        opts.instrument = build_command.get<bool>("instrument");
+        opts.profile_use = build_command.get<std::string>("profile-use");
+        opts.batch = build_command.get<bool>("prefetch-batch");
+        opts.spmd = build_command.get<bool>("spmd");
+        opts.rvv = build_command.get<bool>("rvv");
+        opts.reroll = !build_command.get<bool>("no-reroll");
+        opts.harts = unsigned_option(build_command, "harts", 0, INTRINSICS_MAX_HARTS);
+        opts.exclusive_maps = build_command.get<std::vector<std::string>>("exclusive-map");
+        opts.sandbox_window = build_command.get<bool>("sandbox") ?
+                unsigned_option(build_command, "sandbox-window", 1, UINT64_MAX) : 0;
+        opts.memo = build_command.get<bool>("memo");
+        opts.prog_arrays = build_command.get<std::vector<std::string>>("prog-array");
+        opts.entry = build_command.get<std::string>("entry");
+        std::stringstream chain(build_command.get<std::string>("chain"));
+        for (std::string stage; std::getline(chain, stage, ',');) {
+            opts.chain.push_back(stage);
+        }
+        opts.single_object = build_command.get<bool>("single-object") || !opts.chain.empty();
+        opts.batch_prefetch_distance = unsigned_option(build_command, "prefetch-distance", 0, BATCH_MAX_PREFETCH_DISTANCE);
+
+        auto backend = build_command.get<std::string>("backend");
+        if (backend != "llvm" && backend != "fast") {
+            std::cerr << "Unknown backend: " << backend << " (expected llvm or fast)" << std::endl;
+            std::exit(1);
+        }
+        opts.fast_backend = backend == "fast";
+        opts.target = build_command.get<std::string>("target");
+        opts.debug_info = build_command.get<bool>("debug-info");
+        opts.regression_baseline = build_command.get<std::string>("fail-on-regression");
+        opts.manifest = build_command.get<bool>("manifest") || !opts.regression_baseline.empty();
+        opts.regression_tolerance = non_negative_option(build_command, "regression-tolerance");
+        opts.layout = build_command.get<bool>("layout");
+        for (const auto &spec : build_command.get<std::vector<std::string>>("isa-variant")) {
+            ebpf_llvm_jit::jit::isa_variant variant;
+            std::string error;
+            if (!ebpf_llvm_jit::jit::parseIsaVariant(spec, variant, error)) {
+                std::cerr << "Invalid ISA variant \"" << spec << "\": " << error << std::endl;
+                std::exit(1);
+            }
+            opts.isa_variants.push_back(variant);
+        }
+        if (auto spec = build_command.get<std::string>("shape"); !spec.empty()) {
+            ebpf_llvm_jit::jit::packet_shape shape;
+            std::string error;
+            if (!ebpf_llvm_jit::jit::parsePacketShape(spec, shape, error)) {
+                std::cerr << "Invalid packet shape \"" << spec << "\": " << error << std::endl;
+                std::exit(1);
+            }
+            opts.shape = shape;
+        }
+        opts.opt_level = unsigned_option(build_command, "opt-level", 0, 3);
+        opts.target_features = build_command.get<std::string>("target-features");
+        opts.unroll = unsigned_option(build_command, "unroll", 0, UINT32_MAX);
+        opts.use_tune = !build_command.get<bool>("no-tune");
+        opts.tune_dir = build_command.get<std::string>("tune-dir");
+        if (opts.tune_dir.empty()) {
+            opts.tune_dir = std::filesystem::path(build_command.get<std::string>("EBPF_ELF")).parent_path();
+        }
+        for (const auto &[option, key] : std::vector<std::pair<std::string, std::string>>{
+                {"opt-level", "opt-level"}, {"target-features", "target-features"}, {"unroll", "unroll"},
+                {"no-hot-cold", "hot-cold"}, {"no-reroll", "reroll"}}) {
+            if (build_command.is_used(option)) {
+                opts.explicit_tune_keys.insert(key);
+            }
+        }
+        opts.wcet.max_cycles = unsigned_option(build_command, "max-cycles", 0, UINT64_MAX);
+        opts.wcet.enabled = build_command.get<bool>("wcet") || opts.wcet.max_cycles;
+        opts.wcet.loop_bound = unsigned_option(build_command, "wcet-loop-bound", 0, UINT32_MAX);
+        opts.wcet.cpu = build_command.get<std::string>("wcet-cpu");
+        if (parse_helper_costs(build_command.get<std::vector<std::string>>("helper-cost"), opts.wcet.helper_cycles) < 0) {
+            std::exit(1);
+        }
+
+        if (!opts.batch && build_command.is_used("prefetch-distance")) {
+            std::cerr << "--prefetch-distance requires --prefetch-batch" << std::endl;
+            std::exit(1);
+        }
+        if (opts.spmd && opts.sandbox_window) {
+            std::cerr << "--spmd is not supported with --sandbox" << std::endl;
+            std::exit(1);
+        }
+        if (opts.memo && opts.wcet.enabled) {
+            std::cerr << "--memo is not supported with --wcet or --max-cycles (the verdict cache of the runtime is not bounded)" << std::endl;
+            std::exit(1);
+        }
+        if (opts.memo && opts.sandbox_window) {
+            std::cerr << "--memo is not supported with --sandbox" << std::endl;
+            std::exit(1);
+        }
+        if (!opts.chain.empty() && (opts.spmd || !opts.entry.empty())) {
+            std::cerr << "--chain is not supported with --spmd or --entry" << std::endl;
+            std::exit(1);
+        }
+        if (opts.single_object && (opts.instrument || !opts.profile_use.empty())) {
+            std::cerr << "--single-object is not supported with --instrument or --profile-use" << std::endl;
+            std::exit(1);
+        }
+        if (opts.fast_backend && (opts.spmd || opts.memo || opts.sandbox_window || opts.single_object ||
+                                  opts.instrument || !opts.profile_use.empty() || !opts.frozen_maps.empty() ||
+                                  !opts.prog_arrays.empty() || opts.debug_info || opts.wcet.enabled || opts.manifest ||
+                                  opts.layout || opts.emit_bitcode || !opts.isa_variants.empty() || opts.shape)) {
+            std::cerr << "--backend fast is not supported with --spmd, --memo, --sandbox, --single-object, --chain, "
+                         "--instrument, --profile-use, --freeze-map, --prog-array, --debug-info, --wcet, --manifest, "
+                         "--layout, --emit-bitcode, --isa-variant or --shape" << std::endl;
+            std::exit(1);
+        }
+        if ((opts.wcet.enabled || opts.manifest || opts.layout) && opts.single_object) {
+            std::cerr << "--wcet, --max-cycles, --manifest and --layout are not supported with --single-object or --chain" << std::endl;
+            std::exit(1);
+        }
+        if (opts.emit_bitcode && (opts.single_object || opts.wcet.enabled || opts.manifest || opts.layout)) {
+            std::cerr << "--emit-bitcode is not supported with --single-object, --chain, --wcet, --max-cycles, "
+                         "--manifest or --layout (they need the native code)" << std::endl;
+            std::exit(1);
+        }
+        if (!opts.isa_variants.empty() && (opts.single_object || !opts.prog_arrays.empty() || opts.wcet.enabled ||
+                                           opts.manifest || opts.emit_bitcode)) {
+            std::cerr << "--isa-variant is not supported with --single-object, --chain, --prog-array, --wcet, "
+                         "--max-cycles, --manifest or --emit-bitcode" << std::endl;
+            std::exit(1);
+        }
+        if (opts.shape && (opts.spmd || opts.sandbox_window || opts.single_object || opts.wcet.enabled ||
+                           opts.manifest || !opts.isa_variants.empty())) {
+            std::cerr << "--shape is not supported with --spmd, --sandbox, --single-object, --chain, --wcet, "
+                         "--max-cycles, --manifest or --isa-variant" << std::endl;
+            std::exit(1);
+        }
+        if (!ebpf_llvm_jit::jit::isRiscvTarget(opts.target) && (opts.spmd || opts.rvv)) {
+            std::cerr << "--spmd and --rvv require a RISC-V --target" << std::endl;
+            std::exit(1);
+        }
+        if (opts.instrument && !opts.profile_use.empty()) {
+            std::cerr << "--instrument and --profile-use are mutually exclusive" << std::endl;
+            std::exit(1);
+        }
+
+        return build_ebpf_program(build_command.get<std::string>("EBPF_ELF"), opts);
+    }
+
+    if (program.is_subcommand_used(tune_command)) {
+        tune_options opts;
+        auto ebpf_elf = tune_command.get<std::string>("EBPF_ELF");
+        opts.output = tune_command.get<std::string>("output");
+        if (opts.output.empty()) {
+            opts.output = std::filesystem::path(ebpf_elf).parent_path();
+        }
+        opts.work_dir = std::filesystem::absolute(tune_command.get<std::string>("work-dir"));
+        opts.program = tune_command.get<std::string>("program");
+        opts.runner.runtime = std::filesystem::absolute(tune_command.get<std::string>("runtime"));
+        opts.runner.trace = std::filesystem::absolute(tune_command.get<std::string>("trace"));
+        opts.runner.ld = tune_command.get<std::string>("ld");
+        opts.runner.qemu = tune_command.get<std::string>("qemu");
+        opts.runner.timeout = unsigned_option(tune_command, "timeout", 1, UINT32_MAX);
+        for (const auto &spec : tune_command.get<std::vector<std::string>>("space")) {
+            std::string error;
+            if (!ebpf_llvm_jit::jit::parseTuneSpace(spec, opts.space, error)) {
+                std::cerr << "Invalid search space \"" << spec << "\": " << error << std::endl;
+                std::exit(1);
+            }
+        }
+
+        if (!std::filesystem::exists(opts.runner.runtime + "/.output/bpf_tune.o")) {
+            std::cerr << "--runtime " << opts.runner.runtime << " is not built (no .output/bpf_tune.o, run make)" << std::endl;
+            std::exit(1);
+        }
+        if (!std::filesystem::exists(opts.runner.trace)) {
+            std::cerr << "--trace " << opts.runner.trace << " not found" << std::endl;
+            std::exit(1);
+        }
+
+        return tune_ebpf_program(ebpf_elf, opts);
     }
 
     return 0;
@@ -0,0 +1,324 @@
+//
+// Created by Davide Collovigh on 19/10/26.
+//
+
+#include "elf_reader.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include <linux/bpf.h>
+#include <linux/btf.h>
+#include <llvm/BinaryFormat/ELF.h>
+#include <llvm/Object/ELFObjectFile.h>
+#include <llvm/Object/ObjectFile.h>
+
+#include "spdlog/spdlog.h"
+
+using namespace llvm;
+using namespace llvm::object;
+
+namespace ebpf_llvm_jit::elf {
+
+    static Expected<OwningBinary<ObjectFile>> openObject(const std::string &sourceFile)
+    {
+        return ObjectFile::createObjectFile(sourceFile);
+    }
+
+    static std::optional<SectionRef> findSection(const ObjectFile &obj, const std::string &sectionName)
+    {
+        for (const SectionRef &section : obj.sections()) {
+            auto name = section.getName();
+
+            if (!name) {
+                SPDLOG_ERROR("Failed to read section name: {}", toString(name.takeError()));
+                continue;
+            }
+
+            if (name->str() == sectionName) {
+                return section;
+            }
+        }
+
+        return std::nullopt;
+    }
+
+    // Offset of the program inside its section, with its size
+    static std::optional<uint64_t> findProgram(const ObjectFile &obj, const SectionRef &progSection, const std::string &progName, uint64_t &size)
+    {
+        for (const SymbolRef &sym : obj.symbols()) {
+            auto name = sym.getName();
+            auto section = sym.getSection();
+            auto value = sym.getValue();
+
+            if (!name || !section || !value) {
+                consumeError(name.takeError());
+                consumeError(section.takeError());
+                consumeError(value.takeError());
+                continue;
+            }
+
+            if (name->str() == progName && *section != obj.section_end() && **section == progSection) {
+                size = ELFSymbolRef(sym).getSize();
+                return *value;
+            }
+        }
+
+        return std::nullopt;
+    }
+
+    std::string loadSection(const std::string &sourceFile, const std::string &sectionName)
+    {
+        auto binaryOrErr = openObject(sourceFile);
+        if (!binaryOrErr) {
+            SPDLOG_ERROR("Failed to open source file {}: {}", sourceFile, toString(binaryOrErr.takeError()));
+            return "";
+        }
+
+        auto section = findSection(*binaryOrErr->getBinary(), sectionName);
+        if (!section) {
+            SPDLOG_INFO("{} section not found", sectionName);
+            return "";
+        }
+
+        auto content = section->getContents();
+        if (!content) {
+            SPDLOG_ERROR("Failed to get content of {} {}", sectionName, toString(content.takeError()));
+            return "";
+        }
+
+        return content->str();
+    }
+
+    std::optional<jit::passthrough_section> loadDataSection(const std::string &sourceFile, const std::string &sectionName, const std::string &outputName)
+    {
+        auto binaryOrErr = openObject(sourceFile);
+        if (!binaryOrErr) {
+            SPDLOG_ERROR("Failed to open source file {}: {}", sourceFile, toString(binaryOrErr.takeError()));
+            return std::nullopt;
+        }
+
+        auto section = findSection(*binaryOrErr->getBinary(), sectionName);
+        if (!section || section->getSize() == 0) {
+            SPDLOG_INFO("{} section not found", sectionName);
+            return std::nullopt;
+        }
+
+        jit::passthrough_section result;
+        result.name = outputName;
+        result.source = sectionName;
+        result.size = section->getSize();
+        result.alignment = std::max<uint64_t>(section->getAlignment(), 1);
+        result.read_only = !(ELFSectionRef(*section).getFlags() & ELF::SHF_WRITE);
+
+        // NOBITS sections (.bss) have a size but no content
+        if (!section->isBSS()) {
+            auto content = section->getContents();
+            if (!content) {
+                SPDLOG_ERROR("Failed to get content of {} {}", sectionName, toString(content.takeError()));
+                return std::nullopt;
+            }
+            result.str_content = content->str();
+        }
+
+        SPDLOG_DEBUG("Loaded data section {} [size: {}, align: {}, read_only: {}]", sectionName, result.size, result.alignment, result.read_only);
+        return result;
+    }
+
+    std::vector<jit::data_relocation> loadProgramRelocations(const std::string &sourceFile, const std::string &progSection, const std::string &progName)
+    {
+        std::vector<jit::data_relocation> result;
+
+        auto binaryOrErr = openObject(sourceFile);
+        if (!binaryOrErr) {
+            SPDLOG_ERROR("Failed to open source file {}: {}", sourceFile, toString(binaryOrErr.takeError()));
+            return result;
+        }
+        const ObjectFile &obj = *binaryOrErr->getBinary();
+
+        auto target = findSection(obj, progSection);
+        if (!target) {
+            SPDLOG_ERROR("Program section {} not found", progSection);
+            return result;
+        }
+
+        uint64_t progSize = 0;
+        auto progOffset = findProgram(obj, *target, progName, progSize);
+        if (!progOffset) {
+            SPDLOG_ERROR("Symbol of program {} not found in {}", progName, progSection);
+            return result;
+        }
+
+        for (const SectionRef &relSection : obj.sections()) {
+            auto relocated = relSection.getRelocatedSection();
+            if (!relocated) {
+                consumeError(relocated.takeError());
+                continue;
+            }
+
+            if (*relocated == obj.section_end() || **relocated != *target) {
+                continue;
+            }
+
+            for (const RelocationRef &reloc : relSection.relocations()) {
+
+                // Only 64 bit relocations are applied to LDDW instructions
+                if (reloc.getType() != ELF::R_BPF_64_64 ||
+                    reloc.getOffset() < *progOffset ||
+                    reloc.getOffset() >= *progOffset + progSize) {
+                    continue;
+                }
+
+                auto sym = reloc.getSymbol();
+                if (sym == obj.symbol_end()) {
+                    continue;
+                }
+
+                auto symSection = sym->getSection();
+                auto symName = sym->getName();
+                auto symValue = sym->getValue();
+                auto symType = sym->getType();
+
+                if (!symSection || !symName || !symValue || !symType || *symSection == obj.section_end()) {
+                    consumeError(symSection.takeError());
+                    consumeError(symName.takeError());
+                    consumeError(symValue.takeError());
+                    consumeError(symType.takeError());
+                    continue;
+                }
+
+                auto secName = (*symSection)->getName();
+                if (!secName) {
+                    consumeError(secName.takeError());
+                    continue;
+                }
+
+                jit::data_relocation relo;
+                relo.pc = (reloc.getOffset() - *progOffset) / 8;
+                relo.section = secName->str();
+
+                // Section symbols already have the offset encoded into imm
+                if (*symType == SymbolRef::ST_Debug) {
+                    relo.sym_offset = 0;
+                } else {
+                    relo.symbol = symName->str();
+                    relo.sym_offset = *symValue;
+                }
+
+                SPDLOG_DEBUG("Relocation of {} at pc {} -> {} {}+{}", progName, relo.pc, relo.section, relo.symbol, relo.sym_offset);
+                result.push_back(relo);
+            }
+        }
+
+        return result;
+    }
+
+    // Header of .BTF.ext (struct btf_ext_header of libbpf), offsets are relative to its end
+    typedef struct btf_ext_header {
+        uint16_t magic;
+        uint8_t version;
+        uint8_t flags;
+        uint32_t hdr_len;
+        uint32_t func_info_off;
+        uint32_t func_info_len;
+        uint32_t line_info_off;
+        uint32_t line_info_len;
+    } btf_ext_header;
+
+    std::vector<jit::source_line> loadProgramLineInfo(const std::string &sourceFile, const std::string &progSection, const std::string &progName)
+    {
+        std::vector<jit::source_line> result;
+
+        auto binaryOrErr = openObject(sourceFile);
+        if (!binaryOrErr) {
+            SPDLOG_ERROR("Failed to open source file {}: {}", sourceFile, toString(binaryOrErr.takeError()));
+            return result;
+        }
+        const ObjectFile &obj = *binaryOrErr->getBinary();
+
+        auto target = findSection(obj, progSection);
+        auto btfSection = findSection(obj, ".BTF");
+        auto extSection = findSection(obj, ".BTF.ext");
+        if (!target || !btfSection || !extSection) {
+            SPDLOG_INFO("No BTF line info for program {}", progName);
+            return result;
+        }
+
+        uint64_t progSize = 0;
+        auto progOffset = findProgram(obj, *target, progName, progSize);
+        auto btf = btfSection->getContents();
+        auto ext = extSection->getContents();
+        if (!progOffset || !btf || !ext) {
+            if (!btf) {
+                consumeError(btf.takeError());
+            }
+            if (!ext) {
+                consumeError(ext.takeError());
+            }
+            SPDLOG_ERROR("Unable to read the BTF line info of program {}", progName);
+            return result;
+        }
+
+        btf_header btfHdr;
+        btf_ext_header extHdr;
+        if (btf->size() < sizeof(btfHdr) || ext->size() < sizeof(extHdr)) {
+            SPDLOG_ERROR("Truncated BTF sections");
+            return result;
+        }
+        memcpy(&btfHdr, btf->data(), sizeof(btfHdr));
+        memcpy(&extHdr, ext->data(), sizeof(extHdr));
+        if (btfHdr.magic != BTF_MAGIC || extHdr.magic != BTF_MAGIC ||
+            (uint64_t)btfHdr.hdr_len + btfHdr.str_off + btfHdr.str_len > btf->size() ||
+            (uint64_t)extHdr.hdr_len + extHdr.line_info_off + extHdr.line_info_len > ext->size() ||
+            extHdr.line_info_len < sizeof(uint32_t)) {
+            SPDLOG_ERROR("Unsupported BTF sections (not little endian or truncated)");
+            return result;
+        }
+
+        StringRef strings = btf->substr(btfHdr.hdr_len + btfHdr.str_off, btfHdr.str_len);
+        auto btfString = [&](uint32_t off) {
+            return strings.substr(off).split('\0').first.str();
+        };
+
+        // rec_size, then for each section: sec_name_off, num_info, records
+        StringRef info = ext->substr(extHdr.hdr_len + extHdr.line_info_off, extHdr.line_info_len);
+        auto read32 = [&](uint64_t off) {
+            uint32_t value;
+            memcpy(&value, info.data() + off, sizeof(value));
+            return value;
+        };
+
+        uint32_t recSize = read32(0);
+        if (recSize < sizeof(bpf_line_info)) {
+            SPDLOG_ERROR("Unsupported BTF line info records of {} bytes", recSize);
+            return result;
+        }
+
+        for (uint64_t off = sizeof(uint32_t); off + 2 * sizeof(uint32_t) <= info.size();) {
+            std::string secName = btfString(read32(off));
+            uint32_t count = read32(off + sizeof(uint32_t));
+            off += 2 * sizeof(uint32_t);
+            if (off + (uint64_t)count * recSize > info.size()) {
+                SPDLOG_ERROR("Truncated BTF line info of section {}", secName);
+                return {};
+            }
+
+            for (uint32_t i = 0; i < count && secName == progSection; i++) {
+                bpf_line_info rec;
+                memcpy(&rec, info.data() + off + (uint64_t)i * recSize, sizeof(rec));
+
+                // insn_off is the byte offset inside the section
+                if (rec.insn_off < *progOffset || rec.insn_off >= *progOffset + progSize) {
+                    continue;
+                }
+                result.push_back({ (uint32_t)((rec.insn_off - *progOffset) / 8), btfString(rec.file_name_off),
+                                   BPF_LINE_INFO_LINE_NUM(rec.line_col), BPF_LINE_INFO_LINE_COL(rec.line_col) });
+            }
+            off += (uint64_t)count * recSize;
+        }
+
+        std::stable_sort(result.begin(), result.end(), [](const auto &a, const auto &b) { return a.pc < b.pc; });
+        SPDLOG_DEBUG("Loaded {} line info records of program {}", result.size(), progName);
+        return result;
+    }
+}
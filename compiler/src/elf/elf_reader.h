@@ -0,0 +1,48 @@
+//
+// Created by Davide Collovigh on 19/10/26.
+//
+
+#ifndef EBPF_LLVM_JIT_ELF_READER_H
+#define EBPF_LLVM_JIT_ELF_READER_H
+
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "../jit/data_relocation.h"
+#include "../jit/passthrough_section.h"
+#include "../jit/source_line.h"
+
+namespace ebpf_llvm_jit::elf {
+
+    /**
+     * @brief returns the raw content of a section of the eBPF ELF ("" if not found)
+     */
+    std::string loadSection(const std::string &sourceFile, const std::string &sectionName);
+
+    /**
+     * @brief loads a data section (.rodata, .data, .bss, ...) of the eBPF ELF so that it can
+     * be injected into the native object as outputName
+     *
+     * @return std::nullopt if the section does not exist or is empty
+     */
+    std::optional<jit::passthrough_section> loadDataSection(const std::string &sourceFile, const std::string &sectionName, const std::string &outputName);
+
+    /**
+     * @brief collects the relocations of the LDDW instructions of a program
+     *
+     * @param sourceFile eBPF ELF
+     * @param progSection section of the program (e.g. "xdp")
+     * @param progName name of the program symbol
+     */
+    std::vector<jit::data_relocation> loadProgramRelocations(const std::string &sourceFile, const std::string &progSection, const std::string &progName);
+
+    /**
+     * @brief collects the line info of a program from the .BTF.ext section (clang -g)
+     *
+     * @return records sorted by pc, empty if the ELF has no BTF line info
+     */
+    std::vector<jit::source_line> loadProgramLineInfo(const std::string &sourceFile, const std::string &progSection, const std::string &progName);
+}
+
+#endif //EBPF_LLVM_JIT_ELF_READER_H
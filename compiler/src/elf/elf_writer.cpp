@@ -0,0 +1,214 @@
+//
+// Created by Davide Collovigh on 19/10/26.
+//
+
+#include "elf_writer.h"
+
+#include <cstring>
+
+#include <llvm/BinaryFormat/ELF.h>
+
+using namespace llvm::ELF;
+
+namespace ebpf_llvm_jit::elf {
+
+    // Appends name to a string table, returns its offset
+    static uint32_t addString(std::vector<uint8_t> &table, const std::string &name)
+    {
+        if (name.empty()) {
+            return 0;
+        }
+
+        auto offset = (uint32_t)table.size();
+        table.insert(table.end(), name.begin(), name.end());
+        table.push_back(0);
+        return offset;
+    }
+
+    static void align(std::vector<uint8_t> &out, uint64_t alignment)
+    {
+        if (alignment > 1) {
+            out.resize((out.size() + alignment - 1) / alignment * alignment, 0);
+        }
+    }
+
+    template <typename T>
+    static void append(std::vector<uint8_t> &out, const T &value)
+    {
+        auto bytes = reinterpret_cast<const uint8_t *>(&value);
+        out.insert(out.end(), bytes, bytes + sizeof(T));
+    }
+
+    uint32_t ElfWriter::addSection(const elf_section &section)
+    {
+        sections.push_back(section);
+        relocations.emplace_back();
+        return sections.size() - 1;
+    }
+
+    uint32_t ElfWriter::addSymbol(const elf_symbol &symbol)
+    {
+        symbols.push_back(symbol);
+        return symbols.size() - 1;
+    }
+
+    uint32_t ElfWriter::sectionSymbol(uint32_t section)
+    {
+        for (uint32_t i = 0; i < symbols.size(); i++) {
+            if (symbols[i].type == STT_SECTION && symbols[i].section == section) {
+                return i;
+            }
+        }
+        return addSymbol({ "", section, 0, 0, STT_SECTION, false });
+    }
+
+    void ElfWriter::addRelocation(uint32_t section, const elf_relocation &relocation)
+    {
+        relocations[section].push_back(relocation);
+    }
+
+    std::vector<uint8_t> ElfWriter::write() const
+    {
+        // Section indexes: null, sections, .rela*, .symtab, .strtab, .shstrtab
+        std::vector<uint32_t> relaOf;
+        uint32_t nextIdx = sections.size() + 1;
+        for (const auto &relocs : relocations) {
+            relaOf.push_back(relocs.empty() ? 0 : nextIdx++);
+        }
+        uint32_t symtabIdx = nextIdx++;
+        uint32_t strtabIdx = nextIdx++;
+        uint32_t shstrtabIdx = nextIdx++;
+
+        // Local symbols come first, sh_info of .symtab is the first global one
+        std::vector<uint32_t> symIdx(symbols.size());
+        std::vector<uint32_t> order;
+        for (int global = 0; global <= 1; global++) {
+            for (uint32_t i = 0; i < symbols.size(); i++) {
+                if (symbols[i].global == (bool)global) {
+                    symIdx[i] = order.size() + 1;
+                    order.push_back(i);
+                }
+            }
+        }
+        uint32_t firstGlobal = 1;
+        for (auto i : order) {
+            if (!symbols[i].global) {
+                firstGlobal++;
+            }
+        }
+
+        std::vector<uint8_t> strtab(1, 0), shstrtab(1, 0), symtab;
+        append(symtab, Elf64_Sym{});
+        for (auto i : order) {
+            const auto &sym = symbols[i];
+            Elf64_Sym entry{};
+            entry.st_name = addString(strtab, sym.name);
+            entry.setBindingAndType(sym.global ? STB_GLOBAL : STB_LOCAL, sym.type);
+            entry.st_shndx = sym.section == UNDEF_SECTION ? (uint32_t)SHN_UNDEF : sym.section + 1;
+            entry.st_value = sym.value;
+            entry.st_size = sym.size;
+            append(symtab, entry);
+        }
+
+        std::vector<Elf64_Shdr> headers(nextIdx);
+        std::vector<uint8_t> out(sizeof(Elf64_Ehdr), 0);
+
+        for (uint32_t s = 0; s < sections.size(); s++) {
+            const auto &section = sections[s];
+            auto &hdr = headers[s + 1];
+
+            hdr.sh_name = addString(shstrtab, section.name);
+            hdr.sh_type = section.type;
+            hdr.sh_flags = section.flags;
+            hdr.sh_addralign = section.alignment;
+            hdr.sh_size = section.size;
+
+            if (section.type != SHT_NOBITS) {
+                align(out, section.alignment);
+                hdr.sh_offset = out.size();
+                out.insert(out.end(), section.content.begin(), section.content.end());
+            } else {
+                hdr.sh_offset = out.size();
+            }
+        }
+
+        for (uint32_t s = 0; s < sections.size(); s++) {
+            if (!relaOf[s]) {
+                continue;
+            }
+
+            auto &hdr = headers[relaOf[s]];
+            hdr.sh_name = addString(shstrtab, ".rela" + sections[s].name);
+            hdr.sh_type = SHT_RELA;
+            hdr.sh_flags = SHF_INFO_LINK;
+            hdr.sh_addralign = 8;
+            hdr.sh_entsize = sizeof(Elf64_Rela);
+            hdr.sh_link = symtabIdx;
+            hdr.sh_info = s + 1;
+
+            align(out, 8);
+            hdr.sh_offset = out.size();
+            for (const auto &relo : relocations[s]) {
+                Elf64_Rela entry{};
+                entry.r_offset = relo.offset;
+                entry.setSymbolAndType(symIdx[relo.symbol], relo.type);
+                entry.r_addend = relo.addend;
+                append(out, entry);
+            }
+            hdr.sh_size = out.size() - hdr.sh_offset;
+        }
+
+        auto &symtabHdr = headers[symtabIdx];
+        symtabHdr.sh_name = addString(shstrtab, ".symtab");
+        symtabHdr.sh_type = SHT_SYMTAB;
+        symtabHdr.sh_addralign = 8;
+        symtabHdr.sh_entsize = sizeof(Elf64_Sym);
+        symtabHdr.sh_link = strtabIdx;
+        symtabHdr.sh_info = firstGlobal;
+        align(out, 8);
+        symtabHdr.sh_offset = out.size();
+        symtabHdr.sh_size = symtab.size();
+        out.insert(out.end(), symtab.begin(), symtab.end());
+
+        auto &strtabHdr = headers[strtabIdx];
+        strtabHdr.sh_name = addString(shstrtab, ".strtab");
+        strtabHdr.sh_type = SHT_STRTAB;
+        strtabHdr.sh_addralign = 1;
+        strtabHdr.sh_offset = out.size();
+        strtabHdr.sh_size = strtab.size();
+        out.insert(out.end(), strtab.begin(), strtab.end());
+
+        auto &shstrtabHdr = headers[shstrtabIdx];
+        shstrtabHdr.sh_name = addString(shstrtab, ".shstrtab");
+        shstrtabHdr.sh_type = SHT_STRTAB;
+        shstrtabHdr.sh_addralign = 1;
+        shstrtabHdr.sh_offset = out.size();
+        shstrtabHdr.sh_size = shstrtab.size();
+        out.insert(out.end(), shstrtab.begin(), shstrtab.end());
+
+        align(out, 8);
+        uint64_t shoff = out.size();
+        for (const auto &hdr : headers) {
+            append(out, hdr);
+        }
+
+        Elf64_Ehdr ehdr{};
+        memcpy(ehdr.e_ident, ElfMagic, strlen(ElfMagic));
+        ehdr.e_ident[EI_CLASS] = ELFCLASS64;
+        ehdr.e_ident[EI_DATA] = ELFDATA2LSB;
+        ehdr.e_ident[EI_VERSION] = EV_CURRENT;
+        ehdr.e_ident[EI_OSABI] = ELFOSABI_NONE;
+        ehdr.e_type = ET_REL;
+        ehdr.e_machine = EM_RISCV;
+        ehdr.e_version = EV_CURRENT;
+        ehdr.e_flags = EF_RISCV_FLOAT_ABI_SOFT;
+        ehdr.e_shoff = shoff;
+        ehdr.e_ehsize = sizeof(Elf64_Ehdr);
+        ehdr.e_shentsize = sizeof(Elf64_Shdr);
+        ehdr.e_shnum = headers.size();
+        ehdr.e_shstrndx = shstrtabIdx;
+        memcpy(out.data(), &ehdr, sizeof(ehdr));
+
+        return out;
+    }
+}
@@ -0,0 +1,65 @@
+//
+// Created by Davide Collovigh on 19/10/26.
+//
+
+#ifndef EBPF_LLVM_JIT_ELF_WRITER_H
+#define EBPF_LLVM_JIT_ELF_WRITER_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace ebpf_llvm_jit::elf {
+
+    typedef struct elf_section {
+        std::string name;
+        uint32_t type;              // SHT_PROGBITS or SHT_NOBITS
+        uint64_t flags;
+        uint64_t alignment;
+        std::vector<uint8_t> content;
+        uint64_t size;              // content.size(), except for NOBITS sections
+    } elf_section;
+
+    typedef struct elf_symbol {
+        std::string name;
+        uint32_t section;           // index in the sections of the writer, UNDEF_SECTION if undefined
+        uint64_t value;
+        uint64_t size;
+        uint8_t type;               // STT_*
+        bool global;
+    } elf_symbol;
+
+    typedef struct elf_relocation {
+        uint64_t offset;
+        uint32_t symbol;            // handle returned by addSymbol()
+        uint32_t type;              // R_RISCV_*
+        int64_t addend;
+    } elf_relocation;
+
+    /**
+     * @brief relocatable RV64 ELF (ET_REL, lp64 soft float ABI, no RVC), as emitted by the LLVM backend
+     *
+     * Sections, symbols and relocations can be added in any order: write() places the local symbols
+     * before the global ones and emits one .rela section per section with relocations.
+     */
+    class ElfWriter {
+        std::vector<elf_section> sections;
+        std::vector<elf_symbol> symbols;
+        std::vector<std::vector<elf_relocation>> relocations;
+
+    public:
+        static const uint32_t UNDEF_SECTION = UINT32_MAX;
+
+        uint32_t addSection(const elf_section &section);
+        uint32_t addSymbol(const elf_symbol &symbol);
+
+        // STT_SECTION symbol of a section, for relocations against an offset in it
+        uint32_t sectionSymbol(uint32_t section);
+
+        void addRelocation(uint32_t section, const elf_relocation &relocation);
+
+        std::vector<uint8_t> write() const;
+    };
+}
+
+#endif //EBPF_LLVM_JIT_ELF_WRITER_H
@@ -0,0 +1,141 @@
+//
+// Created by Davide Collovigh on 19/10/26.
+//
+
+#include "batch.h"
+
+#include <functional>
+
+#include <llvm/IR/IRBuilder.h>
+#include <llvm/IR/InlineAsm.h>
+
+#include "target.h"
+#include "xdp_md.h"
+#include "spdlog/spdlog.h"
+
+using namespace llvm;
+
+namespace ebpf_llvm_jit::jit {
+
+    // Loads one byte into x0: the load is issued (and may miss) but nothing waits for it.
+    // llvm.prefetch is dropped on RISC-V without Zicbop, the other targets use it.
+    static void emitTouch(IRBuilder<> &builder, Value *ptr)
+    {
+        if (!isRiscvModule(*builder.GetInsertBlock()->getModule())) {
+            // read, high locality, data cache
+            builder.CreateIntrinsic(Intrinsic::prefetch, { ptr->getType() },
+                                    { ptr, builder.getInt32(0), builder.getInt32(3), builder.getInt32(1) });
+            return;
+        }
+
+        auto asmFn = InlineAsm::get(
+                FunctionType::get(builder.getVoidTy(), { builder.getPtrTy() }, false),
+                "lbu zero, 0($0)", "r", true);
+        builder.CreateCall(asmFn, { ptr });
+    }
+
+    // Runs emit() only when cond is true, leaves the builder after the guarded code
+    static void emitGuarded(IRBuilder<> &builder, Value *cond, const char *name,
+                            const std::function<void(IRBuilder<> &)> &emit)
+    {
+        auto func = builder.GetInsertBlock()->getParent();
+        auto thenBlk = BasicBlock::Create(builder.getContext(), name, func);
+        auto nextBlk = BasicBlock::Create(builder.getContext(), std::string(name) + ".next", func);
+
+        builder.CreateCondBr(cond, thenBlk, nextBlk);
+        builder.SetInsertPoint(thenBlk);
+        emit(builder);
+        builder.CreateBr(nextBlk);
+        builder.SetInsertPoint(nextBlk);
+    }
+
+    static Value *loadCtx(IRBuilder<> &builder, Value *ctxArr, Value *idx)
+    {
+        return builder.CreateLoad(builder.getPtrTy(),
+                                  builder.CreateInBoundsGEP(builder.getPtrTy(), ctxArr, idx));
+    }
+
+    // Stage 1: xdp_md of packet j
+    static void emitTouchCtx(IRBuilder<> &builder, Value *ctxArr, Value *n, Value *j)
+    {
+        emitGuarded(builder, builder.CreateICmpULT(j, n), "touch_ctx", [&](IRBuilder<> &b) {
+            emitTouch(b, loadCtx(b, ctxArr, j));
+        });
+    }
+
+    // Stage 2: first cache line of packet j, only if the packet is not empty
+    static void emitTouchData(IRBuilder<> &builder, Value *ctxArr, Value *n, Value *j, GlobalVariable *pktMemBase)
+    {
+        emitGuarded(builder, builder.CreateICmpULT(j, n), "touch_data", [&](IRBuilder<> &b) {
+            Value *ctx = loadCtx(b, ctxArr, j);
+            Value *base = b.CreateLoad(b.getInt64Ty(), pktMemBase);
+            Value *data = b.CreateZExt(b.CreateLoad(b.getInt32Ty(), ctx), b.getInt64Ty());
+            Value *dataEnd = b.CreateZExt(
+                    b.CreateLoad(b.getInt32Ty(), b.CreateConstInBoundsGEP1_64(b.getInt8Ty(), ctx, 4)),
+                    b.getInt64Ty());
+
+            emitGuarded(b, b.CreateICmpULT(data, dataEnd), "touch_pkt", [&](IRBuilder<> &bb) {
+                emitTouch(bb, bb.CreateIntToPtr(bb.CreateAdd(data, base), bb.getPtrTy()));
+            });
+        });
+    }
+
+    Function *emitBatchEntry(Module &module, Function *bpfMain, GlobalVariable *pktMemBase, unsigned prefetchDistance)
+    {
+        auto &ctx = module.getContext();
+        IRBuilder<> builder(ctx);
+
+        auto func = Function::Create(
+                FunctionType::get(builder.getVoidTy(),
+                                  { builder.getPtrTy(), builder.getInt64Ty(), builder.getPtrTy() },
+                                  false),
+                Function::ExternalLinkage, BATCH_ENTRY_SYM, module);
+
+        Value *ctxArr = func->getArg(0);
+        Value *n = func->getArg(1);
+        Value *verdicts = func->getArg(2);
+        Value *distance = builder.getInt64(prefetchDistance);
+
+        auto entryBlk = BasicBlock::Create(ctx, "entry", func);
+        builder.SetInsertPoint(entryBlk);
+
+        // Fill the pipeline: xdp_md of the first 2 * distance packets, data of the first distance packets
+        if (prefetchDistance > 0) {
+            for (unsigned j = 0; j < 2 * prefetchDistance; j++) {
+                emitTouchCtx(builder, ctxArr, n, builder.getInt64(j));
+            }
+            for (unsigned j = 0; j < prefetchDistance; j++) {
+                emitTouchData(builder, ctxArr, n, builder.getInt64(j), pktMemBase);
+            }
+        }
+
+        auto preheader = builder.GetInsertBlock();
+        auto loopBlk = BasicBlock::Create(ctx, "loop", func);
+        auto exitBlk = BasicBlock::Create(ctx, "exit", func);
+        builder.CreateCondBr(builder.CreateICmpEQ(n, builder.getInt64(0)), exitBlk, loopBlk);
+
+        builder.SetInsertPoint(loopBlk);
+        auto i = builder.CreatePHI(builder.getInt64Ty(), 2, "i");
+        i->addIncoming(builder.getInt64(0), preheader);
+
+        // Keep the pipeline full while packet i runs
+        if (prefetchDistance > 0) {
+            emitTouchCtx(builder, ctxArr, n, builder.CreateAdd(i, builder.CreateShl(distance, 1)));
+            emitTouchData(builder, ctxArr, n, builder.CreateAdd(i, distance), pktMemBase);
+        }
+
+        Value *ret = builder.CreateCall(bpfMain, { loadCtx(builder, ctxArr, i), builder.getInt64(XDP_MD_SIZE) });
+        builder.CreateStore(builder.CreateTrunc(ret, builder.getInt32Ty()),
+                            builder.CreateInBoundsGEP(builder.getInt32Ty(), verdicts, i));
+
+        Value *next = builder.CreateAdd(i, builder.getInt64(1));
+        i->addIncoming(next, builder.GetInsertBlock());
+        builder.CreateCondBr(builder.CreateICmpULT(next, n), loopBlk, exitBlk);
+
+        builder.SetInsertPoint(exitBlk);
+        builder.CreateRetVoid();
+
+        SPDLOG_INFO("Emitted {} [prefetch distance: {}]", BATCH_ENTRY_SYM, prefetchDistance);
+        return func;
+    }
+}
@@ -0,0 +1,33 @@
+//
+// Created by Davide Collovigh on 19/10/26.
+//
+
+#ifndef EBPF_LLVM_JIT_BATCH_H
+#define EBPF_LLVM_JIT_BATCH_H
+
+#include <llvm/IR/Function.h>
+#include <llvm/IR/GlobalVariable.h>
+#include <llvm/IR/Module.h>
+
+// void bpf_main_batch(struct xdp_md *ctx[], uint64_t n, int verdicts[])
+#define BATCH_ENTRY_SYM "bpf_main_batch"
+
+// Packets touched ahead of the one being executed
+#define BATCH_DEFAULT_PREFETCH_DISTANCE 2
+#define BATCH_MAX_PREFETCH_DISTANCE 16
+
+namespace ebpf_llvm_jit::jit {
+
+    /**
+     * @brief emits bpf_main_batch(), running bpf_main over n packets
+     *
+     * While packet i runs, the xdp_md of packet i + 2 * distance and the first cache line
+     * of packet i + distance are loaded, so their misses overlap with the execution of packet i
+     * instead of stalling the first header loads. The program itself is unchanged: each
+     * packet is still run by bpf_main, in order.
+     */
+    llvm::Function *emitBatchEntry(llvm::Module &module, llvm::Function *bpfMain,
+                                   llvm::GlobalVariable *pktMemBase, unsigned prefetchDistance);
+}
+
+#endif //EBPF_LLVM_JIT_BATCH_H
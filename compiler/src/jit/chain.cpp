@@ -0,0 +1,109 @@
+//
+// Created by Davide Collovigh on 19/10/26.
+//
+
+#include "chain.h"
+
+#include <llvm/IR/IRBuilder.h>
+#include <llvm/IR/Instructions.h>
+#include <llvm/Passes/PassBuilder.h>
+#include <llvm/Transforms/Utils/Cloning.h>
+
+#include "tail_call.h"
+#include "spdlog/spdlog.h"
+
+using namespace llvm;
+
+namespace ebpf_llvm_jit::jit {
+
+    // Program of a stage, MergeFunctions may have turned it into an alias of an identical one
+    static Function *stageFunction(Module &module, const std::string &name)
+    {
+        auto gv = module.getNamedValue(PROG_SYM_PREFIX + name);
+        if (!gv) {
+            return nullptr;
+        }
+        return dyn_cast_or_null<Function>(gv->getAliaseeObject());
+    }
+
+    // Same pipeline as the per-program optimization, on bpf_main only: the stages are already optimized
+    static void optimizeChain(Function &F)
+    {
+        LoopAnalysisManager LAM;
+        FunctionAnalysisManager FAM;
+        CGSCCAnalysisManager CGAM;
+        ModuleAnalysisManager MAM;
+
+        PassBuilder PB;
+        PB.registerModuleAnalyses(MAM);
+        PB.registerCGSCCAnalyses(CGAM);
+        PB.registerFunctionAnalyses(FAM);
+        PB.registerLoopAnalyses(LAM);
+        PB.crossRegisterProxies(LAM, FAM, CGAM, MAM);
+
+        FunctionPassManager FPM = PB.buildFunctionSimplificationPipeline(OptimizationLevel::O3,
+                                                                         ThinOrFullLTOPhase::None);
+        FPM.run(F, FAM);
+    }
+
+    Function *emitChain(Module &module, const std::vector<chain_stage> &stages, std::string &error)
+    {
+        std::vector<Function *> progs;
+        for (const auto &stage : stages) {
+            auto prog = stageFunction(module, stage.name);
+            if (!prog) {
+                error = "Program " + stage.name + " of the chain not found";
+                return nullptr;
+            }
+            progs.push_back(prog);
+        }
+
+        auto &ctx = module.getContext();
+        IRBuilder<> builder(ctx);
+
+        auto func = Function::Create(progs.front()->getFunctionType(), Function::ExternalLinkage, "bpf_main", module);
+        auto entryBlk = BasicBlock::Create(ctx, "entry", func);
+        auto exitBlk = BasicBlock::Create(ctx, "exit", func);
+
+        builder.SetInsertPoint(exitBlk);
+        auto verdict = builder.CreatePHI(func->getReturnType(), stages.size(), "verdict");
+        builder.CreateRet(verdict);
+
+        // stage i: r0 = prog(ctx, size); switch (r0) { continue_actions: stage i + 1; default: exit }
+        std::vector<CallInst *> calls;
+        BasicBlock *stageBlk = entryBlk;
+        for (size_t i = 0; i < stages.size(); i++) {
+            builder.SetInsertPoint(stageBlk);
+            auto call = builder.CreateCall(progs[i], { func->getArg(0), func->getArg(1) });
+            calls.push_back(call);
+            verdict->addIncoming(call, stageBlk);
+
+            if (i + 1 == stages.size()) {
+                builder.CreateBr(exitBlk);
+                break;
+            }
+
+            auto nextBlk = BasicBlock::Create(ctx, "stage_" + stages[i + 1].name, func);
+            auto sw = builder.CreateSwitch(call, exitBlk);
+            for (uint32_t action = 0; action < 32; action++) {
+                if (stages[i].continue_actions & (1u << action)) {
+                    sw->addCase(builder.getInt64(action), nextBlk);
+                }
+            }
+            stageBlk = nextBlk;
+        }
+
+        size_t inlined = 0;
+        for (auto call : calls) {
+            InlineFunctionInfo info;
+            if (InlineFunction(*call, info).isSuccess()) {
+                inlined++;
+            }
+        }
+
+        optimizeChain(*func);
+
+        SPDLOG_INFO("Emitted chain of {} programs [inlined: {}]", stages.size(), inlined);
+        return func;
+    }
+}
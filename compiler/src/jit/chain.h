@@ -0,0 +1,42 @@
+//
+// Created by Davide Collovigh on 19/10/26.
+//
+
+#ifndef EBPF_LLVM_JIT_CHAIN_H
+#define EBPF_LLVM_JIT_CHAIN_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <llvm/IR/Function.h>
+#include <llvm/IR/Module.h>
+
+// enum xdp_action of bpf_helpers.h
+#define XDP_ACTION_NAMES { "aborted", "drop", "pass", "tx", "redirect" }
+
+// Verdicts running the next stage when the chain does not say otherwise: XDP_PASS
+#define CHAIN_DEFAULT_ACTIONS (1u << 2)
+
+namespace ebpf_llvm_jit::jit {
+
+    // Program of a chain, as libxdp chain_call_actions
+    typedef struct chain_stage {
+        std::string name;
+        uint32_t continue_actions;  // bit i set: verdict i runs the next stage
+    } chain_stage;
+
+    /**
+     * @brief defines bpf_main running the programs of the chain in order, fused into one function
+     *
+     * Each stage runs if the verdict of the previous one is in its continue_actions, otherwise
+     * that verdict is returned; the last stage returns its own. The stages (bpf_prog_<name>) are
+     * inlined into bpf_main and the result is optimized as a whole, so the loads of the xdp_md
+     * and the header parsing repeated by the stages can be shared. The stages are still exported.
+     *
+     * @return nullptr (with error set) if a stage is not in the module
+     */
+    llvm::Function *emitChain(llvm::Module &module, const std::vector<chain_stage> &stages, std::string &error);
+}
+
+#endif //EBPF_LLVM_JIT_CHAIN_H
@@ -251,6 +251,21 @@ namespace ebpf_llvm_jit::jit {
                                  { builder.getInt64(inst.off) });
     }
 
+    void
+    emitLoadSectionAddr(llvm::IRBuilder<> &builder, llvm::Value **regs, const ebpf_inst &inst,
+                        llvm::GlobalVariable *section, uint64_t offset)
+    {
+        // dst = &section[offset], kept as a constant expression so that the
+        // optimizer can see which global the register points to
+        builder.CreateStore(
+                llvm::ConstantExpr::getPtrToInt(
+                        llvm::ConstantExpr::getInBoundsGetElementPtr(
+                                builder.getInt8Ty(), section,
+                                builder.getInt64(offset)),
+                        builder.getInt64Ty()),
+                regs[inst.dst_reg]);
+    }
+
     void
     emitLDXStoringResult(llvm::IRBuilder<> &builder, llvm::Value **regs, const ebpf_inst &inst, llvm::Value *result)
     {
@@ -318,8 +333,8 @@ namespace ebpf_llvm_jit::jit {
 
                     });
             builder.CreateStore(callInst, regs[0]);
-            // for bpf_tail_call, just exit after calling the helper, which
-            // simulates the behavior of kernel
+            // for bpf_tail_call on a map that is not a prog array of the build, just exit
+            // after calling the helper, which simulates the behavior of kernel
             if (inst.imm == 12) {
                 builder.CreateBr(exitBlk);
             }
@@ -334,6 +349,7 @@ namespace ebpf_llvm_jit::jit {
     void
     emitAtomicBinOp(llvm::IRBuilder<> &builder, llvm::Value **regs, llvm::AtomicRMWInst::BinOp op, const ebpf_inst &inst, bool is64, bool is_fetch)
     {
+        // Naturally aligned, as required by the eBPF ISA
         auto oldValue = builder.CreateAtomicRMW(
                 op,
                 builder.CreateGEP(builder.getInt8Ty(),
@@ -346,10 +362,73 @@ namespace ebpf_llvm_jit::jit {
                         builder.CreateLoad(builder.getInt64Ty(),
                                            regs[inst.src_reg]),
                         builder.getInt32Ty()),
-                llvm::MaybeAlign(32), llvm::AtomicOrdering::Monotonic);
+                llvm::MaybeAlign(), llvm::AtomicOrdering::Monotonic);
         if (is_fetch) {
-            builder.CreateStore(oldValue, regs[inst.src_reg]);
+            // 32 bit fetches zero extend the old value
+            builder.CreateStore(builder.CreateZExt(oldValue, builder.getInt64Ty()), regs[inst.src_reg]);
+        }
+    }
+
+    /// Build an inlinable bpf_map_lookup_elem() resolving the frozen maps
+    ///
+    /// The map argument is compared against the address of each constant table:
+    /// once inlined, a constant map pointer folds the comparisons and the lookup
+    /// becomes a bound check plus a direct table access. Unknown maps are
+    /// forwarded to the real helper (if any).
+    llvm::Function *
+    emitFrozenMapLookup(llvm::Module &module, llvm::FunctionType *helperFuncTy,
+                        llvm::Function *fallback,
+                        const std::map<std::string, frozen_map> &maps,
+                        const std::map<std::string, llvm::GlobalVariable *> &tables)
+    {
+        auto &ctx = module.getContext();
+        auto func = llvm::Function::Create(helperFuncTy,
+                                           llvm::Function::InternalLinkage,
+                                           "__frozen_map_lookup_elem", module);
+        func->addFnAttr(llvm::Attribute::AlwaysInline);
+
+        llvm::Value *mapArg = func->getArg(0);
+        llvm::Value *keyArg = func->getArg(1);
+
+        auto currBlk = llvm::BasicBlock::Create(ctx, "entry", func);
+        llvm::IRBuilder<> builder(currBlk);
+
+        for (const auto &[name, map] : maps) {
+            auto table = tables.at(name);
+            auto foundBlk = llvm::BasicBlock::Create(ctx, "found_" + name, func);
+            auto nextBlk = llvm::BasicBlock::Create(ctx, "next_" + name, func);
+
+            builder.CreateCondBr(
+                    builder.CreateICmpEQ(mapArg, builder.CreatePtrToInt(table, builder.getInt64Ty())),
+                    foundBlk, nextBlk);
+
+            // ARRAY maps: key is an u32 index, out of bound keys return NULL
+            builder.SetInsertPoint(foundBlk);
+            auto key = builder.CreateLoad(builder.getInt32Ty(),
+                                          builder.CreateIntToPtr(keyArg, builder.getPtrTy()));
+            auto elem = builder.CreateInBoundsGEP(
+                    builder.getInt8Ty(), table,
+                    { builder.CreateMul(builder.CreateZExt(key, builder.getInt64Ty()),
+                                        builder.getInt64(map.value_size)) });
+            builder.CreateRet(builder.CreateSelect(
+                    builder.CreateICmpULT(key, builder.getInt32(map.max_entries)),
+                    builder.CreatePtrToInt(elem, builder.getInt64Ty()),
+                    builder.getInt64(0)));
+
+            builder.SetInsertPoint(nextBlk);
         }
+
+        if (fallback) {
+            std::vector<llvm::Value *> args;
+            for (auto &arg : func->args()) {
+                args.push_back(&arg);
+            }
+            builder.CreateRet(builder.CreateCall(helperFuncTy, fallback, args));
+        } else {
+            builder.CreateRet(builder.getInt64(0));
+        }
+
+        return func;
     }
 }
 
@@ -92,6 +92,10 @@ namespace ebpf_llvm_jit::jit {
     llvm::Value
     *emitLDXLoadingAddr(llvm::IRBuilder<> &builder, llvm::Value **regs, const ebpf_inst &inst);
 
+    void
+    emitLoadSectionAddr(llvm::IRBuilder<> &builder, llvm::Value **regs, const ebpf_inst &inst,
+                        llvm::GlobalVariable *section, uint64_t offset);
+
     void
     emitLDXStoringResult(llvm::IRBuilder<> &builder, llvm::Value **regs, const ebpf_inst &inst, llvm::Value *result);
 
@@ -115,6 +119,12 @@ namespace ebpf_llvm_jit::jit {
     emitAtomicBinOp(llvm::IRBuilder<> &builder, llvm::Value **regs,
                          llvm::AtomicRMWInst::BinOp op, const ebpf_inst &inst,
                          bool is64, bool is_fetch);
+
+    llvm::Function *
+    emitFrozenMapLookup(llvm::Module &module, llvm::FunctionType *helperFuncTy,
+                        llvm::Function *fallback,
+                        const std::map<std::string, frozen_map> &maps,
+                        const std::map<std::string, llvm::GlobalVariable *> &tables);
 }
 
 #endif //EBPF_LLVM_JIT_CODE_GEN_H
@@ -0,0 +1,220 @@
+//
+// Created by Davide Collovigh on 19/10/26.
+//
+
+#include "cold_blocks.h"
+#include "code_gen.h"
+
+#include <algorithm>
+#include <map>
+#include <set>
+
+#include <llvm/IR/Instructions.h>
+#include <llvm/IR/MDBuilder.h>
+
+#include "spdlog/spdlog.h"
+
+using namespace llvm;
+
+namespace ebpf_llvm_jit::jit {
+
+    // Max number of instructions of a block that only leads to exit
+    static const size_t EXIT_BLOCK_MAX_LEN = 4;
+
+    static bool is_bounds_check(const ebpf_inst &inst)
+    {
+        switch (inst.code) {
+            case EBPF_OP_JGT_REG:
+            case EBPF_OP_JGE_REG:
+            case EBPF_OP_JLT_REG:
+            case EBPF_OP_JLE_REG:
+                return true;
+            default:
+                return false;
+        }
+    }
+
+    std::vector<bool> classify_cold_blocks(const std::vector<ebpf_inst> &insns, const std::vector<bool> &blockBegin)
+    {
+        const size_t n = insns.size();
+        std::vector<bool> cold(n, false);
+
+        // Block boundaries: [start, end]
+        std::vector<size_t> starts;
+        std::vector<size_t> blockOf(n, 0);
+        for (size_t i = 0; i < n; i++) {
+            if (blockBegin[i]) {
+                starts.push_back(i);
+            }
+            blockOf[i] = starts.back();
+        }
+
+        auto blockEnd = [&](size_t b) {
+            auto next = std::upper_bound(starts.begin(), starts.end(), b);
+            return (next == starts.end() ? n : *next) - 1;
+        };
+
+        // Successors and predecessors of each block
+        std::map<size_t, std::vector<size_t>> succs, preds;
+        for (size_t b : starts) {
+            size_t end = blockEnd(b);
+            const auto &last = insns[end];
+
+            if (last.code == EBPF_OP_EXIT) {
+                continue;
+            }
+
+            // Taken edge first, then the fallthrough one
+            if (last.code == EBPF_OP_CALL) {
+                if (last.src_reg == 1 && end + last.imm + 1 < n) {
+                    succs[b].push_back(blockOf[end + last.imm + 1]);
+                }
+            } else if (is_jmp(last) && end + last.off + 1 < n) {
+                succs[b].push_back(blockOf[end + last.off + 1]);
+            }
+            if (last.code != EBPF_OP_JA && end + 1 < n) {
+                succs[b].push_back(blockOf[end + 1]);
+            }
+        }
+        for (const auto &[b, ss] : succs) {
+            for (size_t s : ss) {
+                preds[s].push_back(b);
+            }
+        }
+
+        // Blocks that only lead to exit without calling anything
+        std::map<size_t, bool> exitOnly;
+        for (auto itr = starts.rbegin(); itr != starts.rend(); itr++) {
+            size_t b = *itr;
+            size_t end = blockEnd(b);
+            const auto &last = insns[end];
+
+            bool result = end - b + 1 <= EXIT_BLOCK_MAX_LEN;
+            for (size_t i = b; i < end && result; i++) {
+                result = !is_jmp(insns[i]);
+            }
+
+            if (last.code == EBPF_OP_EXIT) {
+                exitOnly[b] = result;
+            } else if (last.code == EBPF_OP_JA && end + last.off + 1 < n) {
+                exitOnly[b] = result && exitOnly[blockOf[end + last.off + 1]];
+            } else {
+                exitOnly[b] = false;
+            }
+        }
+
+        auto isCall = [&](size_t b) { return insns[blockEnd(b)].code == EBPF_OP_CALL; };
+        auto isPrintk = [&](size_t b) {
+            const auto &last = insns[blockEnd(b)];
+            return last.code == EBPF_OP_CALL && last.src_reg == 0 && last.imm == 6;
+        };
+
+        // Failed bounds checks
+        for (size_t b : starts) {
+            if (is_bounds_check(insns[blockEnd(b)]) && succs[b].size() == 2) {
+                size_t taken = succs[b][0], fallthrough = succs[b][1];
+                if (exitOnly[taken] != exitOnly[fallthrough]) {
+                    cold[exitOnly[taken] ? taken : fallthrough] = true;
+                }
+            }
+        }
+
+        // bpf_printk() diagnostics: only when one side of a conditional branch, the other side not being cold.
+        // A bpf_printk() on the straight-line path (e.g. after a call) stays hot.
+        std::vector<size_t> printkBlocks;
+        for (size_t b : starts) {
+            if (b == 0 || !isPrintk(b)) {
+                continue;
+            }
+
+            bool diagnostic = std::any_of(preds[b].begin(), preds[b].end(), [&](size_t p) {
+                if (isCall(p) || succs[p].size() != 2 || succs[p][0] == succs[p][1]) {
+                    return false;
+                }
+                size_t other = succs[p][0] == b ? succs[p][1] : succs[p][0];
+                return !cold[other] && !isPrintk(other);
+            });
+            if (diagnostic) {
+                printkBlocks.push_back(b);
+            }
+        }
+        for (size_t b : printkBlocks) {
+            cold[b] = true;
+        }
+
+        // The entry block is always hot, the blocks it leads to are never cold through it
+        cold[0] = false;
+
+        // Blocks only reachable from cold blocks, but not through the fallthrough of a call: the code after a
+        // helper call continues the path of the block making it
+        bool changed = true;
+        while (changed) {
+            changed = false;
+            for (size_t b : starts) {
+                if (b == 0 || cold[b] || preds[b].empty()) {
+                    continue;
+                }
+
+                bool allCold = std::all_of(preds[b].begin(), preds[b].end(), [&](size_t p) {
+                    return cold[p] && !isCall(p);
+                });
+                if (allCold) {
+                    cold[b] = true;
+                    changed = true;
+                }
+            }
+        }
+
+        for (size_t b : starts) {
+            if (cold[b]) {
+                SPDLOG_DEBUG("Block at pc {} is cold", b);
+            }
+        }
+
+        return cold;
+    }
+
+    void annotate_cold_blocks(program_t &p, const std::vector<bool> &cold)
+    {
+        std::set<BasicBlock *> coldBlocks;
+        for (const auto &[pc, bb] : p.instBlocks) {
+            if (pc < cold.size() && cold[pc]) {
+                coldBlocks.insert(bb);
+            }
+        }
+
+        if (coldBlocks.empty()) {
+            return;
+        }
+
+        MDBuilder mdBuilder(p.bpf_main->getContext());
+
+        for (auto &bb : *p.bpf_main) {
+            bool isCold = coldBlocks.count(&bb);
+
+            for (auto &inst : bb) {
+
+                // Helper calls of cold blocks (e.g. bpf_printk)
+                if (auto call = dyn_cast<CallInst>(&inst); call && isCold && !call->isInlineAsm()) {
+                    call->addFnAttr(Attribute::Cold);
+                }
+            }
+
+            auto br = dyn_cast<BranchInst>(bb.getTerminator());
+            if (!br || !br->isConditional()) {
+                continue;
+            }
+
+            bool coldTrue = coldBlocks.count(br->getSuccessor(0));
+            bool coldFalse = coldBlocks.count(br->getSuccessor(1));
+            if (coldTrue == coldFalse) {
+                continue;
+            }
+
+            br->setMetadata(LLVMContext::MD_prof,
+                            mdBuilder.createBranchWeights(
+                                    coldTrue ? COLD_BRANCH_WEIGHT : HOT_BRANCH_WEIGHT,
+                                    coldFalse ? COLD_BRANCH_WEIGHT : HOT_BRANCH_WEIGHT));
+        }
+    }
+}
@@ -0,0 +1,38 @@
+//
+// Created by Davide Collovigh on 19/10/26.
+//
+
+#ifndef EBPF_LLVM_JIT_COLD_BLOCKS_H
+#define EBPF_LLVM_JIT_COLD_BLOCKS_H
+
+#include <vector>
+
+#include "../ebpf_inst.h"
+#include "program.h"
+
+// Weights given to the hot/cold edges of a branch
+#define HOT_BRANCH_WEIGHT 2000
+#define COLD_BRANCH_WEIGHT 1
+
+namespace ebpf_llvm_jit::jit {
+
+    /**
+     * @brief classifies the blocks of the program using static heuristics
+     *
+     * A block is cold if:
+     * - it only leads to exit and is taken when a bounds check (jgt/jge/jlt/jle on registers) fails
+     * - it calls bpf_printk() and is one side of a conditional branch whose other side is not cold
+     * - all its predecessors are cold and none of them ends with a call (its fallthrough stays hot)
+     *
+     * @return for each pc starting a block, true if the block is cold
+     */
+    std::vector<bool> classify_cold_blocks(const std::vector<ebpf_inst> &insns, const std::vector<bool> &blockBegin);
+
+    /**
+     * @brief sets branch weights on the edges between hot and cold blocks and marks
+     * the helper calls of cold blocks as cold, so that they can be outlined
+     */
+    void annotate_cold_blocks(program_t &p, const std::vector<bool> &cold);
+}
+
+#endif //EBPF_LLVM_JIT_COLD_BLOCKS_H
@@ -8,7 +8,15 @@
 #include "compiler_xdp.h"
 #include "../ebpf_inst.h"
 #include "code_gen.h"
+#include "cold_blocks.h"
+#include "intrinsics.h"
+#include "profile.h"
+#include "batch.h"
+#include "tail_call.h"
+#include "static_map.h"
+#include "debug_info.h"
 #include "program.h"
+#include "xdp_md.h"
 
 #include <cassert>
 #include <cstdint>
@@ -168,6 +176,8 @@ Expected<ThreadSafeModule> CompilerXDP::generateModule(
     SPDLOG_INFO("Generating module: patch_map_val_at_compile_time={}", patch_map_val_at_compile_time);
     std::unique_ptr<llvm::LLVMContext> ctx = std::make_unique<LLVMContext>();
     auto jitModule = std::make_unique<Module>("bpf-jit", *ctx);
+    // The lowering of intrinsics and prefetches depends on the target
+    jitModule->setTargetTriple(target.triple);
 
     if (insts.empty()) {
         return llvm::make_error<llvm::StringError>("No instructions provided", llvm::inconvertibleErrorCode());
@@ -185,43 +195,101 @@ Expected<ThreadSafeModule> CompilerXDP::generateModule(
      * Inject memory sections into target
      *****************************************************/
 
-    for (auto [section_name, section_content] : sections) {
+    for (const auto &section : sections) {
 
         // if section is empty -> skip
-        if (section_content.empty())
+        if (section.size == 0)
         {
             continue;
         }
 
-        SPDLOG_INFO("Injecting {} section into module...", section_name);
-        SPDLOG_INFO("{} = {}", section_name, section_content);
+        SPDLOG_INFO("Injecting {} section into module as {}...", section.source, section.name);
 
-        // Convert roData string to an LLVM constant array
-        llvm::Constant *roDataConstant = llvm::ConstantDataArray::getString(*ctx, section_content, true);
+        // Content of the section as a byte array, NOBITS sections (.bss) are zero initialized
+        auto *sectionTy = llvm::ArrayType::get(Type::getInt8Ty(*ctx), section.size);
+        llvm::Constant *sectionInit;
 
-        // Ensure the jitModule is valid and roDataConstant is properly assigned
-        if (!roDataConstant) {
-            SPDLOG_ERROR("Failed to create ConstantDataArray for \"{}\" section", section_name);
-            return llvm::make_error<llvm::StringError>("Failed to create ConstantDataArray", llvm::inconvertibleErrorCode());
+        if (section.str_content.empty()) {
+            sectionInit = llvm::ConstantAggregateZero::get(sectionTy);
+        } else {
+            std::vector<uint8_t> bytes(section.str_content.begin(), section.str_content.end());
+            bytes.resize(section.size, 0);
+            sectionInit = llvm::ConstantDataArray::get(*ctx, bytes);
         }
 
-        // Create a global variable for roData in the module
-        auto *roDataGV = new llvm::GlobalVariable(
+        // Read only sections are constant so that loads from them can be folded at compile time.
+        // Linked with the other programs of the ELF, the sections are merged into one copy
+        auto *sectionGV = new llvm::GlobalVariable(
+                *jitModule,
+                sectionTy,
+                section.read_only, // isConstant
+                single_object ? llvm::GlobalValue::LinkOnceODRLinkage : llvm::GlobalValue::PrivateLinkage,
+                sectionInit,
+                section.name
+        );
+
+        // Set the section for the global variable to s.name
+        sectionGV->setSection(section.name);
+        sectionGV->setAlignment(llvm::Align(section.alignment));
+
+        p.sectionGlobals[section.source] = sectionGV;
+
+        SPDLOG_INFO("Injected {} [OK]", section.name);
+    }
+
+    /*****************************************************
+     * Inject frozen maps as constant tables
+     *****************************************************/
+
+    for (const auto &[name, map] : frozen_maps) {
+
+        SPDLOG_INFO("Injecting frozen map {} [value_size: {}, max_entries: {}]", name, map.value_size, map.max_entries);
+
+        std::vector<uint8_t> bytes(map.content.begin(), map.content.end());
+        auto *tableInit = llvm::ConstantDataArray::get(*ctx, bytes);
+
+        auto *tableGV = new llvm::GlobalVariable(
                 *jitModule,
-                roDataConstant->getType(),
+                tableInit->getType(),
                 true, // isConstant
                 llvm::GlobalValue::PrivateLinkage,
-                roDataConstant,
-                section_name
+                tableInit,
+                FROZEN_MAP_SECTION "." + name
         );
+        tableGV->setSection(FROZEN_MAP_SECTION);
+        tableGV->setAlignment(llvm::Align(8));
 
-        // Set the section for the global variable to s.name
-        roDataGV->setSection(section_name);
+        p.frozenMaps[name] = tableGV;
+    }
 
-        // Optionally align the data (e.g., 4-byte alignment)
-        roDataGV->setAlignment(llvm::Align(1));
+    /*****************************************************
+     * Allocate the storage of the other maps
+     *****************************************************/
 
-        SPDLOG_INFO("Injected {} [OK]", section_name);
+    for (const auto &[name, map] : static_maps) {
+        p.staticMaps[name] = emitStaticMap(*jitModule, map);
+    }
+
+    // bpf_map_lookup_elem() is resolved inline on static ARRAY maps
+    if (!static_maps.empty()) {
+        auto lookupName = ext_func_sym(1);
+        auto fallback = p.extFunc.find(lookupName);
+
+        p.extFunc[lookupName] = emitStaticMapLookup(
+                *jitModule, p.helperFuncTy,
+                fallback != p.extFunc.end() ? fallback->second : nullptr,
+                static_maps, p.staticMaps);
+    }
+
+    // bpf_map_lookup_elem() is resolved inline on frozen maps
+    if (!frozen_maps.empty()) {
+        auto lookupName = ext_func_sym(1);
+        auto fallback = p.extFunc.find(lookupName);
+
+        p.extFunc[lookupName] = emitFrozenMapLookup(
+                *jitModule, p.helperFuncTy,
+                fallback != p.extFunc.end() ? fallback->second : nullptr,
+                frozen_maps, p.frozenMaps);
     }
 
     /*****************************************************
@@ -250,6 +318,25 @@ Expected<ThreadSafeModule> CompilerXDP::generateModule(
         jitModule.get()
     );
 
+    // Entry point of the program for the tail calls of the other programs of the build
+    if (!program_name.empty()) {
+        GlobalAlias::create(GlobalValue::ExternalLinkage, PROG_SYM_PREFIX + program_name, p.bpf_main);
+    }
+
+    // Native code of every pc tagged with its location, mapped back to the pc by the line table
+    std::vector<DILocation *> pcLocations;
+    if (debug_info || wcet.enabled || manifest) {
+        pcLocations = emitDebugLocations(*jitModule, *p.bpf_main, program_name, p.insns.size(), source_lines);
+    }
+
+    /*****************************************************
+     * Inject the prog arrays as tables of entry points
+     *****************************************************/
+
+    for (const auto &[name, array] : prog_arrays) {
+        p.progArrays[name] = emitProgArray(*jitModule, p.bpf_main->getFunctionType(), array);
+    }
+
     // Get args of uint64_t bpf_main(uint64_t, uint64_t)
     llvm::Argument *mem = p.bpf_main->getArg(0);
     llvm::Argument *mem_len = p.bpf_main->getArg(1);
@@ -340,6 +427,10 @@ Expected<ThreadSafeModule> CompilerXDP::generateModule(
     p.exitBlock = BasicBlock::Create(*ctx, "exitBlock", p.bpf_main);
     {
         IRBuilder<> builder(p.exitBlock);
+        // The chain of tail calls ends with the program returning
+        if (!prog_arrays.empty()) {
+            emitTailCallCountReset(builder, intrinsics);
+        }
         builder.CreateRet(builder.CreateLoad(builder.getInt64Ty(), p.regs[0]));
     }
 
@@ -415,7 +506,7 @@ Expected<ThreadSafeModule> CompilerXDP::generateModule(
         true,                                         // Is the variable constant?
         GlobalValue::ExternalLinkage,                 // Linkage type (external, for linking)
         nullptr,                                      // Initializer (not used here, as it's external)
-        "ebpf_pkt_mem_base"                         // Name of the external variable
+        PKT_MEM_BASE_SYM                            // Name of the external variable
     );
 
     for (uint16_t pc = 0; pc < p.insns.size(); pc++) {
@@ -435,6 +526,9 @@ Expected<ThreadSafeModule> CompilerXDP::generateModule(
         }
 
         builder.SetInsertPoint(currBB);
+        if (!pcLocations.empty()) {
+            builder.SetCurrentDebugLocation(pcLocations[pc]);
+        }
 
         // Precheck for registers
         if (inst.dst_reg > 10 || inst.src_reg > 10) {
@@ -841,10 +935,52 @@ Expected<ThreadSafeModule> CompilerXDP::generateModule(
                 SPDLOG_DEBUG("Load LDDW val= {} part1={:x} part2={:x}",
                              val, (uint64_t)inst.imm,
                              (uint64_t)nextInst.imm);
-                if (inst.src_reg == 0) {
+                if (auto relo = relocations.find(pc - 1);
+                        inst.src_reg == 0 && relo != relocations.end() &&
+                        (relo->second.section == ".maps" || relo->second.section == "maps")) {
+                    // Reference to a map: the address of its table, descriptor or storage in the native ELF
+                    if (auto table = p.frozenMaps.find(relo->second.symbol); table != p.frozenMaps.end()) {
+                        SPDLOG_DEBUG("Emit lddw of frozen map {} at pc {}", relo->second.symbol, pc);
+                        emitLoadSectionAddr(builder, &p.regs[0], inst, table->second, 0);
+                    } else if (auto desc = p.staticMaps.find(relo->second.symbol); desc != p.staticMaps.end()) {
+                        SPDLOG_DEBUG("Emit lddw of static map {} at pc {}", relo->second.symbol, pc);
+                        emitLoadSectionAddr(builder, &p.regs[0], inst, desc->second, 0);
+                    } else if (auto progs = p.progArrays.find(relo->second.symbol); progs != p.progArrays.end()) {
+                        SPDLOG_DEBUG("Emit lddw of prog array {} at pc {}", relo->second.symbol, pc);
+                        emitLoadSectionAddr(builder, &p.regs[0], inst, progs->second, 0);
+                    } else {
+                        SPDLOG_INFO("Map {} has no storage, will use the default behavior", relo->second.symbol);
+                        builder.CreateStore(builder.getInt64(val), p.regs[inst.dst_reg]);
+                    }
+                } else if (auto relo = relocations.find(pc - 1);
+                        inst.src_reg == 0 && relo != relocations.end()) {
+                    auto gv = p.sectionGlobals.find(relo->second.section);
+                    if (gv == p.sectionGlobals.end()) {
+                        return llvm::make_error<llvm::StringError>(
+                                "LDDW at pc=" + std::to_string(pc - 1) +
+                                " references section " + relo->second.section +
+                                " which was not injected",
+                                llvm::inconvertibleErrorCode());
+                    }
+                    SPDLOG_DEBUG("Emit lddw of {}+{} at pc {}", relo->second.section,
+                                 (uint64_t)inst.imm + relo->second.sym_offset, pc);
+                    emitLoadSectionAddr(builder, &p.regs[0], inst, gv->second,
+                                        (uint32_t)inst.imm + relo->second.sym_offset);
+                } else if (inst.src_reg == 0) {
                     SPDLOG_DEBUG("Emit lddw helper 0 at pc {}", pc);
                     builder.CreateStore(builder.getInt64(val),
                                         p.regs[inst.dst_reg]);
+                } else if (auto sec = map_sections.find(inst.imm);
+                        (inst.src_reg == 2 || inst.src_reg == 6) &&
+                        sec != map_sections.end() &&
+                        p.sectionGlobals.count(sec->second)) {
+                    // BPF_PSEUDO_MAP_VALUE / BPF_PSEUDO_MAP_IDX_VALUE on an internal map:
+                    // reference directly the injected section
+                    SPDLOG_DEBUG("Emit lddw of map {} ({}) value +{} at pc {}",
+                                 inst.imm, sec->second, nextInst.imm, pc);
+                    emitLoadSectionAddr(builder, &p.regs[0], inst,
+                                        p.sectionGlobals[sec->second],
+                                        (uint32_t)nextInst.imm);
                 } else if (inst.src_reg == 1) {
                     SPDLOG_DEBUG(
                             "Emit lddw helper 1 (map_by_fd) at pc {}, imm={}, patched at compile time",
@@ -1124,6 +1260,20 @@ Expected<ThreadSafeModule> CompilerXDP::generateModule(
                         return dstBlk.takeError();
                     }
 
+                } else if (inst.imm == BPF_FUNC_TAIL_CALL && !p.progArrays.empty()) {
+                    // Jump to the program in the prog array, continue with the next instruction if it fails
+                    SPDLOG_INFO("Emitting tail call at pc {}", pc);
+                    builder.SetInsertPoint(emitTailCall(builder, p.bpf_main, &p.regs[0], callItemCnt,
+                                                        p.localRetBlock, intrinsics));
+                    if (auto nextBlk = loadJmpNextBlock(pc, inst, p.instBlocks); nextBlk) {
+                        builder.CreateBr(nextBlk.get());
+                    } else {
+                        return nextBlk.takeError();
+                    }
+                } else if (auto result = emitHelperIntrinsic(builder, *jitModule, inst.imm, intrinsics);
+                        result) {
+                    // Cheap helpers are lowered inline
+                    builder.CreateStore(result, p.regs[0]);
                 } else {
                     if (auto exp = emitExtFuncCall(
                                 builder, inst, p.extFunc, &p.regs[0],
@@ -1344,25 +1494,22 @@ Expected<ThreadSafeModule> CompilerXDP::generateModule(
                                 builder.CreateLoad(builder.getPtrTy(),
                                                    p.regs[inst.dst_reg]),
                                 { builder.getInt64(inst.off) });
-                        auto beforeVal = builder.CreateLoad(
-                                is64 ? builder.getInt64Ty() :
-                                builder.getInt32Ty(),
-                                vPtr);
-                        builder.CreateAtomicCmpXchg(
+                        // r0 = old value, whether the exchange happened or not
+                        auto result = builder.CreateAtomicCmpXchg(
                                 vPtr,
-                                builder.CreateLoad(
+                                builder.CreateTrunc(
+                                        builder.CreateLoad(builder.getInt64Ty(), p.regs[0]),
                                         is64 ? builder.getInt64Ty() :
-                                        builder.getInt32Ty(),
-                                        p.regs[0]),
-                                builder.CreateLoad(
+                                        builder.getInt32Ty()),
+                                builder.CreateTrunc(
+                                        builder.CreateLoad(builder.getInt64Ty(), p.regs[inst.src_reg]),
                                         is64 ? builder.getInt64Ty() :
-                                        builder.getInt32Ty(),
-                                        p.regs[inst.src_reg]),
-                                MaybeAlign(0),
+                                        builder.getInt32Ty()),
+                                MaybeAlign(),
                                 AtomicOrdering::Monotonic,
                                 AtomicOrdering::Monotonic);
                         builder.CreateStore(
-                                builder.CreateZExt(beforeVal,
+                                builder.CreateZExt(builder.CreateExtractValue(result, 0),
                                                    builder.getInt64Ty()),
                                 p.regs[0]);
                         break;
@@ -1393,6 +1540,25 @@ Expected<ThreadSafeModule> CompilerXDP::generateModule(
             builder.CreateBr(p.allBlocks[i + 1]);
         }
     }
+
+    // Block counters for profile guided optimization
+    if (instrument) {
+        instrument_blocks(p, *jitModule, program_name);
+    }
+
+    // Move error and debug paths out of the way of the hot path, a profile replaces the static heuristics
+    if (!profile.empty()) {
+        annotate_cold_blocks(p, cold_blocks_from_profile(p, profile));
+        apply_profile(p, profile);
+    } else if (hot_cold_splitting) {
+        annotate_cold_blocks(p, classify_cold_blocks(p.insns, p.blockBegin));
+    }
+
+    // Multi-packet entry point
+    if (batch) {
+        emitBatchEntry(*jitModule, p.bpf_main, baseGlobal, batch_prefetch_distance);
+    }
+
     if (verifyModule(*jitModule, &dbgs())) {
         return llvm::make_error<llvm::StringError>(
                 "Invalid module generated",
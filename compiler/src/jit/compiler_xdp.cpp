@@ -4,8 +4,11 @@
 
 #include "compiler_xdp.h"
 #include "passthrough_section.h"
+#include "ir_passes.h"
+#include "xdp_md.h"
 #include "spdlog/spdlog.h"
 
+#include <llvm/IR/DebugInfo.h>
 #include <llvm/IR/Module.h>
 #include <llvm/IR/GlobalVariable.h>
 #include <llvm/IR/LegacyPassManager.h>
@@ -17,6 +20,7 @@
 #include <llvm/Transforms/IPO/PassManagerBuilder.h>
 #include <llvm/Support/Host.h>
 #include <llvm/MC/TargetRegistry.h>
+#include <llvm/Bitcode/BitcodeWriter.h>
 
 
 using namespace ebpf_llvm_jit::jit;
@@ -99,6 +103,7 @@ CompilerXDP::CompilerXDP() : ext_funcs(MAX_EXT_FUNCS)
         LLVMInitializeAllTargetMCs();
         LLVMInitializeAllAsmParsers();
         LLVMInitializeAllAsmPrinters();
+        LLVMInitializeAllDisassemblers();
         SPDLOG_INFO("done");
     }
 
@@ -123,7 +128,57 @@ int CompilerXDP::load_code(const void *code, size_t code_len)
     insts.assign((ebpf_inst *)code,(ebpf_inst *)code + code_len / 8);
     return 0;
 }
-std::vector<uint8_t> CompilerXDP::do_aot_compile(bool print_ir, const std::vector<ebpf_llvm_jit::jit::passthrough_section> &sections)
+static std::vector<uint8_t> emitObject(llvm::Module &module, llvm::TargetMachine &targetMachine, codegen_stats *stats = nullptr)
+{
+    llvm::SmallVector<char, 0> objStream;
+    std::unique_ptr<llvm::raw_svector_ostream> BOS =std::make_unique<llvm::raw_svector_ostream>(objStream);
+
+    llvm::legacy::PassManager pass;
+// auto FileType = CGFT_ObjectFile;
+#if LLVM_VERSION_MAJOR >= 18
+    if (targetMachine.addPassesToEmitFile(
+            pass, *BOS, nullptr,
+            CodeGenFileType::ObjectFile)) {
+#elif LLVM_VERSION_MAJOR >= 10
+    if (targetMachine.addPassesToEmitFile(pass, *BOS, nullptr, llvm::CGFT_ObjectFile)) {
+#elif LLVM_VERSION_MAJOR >= 8
+    if (targetMachine.addPassesToEmitFile(
+            pass, *BOS, nullptr,
+            TargetMachine::CGFT_ObjectFile)) {
+#else
+    if (targetMachine.addPassesToEmitFile(
+            pass, *BOS, TargetMachine::CGFT_ObjectFile,
+            true)) {
+#endif
+        SPDLOG_ERROR("Unable to emit module for target machine");
+        throw std::runtime_error("Unable to emit module for target machine");
+    }
+
+    // Spill and frame size remarks of the code generator
+    std::unique_ptr<llvm::DiagnosticHandler> handler;
+    if (stats) {
+        handler = module.getContext().getDiagnosticHandler();
+        module.getContext().setDiagnosticHandler(createCodegenStatsHandler(*stats));
+    }
+
+    pass.run(module);
+
+    if (stats) {
+        module.getContext().setDiagnosticHandler(std::move(handler));
+    }
+    SPDLOG_INFO("AOT: done, received {} bytes",objStream.size());
+
+    return std::vector<uint8_t>(objStream.begin(),objStream.end());
+}
+std::string CompilerXDP::target_features() const
+{
+    // RVV is required by the SPMD entry point
+    if (vector || spmd) {
+        return "+v";
+    }
+    return "";
+}
+llvm::orc::ThreadSafeModule CompilerXDP::build_module(const std::vector<ebpf_llvm_jit::jit::passthrough_section> &sections)
 {
 
     std::vector<std::string> extFuncNames, lddwHelpers;
@@ -156,82 +211,303 @@ std::vector<uint8_t> CompilerXDP::do_aot_compile(bool print_ir, const std::vecto
     tryDefineLddwHelper(LDDW_HELPER_MAP_VAL, (void *)map_val);
 
     SPDLOG_INFO("AOT: start");
-    if (auto module = generateModule(extFuncNames, lddwHelpers, false, sections); module) {
+    // Maps (frozen ones included) are resolved through the LDDW relocations of libbpf, not by map_val
+    auto module = generateModule(extFuncNames, lddwHelpers, false, sections);
+    if (!module) {
+        std::string buf;
+        llvm::raw_string_ostream os(buf);
+        os << module.takeError();
+        SPDLOG_ERROR("Unable to generate module: {}", buf);
+        throw std::runtime_error("Unable to generate llvm module");
+    }
 
-        SPDLOG_INFO("AOT: generated module");
+    SPDLOG_INFO("AOT: generated module");
+    SPDLOG_INFO("AOT: target triple: {}", target.triple);
 
-        auto targetTriple = "riscv64-unknown-elf";
-        auto cpu = "generic"; // or a specific RISC-V CPU like 'rocket'
-        auto features = ""; //"+f,+d";
+    module->withModuleDo([&](auto &module) {
+        // TODO: disabled otherwise it would eliminate calls to helpers
+        //optimizeModule(module);
 
-        SPDLOG_INFO("AOT: target triple: {}", targetTriple);
-        return module->withModuleDo([&](auto &module) -> std::vector<uint8_t> {
-            if (print_ir) {
-                module.print(llvm::errs(), nullptr);
+        // Set the target triple for the module
+        module.setTargetTriple(target.triple);
+        module.setDataLayout(createTargetMachine(target, target_features())->createDataLayout());
+
+        // Resolve pointers to the data sections and fold .rodata loads
+        // Atomics that no other hart can race with
+        exclusive_memory exclusive;
+        exclusive.all = harts == 1;
+        for (const auto &section : sections) {
+            if (exclusive_sections.count(section.source)) {
+                exclusive.globals.insert(section.name);
             }
+        }
 
-            // TODO: disabled otherwise it would eliminate calls to helpers
-            //optimizeModule(module);
+        // With the sandbox, the cold regions are outlined after the accesses are masked,
+        // with memoization after bpf_main has been analyzed as a whole
+        bool splitLater = sandbox_window || memo;
+        std::string simplifyError;
+        if (!simplifyModule(module, hot_cold_splitting && !splitLater, exclusive, unroll_count, simplifyError)) {
+            SPDLOG_ERROR("AOT: {}", simplifyError);
+            throw std::runtime_error("Unable to simplify module");
+        }
 
-            // Set the target triple for the module
-            module.setTargetTriple(targetTriple);
+        if (memo) {
+            std::string memoReason;
+            if (auto info = analyzeMemoization(*module.getFunction("bpf_main"), memoReason)) {
+                emitMemoization(module, *info);
+            } else {
+                SPDLOG_WARN("AOT: program is not memoizable: {}", memoReason);
+            }
+        }
 
-            std::string error;
-            auto target = llvm::TargetRegistry::lookupTarget(targetTriple, error);
+        if (shape) {
+            std::string shapeReason;
+            if (!emitShapeSpecialization(module, *shape, shapeReason)) {
+                SPDLOG_WARN("AOT: program is not specialized for shape {}: {}", shape->spec, shapeReason);
+            }
+        }
 
-            if (!target) {
-                SPDLOG_ERROR("AOT: Failed to get local target: {}", error);
-                throw std::runtime_error("Unable to get local target");
+        if (sandbox_window) {
+            std::string sandboxError;
+            if (!sandboxMemoryAccesses(module, sandbox_window, sandboxError)) {
+                SPDLOG_ERROR("AOT: program cannot be sandboxed: {}", sandboxError);
+                throw std::runtime_error("Unable to sandbox program");
             }
+        }
 
-            // Create target machine with hardware floating-point support (RV64G with FD extensions)
-            llvm::TargetMachine *targetMachine = target->createTargetMachine(
-                    targetTriple, cpu, features, llvm::TargetOptions(), llvm::Reloc::PIC_);
+        if (hot_cold_splitting && splitLater) {
+            splitColdRegions(module);
+        }
 
-            SPDLOG_INFO("Creating LLVM target machine using [target_machine={}, cpu={}, features={}]", targetTriple, cpu, features);
+        // The WCET bound charges calls by their instruction only: keep the unrolled stores of memcpy/memset
+        if (reroll && !wcet.enabled && rerollMemoryOps(module, vector || spmd)) {
+            SPDLOG_INFO("AOT: re-rolled memory operations");
+        }
+
+        // Vector entry point, built from the simplified bpf_main
+        if (spmd) {
+            emitSpmdEntry(module, module.getFunction("bpf_main"));
+        }
+    });
+
+    return std::move(*module);
+}
+std::vector<uint8_t> CompilerXDP::do_aot_compile(bool print_ir, const std::vector<ebpf_llvm_jit::jit::passthrough_section> &sections)
+{
+    auto module = build_module(sections);
 
-            if (!targetMachine) {
-                SPDLOG_ERROR("Unable to create target machine");
-                throw std::runtime_error("Unable to create target machine");
+    return module.withModuleDo([&](auto &module) -> std::vector<uint8_t> {
+        hide_entry_points(module);
+        if (!isa_variants.empty()) {
+            emitIsaVariants(module, isa_variants, *createTargetMachine(target, target_features()), target.cpu,
+                            targetFeatures(target, target_features()));
+        }
+
+        if (print_ir) {
+            module.print(llvm::errs(), nullptr);
+        }
+
+        codegen_stats stats;
+        auto object = emitObject(module, *createTargetMachine(target, target_features()), manifest || layout ? &stats : nullptr);
+        if (wcet.enabled && !check_wcet(object)) {
+            return {};
+        }
+
+        if (manifest) {
+            std::string error;
+            last_manifest = buildManifest(object, insts, target, target_features(), stats, inlined_helpers(),
+                                          sections, error);
+            if (!last_manifest) {
+                error_msg = "unable to build the manifest: " + error;
+                return {};
             }
-            module.setDataLayout(targetMachine->createDataLayout());
-            llvm::SmallVector<char, 0> objStream;
-            std::unique_ptr<llvm::raw_svector_ostream> BOS =std::make_unique<llvm::raw_svector_ostream>(objStream);
+            last_manifest->program = program_name;
+        }
 
-            llvm::legacy::PassManager pass;
-// auto FileType = CGFT_ObjectFile;
-#if LLVM_VERSION_MAJOR >= 18
-            if (targetMachine->addPassesToEmitFile(
-				    pass, *BOS, nullptr,
-				    CodeGenFileType::ObjectFile)) {
-#elif LLVM_VERSION_MAJOR >= 10
-            if (targetMachine->addPassesToEmitFile(pass, *BOS, nullptr, llvm::CGFT_ObjectFile)) {
-#elif LLVM_VERSION_MAJOR >= 8
-                if (targetMachine->addPassesToEmitFile(
-				    pass, *BOS, nullptr,
-				    TargetMachine::CGFT_ObjectFile)) {
-#else
-			if (targetMachine->addPassesToEmitFile(
-				    pass, *BOS, TargetMachine::CGFT_ObjectFile,
-				    true)) {
-#endif
-                SPDLOG_ERROR("Unable to emit module for target machine");
-                throw std::runtime_error("Unable to emit module for target machine");
+        // The line table was only there for the analyses: without -g, the same code is emitted again without it
+        if (!debug_info && (wcet.enabled || manifest)) {
+            llvm::StripDebugInfo(module);
+            object = emitObject(module, *createTargetMachine(target, target_features()));
+        }
+
+        if (layout) {
+            last_layout = buildLayout(stats, sections, static_maps, !prog_arrays.empty());
+            last_layout->program = program_name;
+            last_layout->harts = std::max(harts, 1u);
+            last_layout->sandbox_window = sandbox_window;
+        }
+        return object;
+    });
+}
+void CompilerXDP::hide_entry_points(llvm::Module &module)
+{
+    // Only the entry program exports the entry points, the others are reached through bpf_prog_<name>
+    if (prog_arrays.empty() || entry) {
+        return;
+    }
+
+    for (const char *sym : { "bpf_main", BATCH_ENTRY_SYM, SPMD_ENTRY_SYM, MEMO_DESC_SYM }) {
+        if (auto gv = module.getNamedValue(sym)) {
+            gv->setLinkage(llvm::GlobalValue::InternalLinkage);
+            if (gv->use_empty()) {
+                gv->eraseFromParent();
+            }
+        }
+    }
+    // Only used by the descriptor
+    if (auto key = module.getFunction(MEMO_KEY_SYM); key && key->use_empty()) {
+        key->eraseFromParent();
+    }
+}
+std::set<int32_t> CompilerXDP::inlined_helpers() const
+{
+    std::set<int32_t> inlined;
+    if (intrinsics.enabled) {
+        inlined.insert(BPF_FUNC_GET_NUMA_NODE_ID);
+        if (isRiscvTarget(target.triple)) {
+            inlined.insert({ BPF_FUNC_KTIME_GET_NS, BPF_FUNC_GET_PRANDOM_U32, BPF_FUNC_GET_SMP_PROCESSOR_ID });
+        }
+    }
+    return inlined;
+}
+bool CompilerXDP::check_wcet(const std::vector<uint8_t> &object)
+{
+    std::string error;
+    auto result = analyzeWcet(object, insts, target, target_features(), inlined_helpers(), wcet, error);
+    if (!result) {
+        if (wcet.max_cycles) {
+            error_msg = "unable to bound the execution time: " + error;
+            return false;
+        }
+        SPDLOG_WARN("WCET: unable to bound the execution time: {}", error);
+        return true;
+    }
+
+    SPDLOG_INFO("WCET: {} cycles, worst path over pcs {}", result->cycles, formatPcRanges(result->path));
+
+    if (!result->undeclared_helpers.empty()) {
+        std::string helpers;
+        for (auto id : result->undeclared_helpers) {
+            helpers += (helpers.empty() ? "" : ", ") + std::to_string(id);
+        }
+        if (wcet.max_cycles) {
+            error_msg = "no cost declared for helpers " + helpers;
+            return false;
+        }
+        SPDLOG_WARN("WCET: no cost declared for helpers {}, counted as 0 cycles", helpers);
+    }
+
+    if (wcet.max_cycles && result->cycles > wcet.max_cycles) {
+        error_msg = "WCET of " + std::to_string(result->cycles) + " cycles over the budget of " +
+                    std::to_string(wcet.max_cycles);
+        return false;
+    }
+    return true;
+}
+std::vector<uint8_t> CompilerXDP::do_fast_compile(const std::vector<ebpf_llvm_jit::jit::passthrough_section> &sections)
+{
+    if (!prog_arrays.empty()) {
+        error_msg = "tail calls through prog arrays are not supported by the fast backend";
+        return {};
+    }
+    if (!isRiscvTarget(target.triple)) {
+        error_msg = "the fast backend only emits RV64 objects";
+        return {};
+    }
+
+    fast_program prog = { program_name, insts, relocations, map_sections, {}, intrinsics, batch };
+    for (size_t i = 0; i < ext_funcs.size(); i++) {
+        if (ext_funcs[i].has_value()) {
+            prog.helpers.insert(i);
+        }
+    }
+
+    return emitFastObject(prog, sections, error_msg);
+}
+std::vector<uint8_t> CompilerXDP::do_aot_compile_bitcode(const std::vector<ebpf_llvm_jit::jit::passthrough_section> &sections)
+{
+    auto module = build_module(sections);
+
+    return module.withModuleDo([&](auto &module) -> std::vector<uint8_t> {
+        renameEntryPoints(module, program_name);
+        if (!debug_info) {
+            // the line table of --wcet/--manifest, which do not analyze bitcode
+            llvm::StripDebugInfo(module);
+        }
+
+        llvm::SmallVector<char, 0> buffer;
+        llvm::raw_svector_ostream os(buffer);
+        llvm::WriteBitcodeToFile(module, os);
+
+        return std::vector<uint8_t>(buffer.begin(), buffer.end());
+    });
+}
+std::vector<uint8_t> CompilerXDP::do_lto_bitcode(bool print_ir, const std::vector<ebpf_llvm_jit::jit::passthrough_section> &sections)
+{
+    auto module = build_module(sections);
+
+    return module.withModuleDo([&](auto &module) -> std::vector<uint8_t> {
+        hide_entry_points(module);
+        if (!debug_info) {
+            llvm::StripDebugInfo(module);
+        }
+
+        std::string features = targetFeatures(target, target_features());
+        if (!lto_features.empty()) {
+            // The code of the program is generated with the features of the runtime
+            llvm::SmallVector<llvm::StringRef, 8> required, available;
+            llvm::StringRef(features).split(required, ',', -1, false);
+            llvm::StringRef(lto_features).split(available, ',', -1, false);
+            for (auto feature : required) {
+                if (feature.startswith("+") && llvm::find(available, feature) == available.end()) {
+                    error_msg = "the runtime is not built with " + feature.str();
+                    return {};
+                }
             }
+            features = lto_features;
+        }
+        setLtoTarget(module, target, lto_cpu.empty() ? target.cpu : lto_cpu, features);
 
-            pass.run(module);
-            SPDLOG_INFO("AOT: done, received {} bytes",objStream.size());
+        if (print_ir) {
+            module.print(llvm::errs(), nullptr);
+        }
 
-            std::vector<uint8_t> result(objStream.begin(),objStream.end());
-            return result;
-        });
-    } else {
-        std::string buf;
-        llvm::raw_string_ostream os(buf);
-        os << module.takeError();
-        SPDLOG_ERROR("Unable to generate module: {}", buf);
-        throw std::runtime_error("Unable to generate llvm module");
+        llvm::SmallVector<char, 0> buffer;
+        llvm::raw_svector_ostream os(buffer);
+        llvm::WriteBitcodeToFile(module, os);
+
+        return std::vector<uint8_t>(buffer.begin(), buffer.end());
+    });
+}
+std::vector<uint8_t> CompilerXDP::link_programs(const std::vector<linked_program> &programs, const std::string &entry_name, bool print_ir)
+{
+    llvm::LLVMContext ctx;
+    auto module = linkPrograms(ctx, programs, chain.empty() ? entry_name : "");
+    if (!module) {
+        throw std::runtime_error("Unable to link the programs");
+    }
+
+    // bpf_main runs the programs of the chain, bpf_main_batch (--prefetch-batch) runs it over n packets
+    if (!chain.empty()) {
+        std::string chainError;
+        auto chainMain = emitChain(*module, chain, chainError);
+        if (!chainMain) {
+            SPDLOG_ERROR("AOT: {}", chainError);
+            throw std::runtime_error("Unable to build the chain");
+        }
+
+        auto pktMemBase = llvm::cast<llvm::GlobalVariable>(
+                module->getOrInsertGlobal(PKT_MEM_BASE_SYM, llvm::Type::getInt64Ty(ctx)));
+        if (batch) {
+            emitBatchEntry(*module, chainMain, pktMemBase, batch_prefetch_distance);
+        }
     }
+
+    if (print_ir) {
+        module->print(llvm::errs(), nullptr);
+    }
+
+    return emitObject(*module, *createTargetMachine(target, target_features()));
 }
 int CompilerXDP::register_external_function(size_t index, const std::string &name, void *fn)
 {
@@ -250,3 +526,279 @@ int CompilerXDP::register_external_function(size_t index, const std::string &nam
     ext_funcs[index] = external_function(name, fn);
     return 0;
 }
+int CompilerXDP::load_relocations(const std::vector<data_relocation> &relocs)
+{
+    for (const auto &relo : relocs) {
+
+        if (relo.pc + 1 >= insts.size() || insts[relo.pc].code != EBPF_OP_LDDW) {
+            error_msg = "Relocation does not point to a LDDW";
+            SPDLOG_ERROR("Relocation against {} at pc {} does not point to a LDDW", relo.section, relo.pc);
+            return -EINVAL;
+        }
+
+        relocations[relo.pc] = relo;
+    }
+
+    return 0;
+}
+void CompilerXDP::register_map_section(uint32_t idx, const std::string &section)
+{
+    map_sections[idx] = section;
+}
+int CompilerXDP::freeze_map(const frozen_map &map)
+{
+    if (map.value_size == 0 || map.max_entries == 0) {
+        error_msg = "Frozen map " + map.name + " is empty";
+        return -EINVAL;
+    }
+
+    if (map.content.size() != (uint64_t)map.value_size * map.max_entries) {
+        error_msg = "Snapshot of " + map.name + " has " + std::to_string(map.content.size()) +
+                    " bytes, expected " + std::to_string((uint64_t)map.value_size * map.max_entries);
+        return -EINVAL;
+    }
+
+    if (frozen_maps.count(map.name)) {
+        error_msg = "Map " + map.name + " already frozen";
+        return -EEXIST;
+    }
+
+    frozen_maps[map.name] = map;
+    return 0;
+}
+int CompilerXDP::register_static_map(const static_map &map)
+{
+    if (map.type != STATIC_MAP_TYPE_ARRAY && map.type != STATIC_MAP_TYPE_HASH && map.type != STATIC_MAP_TYPE_LRU_HASH) {
+        error_msg = "Map " + map.name + " has an unsupported type " + std::to_string(map.type);
+        return -ENOTSUP;
+    }
+
+    if (map.value_size == 0 || map.max_entries == 0) {
+        error_msg = "Map " + map.name + " is empty";
+        return -EINVAL;
+    }
+
+    if (map.type == STATIC_MAP_TYPE_ARRAY && map.key_size != 4) {
+        error_msg = "ARRAY map " + map.name + " must have 4 bytes keys";
+        return -EINVAL;
+    }
+
+    if (static_maps.count(map.name) || frozen_maps.count(map.name)) {
+        error_msg = "Map " + map.name + " already registered";
+        return -EEXIST;
+    }
+
+    static_maps[map.name] = map;
+    return 0;
+}
+int CompilerXDP::set_intrinsics(const intrinsics_config &config)
+{
+    if (config.timebase_hz == 0 || config.timebase_hz > 1000000000) {
+        error_msg = "Timebase frequency must be in (0, 1GHz]";
+        return -EINVAL;
+    }
+
+    intrinsics = config;
+    return 0;
+}
+void CompilerXDP::set_hot_cold_splitting(bool enabled)
+{
+    hot_cold_splitting = enabled;
+}
+void CompilerXDP::set_instrumentation(bool enabled)
+{
+    instrument = enabled;
+}
+void CompilerXDP::set_profile(const block_profile &blocks)
+{
+    profile = blocks;
+}
+void CompilerXDP::set_batch(bool enabled)
+{
+    batch = enabled;
+}
+int CompilerXDP::set_batch_prefetch_distance(unsigned distance)
+{
+    if (distance > BATCH_MAX_PREFETCH_DISTANCE) {
+        error_msg = "Batch prefetch distance too large";
+        return -EINVAL;
+    }
+
+    batch_prefetch_distance = distance;
+    return 0;
+}
+void CompilerXDP::set_spmd(bool enabled)
+{
+    spmd = enabled;
+}
+void CompilerXDP::set_vector(bool enabled)
+{
+    vector = enabled;
+}
+void CompilerXDP::set_reroll(bool enabled)
+{
+    reroll = enabled;
+}
+void CompilerXDP::set_harts(unsigned count)
+{
+    harts = count;
+}
+int CompilerXDP::set_sandbox(uint64_t window)
+{
+    if (window && (window & (window - 1))) {
+        error_msg = "Sandbox window size must be a power of two";
+        return -EINVAL;
+    }
+
+    sandbox_window = window;
+    return 0;
+}
+void CompilerXDP::set_program(const std::string &name, bool is_entry)
+{
+    program_name = name;
+    entry = is_entry;
+}
+void CompilerXDP::set_memoization(bool enabled)
+{
+    memo = enabled;
+}
+void CompilerXDP::set_single_object(bool enabled)
+{
+    single_object = enabled;
+}
+int CompilerXDP::set_target(const std::string &triple)
+{
+    aot_target resolved;
+    if (!resolveTarget(triple, resolved, error_msg)) {
+        return -EINVAL;
+    }
+
+    target = resolved;
+    return 0;
+}
+int CompilerXDP::set_codegen(unsigned optLevel, const std::string &features)
+{
+    if (optLevel > 3) {
+        error_msg = "Optimization level must be 0-3";
+        return -EINVAL;
+    }
+
+    llvm::SmallVector<llvm::StringRef, 4> added;
+    llvm::StringRef(features).split(added, ',', -1, false);
+    for (auto feature : added) {
+        if (feature.size() < 2 || (feature[0] != '+' && feature[0] != '-')) {
+            error_msg = "invalid target feature \"" + feature.str() + "\" (expected +name or -name)";
+            return -EINVAL;
+        }
+    }
+
+    target.opt_level = optLevel;
+    if (!features.empty()) {
+        target.features += (target.features.empty() ? "" : ",") + features;
+    }
+    return 0;
+}
+void CompilerXDP::set_unroll(unsigned count)
+{
+    unroll_count = count;
+}
+void CompilerXDP::set_wcet(const wcet_config &config)
+{
+    wcet = config;
+}
+void CompilerXDP::set_manifest(bool enabled)
+{
+    manifest = enabled;
+}
+const std::optional<program_manifest> &CompilerXDP::get_manifest() const
+{
+    return last_manifest;
+}
+int CompilerXDP::set_lto_caller(const std::string &bitcodeFile)
+{
+    if (!readTargetAttributes(bitcodeFile, lto_cpu, lto_features, error_msg)) {
+        return -EINVAL;
+    }
+    return 0;
+}
+int CompilerXDP::set_isa_variants(const std::vector<isa_variant> &variants)
+{
+    if (!variants.empty() && !isRiscvTarget(target.triple)) {
+        error_msg = "ISA variants require a RISC-V target";
+        return -EINVAL;
+    }
+
+    std::set<std::string> names;
+    for (const auto &variant : variants) {
+        if (!names.insert(variant.name).second) {
+            error_msg = "duplicated variant " + variant.name;
+            return -EINVAL;
+        }
+    }
+
+    isa_variants = variants;
+    return 0;
+}
+void CompilerXDP::set_packet_shape(const std::optional<packet_shape> &packetShape)
+{
+    shape = packetShape;
+}
+void CompilerXDP::set_layout(bool enabled)
+{
+    layout = enabled;
+}
+const std::optional<memory_layout> &CompilerXDP::get_layout() const
+{
+    return last_layout;
+}
+void CompilerXDP::set_debug_info(bool enabled, const std::vector<source_line> &lines)
+{
+    debug_info = enabled;
+    source_lines = lines;
+}
+int CompilerXDP::set_chain(const std::vector<chain_stage> &stages)
+{
+    for (const auto &stage : stages) {
+        if (stage.continue_actions == 0 && &stage != &stages.back()) {
+            error_msg = "Stage " + stage.name + " of the chain never runs the next one";
+            return -EINVAL;
+        }
+    }
+
+    chain = stages;
+    return 0;
+}
+int CompilerXDP::register_prog_array(const prog_array &array)
+{
+    if (array.max_entries == 0) {
+        error_msg = "Prog array " + array.name + " is empty";
+        return -EINVAL;
+    }
+
+    for (const auto &[slot, prog] : array.slots) {
+        if (slot >= array.max_entries) {
+            error_msg = "Slot " + std::to_string(slot) + " of prog array " + array.name +
+                        " is out of bounds (max_entries: " + std::to_string(array.max_entries) + ")";
+            return -EINVAL;
+        }
+    }
+
+    if (prog_arrays.count(array.name)) {
+        error_msg = "Prog array " + array.name + " already registered";
+        return -EEXIST;
+    }
+
+    prog_arrays[array.name] = array;
+    return 0;
+}
+int CompilerXDP::set_exclusive_map(uint32_t idx)
+{
+    auto section = map_sections.find(idx);
+    if (section == map_sections.end()) {
+        error_msg = "Only the maps of global data sections (.data, .bss) can be exclusive";
+        return -EINVAL;
+    }
+
+    exclusive_sections.insert(section->second);
+    return 0;
+}
@@ -7,6 +7,7 @@
 
 #include <optional>
 #include <memory>
+#include <set>
 
 #include <llvm/ExecutionEngine/Orc/Core.h>
 #include <llvm/Support/InitLLVM.h>
@@ -21,6 +22,28 @@
 #include "external_function.h"
 #include "program.h"
 #include "passthrough_section.h"
+#include "data_relocation.h"
+#include "frozen_map.h"
+#include "intrinsics.h"
+#include "profile.h"
+#include "batch.h"
+#include "spmd.h"
+#include "reroll.h"
+#include "sandbox.h"
+#include "tail_call.h"
+#include "link.h"
+#include "chain.h"
+#include "static_map.h"
+#include "memo.h"
+#include "fast_backend.h"
+#include "target.h"
+#include "wcet.h"
+#include "source_line.h"
+#include "manifest.h"
+#include "layout.h"
+#include "isa_variants.h"
+#include "shape.h"
+#include "tune.h"
 
 #ifndef MAX_EXT_FUNCS
 #define MAX_EXT_FUNCS 8192
@@ -56,11 +79,119 @@ namespace ebpf_llvm_jit::jit {
 
         std::vector<std::optional<external_function>> ext_funcs;
 
+        // LDDW relocations of the loaded program, indexed by pc
+        std::map<uint32_t, data_relocation> relocations;
+
+        // eBPF ELF section backing the internal maps (.rodata, .data, .bss), indexed by map idx
+        std::map<uint32_t, std::string> map_sections;
+
+        // ARRAY maps treated as constants, indexed by map name
+        std::map<std::string, frozen_map> frozen_maps;
+
+        // Maps with storage allocated in the native ELF, indexed by map name
+        std::map<std::string, static_map> static_maps;
+
+        // Inline lowering of cheap helpers
+        intrinsics_config intrinsics;
+
+        // Outline cold blocks into .text.unlikely
+        bool hot_cold_splitting = true;
+
+        // Profile guided optimization
+        bool instrument = false;
+        block_profile profile;
+
+        // Emit the multi-packet entry point, with packets prefetched ahead
+        bool batch = false;
+        unsigned batch_prefetch_distance = BATCH_DEFAULT_PREFETCH_DISTANCE;
+
+        // Emit the RVV entry point (experimental)
+        bool spmd = false;
+
+        // Target has RVV
+        bool vector = false;
+
+        // Turn unrolled memcpy/memset back into intrinsics
+        bool reroll = true;
+
+        // Harts running the programs (0 = unknown), with 1 atomics are plain read-modify-write
+        unsigned harts = 0;
+
+        // eBPF ELF sections (internal maps) only accessed by the hart running the program
+        std::set<std::string> exclusive_sections;
+
+        // Confine the memory accesses to a window of this size (0 = unchecked)
+        uint64_t sandbox_window = 0;
+
+        // Export the memoization key of stateless programs
+        bool memo = false;
+
+        // Name of the program, exported as bpf_prog_<name> for the tail calls
+        std::string program_name;
+
+        // Program exporting bpf_main when the programs of the build are linked together
+        bool entry = true;
+
+        // Prog arrays of the build, indexed by map name
+        std::map<std::string, prog_array> prog_arrays;
+
+        // Linked with the other programs of the ELF into one object
+        bool single_object = false;
+
+        // Programs fused into bpf_main by link_programs(), in order
+        std::vector<chain_stage> chain;
+
+        // Triple, CPU and ABI of the native objects
+        aot_target target;
+
+        // Fully unroll the loops with up to this many iterations (0 = loops are kept)
+        unsigned unroll_count = 0;
+
+        // Static bound of the cycles of bpf_main, checked against the budget
+        wcet_config wcet;
+
+        // DWARF line table of bpf_main, with the C lines of the BTF line info
+        bool debug_info = false;
+        std::vector<source_line> source_lines;
+
+        // Code quality manifest of the last object
+        bool manifest = false;
+        std::optional<program_manifest> last_manifest;
+
+        // target-cpu/target-features of the runtime code calling the program in a LTO build (empty: of the target)
+        std::string lto_cpu;
+        std::string lto_features;
+
+        // Variants of bpf_main for other ISA extensions, selected at boot by the runtime
+        std::vector<isa_variant> isa_variants;
+
+        // Dominant packet shape, bpf_main is also compiled for it behind a check of the shape
+        std::optional<packet_shape> shape;
+
+        // Memory needs of the last object, for the linker script of the runtime
+        bool layout = false;
+        std::optional<memory_layout> last_layout;
+
 
         static void loadLddwHelpers(program_t *p, std::unique_ptr<llvm::LLVMContext> &ctx, std::unique_ptr<llvm::Module> &module, const std::vector<std::string> &lddwHelpers);
         static void loadExtFuncs(program_t *p, std::unique_ptr<llvm::LLVMContext> &ctx, std::unique_ptr<llvm::Module> &module, const std::vector<std::string> &extFuncNames);
         static void split_blocks(program_t *p);
 
+        // Features added to the defaults of the target
+        std::string target_features() const;
+
+        // Helpers lowered inline by emitHelperIntrinsic(), their code is charged to the pc of the call
+        std::set<int32_t> inlined_helpers() const;
+
+        // Makes the entry points internal in the programs reached only through a prog array
+        void hide_entry_points(llvm::Module &module);
+
+        // Bounds the cycles of bpf_main in the object, false (with the error message set) if over the budget
+        bool check_wcet(const std::vector<uint8_t> &object);
+
+        // Generates and optimizes the module of the program
+        llvm::orc::ThreadSafeModule build_module(const std::vector<ebpf_llvm_jit::jit::passthrough_section> &sections);
+
         llvm::Expected<llvm::orc::ThreadSafeModule>
         generateModule(const std::vector<std::string> &extFuncNames,
                        const std::vector<std::string> &lddwHelpers,
@@ -80,8 +211,59 @@ namespace ebpf_llvm_jit::jit {
 
         int load_code(const void *code, size_t code_len);
         int register_external_function(size_t index, const std::string &name, void *fn);
+        int load_relocations(const std::vector<data_relocation> &relocs);
+        void register_map_section(uint32_t idx, const std::string &section);
+        int freeze_map(const frozen_map &map);
+        int register_static_map(const static_map &map);
+        int set_intrinsics(const intrinsics_config &config);
+        void set_hot_cold_splitting(bool enabled);
+        void set_instrumentation(bool enabled);
+        void set_profile(const block_profile &blocks);
+        void set_batch(bool enabled);
+        int set_batch_prefetch_distance(unsigned distance);
+        void set_spmd(bool enabled);
+        void set_vector(bool enabled);
+        void set_reroll(bool enabled);
+        void set_harts(unsigned count);
+        int set_exclusive_map(uint32_t idx);
+        int set_sandbox(uint64_t window);
+        void set_program(const std::string &name, bool is_entry);
+        int register_prog_array(const prog_array &array);
+        void set_memoization(bool enabled);
+        void set_single_object(bool enabled);
+        int set_chain(const std::vector<chain_stage> &stages);
+        int set_target(const std::string &triple);
+        int set_codegen(unsigned optLevel, const std::string &features);
+        void set_unroll(unsigned count);
+        void set_wcet(const wcet_config &config);
+        void set_debug_info(bool enabled, const std::vector<source_line> &lines);
+        void set_manifest(bool enabled);
+        void set_layout(bool enabled);
+        int set_lto_caller(const std::string &bitcodeFile);
+        int set_isa_variants(const std::vector<isa_variant> &variants);
+        void set_packet_shape(const std::optional<packet_shape> &packetShape);
+
+        // Manifest of the object of the last do_aot_compile(), with set_manifest()
+        const std::optional<program_manifest> &get_manifest() const;
 
+        // Memory needs of the object of the last do_aot_compile(), with set_layout()
+        const std::optional<memory_layout> &get_layout() const;
+
+        // Object of the program, empty (with the error message set) if its WCET is over the budget
         std::vector<uint8_t> do_aot_compile(bool print_ir, const std::vector<ebpf_llvm_jit::jit::passthrough_section> &sections);
+
+        // Object built by the template backend, empty (with the error message set) if the program needs LLVM
+        std::vector<uint8_t> do_fast_compile(const std::vector<ebpf_llvm_jit::jit::passthrough_section> &sections);
+
+        // Optimized module of the program as bitcode, for a link time optimized build with the runtime,
+        // empty (with the error message set) if the runtime code of set_lto_caller() lacks a feature of the program
+        std::vector<uint8_t> do_lto_bitcode(bool print_ir, const std::vector<ebpf_llvm_jit::jit::passthrough_section> &sections);
+
+        // Optimized module of the program, with per-program entry point names, to be linked by link_programs()
+        std::vector<uint8_t> do_aot_compile_bitcode(const std::vector<ebpf_llvm_jit::jit::passthrough_section> &sections);
+
+        // Single object holding the programs compiled by do_aot_compile_bitcode(), bpf_main is entry_name (or the chain)
+        std::vector<uint8_t> link_programs(const std::vector<linked_program> &programs, const std::string &entry_name, bool print_ir);
     };
 }
 
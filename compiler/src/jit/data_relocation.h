@@ -0,0 +1,29 @@
+//
+// Created by Davide Collovigh on 19/10/26.
+//
+
+#ifndef EBPF_LLVM_JIT_DATA_RELOCATION_H
+#define EBPF_LLVM_JIT_DATA_RELOCATION_H
+
+#include <cstdint>
+#include <string>
+
+namespace ebpf_llvm_jit::jit {
+
+    /**
+     * @brief relocation of a LDDW instruction against a symbol of the eBPF ELF
+     *
+     * libbpf only applies relocations at load time, so the instructions we get
+     * still hold the offset inside the section of the referenced symbol (imm)
+     * and the symbol itself is only known from the ELF relocation table.
+     */
+    typedef struct data_relocation {
+        uint32_t pc;            // index of the LDDW inside the program
+        std::string section;    // section of the eBPF ELF the symbol belongs to (e.g. ".rodata")
+        std::string symbol;     // name of the symbol (empty for section symbols)
+        uint64_t sym_offset;    // value of the symbol, to be added to the LDDW imm
+    } data_relocation;
+
+}
+
+#endif //EBPF_LLVM_JIT_DATA_RELOCATION_H
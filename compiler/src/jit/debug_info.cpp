@@ -0,0 +1,81 @@
+//
+// Created by Davide Collovigh on 19/10/26.
+//
+
+#include "debug_info.h"
+
+#include <map>
+
+#include <llvm/IR/DIBuilder.h>
+#include <llvm/Support/Path.h>
+
+using namespace llvm;
+
+namespace ebpf_llvm_jit::jit {
+
+    std::vector<DILocation *> emitDebugLocations(Module &module, Function &bpfMain, const std::string &name,
+                                                 size_t insnCount, const std::vector<source_line> &lines)
+    {
+        DIBuilder dib(module);
+
+        auto pcFile = dib.createFile((name.empty() ? "bpf_main" : name) + ".ebpf", ".");
+
+        std::map<std::string, DIFile *> sourceFiles;
+        auto sourceFile = [&](const std::string &path) {
+            auto &file = sourceFiles[path];
+            if (!file) {
+                file = dib.createFile(sys::path::filename(path), sys::path::parent_path(path));
+            }
+            return file;
+        };
+
+        // The subprogram starts at the first line of the program
+        DIFile *mainFile = lines.empty() ? pcFile : sourceFile(lines.front().file);
+        unsigned mainLine = lines.empty() ? PC_LINE(0) : lines.front().line;
+
+        auto cu = dib.createCompileUnit(dwarf::DW_LANG_C, mainFile, "ebpf_llvm_jit", true, "", 0, "",
+                                        DICompileUnit::LineTablesOnly);
+        auto sp = dib.createFunction(cu, bpfMain.getName(), StringRef(), mainFile, mainLine,
+                                     dib.createSubroutineType(dib.getOrCreateTypeArray({})), mainLine,
+                                     DINode::FlagZero,
+                                     DISubprogram::SPFlagDefinition | DISubprogram::SPFlagOptimized);
+        bpfMain.setSubprogram(sp);
+
+        // Lines of other files (headers, inlined functions) are in a lexical block of their file
+        std::map<DIFile *, DILocalScope *> scopes = { { mainFile, sp } };
+        auto scope = [&](DIFile *file) {
+            auto &s = scopes[file];
+            if (!s) {
+                s = dib.createLexicalBlockFile(sp, file);
+            }
+            return s;
+        };
+
+        std::vector<DILocation *> locations(insnCount);
+        const source_line *current = nullptr;
+        size_t next = 0;
+        for (size_t pc = 0; pc < insnCount; pc++) {
+            while (next < lines.size() && lines[next].pc <= pc) {
+                current = &lines[next++];
+            }
+
+            if (current) {
+                locations[pc] = DILocation::get(module.getContext(), current->line, PC_COLUMN(pc),
+                                                scope(sourceFile(current->file)));
+            } else {
+                locations[pc] = DILocation::get(module.getContext(), PC_LINE(pc), PC_COLUMN(pc), scope(pcFile));
+            }
+        }
+
+        dib.finalize();
+
+        if (!module.getModuleFlag("Debug Info Version")) {
+            module.addModuleFlag(Module::Warning, "Debug Info Version", DEBUG_METADATA_VERSION);
+        }
+        if (!module.getModuleFlag("Dwarf Version")) {
+            module.addModuleFlag(Module::Warning, "Dwarf Version", 4);
+        }
+
+        return locations;
+    }
+}
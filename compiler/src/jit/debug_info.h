@@ -0,0 +1,39 @@
+//
+// Created by Davide Collovigh on 19/10/26.
+//
+
+#ifndef EBPF_LLVM_JIT_DEBUG_INFO_H
+#define EBPF_LLVM_JIT_DEBUG_INFO_H
+
+#include <string>
+#include <vector>
+
+#include <llvm/IR/DebugInfoMetadata.h>
+#include <llvm/IR/Module.h>
+
+#include "source_line.h"
+
+// Line of an eBPF instruction in the <program>.ebpf pseudo file (the pcs of llvm-objdump -d of the eBPF ELF)
+#define PC_LINE(pc) ((pc) + 1)
+
+// Column of the native code of an eBPF instruction (column 0 is reserved for code of no instruction)
+#define PC_COLUMN(pc) ((pc) + 1)
+#define COLUMN_PC(column) ((column) - 1)
+
+namespace ebpf_llvm_jit::jit {
+
+    /**
+     * @brief attaches a line tables only compile unit to the module, with bpf_main as subprogram
+     *
+     * Every pc gets a location in column PC_COLUMN(pc), so the DWARF line table of the object maps
+     * each native address back to its pc. The line is the one of the C source from the BTF line info
+     * (the record of the closest pc up to this one), or PC_LINE(pc) of <name>.ebpf without it.
+     *
+     * @return the location of every pc of the program
+     */
+    std::vector<llvm::DILocation *> emitDebugLocations(llvm::Module &module, llvm::Function &bpfMain,
+                                                       const std::string &name, size_t insnCount,
+                                                       const std::vector<source_line> &lines);
+}
+
+#endif //EBPF_LLVM_JIT_DEBUG_INFO_H
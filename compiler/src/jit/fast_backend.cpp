@@ -0,0 +1,1037 @@
+//
+// Created by Davide Collovigh on 19/10/26.
+//
+
+#include "fast_backend.h"
+
+#include <llvm/BinaryFormat/ELF.h>
+
+#include "../elf/elf_writer.h"
+#include "batch.h"
+#include "code_gen.h"
+#include "tail_call.h"
+#include "xdp_md.h"
+#include "spdlog/spdlog.h"
+
+using namespace llvm::ELF;
+
+namespace ebpf_llvm_jit::jit {
+
+    // RISC-V registers
+    enum : uint8_t {
+        RV_ZERO = 0, RV_RA = 1, RV_SP = 2, RV_TP = 4,
+        RV_T0 = 5, RV_T1 = 6, RV_T2 = 7, RV_S0 = 8, RV_S1 = 9,
+        RV_A0 = 10, RV_A1 = 11, RV_A2 = 12, RV_A3 = 13, RV_A4 = 14, RV_A5 = 15,
+        RV_S2 = 18, RV_S3 = 19, RV_S4 = 20, RV_S5 = 21, RV_S6 = 22, RV_T3 = 28,
+    };
+
+    // eBPF register -> RISC-V register, as the RV64 JIT of Linux
+    static const uint8_t REG_MAP[11] = {
+            RV_A5, RV_A0, RV_A1, RV_A2, RV_A3, RV_A4, RV_S1, RV_S2, RV_S3, RV_S4, RV_S5
+    };
+
+    // ebpf_pkt_mem_base, loaded once by the prologue of bpf_main
+    static const uint8_t RV_PKT_BASE = RV_S6;
+
+    // ra, s0 (frame pointer) and s1-s6 saved by bpf_main
+    static const int32_t SAVE_AREA = 64;
+
+    // r6-r9 saved around a local call
+    static const int32_t CALL_SAVE_AREA = 32;
+
+    static const char *PRANDOM_STATE_SYM = "__bpf_prandom_state";
+
+    // Opcodes
+    static const uint32_t OP_LOAD = 0x03, OP_IMM = 0x13, OP_AUIPC = 0x17, OP_IMM_32 = 0x1b, OP_STORE = 0x23,
+            OP_AMO = 0x2f, OP_REG = 0x33, OP_LUI = 0x37, OP_REG_32 = 0x3b, OP_BRANCH = 0x63, OP_JALR = 0x67,
+            OP_JAL = 0x6f, OP_SYSTEM = 0x73;
+
+    // funct3 of OP/OP-IMM, of the branches and of the M extension (funct7 = 1)
+    static const uint32_t F_ADD = 0, F_SLL = 1, F_XOR = 4, F_SRL = 5, F_OR = 6, F_AND = 7;
+    static const uint32_t F_BEQ = 0, F_BNE = 1, F_BLT = 4, F_BGE = 5, F_BLTU = 6, F_BGEU = 7;
+    static const uint32_t F_MUL = 0, F_DIVU = 5, F_REMU = 7;
+    static const uint32_t F7_SUB_SRA = 0x20, F7_MULDIV = 0x01;
+
+    // funct5 of the A extension
+    static const uint32_t AMO_ADD = 0x00, AMO_SWAP = 0x01, AMO_LR = 0x02, AMO_SC = 0x03, AMO_XOR = 0x04,
+            AMO_OR = 0x08, AMO_AND = 0x0c;
+
+    static const uint32_t CSR_TIME = 0xc01, CSR_MHARTID = 0xf14;
+
+    static uint32_t rType(uint32_t opcode, uint32_t funct3, uint32_t funct7, uint8_t rd, uint8_t rs1, uint8_t rs2)
+    {
+        return funct7 << 25 | (uint32_t)rs2 << 20 | (uint32_t)rs1 << 15 | funct3 << 12 | (uint32_t)rd << 7 | opcode;
+    }
+
+    static uint32_t iType(uint32_t opcode, uint32_t funct3, uint8_t rd, uint8_t rs1, int32_t imm)
+    {
+        return ((uint32_t)imm & 0xfff) << 20 | (uint32_t)rs1 << 15 | funct3 << 12 | (uint32_t)rd << 7 | opcode;
+    }
+
+    static uint32_t sType(uint32_t funct3, uint8_t rs1, uint8_t rs2, int32_t imm)
+    {
+        auto u = (uint32_t)imm;
+        return (u >> 5 & 0x7f) << 25 | (uint32_t)rs2 << 20 | (uint32_t)rs1 << 15 | funct3 << 12 | (u & 0x1f) << 7 | OP_STORE;
+    }
+
+    static uint32_t bType(uint32_t funct3, uint8_t rs1, uint8_t rs2, int32_t imm)
+    {
+        auto u = (uint32_t)imm;
+        return (u >> 12 & 1) << 31 | (u >> 5 & 0x3f) << 25 | (uint32_t)rs2 << 20 | (uint32_t)rs1 << 15 |
+               funct3 << 12 | (u >> 1 & 0xf) << 8 | (u >> 11 & 1) << 7 | OP_BRANCH;
+    }
+
+    static uint32_t jType(uint8_t rd, int32_t imm)
+    {
+        auto u = (uint32_t)imm;
+        return (u >> 20 & 1) << 31 | (u >> 1 & 0x3ff) << 21 | (u >> 11 & 1) << 20 | (u >> 12 & 0xff) << 12 |
+               (uint32_t)rd << 7 | OP_JAL;
+    }
+
+    static uint32_t amoType(uint32_t funct5, bool is64, uint8_t rd, uint8_t rs1, uint8_t rs2)
+    {
+        return rType(OP_AMO, is64 ? 3 : 2, funct5 << 2, rd, rs1, rs2);
+    }
+
+    static bool fitsImm12(int64_t imm)
+    {
+        return imm >= -2048 && imm < 2048;
+    }
+
+    static bool fitsBranch(int64_t offset)
+    {
+        return offset >= -4096 && offset < 4096;
+    }
+
+    static bool fitsJal(int64_t offset)
+    {
+        return offset >= -(1 << 20) && offset < (1 << 20);
+    }
+
+    typedef struct fast_relocation {
+        uint64_t offset;
+        uint32_t type;
+        std::string symbol;     // section of the object, .Lpcrel_hi label or external symbol
+        int64_t addend;
+    } fast_relocation;
+
+    class FastEmitter {
+        const fast_program &prog;
+        const std::vector<passthrough_section> &sections;
+        size_t n;
+
+        // Program analysis
+        std::vector<bool> subprogStart;
+        std::vector<uint32_t> subprogOf;
+        std::vector<bool> ctxLoad;
+        uint32_t callDepth = 1;
+        bool usesCtx = false;
+
+        // Output of the current pass
+        std::vector<uint32_t> code;
+        std::vector<fast_relocation> relocs;
+        std::vector<std::pair<std::string, uint64_t>> pcrelLabels;
+        bool usesPrandom = false;
+
+        // Byte offsets of the labels: instruction pc, entry of the local function at pc (n + pc), epilogue (2n)
+        std::vector<int64_t> labels, prevLabels;
+        bool havePrev = false;
+        uint32_t curPc = 0;
+
+        std::string error;
+
+        uint64_t pos() const
+        {
+            return code.size() * 4;
+        }
+
+        void emit(uint32_t inst)
+        {
+            code.push_back(inst);
+        }
+
+        uint32_t epilogueLabel() const
+        {
+            return 2 * n;
+        }
+
+        // Current position in the layout of the previous pass, where the labels are known
+        int64_t prevPos() const
+        {
+            return prevLabels[curPc] + ((int64_t)pos() - labels[curPc]);
+        }
+
+        bool fail(const std::string &msg)
+        {
+            error = msg;
+            return false;
+        }
+
+        void emitLi(uint8_t rd, int64_t val)
+        {
+            if (val >= INT32_MIN && val <= INT32_MAX) {
+                int64_t hi = (val + 0x800) >> 12;
+                int32_t lo = (int32_t)(val - (hi << 12));
+                if (hi) {
+                    emit(((uint32_t)hi & 0xfffff) << 12 | (uint32_t)rd << 7 | OP_LUI);
+                    if (lo) {
+                        emit(iType(OP_IMM_32, F_ADD, rd, rd, lo));
+                    }
+                } else {
+                    emit(iType(OP_IMM, F_ADD, rd, RV_ZERO, lo));
+                }
+                return;
+            }
+
+            // Upper bits first, then shift and add the low 12 bits (as the RISC-V backend of LLVM)
+            auto lo = (int32_t)(((int64_t)((uint64_t)val << 52)) >> 52);
+            auto hi = (int64_t)(((uint64_t)val + 0x800) >> 12);
+            int shift = 12 + __builtin_ctzll((uint64_t)hi);
+            hi = ((int64_t)((uint64_t)hi >> (shift - 12) << shift)) >> shift;
+
+            emitLi(rd, hi);
+            emit(iType(OP_IMM, F_SLL, rd, rd, shift));
+            if (lo) {
+                emit(iType(OP_IMM, F_ADD, rd, rd, lo));
+            }
+        }
+
+        void emitMv(uint8_t rd, uint8_t rs)
+        {
+            if (rd != rs) {
+                emit(iType(OP_IMM, F_ADD, rd, rs, 0));
+            }
+        }
+
+        void emitAddImm(uint8_t rd, uint8_t rs, int64_t imm, uint8_t tmp)
+        {
+            if (fitsImm12(imm)) {
+                emit(iType(OP_IMM, F_ADD, rd, rs, (int32_t)imm));
+            } else {
+                emitLi(tmp, imm);
+                emit(rType(OP_REG, F_ADD, 0, rd, rs, tmp));
+            }
+        }
+
+        void emitZext32(uint8_t rd, uint8_t rs)
+        {
+            emit(iType(OP_IMM, F_SLL, rd, rs, 32));
+            emit(iType(OP_IMM, F_SRL, rd, rd, 32));
+        }
+
+        void emitLoad(uint32_t funct3, uint8_t rd, uint8_t base, int32_t off)
+        {
+            emit(iType(OP_LOAD, funct3, rd, base, off));
+        }
+
+        void emitStore(uint32_t funct3, uint8_t base, uint8_t rs, int32_t off)
+        {
+            emit(sType(funct3, base, rs, off));
+        }
+
+        // base + off as a base register and a 12 bit offset
+        std::pair<uint8_t, int32_t> emitAddress(uint8_t base, int16_t off)
+        {
+            if (fitsImm12(off)) {
+                return { base, off };
+            }
+            emitAddImm(RV_T1, base, off, RV_T1);
+            return { RV_T1, 0 };
+        }
+
+        void emitJal(uint8_t rd, uint32_t label)
+        {
+            int64_t offset = 0;
+            if (havePrev) {
+                offset = prevLabels[label] - prevPos();
+                if (!fitsJal(offset)) {
+                    error = "Program too large for the fast backend";
+                }
+            }
+            emit(jType(rd, (int32_t)offset));
+        }
+
+        // Short branch when the target was in range in the previous pass, otherwise a branch over a jal
+        void emitBranch(uint32_t funct3, uint8_t rs1, uint8_t rs2, uint32_t label)
+        {
+            if (havePrev) {
+                int64_t offset = prevLabels[label] - prevPos();
+                if (fitsBranch(offset)) {
+                    emit(bType(funct3, rs1, rs2, (int32_t)offset));
+                    return;
+                }
+            }
+            emit(bType(funct3 ^ 1, rs1, rs2, 8));
+            emitJal(RV_ZERO, label);
+        }
+
+        // auipc + addi (or ld) of symbol + addend, through a .Lpcrel_hi label
+        void emitSymbolRef(uint8_t rd, const std::string &symbol, int64_t addend, bool load)
+        {
+            std::string label = ".Lpcrel_hi" + std::to_string(pcrelLabels.size());
+            pcrelLabels.emplace_back(label, pos());
+
+            relocs.push_back({ pos(), R_RISCV_PCREL_HI20, symbol, addend });
+            emit((uint32_t)rd << 7 | OP_AUIPC);
+
+            relocs.push_back({ pos(), R_RISCV_PCREL_LO12_I, label, 0 });
+            if (load) {
+                emitLoad(3, rd, rd, 0);
+            } else {
+                emit(iType(OP_IMM, F_ADD, rd, rd, 0));
+            }
+        }
+
+        void emitCall(const std::string &symbol)
+        {
+            relocs.push_back({ pos(), R_RISCV_CALL_PLT, symbol, 0 });
+            emit((uint32_t)RV_RA << 7 | OP_AUIPC);
+            emit(iType(OP_JALR, 0, RV_RA, RV_RA, 0));
+        }
+
+        void emitHartId(uint8_t rd)
+        {
+            if (prog.intrinsics.hartid_from_tp) {
+                emitMv(rd, RV_TP);
+            } else {
+                emit(iType(OP_SYSTEM, 2, rd, RV_ZERO, CSR_MHARTID));
+            }
+        }
+
+        const passthrough_section *sectionBySource(const std::string &source) const
+        {
+            for (const auto &section : sections) {
+                if (section.source == source && section.size > 0) {
+                    return &section;
+                }
+            }
+            return nullptr;
+        }
+
+        void analyze()
+        {
+            subprogStart.assign(n, false);
+            subprogStart[0] = true;
+            for (size_t pc = 0; pc < n; pc++) {
+                const auto &inst = prog.insts[pc];
+                if ((inst.code == EBPF_OP_CALL || inst.code == (EBPF_OP_CALL | 0x8)) && inst.src_reg == 0x1) {
+                    int64_t target = (int64_t)pc + 1 + inst.imm;
+                    if (target > 0 && target < (int64_t)n && !subprogStart[target]) {
+                        subprogStart[target] = true;
+                        callDepth++;
+                    }
+                }
+            }
+            callDepth = std::min<uint32_t>(callDepth, FAST_MAX_CALL_DEPTH);
+
+            subprogOf.assign(n, 0);
+            for (size_t pc = 1; pc < n; pc++) {
+                subprogOf[pc] = subprogStart[pc] ? pc : subprogOf[pc - 1];
+            }
+
+            // Same tracking of the registers holding ctx as the LLVM backend: ctx->data and
+            // ctx->data_end are offsets from ebpf_pkt_mem_base
+            ctxLoad.assign(n, false);
+            bool containsCtx[11] = { false, true };
+            for (size_t pc = 0; pc < n; pc++) {
+                const auto &inst = prog.insts[pc];
+                if (inst.dst_reg > 10 || inst.src_reg > 10) {
+                    continue;
+                }
+                if (inst.code == EBPF_OP_LDXW && containsCtx[inst.src_reg]) {
+                    ctxLoad[pc] = usesCtx = true;
+                }
+
+                containsCtx[inst.dst_reg] = false;
+                if ((inst.code == EBPF_OP_MOV_REG || inst.code == EBPF_OP_MOV64_REG) && containsCtx[inst.src_reg]) {
+                    containsCtx[inst.dst_reg] = true;
+                }
+            }
+        }
+
+        void emitPrologue()
+        {
+            static const uint8_t saved[] = { RV_RA, RV_S0, RV_S1, RV_S2, RV_S3, RV_S4, RV_S5, RV_S6 };
+
+            emit(iType(OP_IMM, F_ADD, RV_SP, RV_SP, -SAVE_AREA));
+            for (int i = 0; i < 8; i++) {
+                emitStore(3, RV_SP, saved[i], SAVE_AREA - 8 * (i + 1));
+            }
+            emit(iType(OP_IMM, F_ADD, RV_S0, RV_SP, SAVE_AREA));
+
+            // eBPF stack: one frame per call level, r10 points to the end of the first one
+            emitAddImm(RV_SP, RV_SP, -(int64_t)EBPF_STACK_SIZE * callDepth, RV_T0);
+            emit(iType(OP_IMM, F_ADD, REG_MAP[10], RV_S0, -SAVE_AREA));
+
+            if (usesCtx) {
+                emitSymbolRef(RV_PKT_BASE, PKT_MEM_BASE_SYM, 0, true);
+            }
+        }
+
+        void emitEpilogue()
+        {
+            static const uint8_t saved[] = { RV_RA, RV_S0, RV_S1, RV_S2, RV_S3, RV_S4, RV_S5, RV_S6 };
+
+            emitMv(RV_A0, REG_MAP[0]);
+            emit(iType(OP_IMM, F_ADD, RV_SP, RV_S0, -SAVE_AREA));
+            for (int i = 0; i < 8; i++) {
+                emitLoad(3, saved[i], RV_SP, SAVE_AREA - 8 * (i + 1));
+            }
+            emit(iType(OP_IMM, F_ADD, RV_SP, RV_SP, SAVE_AREA));
+            emit(iType(OP_JALR, 0, RV_ZERO, RV_RA, 0));
+        }
+
+        bool emitAlu(const ebpf_inst &inst)
+        {
+            bool is64 = (inst.code & EBPF_CLS_MASK) == EBPF_CLS_ALU64;
+            bool useImm = (inst.code & EBPF_SRC_REG) == EBPF_SRC_IMM;
+            uint32_t op = inst.code & EBPF_ALU_OP_MASK;
+            uint8_t dst = REG_MAP[inst.dst_reg];
+            uint32_t opReg = is64 ? OP_REG : OP_REG_32;
+            uint32_t opImm = is64 ? OP_IMM : OP_IMM_32;
+            int64_t imm = inst.imm;
+
+            // Register holding the source operand
+            auto src = [&]() -> uint8_t {
+                if (!useImm) {
+                    return REG_MAP[inst.src_reg];
+                }
+                emitLi(RV_T0, imm);
+                return RV_T0;
+            };
+
+            switch (op) {
+                case 0x00: // ADD
+                    if (useImm && fitsImm12(imm)) {
+                        emit(iType(opImm, F_ADD, dst, dst, (int32_t)imm));
+                    } else {
+                        emit(rType(opReg, F_ADD, 0, dst, dst, src()));
+                    }
+                    break;
+                case 0x10: // SUB
+                    if (useImm && fitsImm12(-imm)) {
+                        emit(iType(opImm, F_ADD, dst, dst, (int32_t)-imm));
+                    } else {
+                        emit(rType(opReg, F_ADD, F7_SUB_SRA, dst, dst, src()));
+                    }
+                    break;
+                case 0x20: // MUL
+                    emit(rType(opReg, F_MUL, F7_MULDIV, dst, dst, src()));
+                    break;
+                case 0x30: { // DIV, by zero gives 0 (divu gives all ones)
+                    uint8_t divisor = src();
+                    if (is64) {
+                        emitMv(RV_T1, divisor);
+                    } else {
+                        emitZext32(RV_T1, divisor);
+                    }
+                    emit(bType(F_BEQ, RV_T1, RV_ZERO, 12));
+                    emit(rType(opReg, F_DIVU, F7_MULDIV, dst, dst, RV_T1));
+                    emit(jType(RV_ZERO, 8));
+                    emit(iType(OP_IMM, F_ADD, dst, RV_ZERO, 0));
+                    break;
+                }
+                case 0x90: // MOD, by zero keeps dst (as remu)
+                    emit(rType(opReg, F_REMU, F7_MULDIV, dst, dst, src()));
+                    break;
+                case 0x40: // OR
+                case 0x50: // AND
+                case 0xa0: { // XOR
+                    uint32_t funct3 = op == 0x40 ? F_OR : op == 0x50 ? F_AND : F_XOR;
+                    if (useImm && fitsImm12(imm)) {
+                        emit(iType(OP_IMM, funct3, dst, dst, (int32_t)imm));
+                    } else {
+                        emit(rType(OP_REG, funct3, 0, dst, dst, src()));
+                    }
+                    break;
+                }
+                case 0x60: // LSH
+                case 0x70: // RSH
+                case 0xc0: { // ARSH
+                    uint32_t funct3 = op == 0x60 ? F_SLL : F_SRL;
+                    uint32_t funct7 = op == 0xc0 ? F7_SUB_SRA : 0;
+                    if (useImm) {
+                        int32_t shamt = (int32_t)(imm & (is64 ? 63 : 31));
+                        emit(iType(opImm, funct3, dst, dst, (int32_t)(funct7 << 5) | shamt));
+                    } else {
+                        emit(rType(opReg, funct3, funct7, dst, dst, src()));
+                    }
+                    break;
+                }
+                case 0x80: // NEG
+                    emit(rType(opReg, F_ADD, F7_SUB_SRA, dst, RV_ZERO, dst));
+                    break;
+                case 0xb0: // MOV
+                    if (useImm) {
+                        emitLi(dst, is64 ? imm : (int64_t)(uint32_t)inst.imm);
+                    } else if (is64) {
+                        emitMv(dst, REG_MAP[inst.src_reg]);
+                    } else {
+                        emitZext32(dst, REG_MAP[inst.src_reg]);
+                    }
+                    return true;
+                case 0xd0: { // LE is a nop, BE swaps the low imm bits
+                    if (is64) {
+                        return fail("Unsupported or illegal opcode: " + std::to_string(inst.code));
+                    }
+                    if (!useImm) {
+                        if (inst.imm != 16 && inst.imm != 32 && inst.imm != 64) {
+                            return fail("Unexpected endian size: " + std::to_string(inst.imm));
+                        }
+                        emit(iType(OP_IMM, F_ADD, RV_T1, RV_ZERO, 0));
+                        for (int i = 0; i < inst.imm; i += 8) {
+                            emit(iType(OP_IMM, F_SRL, RV_T0, dst, i));
+                            emit(iType(OP_IMM, F_AND, RV_T0, RV_T0, 0xff));
+                            emit(iType(OP_IMM, F_SLL, RV_T1, RV_T1, 8));
+                            emit(rType(OP_REG, F_OR, 0, RV_T1, RV_T1, RV_T0));
+                        }
+                        emitMv(dst, RV_T1);
+                    }
+                    return true;
+                }
+                default:
+                    return fail("Unsupported or illegal opcode: " + std::to_string(inst.code));
+            }
+
+            // 32 bit operations clear the upper half
+            if (!is64) {
+                emitZext32(dst, dst);
+            }
+            return true;
+        }
+
+        bool emitCondJump(uint32_t pc, const ebpf_inst &inst)
+        {
+            bool is32 = (inst.code & EBPF_CLS_MASK) == EBPF_CLS_JMP32;
+            bool useImm = (inst.code & EBPF_SRC_REG) == EBPF_SRC_IMM;
+            uint32_t op = inst.code & EBPF_JMP_OP_MASK;
+            bool isSigned = op == 0x60 || op == 0x70 || op == 0xc0 || op == 0xd0;
+            int64_t target = (int64_t)pc + 1 + inst.off;
+
+            if (target < 0 || target >= (int64_t)n) {
+                return fail("Instruction at pc=" + std::to_string(pc) +
+                            " is going to jump to an illegal position " + std::to_string(target));
+            }
+
+            uint8_t a = REG_MAP[inst.dst_reg], b;
+            if (!is32) {
+                if (!useImm) {
+                    b = REG_MAP[inst.src_reg];
+                } else if (inst.imm == 0) {
+                    b = RV_ZERO;
+                } else {
+                    emitLi(RV_T1, inst.imm);
+                    b = RV_T1;
+                }
+            } else if (isSigned) {
+                emit(iType(OP_IMM_32, F_ADD, RV_T2, a, 0));
+                a = RV_T2;
+                if (useImm) {
+                    emitLi(RV_T1, inst.imm);
+                } else {
+                    emit(iType(OP_IMM_32, F_ADD, RV_T1, REG_MAP[inst.src_reg], 0));
+                }
+                b = RV_T1;
+            } else {
+                emitZext32(RV_T2, a);
+                a = RV_T2;
+                if (useImm) {
+                    emitLi(RV_T1, (int64_t)(uint32_t)inst.imm);
+                } else {
+                    emitZext32(RV_T1, REG_MAP[inst.src_reg]);
+                }
+                b = RV_T1;
+            }
+
+            auto label = (uint32_t)target;
+            switch (op) {
+                case 0x10: emitBranch(F_BEQ, a, b, label); break;     // JEQ
+                case 0x50: emitBranch(F_BNE, a, b, label); break;     // JNE
+                case 0x20: emitBranch(F_BLTU, b, a, label); break;    // JGT
+                case 0x30: emitBranch(F_BGEU, a, b, label); break;    // JGE
+                case 0xa0: emitBranch(F_BLTU, a, b, label); break;    // JLT
+                case 0xb0: emitBranch(F_BGEU, b, a, label); break;    // JLE
+                case 0x60: emitBranch(F_BLT, b, a, label); break;     // JSGT
+                case 0x70: emitBranch(F_BGE, a, b, label); break;     // JSGE
+                case 0xc0: emitBranch(F_BLT, a, b, label); break;     // JSLT
+                case 0xd0: emitBranch(F_BGE, b, a, label); break;     // JSLE
+                case 0x40:                                            // JSET
+                    emit(rType(OP_REG, F_AND, 0, RV_T0, a, b));
+                    emitBranch(F_BNE, RV_T0, RV_ZERO, label);
+                    break;
+                default:
+                    return fail("Unsupported or illegal opcode: " + std::to_string(inst.code));
+            }
+            return true;
+        }
+
+        bool emitIntrinsic(int32_t helper)
+        {
+            const uint64_t NSEC_PER_SEC = 1000000000;
+            uint8_t r0 = REG_MAP[0];
+
+            switch (helper) {
+                case BPF_FUNC_GET_SMP_PROCESSOR_ID:
+                    emitHartId(r0);
+                    return true;
+                case BPF_FUNC_GET_NUMA_NODE_ID:
+                    emitLi(r0, 0);
+                    return true;
+                case BPF_FUNC_KTIME_GET_NS: {
+                    uint64_t hz = prog.intrinsics.timebase_hz;
+                    emit(iType(OP_SYSTEM, 2, r0, RV_ZERO, CSR_TIME));
+                    if (NSEC_PER_SEC % hz == 0) {
+                        emitLi(RV_T0, NSEC_PER_SEC / hz);
+                        emit(rType(OP_REG, F_MUL, F7_MULDIV, r0, r0, RV_T0));
+                    } else {
+                        // ticks / hz * 1e9 + (ticks % hz) * 1e9 / hz
+                        emitLi(RV_T0, hz);
+                        emitLi(RV_T3, NSEC_PER_SEC);
+                        emit(rType(OP_REG, F_DIVU, F7_MULDIV, RV_T1, r0, RV_T0));
+                        emit(rType(OP_REG, F_REMU, F7_MULDIV, RV_T2, r0, RV_T0));
+                        emit(rType(OP_REG, F_MUL, F7_MULDIV, RV_T1, RV_T1, RV_T3));
+                        emit(rType(OP_REG, F_MUL, F7_MULDIV, RV_T2, RV_T2, RV_T3));
+                        emit(rType(OP_REG, F_DIVU, F7_MULDIV, RV_T2, RV_T2, RV_T0));
+                        emit(rType(OP_REG, F_ADD, 0, r0, RV_T1, RV_T2));
+                    }
+                    return true;
+                }
+                case BPF_FUNC_GET_PRANDOM_U32: {
+                    // xorshift64 on the state of the hart
+                    usesPrandom = true;
+                    emitHartId(RV_T0);
+                    emit(iType(OP_IMM, F_AND, RV_T0, RV_T0, INTRINSICS_MAX_HARTS - 1));
+                    emit(iType(OP_IMM, F_SLL, RV_T0, RV_T0, 3));
+                    emitSymbolRef(RV_T1, PRANDOM_STATE_SYM, 0, false);
+                    emit(rType(OP_REG, F_ADD, 0, RV_T1, RV_T1, RV_T0));
+                    emitLoad(3, RV_T2, RV_T1, 0);
+                    emit(iType(OP_IMM, F_SLL, RV_T0, RV_T2, 13));
+                    emit(rType(OP_REG, F_XOR, 0, RV_T2, RV_T2, RV_T0));
+                    emit(iType(OP_IMM, F_SRL, RV_T0, RV_T2, 7));
+                    emit(rType(OP_REG, F_XOR, 0, RV_T2, RV_T2, RV_T0));
+                    emit(iType(OP_IMM, F_SLL, RV_T0, RV_T2, 17));
+                    emit(rType(OP_REG, F_XOR, 0, RV_T2, RV_T2, RV_T0));
+                    emitStore(3, RV_T1, RV_T2, 0);
+                    emitZext32(r0, RV_T2);
+                    return true;
+                }
+                default:
+                    return false;
+            }
+        }
+
+        bool emitCallInst(uint32_t pc, const ebpf_inst &inst)
+        {
+            // Local function: r6-r9 are saved on the native stack, r10 moves to the next frame
+            if (inst.src_reg == 0x1) {
+                int64_t target = (int64_t)pc + 1 + inst.imm;
+                if (target <= 0 || target >= (int64_t)n) {
+                    return fail("Instruction at pc=" + std::to_string(pc) +
+                                " is going to jump to an illegal position " + std::to_string(target));
+                }
+
+                emit(iType(OP_IMM, F_ADD, RV_SP, RV_SP, -CALL_SAVE_AREA));
+                for (int i = 6; i <= 9; i++) {
+                    emitStore(3, RV_SP, REG_MAP[i], 8 * (i - 6));
+                }
+                emit(iType(OP_IMM, F_ADD, REG_MAP[10], REG_MAP[10], -EBPF_STACK_SIZE));
+                emitJal(RV_RA, n + target);
+                emit(iType(OP_IMM, F_ADD, REG_MAP[10], REG_MAP[10], EBPF_STACK_SIZE));
+                for (int i = 6; i <= 9; i++) {
+                    emitLoad(3, REG_MAP[i], RV_SP, 8 * (i - 6));
+                }
+                emit(iType(OP_IMM, F_ADD, RV_SP, RV_SP, CALL_SAVE_AREA));
+                return true;
+            }
+
+            if (prog.intrinsics.enabled && emitIntrinsic(inst.imm)) {
+                return true;
+            }
+
+            // r1-r5 already are a0-a4
+            auto name = ext_func_sym(inst.imm);
+            if (!prog.helpers.count(inst.imm)) {
+                return fail("Ext func not found: " + name);
+            }
+            emitCall(name);
+            emitMv(REG_MAP[0], RV_A0);
+
+            // bpf_tail_call() without prog arrays: exit after the helper, as the LLVM backend
+            if (inst.imm == BPF_FUNC_TAIL_CALL) {
+                emitJal(RV_ZERO, epilogueLabel());
+            }
+            return true;
+        }
+
+        bool emitAtomic(const ebpf_inst &inst)
+        {
+            bool is64 = inst.code == EBPF_ATOMIC_OPCODE_64;
+            uint8_t src = REG_MAP[inst.src_reg];
+            uint8_t addr = REG_MAP[inst.dst_reg];
+            if (inst.off != 0) {
+                emitAddImm(RV_T0, addr, inst.off, RV_T0);
+                addr = RV_T0;
+            }
+
+            if (inst.imm == EBPF_CMPXCHG) {
+                // r0 = *addr; if (r0 == old r0) *addr = src, with lr/sc
+                uint8_t r0 = REG_MAP[0];
+                if (is64) {
+                    emitMv(RV_T1, r0);
+                } else {
+                    emit(iType(OP_IMM_32, F_ADD, RV_T1, r0, 0));
+                }
+                emit(amoType(AMO_LR, is64, RV_T2, addr, RV_ZERO));
+                emit(bType(F_BNE, RV_T2, RV_T1, 12));
+                emit(amoType(AMO_SC, is64, RV_T3, addr, src));
+                emit(bType(F_BNE, RV_T3, RV_ZERO, -12));
+                if (is64) {
+                    emitMv(r0, RV_T2);
+                } else {
+                    emitZext32(r0, RV_T2);
+                }
+                return true;
+            }
+
+            uint32_t funct5;
+            bool fetch = (inst.imm & EBPF_FETCH) == EBPF_FETCH;
+            switch (inst.imm & ~EBPF_FETCH) {
+                case EBPF_ATOMIC_ADD: funct5 = AMO_ADD; break;
+                case EBPF_ATOMIC_OR: funct5 = AMO_OR; break;
+                case EBPF_ATOMIC_AND: funct5 = AMO_AND; break;
+                case EBPF_ATOMIC_XOR: funct5 = AMO_XOR; break;
+                // the old value is dropped, as in the LLVM backend
+                case EBPF_XCHG & ~EBPF_FETCH: funct5 = AMO_SWAP; fetch = false; break;
+                default:
+                    return fail("Unsupported atomic operation: " + std::to_string(inst.imm));
+            }
+
+            emit(amoType(funct5, is64, fetch ? src : static_cast<uint8_t>(RV_ZERO), addr, src));
+            if (fetch && !is64) {
+                emitZext32(src, src);
+            }
+            return true;
+        }
+
+        bool emitLddw(uint32_t pc, const ebpf_inst &inst)
+        {
+            if (pc + 1 >= n) {
+                return fail("Loaded LDDW at pc=" + std::to_string(pc) +
+                            " which requires an extra pseudo instruction, but it's the last instruction");
+            }
+            const auto &next = prog.insts[pc + 1];
+            if (next.code || next.dst_reg || next.src_reg || next.off) {
+                return fail("Loaded LDDW at pc=" + std::to_string(pc) +
+                            " which requires an extra pseudo instruction, but the next instruction is not a legal one");
+            }
+
+            uint8_t dst = REG_MAP[inst.dst_reg];
+            auto relo = prog.relocations.find(pc);
+
+            if (inst.src_reg == 0 && relo != prog.relocations.end()) {
+                if (relo->second.section == ".maps" || relo->second.section == "maps") {
+                    return fail("map " + relo->second.symbol + " is not supported by the fast backend");
+                }
+                auto section = sectionBySource(relo->second.section);
+                if (!section) {
+                    return fail("LDDW at pc=" + std::to_string(pc) + " references section " +
+                                relo->second.section + " which was not injected");
+                }
+                emitSymbolRef(dst, section->name, (uint32_t)inst.imm + relo->second.sym_offset, false);
+            } else if (inst.src_reg == 0) {
+                emitLi(dst, (int64_t)((uint64_t)(uint32_t)inst.imm | ((uint64_t)(uint32_t)next.imm << 32)));
+            } else if (auto sec = prog.map_sections.find(inst.imm);
+                    (inst.src_reg == 2 || inst.src_reg == 6) && sec != prog.map_sections.end() &&
+                    sectionBySource(sec->second)) {
+                // Value of an internal map: offset in the injected section
+                emitSymbolRef(dst, sectionBySource(sec->second)->name, (uint32_t)next.imm, false);
+            } else {
+                return fail("LDDW with src_reg " + std::to_string(inst.src_reg) + " is not supported by the fast backend");
+            }
+            return true;
+        }
+
+        bool emitInst(uint32_t &pc)
+        {
+            const auto &inst = prog.insts[pc];
+
+            if (inst.dst_reg > 10 || inst.src_reg > 10) {
+                return fail("Illegal src reg/dst reg at pc " + std::to_string(pc));
+            }
+
+            uint8_t dst = REG_MAP[inst.dst_reg];
+            uint8_t src = REG_MAP[inst.src_reg];
+
+            switch (inst.code & EBPF_CLS_MASK) {
+                case EBPF_CLS_ALU:
+                case EBPF_CLS_ALU64:
+                    return emitAlu(inst);
+
+                case EBPF_CLS_LDX: {
+                    static const std::map<uint8_t, uint32_t> loads = {
+                            {EBPF_OP_LDXB, 4}, {EBPF_OP_LDXH, 5}, {EBPF_OP_LDXW, 6}, {EBPF_OP_LDXDW, 3},
+                    };
+                    auto funct3 = loads.find(inst.code);
+                    if (funct3 == loads.end()) {
+                        break;
+                    }
+                    auto [base, off] = emitAddress(src, inst.off);
+                    emitLoad(funct3->second, dst, base, off);
+                    // ctx->data/data_end: packet offsets from ebpf_pkt_mem_base
+                    if (ctxLoad[pc]) {
+                        emit(rType(OP_REG, F_ADD, 0, dst, dst, RV_PKT_BASE));
+                    }
+                    return true;
+                }
+
+                case EBPF_CLS_ST:
+                case EBPF_CLS_STX: {
+                    if (inst.code == EBPF_ATOMIC_OPCODE_32 || inst.code == EBPF_ATOMIC_OPCODE_64) {
+                        return emitAtomic(inst);
+                    }
+                    if ((inst.code & EBPF_LD_MODE_MASK) != EBPF_MODE_MEM) {
+                        break;
+                    }
+                    static const std::map<uint8_t, uint32_t> sizes = {
+                            {EBPF_SIZE_B, 0}, {EBPF_SIZE_H, 1}, {EBPF_SIZE_W, 2}, {EBPF_SIZE_DW, 3},
+                    };
+                    uint8_t value = src;
+                    if ((inst.code & EBPF_CLS_MASK) == EBPF_CLS_ST) {
+                        emitLi(RV_T0, inst.imm);
+                        value = RV_T0;
+                    }
+                    auto [base, off] = emitAddress(dst, inst.off);
+                    emitStore(sizes.at(inst.code & 0x18), base, value, off);
+                    return true;
+                }
+
+                case EBPF_CLS_LD:
+                    if (inst.code != EBPF_OP_LDDW) {
+                        break;
+                    }
+                    if (!emitLddw(pc, inst)) {
+                        return false;
+                    }
+                    // the second half of the LDDW has no code
+                    pc++;
+                    labels[pc] = pos();
+                    return true;
+
+                case EBPF_CLS_JMP:
+                case EBPF_CLS_JMP32: {
+                    if (inst.code == EBPF_OP_JA) {
+                        int64_t target = (int64_t)pc + 1 + inst.off;
+                        if (target < 0 || target >= (int64_t)n) {
+                            return fail("Instruction at pc=" + std::to_string(pc) +
+                                        " is going to jump to an illegal position " + std::to_string(target));
+                        }
+                        emitJal(RV_ZERO, target);
+                        return true;
+                    }
+                    if (inst.code == EBPF_OP_CALL || inst.code == (EBPF_OP_CALL | 0x8)) {
+                        return emitCallInst(pc, inst);
+                    }
+                    if (inst.code == EBPF_OP_EXIT) {
+                        if (subprogOf[pc] == 0) {
+                            emitJal(RV_ZERO, epilogueLabel());
+                        } else {
+                            emitLoad(3, RV_RA, RV_SP, 8);
+                            emit(iType(OP_IMM, F_ADD, RV_SP, RV_SP, 16));
+                            emit(iType(OP_JALR, 0, RV_ZERO, RV_RA, 0));
+                        }
+                        return true;
+                    }
+                    uint32_t op = inst.code & EBPF_JMP_OP_MASK;
+                    if (op == 0x00 || op == 0x80 || op == 0x90 || op >= 0xe0) {
+                        break;
+                    }
+                    return emitCondJump(pc, inst);
+                }
+            }
+
+            return fail("Unsupported or illegal opcode: " + std::to_string(inst.code));
+        }
+
+        bool emitProgram()
+        {
+            code.clear();
+            relocs.clear();
+            pcrelLabels.clear();
+            usesPrandom = false;
+            labels.assign(2 * n + 1, 0);
+            curPc = 0;
+            labels[0] = 0;
+
+            emitPrologue();
+
+            for (uint32_t pc = 0; pc < n; pc++) {
+                // Local functions save ra, their exit returns to the caller
+                if (pc != 0 && subprogStart[pc]) {
+                    labels[n + pc] = pos();
+                    emit(iType(OP_IMM, F_ADD, RV_SP, RV_SP, -16));
+                    emitStore(3, RV_SP, RV_RA, 8);
+                }
+
+                labels[pc] = pos();
+                curPc = pc;
+                if (!emitInst(pc)) {
+                    return false;
+                }
+                if (!error.empty()) {
+                    return false;
+                }
+            }
+
+            labels[epilogueLabel()] = pos();
+            emitEpilogue();
+            return true;
+        }
+
+        // void bpf_main_batch(struct xdp_md *ctx[], uint64_t n, int verdicts[])
+        void emitBatchEntry()
+        {
+            emit(iType(OP_IMM, F_ADD, RV_SP, RV_SP, -48));
+            emitStore(3, RV_SP, RV_RA, 40);
+            emitStore(3, RV_SP, RV_S1, 32);
+            emitStore(3, RV_SP, RV_S2, 24);
+            emitStore(3, RV_SP, RV_S3, 16);
+            emitStore(3, RV_SP, RV_S4, 8);
+            emitMv(RV_S1, RV_A0);
+            emitMv(RV_S2, RV_A1);
+            emitMv(RV_S3, RV_A2);
+            emitLi(RV_S4, 0);
+
+            size_t skip = code.size();
+            emit(0);
+
+            uint64_t loop = pos();
+            emit(iType(OP_IMM, F_SLL, RV_T0, RV_S4, 3));
+            emit(rType(OP_REG, F_ADD, 0, RV_T0, RV_S1, RV_T0));
+            emitLoad(3, RV_A0, RV_T0, 0);
+            emitLi(RV_A1, XDP_MD_SIZE);
+            emit(jType(RV_RA, -(int32_t)pos()));
+            emit(iType(OP_IMM, F_SLL, RV_T0, RV_S4, 2));
+            emit(rType(OP_REG, F_ADD, 0, RV_T0, RV_S3, RV_T0));
+            emitStore(2, RV_T0, RV_A0, 0);
+            emit(iType(OP_IMM, F_ADD, RV_S4, RV_S4, 1));
+            emit(bType(F_BLTU, RV_S4, RV_S2, (int32_t)(loop - pos())));
+
+            code[skip] = bType(F_BEQ, RV_S2, RV_ZERO, (int32_t)(pos() - skip * 4));
+            emitLoad(3, RV_RA, RV_SP, 40);
+            emitLoad(3, RV_S1, RV_SP, 32);
+            emitLoad(3, RV_S2, RV_SP, 24);
+            emitLoad(3, RV_S3, RV_SP, 16);
+            emitLoad(3, RV_S4, RV_SP, 8);
+            emit(iType(OP_IMM, F_ADD, RV_SP, RV_SP, 48));
+            emit(iType(OP_JALR, 0, RV_ZERO, RV_RA, 0));
+        }
+
+        std::vector<uint8_t> writeObject(uint64_t mainSize)
+        {
+            elf::ElfWriter obj;
+            std::map<std::string, uint32_t> syms;
+
+            std::vector<uint8_t> text(code.size() * 4);
+            memcpy(text.data(), code.data(), text.size());
+            auto textIdx = obj.addSection({ ".text", SHT_PROGBITS, SHF_ALLOC | SHF_EXECINSTR, 4, text, text.size() });
+
+            for (const auto &section : sections) {
+                if (section.size == 0) {
+                    continue;
+                }
+                bool bss = section.name.rfind(".bss", 0) == 0;
+                std::vector<uint8_t> content;
+                if (!bss) {
+                    content.assign(section.str_content.begin(), section.str_content.end());
+                    content.resize(section.size, 0);
+                }
+                auto idx = obj.addSection({ section.name, bss ? (uint32_t)SHT_NOBITS : (uint32_t)SHT_PROGBITS,
+                                            section.read_only ? SHF_ALLOC : SHF_ALLOC | SHF_WRITE,
+                                            section.alignment, content, section.size });
+                syms[section.name] = obj.sectionSymbol(idx);
+            }
+
+            if (usesPrandom) {
+                std::vector<uint8_t> seeds;
+                for (uint64_t i = 0; i < INTRINSICS_MAX_HARTS; i++) {
+                    uint64_t seed = 0x9E3779B97F4A7C15ULL * (i + 1);
+                    seeds.insert(seeds.end(), (uint8_t *)&seed, (uint8_t *)&seed + 8);
+                }
+                auto idx = obj.addSection({ ".data", SHT_PROGBITS, SHF_ALLOC | SHF_WRITE, 8, seeds, seeds.size() });
+                syms[PRANDOM_STATE_SYM] = obj.addSymbol({ PRANDOM_STATE_SYM, idx, 0, seeds.size(), STT_OBJECT, false });
+            }
+
+            for (const auto &[label, offset] : pcrelLabels) {
+                syms[label] = obj.addSymbol({ label, textIdx, offset, 0, STT_NOTYPE, false });
+            }
+
+            obj.addSymbol({ "bpf_main", textIdx, 0, mainSize, STT_FUNC, true });
+            if (!prog.name.empty()) {
+                obj.addSymbol({ PROG_SYM_PREFIX + prog.name, textIdx, 0, mainSize, STT_FUNC, true });
+            }
+            if (prog.batch) {
+                obj.addSymbol({ BATCH_ENTRY_SYM, textIdx, mainSize, text.size() - mainSize, STT_FUNC, true });
+            }
+
+            for (const auto &relo : relocs) {
+                auto sym = syms.find(relo.symbol);
+                if (sym == syms.end()) {
+                    sym = syms.emplace(relo.symbol, obj.addSymbol({ relo.symbol, elf::ElfWriter::UNDEF_SECTION,
+                                                                    0, 0, STT_NOTYPE, true })).first;
+                }
+                obj.addRelocation(textIdx, { relo.offset, sym->second, relo.type, relo.addend });
+            }
+
+            return obj.write();
+        }
+
+    public:
+        FastEmitter(const fast_program &prog, const std::vector<passthrough_section> &sections)
+                : prog(prog), sections(sections), n(prog.insts.size())
+        {
+        }
+
+        std::vector<uint8_t> run(std::string &err)
+        {
+            if (n == 0) {
+                err = "No instructions provided";
+                return {};
+            }
+
+            analyze();
+
+            // Shorten the branches until the layout is stable (sizes only decrease)
+            int passes = 0;
+            for (;; passes++) {
+                if (!emitProgram()) {
+                    err = error;
+                    return {};
+                }
+                if (havePrev && labels == prevLabels) {
+                    break;
+                }
+                if (passes > 32) {
+                    err = "Layout of the program did not converge";
+                    return {};
+                }
+                prevLabels = labels;
+                havePrev = true;
+            }
+
+            uint64_t mainSize = pos();
+            if (prog.batch) {
+                emitBatchEntry();
+            }
+
+            SPDLOG_INFO("Fast backend: {} eBPF instructions -> {} bytes [passes: {}, relocations: {}]",
+                        n, pos(), passes + 1, relocs.size());
+            return writeObject(mainSize);
+        }
+    };
+
+    std::vector<uint8_t> emitFastObject(const fast_program &prog, const std::vector<passthrough_section> &sections,
+                                        std::string &error)
+    {
+        return FastEmitter(prog, sections).run(error);
+    }
+}
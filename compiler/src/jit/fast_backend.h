@@ -0,0 +1,56 @@
+//
+// Created by Davide Collovigh on 19/10/26.
+//
+
+#ifndef EBPF_LLVM_JIT_FAST_BACKEND_H
+#define EBPF_LLVM_JIT_FAST_BACKEND_H
+
+#include <cstdint>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "../ebpf_inst.h"
+#include "data_relocation.h"
+#include "intrinsics.h"
+#include "passthrough_section.h"
+
+// Frames of eBPF stack reserved for the local calls (the verifier allows 8)
+#define FAST_MAX_CALL_DEPTH 8
+
+namespace ebpf_llvm_jit::jit {
+
+    /**
+     * @brief what the fast backend needs to know about a program
+     */
+    typedef struct fast_program {
+        std::string name;                                   // exported as bpf_prog_<name> (empty: not exported)
+        std::vector<ebpf_inst> insts;
+        std::map<uint32_t, data_relocation> relocations;    // LDDW relocations, indexed by pc
+        std::map<uint32_t, std::string> map_sections;       // sections backing the internal maps, indexed by map idx
+        std::set<int32_t> helpers;                          // ids of the helpers the runtime provides
+        intrinsics_config intrinsics;
+        bool batch;                                         // also export bpf_main_batch
+    } fast_program;
+
+    /**
+     * @brief translates a program straight into a RV64 object, one template per eBPF instruction
+     *
+     * eBPF registers live in fixed RISC-V registers, as in the RV64 JIT of Linux (r0: a5,
+     * r1-r5: a0-a4, r6-r9: s1-s4, r10: s5), so helper calls need no argument shuffling.
+     * No IR is built and nothing is optimized: the object exports bpf_main, bpf_prog_<name> and
+     * with batch bpf_main_batch (without prefetching), and holds the injected data sections, as
+     * the objects of the LLVM backend.
+     *
+     * Branches are first emitted as a branch over a jal and shortened while their target is in
+     * range, until the layout does not change anymore.
+     *
+     * @return the object, empty (with error set) if the program uses something the templates
+     * do not cover (maps of the .maps section, unsupported opcodes), which the LLVM backend can handle
+     */
+    std::vector<uint8_t> emitFastObject(const fast_program &prog, const std::vector<passthrough_section> &sections,
+                                        std::string &error);
+}
+
+#endif //EBPF_LLVM_JIT_FAST_BACKEND_H
@@ -0,0 +1,31 @@
+//
+// Created by Davide Collovigh on 19/10/26.
+//
+
+#ifndef EBPF_LLVM_JIT_FROZEN_MAP_H
+#define EBPF_LLVM_JIT_FROZEN_MAP_H
+
+#include <cstdint>
+#include <string>
+
+// Section of the constant tables, named FROZEN_MAP_SECTION "." NAME
+#define FROZEN_MAP_SECTION ".rodata.frozen"
+
+namespace ebpf_llvm_jit::jit {
+
+    /**
+     * @brief snapshot of an ARRAY map whose content never changes after load
+     *
+     * The content is compiled into the native ELF as a constant table and
+     * bpf_map_lookup_elem() on the map is resolved without calling the helper.
+     */
+    typedef struct frozen_map {
+        std::string name;       // name of the map symbol in the eBPF ELF
+        uint32_t value_size;
+        uint32_t max_entries;
+        std::string content;    // max_entries * value_size bytes
+    } frozen_map;
+
+}
+
+#endif //EBPF_LLVM_JIT_FROZEN_MAP_H
@@ -0,0 +1,128 @@
+//
+// Created by Davide Collovigh on 19/10/26.
+//
+
+#include "intrinsics.h"
+
+#include <functional>
+#include <map>
+
+#include <llvm/IR/InlineAsm.h>
+
+#include "target.h"
+#include "spdlog/spdlog.h"
+
+using namespace llvm;
+
+namespace ebpf_llvm_jit::jit {
+
+    typedef std::function<Value *(IRBuilder<> &, Module &, const intrinsics_config &)> intrinsic_emitter;
+
+    // Reads a value through a single RISC-V instruction, volatile reads (e.g. counters)
+    // are never merged or removed
+    static Value *emitReadAsm(IRBuilder<> &builder, const char *asmString, bool isVolatile)
+    {
+        auto asmFn = InlineAsm::get(
+                FunctionType::get(builder.getInt64Ty(), false),
+                asmString, "=r", isVolatile);
+        auto call = builder.CreateCall(asmFn);
+        if (!isVolatile) {
+            call->setDoesNotAccessMemory();
+        }
+        return call;
+    }
+
+    // The hart id does not change while the program runs
+    Value *emitHartId(IRBuilder<> &builder, const intrinsics_config &config)
+    {
+        return emitReadAsm(builder, config.hartid_from_tp ? "mv $0, tp" : "csrr $0, mhartid", false);
+    }
+
+    // ns = ticks / hz * 1e9 + (ticks % hz) * 1e9 / hz, exact and without overflow for hz <= 1e9
+    static Value *emitKtimeGetNs(IRBuilder<> &builder, Module &, const intrinsics_config &config)
+    {
+        const uint64_t NSEC_PER_SEC = 1000000000;
+        Value *ticks = emitReadAsm(builder, "rdtime $0", true);
+
+        if (NSEC_PER_SEC % config.timebase_hz == 0) {
+            return builder.CreateMul(ticks, builder.getInt64(NSEC_PER_SEC / config.timebase_hz));
+        }
+
+        Value *hz = builder.getInt64(config.timebase_hz);
+        return builder.CreateAdd(
+                builder.CreateMul(builder.CreateUDiv(ticks, hz), builder.getInt64(NSEC_PER_SEC)),
+                builder.CreateUDiv(
+                        builder.CreateMul(builder.CreateURem(ticks, hz), builder.getInt64(NSEC_PER_SEC)),
+                        hz));
+    }
+
+    // xorshift64 with one state per hart, so that no locking is needed
+    static Value *emitGetPrandomU32(IRBuilder<> &builder, Module &module, const intrinsics_config &config)
+    {
+        const char *stateName = "__bpf_prandom_state";
+        auto stateTy = ArrayType::get(builder.getInt64Ty(), INTRINSICS_MAX_HARTS);
+
+        auto state = module.getGlobalVariable(stateName, true);
+        if (!state) {
+            std::vector<Constant *> seeds;
+            for (uint64_t i = 0; i < INTRINSICS_MAX_HARTS; i++) {
+                seeds.push_back(builder.getInt64(0x9E3779B97F4A7C15ULL * (i + 1)));
+            }
+
+            state = new GlobalVariable(module, stateTy, false, GlobalValue::InternalLinkage,
+                                       ConstantArray::get(stateTy, seeds), stateName);
+            state->setAlignment(Align(8));
+        }
+
+        Value *slot = builder.CreateInBoundsGEP(
+                stateTy, state,
+                { builder.getInt64(0),
+                  builder.CreateAnd(emitHartId(builder, config), builder.getInt64(INTRINSICS_MAX_HARTS - 1)) });
+
+        Value *x = builder.CreateLoad(builder.getInt64Ty(), slot);
+        x = builder.CreateXor(x, builder.CreateShl(x, 13));
+        x = builder.CreateXor(x, builder.CreateLShr(x, 7));
+        x = builder.CreateXor(x, builder.CreateShl(x, 17));
+        builder.CreateStore(x, slot);
+
+        return builder.CreateAnd(x, builder.getInt64(0xffffffff));
+    }
+
+    static Value *emitGetSmpProcessorId(IRBuilder<> &builder, Module &, const intrinsics_config &config)
+    {
+        return emitHartId(builder, config);
+    }
+
+    // Single memory node
+    static Value *emitGetNumaNodeId(IRBuilder<> &builder, Module &, const intrinsics_config &)
+    {
+        return builder.getInt64(0);
+    }
+
+    static const std::map<int32_t, intrinsic_emitter> intrinsics = {
+            {BPF_FUNC_KTIME_GET_NS,         emitKtimeGetNs},
+            {BPF_FUNC_GET_PRANDOM_U32,      emitGetPrandomU32},
+            {BPF_FUNC_GET_SMP_PROCESSOR_ID, emitGetSmpProcessorId},
+            {BPF_FUNC_GET_NUMA_NODE_ID,     emitGetNumaNodeId},
+    };
+
+    Value *emitHelperIntrinsic(IRBuilder<> &builder, Module &module, int32_t helper, const intrinsics_config &config)
+    {
+        if (!config.enabled) {
+            return nullptr;
+        }
+
+        auto itr = intrinsics.find(helper);
+        if (itr == intrinsics.end()) {
+            return nullptr;
+        }
+
+        // Time and hart id are read from RISC-V CSRs, other targets call the helpers of their runtime
+        if (!isRiscvModule(module) && helper != BPF_FUNC_GET_NUMA_NODE_ID) {
+            return nullptr;
+        }
+
+        SPDLOG_DEBUG("Lowering helper {} to intrinsic", helper);
+        return itr->second(builder, module, config);
+    }
+}
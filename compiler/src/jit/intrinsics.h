@@ -0,0 +1,48 @@
+//
+// Created by Davide Collovigh on 19/10/26.
+//
+
+#ifndef EBPF_LLVM_JIT_INTRINSICS_H
+#define EBPF_LLVM_JIT_INTRINSICS_H
+
+#include <cstdint>
+
+#include <llvm/IR/IRBuilder.h>
+#include <llvm/IR/Module.h>
+
+// helper ids (see enum bpf_func_id in linux/bpf.h)
+#define BPF_FUNC_KTIME_GET_NS 5
+#define BPF_FUNC_GET_PRANDOM_U32 7
+#define BPF_FUNC_GET_SMP_PROCESSOR_ID 8
+#define BPF_FUNC_GET_NUMA_NODE_ID 42
+
+// Number of per-hart prandom states
+#define INTRINSICS_MAX_HARTS 8
+
+namespace ebpf_llvm_jit::jit {
+
+    typedef struct intrinsics_config {
+        bool enabled = true;
+
+        // frequency of the rdtime counter (10 MHz on QEMU virt)
+        uint64_t timebase_hz = 10000000;
+
+        // read the hart id from tp instead of mhartid (code not running in M-mode)
+        bool hartid_from_tp = false;
+    } intrinsics_config;
+
+    /**
+     * @brief emits the inline lowering of a helper call on RISC-V
+     *
+     * @return value of r0 after the call, nullptr if the helper has no intrinsic
+     * (or intrinsics are disabled, or the module does not target RISC-V) and must be called out of line
+     */
+    llvm::Value *emitHelperIntrinsic(llvm::IRBuilder<> &builder, llvm::Module &module, int32_t helper, const intrinsics_config &config);
+
+    /**
+     * @brief reads the id of the running hart (mhartid, or tp with hartid_from_tp), RISC-V only
+     */
+    llvm::Value *emitHartId(llvm::IRBuilder<> &builder, const intrinsics_config &config);
+}
+
+#endif //EBPF_LLVM_JIT_INTRINSICS_H
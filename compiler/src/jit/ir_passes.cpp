@@ -0,0 +1,437 @@
+//
+// Created by Davide Collovigh on 19/10/26.
+//
+
+#include "ir_passes.h"
+
+#include <cstring>
+#include <optional>
+#include <set>
+#include <utility>
+#include <vector>
+
+#include <llvm/Analysis/ValueTracking.h>
+#include <llvm/IR/Constants.h>
+#include <llvm/IR/IRBuilder.h>
+#include <llvm/IR/InstIterator.h>
+#include <llvm/IR/Instructions.h>
+#include <llvm/IR/IntrinsicInst.h>
+#include <llvm/IR/Operator.h>
+#include <llvm/IR/PassManager.h>
+#include <llvm/Passes/PassBuilder.h>
+#include <llvm/Transforms/IPO/AlwaysInliner.h>
+#include <llvm/Transforms/IPO/GlobalDCE.h>
+#include <llvm/Transforms/IPO/HotColdSplitting.h>
+#include <llvm/Transforms/InstCombine/InstCombine.h>
+#include <llvm/Transforms/Scalar/ADCE.h>
+#include <llvm/Transforms/Scalar/EarlyCSE.h>
+#include <llvm/Transforms/Scalar/GVN.h>
+#include <llvm/Transforms/Scalar/LoopUnrollPass.h>
+#include <llvm/Transforms/Scalar/SCCP.h>
+#include <llvm/Transforms/Scalar/SROA.h>
+#include <llvm/Transforms/Scalar/SimplifyCFG.h>
+
+#include "../utils/bo.h"
+#include "frozen_map.h"
+#include "spdlog/spdlog.h"
+
+using namespace llvm;
+
+namespace ebpf_llvm_jit::jit {
+
+    // Returns (pointer, offset) if V is ptrtoint(pointer) + constants
+    static std::optional<std::pair<Value *, int64_t>> decomposePointer(Value *V)
+    {
+        if (auto *p2i = dyn_cast<PtrToIntOperator>(V)) {
+            return std::make_pair(p2i->getPointerOperand(), (int64_t)0);
+        }
+
+        if (auto *op = dyn_cast<Operator>(V);
+                op && (op->getOpcode() == Instruction::Add || op->getOpcode() == Instruction::Sub)) {
+            auto *c = dyn_cast<ConstantInt>(op->getOperand(1));
+            if (!c) {
+                return std::nullopt;
+            }
+
+            auto base = decomposePointer(op->getOperand(0));
+            if (!base) {
+                return std::nullopt;
+            }
+
+            int64_t off = c->getSExtValue();
+            base->second += op->getOpcode() == Instruction::Add ? off : -off;
+            return base;
+        }
+
+        return std::nullopt;
+    }
+
+    bool recoverGlobalPointers(Module &M)
+    {
+        std::vector<IntToPtrInst *> worklist;
+
+        for (Function &F : M) {
+            for (Instruction &I : instructions(F)) {
+                if (auto *i2p = dyn_cast<IntToPtrInst>(&I)) {
+                    worklist.push_back(i2p);
+                }
+            }
+        }
+
+        bool changed = false;
+        for (IntToPtrInst *i2p : worklist) {
+            auto base = decomposePointer(i2p->getOperand(0));
+            // Globals (sections, frozen maps) and the eBPF stack
+            auto object = base ? base->first->stripInBoundsConstantOffsets() : nullptr;
+            if (!object || !(isa<GlobalVariable>(object) || isa<AllocaInst>(object))) {
+                continue;
+            }
+
+            IRBuilder<> builder(i2p);
+            Value *ptr = builder.CreatePointerCast(base->first, builder.getInt8PtrTy());
+            ptr = builder.CreateGEP(builder.getInt8Ty(), ptr, builder.getInt64(base->second));
+            ptr = builder.CreatePointerCast(ptr, i2p->getType());
+
+            i2p->replaceAllUsesWith(ptr);
+            i2p->eraseFromParent();
+            changed = true;
+        }
+
+        SPDLOG_DEBUG("Recovered pointers to globals: {}", changed);
+        return changed;
+    }
+
+    static bool isExclusive(Value *ptr, const exclusive_memory &exclusive)
+    {
+        if (exclusive.all) {
+            return true;
+        }
+
+        auto *gv = dyn_cast<GlobalVariable>(getUnderlyingObject(ptr));
+        return gv && exclusive.globals.count(gv->getName().str());
+    }
+
+    bool lowerExclusiveAtomics(Module &M, const exclusive_memory &exclusive)
+    {
+        std::vector<Instruction *> worklist;
+
+        for (Function &F : M) {
+            for (Instruction &I : instructions(F)) {
+                if (auto *rmw = dyn_cast<AtomicRMWInst>(&I); rmw && isExclusive(rmw->getPointerOperand(), exclusive)) {
+                    worklist.push_back(rmw);
+                } else if (auto *cas = dyn_cast<AtomicCmpXchgInst>(&I); cas && isExclusive(cas->getPointerOperand(), exclusive)) {
+                    worklist.push_back(cas);
+                }
+            }
+        }
+
+        for (Instruction *I : worklist) {
+            IRBuilder<> builder(I);
+
+            if (auto *rmw = dyn_cast<AtomicRMWInst>(I)) {
+                Value *ptr = rmw->getPointerOperand();
+                Value *val = rmw->getValOperand();
+                Value *old = builder.CreateAlignedLoad(val->getType(), ptr, rmw->getAlign());
+                Value *res;
+
+                switch (rmw->getOperation()) {
+                    case AtomicRMWInst::Xchg: res = val; break;
+                    case AtomicRMWInst::Add: res = builder.CreateAdd(old, val); break;
+                    case AtomicRMWInst::And: res = builder.CreateAnd(old, val); break;
+                    case AtomicRMWInst::Or: res = builder.CreateOr(old, val); break;
+                    case AtomicRMWInst::Xor: res = builder.CreateXor(old, val); break;
+                    default: llvm_unreachable("atomic operation not emitted for eBPF");
+                }
+
+                builder.CreateAlignedStore(res, ptr, rmw->getAlign());
+                rmw->replaceAllUsesWith(old);
+            } else {
+                auto *cas = cast<AtomicCmpXchgInst>(I);
+                Value *ptr = cas->getPointerOperand();
+                Value *old = builder.CreateAlignedLoad(cas->getCompareOperand()->getType(), ptr, cas->getAlign());
+                Value *equal = builder.CreateICmpEQ(old, cas->getCompareOperand());
+
+                // the store is always done (with the old value on failure), no branch
+                builder.CreateAlignedStore(builder.CreateSelect(equal, cas->getNewValOperand(), old), ptr, cas->getAlign());
+
+                Value *res = builder.CreateInsertValue(UndefValue::get(cas->getType()), old, 0);
+                res = builder.CreateInsertValue(res, equal, 1);
+                cas->replaceAllUsesWith(res);
+            }
+
+            I->eraseFromParent();
+        }
+
+        SPDLOG_DEBUG("Lowered {} atomics on exclusive memory", worklist.size());
+
+        // Weak, the programs of an image all define it
+        if (exclusive.all && !M.getNamedValue(SINGLE_HART_ATOMICS_SYM)) {
+            new GlobalVariable(M, Type::getInt64Ty(M.getContext()), true, GlobalValue::WeakODRLinkage,
+                               ConstantInt::get(Type::getInt64Ty(M.getContext()), 1), SINGLE_HART_ATOMICS_SYM);
+            return true;
+        }
+        return !worklist.empty();
+    }
+
+    // Helpers only reading the memory they are passed: map lookup/update/delete, trace_printk, perf_event_output,
+    // csum_diff
+    static const uint32_t FROZEN_READ_ONLY_HELPERS[] = { 1, 2, 3, 6, 25, 28 };
+
+    // v may point into one of roots: through the integer round trips, offsets, selects and phis of the eBPF registers
+    static bool pointsInto(Value *v, const std::set<Value *> &roots, std::set<Value *> &visited)
+    {
+        if (!visited.insert(v).second) {
+            return false;
+        }
+        if (roots.count(v)) {
+            return true;
+        }
+
+        auto follow = [&](Value *op) { return pointsInto(op, roots, visited); };
+
+        if (auto ce = dyn_cast<ConstantExpr>(v)) {
+            return llvm::any_of(ce->operands(), follow);
+        }
+
+        auto inst = dyn_cast<Instruction>(v);
+        if (!inst) {
+            return false;
+        }
+        switch (inst->getOpcode()) {
+            case Instruction::IntToPtr:
+            case Instruction::PtrToInt:
+            case Instruction::BitCast:
+            case Instruction::Add:
+            case Instruction::Sub:
+            case Instruction::GetElementPtr:
+            case Instruction::PHI:
+                return llvm::any_of(inst->operands(), follow);
+            case Instruction::Select:
+                return follow(inst->getOperand(1)) || follow(inst->getOperand(2));
+            default:
+                return false;
+        }
+    }
+
+    // Finds a write through roots in F, or in the subprograms it passes them to (callers: the ones being checked)
+    static bool writesThrough(Function &F, const std::set<Value *> &roots, std::set<Function *> &callers,
+                              std::string &reason)
+    {
+        callers.insert(&F);
+
+        auto reaches = [&](Value *v) {
+            std::set<Value *> visited;
+            return pointsInto(v, roots, visited);
+        };
+
+        for (auto &inst : instructions(F)) {
+            Value *ptr = nullptr;
+            if (auto store = dyn_cast<StoreInst>(&inst)) {
+                ptr = store->getPointerOperand();
+            } else if (auto rmw = dyn_cast<AtomicRMWInst>(&inst)) {
+                ptr = rmw->getPointerOperand();
+            } else if (auto cmpxchg = dyn_cast<AtomicCmpXchgInst>(&inst)) {
+                ptr = cmpxchg->getPointerOperand();
+            } else if (auto memIntrinsic = dyn_cast<AnyMemIntrinsic>(&inst)) {
+                ptr = memIntrinsic->getRawDest();
+            } else if (auto call = dyn_cast<CallBase>(&inst); call && !isa<IntrinsicInst>(call)) {
+                auto callee = call->getCalledFunction();
+                bool helper = !callee || callee->getName().startswith(EXT_FUNC_SYM_PREFIX);
+
+                if (helper) {
+                    bool lookup = callee && callee->getName() == utils::ext_func_sym(1);
+                    bool readOnly = callee && llvm::any_of(FROZEN_READ_ONLY_HELPERS, [&](uint32_t id) {
+                        return callee->getName() == utils::ext_func_sym(id);
+                    });
+                    for (unsigned i = 0; i < call->arg_size(); i++) {
+                        Value *arg = call->getArgOperand(i);
+                        if (!reaches(arg)) {
+                            continue;
+                        }
+                        // the address of the table is the map itself, anything else a value pointer
+                        if (isa<Constant>(arg) && !(lookup && i == 0)) {
+                            reason = "it is passed to " + (callee ? callee->getName().str() : std::string("an indirect call"));
+                            return true;
+                        }
+                        if (!isa<Constant>(arg) && !readOnly) {
+                            reason = "a value of it is passed to " +
+                                     (callee ? callee->getName().str() : std::string("an indirect call"));
+                            return true;
+                        }
+                    }
+                } else if (!callee->isDeclaration()) {
+                    std::set<Value *> calleeRoots;
+                    for (unsigned i = 0; i < call->arg_size() && i < callee->arg_size(); i++) {
+                        if (reaches(call->getArgOperand(i))) {
+                            calleeRoots.insert(callee->getArg(i));
+                        }
+                    }
+                    if (!calleeRoots.empty() && !callers.count(callee) &&
+                        writesThrough(*callee, calleeRoots, callers, reason)) {
+                        return true;
+                    }
+                }
+                continue;
+            }
+
+            if (ptr && reaches(ptr)) {
+                reason = isa<StoreInst>(inst) || isa<AnyMemIntrinsic>(inst) ? "the program writes to it"
+                                                                            : "the program updates it atomically";
+                return true;
+            }
+        }
+
+        callers.erase(&F);
+        return false;
+    }
+
+    bool checkFrozenMaps(Module &M, std::string &error)
+    {
+        for (auto &table : M.globals()) {
+            if (table.getSection() != FROZEN_MAP_SECTION) {
+                continue;
+            }
+
+            // the lookups on the map are inlined in the functions of the program, the pointers they return
+            // are followed into the subprograms
+            for (auto &F : M) {
+                std::set<Function *> callers;
+                std::string reason;
+                if (F.isDeclaration() || !writesThrough(F, { &table }, callers, reason)) {
+                    continue;
+                }
+
+                std::string name = table.getName().str().substr(strlen(FROZEN_MAP_SECTION "."));
+                error = "map " + name + " cannot be frozen, " + reason + " (in " + F.getName().str() + ")";
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Constant folding and dead branch removal, after the loads from read-only memory are visible
+    static void addFoldPasses(FunctionPassManager &FPM)
+    {
+        FPM.addPass(InstCombinePass());
+        FPM.addPass(GVNPass());
+        FPM.addPass(SCCPPass());
+        FPM.addPass(SimplifyCFGPass());
+        FPM.addPass(InstCombinePass());
+        FPM.addPass(ADCEPass());
+    }
+
+    bool simplifyModule(Module &M, bool splitCold, const exclusive_memory &exclusive, unsigned unrollCount,
+                        std::string &error)
+    {
+        LoopAnalysisManager LAM;
+        FunctionAnalysisManager FAM;
+        CGSCCAnalysisManager CGAM;
+        ModuleAnalysisManager MAM;
+
+        PassBuilder PB;
+        PB.registerModuleAnalyses(MAM);
+        PB.registerCGSCCAnalyses(CGAM);
+        PB.registerFunctionAnalyses(FAM);
+        PB.registerLoopAnalyses(LAM);
+        PB.crossRegisterProxies(LAM, FAM, CGAM, MAM);
+
+        // Registers to SSA
+        {
+            FunctionPassManager FPM;
+#if LLVM_VERSION_MAJOR >= 16
+            FPM.addPass(SROAPass(SROAOptions::ModifyCFG));
+#else
+            FPM.addPass(SROAPass());
+#endif
+            FPM.addPass(EarlyCSEPass());
+            FPM.addPass(InstCombinePass());
+
+            // Inline the lookups on frozen maps first
+            ModulePassManager MPM;
+            MPM.addPass(AlwaysInlinerPass());
+            MPM.addPass(createModuleToFunctionPassAdaptor(std::move(FPM)));
+            MPM.run(M, MAM);
+        }
+
+        // Before anything folds a store to a constant table away
+        if (!checkFrozenMaps(M, error)) {
+            return false;
+        }
+
+        bool changed = recoverGlobalPointers(M);
+        changed |= lowerExclusiveAtomics(M, exclusive);
+        if (changed) {
+            MAM.invalidate(M, PreservedAnalyses::none());
+        }
+
+        // Fold loads from read-only sections and drop the dead branches
+        {
+            FunctionPassManager FPM;
+            if (unrollCount) {
+                // Bounded loops with a constant trip count, the body is folded per iteration
+                FPM.addPass(LoopUnrollPass(LoopUnrollOptions(3)
+                                                   .setPartial(false)
+                                                   .setRuntime(false)
+                                                   .setUpperBound(false)
+                                                   .setFullUnrollMaxCount(unrollCount)));
+            }
+            addFoldPasses(FPM);
+
+            ModulePassManager MPM;
+            MPM.addPass(createModuleToFunctionPassAdaptor(std::move(FPM)));
+            MPM.addPass(GlobalDCEPass());
+            MPM.run(M, MAM);
+        }
+
+        // Outline the regions reached only through cold calls or cold branches
+        if (splitCold) {
+            splitColdRegions(M);
+        }
+        return true;
+    }
+
+    void simplifyFunction(Function &F)
+    {
+        LoopAnalysisManager LAM;
+        FunctionAnalysisManager FAM;
+        CGSCCAnalysisManager CGAM;
+        ModuleAnalysisManager MAM;
+
+        PassBuilder PB;
+        PB.registerModuleAnalyses(MAM);
+        PB.registerCGSCCAnalyses(CGAM);
+        PB.registerFunctionAnalyses(FAM);
+        PB.registerLoopAnalyses(LAM);
+        PB.crossRegisterProxies(LAM, FAM, CGAM, MAM);
+
+        FunctionPassManager FPM;
+        addFoldPasses(FPM);
+        FPM.run(F, FAM);
+    }
+
+    void splitColdRegions(Module &M)
+    {
+        LoopAnalysisManager LAM;
+        FunctionAnalysisManager FAM;
+        CGSCCAnalysisManager CGAM;
+        ModuleAnalysisManager MAM;
+
+        PassBuilder PB;
+        PB.registerModuleAnalyses(MAM);
+        PB.registerCGSCCAnalyses(CGAM);
+        PB.registerFunctionAnalyses(FAM);
+        PB.registerLoopAnalyses(LAM);
+        PB.crossRegisterProxies(LAM, FAM, CGAM, MAM);
+
+        ModulePassManager MPM;
+        MPM.addPass(HotColdSplittingPass());
+        MPM.run(M, MAM);
+
+        for (Function &F : M) {
+            if (!F.isDeclaration() && F.hasFnAttribute(Attribute::Cold)) {
+                SPDLOG_DEBUG("Placing cold function {} in .text.unlikely", F.getName().str());
+                F.setSection(".text.unlikely");
+            }
+        }
+    }
+}
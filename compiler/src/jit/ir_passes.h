@@ -0,0 +1,87 @@
+//
+// Created by Davide Collovigh on 19/10/26.
+//
+
+#ifndef EBPF_LLVM_JIT_IR_PASSES_H
+#define EBPF_LLVM_JIT_IR_PASSES_H
+
+#include <set>
+#include <string>
+
+#include <llvm/IR/Module.h>
+
+// Defined by the objects whose atomics were all lowered (--harts 1), baremetal.ld checks it against BPF_LAYOUT_HARTS
+#define SINGLE_HART_ATOMICS_SYM "bpf_single_hart_atomics"
+
+namespace ebpf_llvm_jit::jit {
+
+    // Memory accessed by a single hart, atomics on it need no amo*/lr/sc
+    typedef struct exclusive_memory {
+        // only one hart runs the programs: all the memory is exclusive
+        bool all = false;
+        // globals (injected sections) owned by the hart running the program
+        std::set<std::string> globals;
+    } exclusive_memory;
+
+    /**
+     * @brief rewrite inttoptr(ptrtoint(@global) + C) into getelementptr(@global, C)
+     *
+     * eBPF registers are plain i64, so every pointer to a data section (or to
+     * the eBPF stack) goes through an integer round trip that hides the object
+     * from alias analysis and constant folding. Must run after SROA, when registers are SSA values.
+     *
+     * @return true if the module was changed
+     */
+    bool recoverGlobalPointers(llvm::Module &M);
+
+    /**
+     * @brief lower atomicrmw/cmpxchg on exclusive memory to plain load, op, store
+     *
+     * Must run after recoverGlobalPointers(), so that the accesses to the globals are visible.
+     * With exclusive.all, also defines SINGLE_HART_ATOMICS_SYM: the object must not run on more than one hart.
+     *
+     * @return true if the module was changed
+     */
+    bool lowerExclusiveAtomics(llvm::Module &M, const exclusive_memory &exclusive);
+
+    /**
+     * @brief checks that the program only reads the frozen maps (FROZEN_MAP_SECTION tables)
+     *
+     * The tables are constant globals, a store to them is undefined behavior. A frozen map must only be
+     * passed to bpf_map_lookup_elem(), and the pointers returned by the lookups (followed through the
+     * integer round trips, offsets, selects and phis of the eBPF registers, and into the subprograms)
+     * must not reach a store, an atomic, the destination of a mem* intrinsic, or a helper that may write them.
+     * Must run after SROA and the inlining of the lookups.
+     *
+     * @return false (with error set) if the program may write one of them
+     */
+    bool checkFrozenMaps(llvm::Module &M, std::string &error);
+
+    /**
+     * @brief conservative cleanup pipeline run before code generation
+     *
+     * Inlines the lookups on frozen maps, promotes registers to SSA, recovers
+     * pointers to the injected data sections and folds loads from read-only
+     * ones (e.g. .rodata config or frozen map tables).
+     * Calls to helpers are never removed.
+     *
+     * @param splitCold outline the cold regions into functions placed in .text.unlikely
+     * @param exclusive memory whose atomics are lowered to plain read-modify-write
+     * @param unrollCount fully unroll the loops with up to this many iterations (0: loops are kept)
+     * @return false (with error set, see checkFrozenMaps()) if the program writes a frozen map
+     */
+    bool simplifyModule(llvm::Module &M, bool splitCold, const exclusive_memory &exclusive, unsigned unrollCount,
+                        std::string &error);
+
+    /**
+     * @brief folding part of simplifyModule() on one function, after some of its values became constants
+     */
+    void simplifyFunction(llvm::Function &F);
+
+    /**
+     * @brief outline the regions reached only through cold calls or cold branches into .text.unlikely
+     */
+    void splitColdRegions(llvm::Module &M);
+}
+
+#endif //EBPF_LLVM_JIT_IR_PASSES_H
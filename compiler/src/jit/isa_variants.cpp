@@ -0,0 +1,138 @@
+//
+// Created by Davide Collovigh on 19/10/26.
+//
+
+#include "isa_variants.h"
+
+#include <llvm/IR/Constants.h>
+#include <llvm/IR/IRBuilder.h>
+#include <llvm/Passes/PassBuilder.h>
+#include <llvm/Transforms/InstCombine/InstCombine.h>
+#include <llvm/Transforms/Scalar/SimplifyCFG.h>
+#include <llvm/Transforms/Utils/Cloning.h>
+#include <llvm/Transforms/Vectorize/LoopVectorize.h>
+#include <llvm/Transforms/Vectorize/SLPVectorizer.h>
+
+#include "spdlog/spdlog.h"
+
+using namespace llvm;
+
+namespace ebpf_llvm_jit::jit {
+
+    bool parseIsaVariant(const std::string &spec, isa_variant &variant, std::string &error)
+    {
+        variant = {};
+
+        SmallVector<StringRef, 4> extensions;
+        StringRef(spec).split(extensions, ',', -1, false);
+        if (extensions.empty()) {
+            error = "empty variant";
+            return false;
+        }
+
+        for (auto extension : extensions) {
+            extension = extension.trim();
+            bool valid = !extension.empty() && !isDigit(extension[0]) &&
+                         llvm::all_of(extension, [](char c) { return isDigit(c) || (c >= 'a' && c <= 'z'); });
+            if (!valid) {
+                error = "invalid extension \"" + extension.str() + "\" (expected a lowercase ISA name, e.g. zbb)";
+                return false;
+            }
+
+            variant.extensions.push_back(extension.str());
+            variant.name += (variant.name.empty() ? "" : "_") + extension.str();
+        }
+
+        return true;
+    }
+
+    // Function pipeline on a clone, with the cost model of its target-features
+    static void optimizeVariant(Function &F, TargetMachine &tm)
+    {
+        LoopAnalysisManager LAM;
+        FunctionAnalysisManager FAM;
+        CGSCCAnalysisManager CGAM;
+        ModuleAnalysisManager MAM;
+
+        PassBuilder PB(&tm);
+        PB.registerModuleAnalyses(MAM);
+        PB.registerCGSCCAnalyses(CGAM);
+        PB.registerFunctionAnalyses(FAM);
+        PB.registerLoopAnalyses(LAM);
+        PB.crossRegisterProxies(LAM, FAM, CGAM, MAM);
+
+        FunctionPassManager FPM = PB.buildFunctionSimplificationPipeline(OptimizationLevel::O2, ThinOrFullLTOPhase::None);
+        FPM.addPass(LoopVectorizePass());
+        FPM.addPass(SLPVectorizerPass());
+        FPM.addPass(InstCombinePass());
+        FPM.addPass(SimplifyCFGPass());
+        FPM.run(F, FAM);
+    }
+
+    void emitIsaVariants(Module &module, const std::vector<isa_variant> &variants, TargetMachine &tm,
+                         const std::string &cpu, const std::string &baseFeatures)
+    {
+        auto &ctx = module.getContext();
+        Function *base = module.getFunction("bpf_main");
+
+        std::vector<Function *> clones;
+        for (const auto &variant : variants) {
+            std::string features = baseFeatures;
+            for (const auto &extension : variant.extensions) {
+                features += (features.empty() ? "+" : ",+") + extension;
+            }
+
+            ValueToValueMapTy vmap;
+            Function *clone = CloneFunction(base, vmap);
+            clone->setName(ISA_VARIANT_PREFIX + variant.name);
+            clone->setLinkage(GlobalValue::InternalLinkage);
+            clone->addFnAttr("target-cpu", cpu);
+            clone->addFnAttr("target-features", features);
+            optimizeVariant(*clone, tm);
+            clones.push_back(clone);
+
+            SPDLOG_INFO("ISA variant {} [features: {}]", variant.name, features);
+        }
+
+        // bpf_main jumps to the selected variant, its callers (batch, aliases) go through it
+        auto dispatch = Function::Create(base->getFunctionType(), GlobalValue::ExternalLinkage, "", module);
+        base->replaceAllUsesWith(dispatch);
+        dispatch->takeName(base);
+        dispatch->setSection("");
+        base->setName(ISA_VARIANT_PREFIX "base");
+        base->setLinkage(GlobalValue::InternalLinkage);
+
+        auto ptrTy = PointerType::getUnqual(ctx);
+        auto selected = new GlobalVariable(module, ptrTy, false, GlobalValue::ExternalLinkage,
+                                           ConstantExpr::getPointerCast(base, ptrTy), ISA_MAIN_SYM);
+        selected->setAlignment(Align(8));
+
+        IRBuilder<> builder(BasicBlock::Create(ctx, "dispatch", dispatch));
+        std::vector<Value *> args;
+        for (auto &arg : dispatch->args()) {
+            args.push_back(&arg);
+        }
+        auto call = builder.CreateCall(dispatch->getFunctionType(), builder.CreateLoad(ptrTy, selected), args);
+        call->setTailCallKind(CallInst::TCK_MustTail);
+        builder.CreateRet(call);
+
+        // { extensions, variant } in the order of the command line, then { NULL, NULL }
+        auto entryTy = StructType::get(ctx, { ptrTy, ptrTy });
+        std::vector<Constant *> entries;
+        for (size_t i = 0; i < variants.size(); i++) {
+            std::string extensions;
+            for (const auto &extension : variants[i].extensions) {
+                extensions += (extensions.empty() ? "" : ",") + extension;
+            }
+            auto name = builder.CreateGlobalStringPtr(extensions, "bpf_isa_extensions_" + variants[i].name, 0, &module);
+            entries.push_back(ConstantStruct::get(
+                    entryTy, { cast<Constant>(name), ConstantExpr::getPointerCast(clones[i], ptrTy) }));
+        }
+        entries.push_back(ConstantStruct::get(entryTy, { ConstantPointerNull::get(ptrTy), ConstantPointerNull::get(ptrTy) }));
+
+        auto tableTy = ArrayType::get(entryTy, entries.size());
+        auto table = new GlobalVariable(module, tableTy, true, GlobalValue::ExternalLinkage,
+                                        ConstantArray::get(tableTy, entries), ISA_VARIANTS_SYM);
+        table->setAlignment(Align(8));
+    }
+}
@@ -0,0 +1,54 @@
+//
+// Created by Davide Collovigh on 19/10/26.
+//
+
+#ifndef EBPF_LLVM_JIT_ISA_VARIANTS_H
+#define EBPF_LLVM_JIT_ISA_VARIANTS_H
+
+#include <string>
+#include <vector>
+
+#include <llvm/IR/Module.h>
+#include <llvm/Target/TargetMachine.h>
+
+// Variants of bpf_main, bpf_main_isa_<name> (bpf_main_isa_base is the one of the target)
+#define ISA_VARIANT_PREFIX "bpf_main_isa_"
+
+// Pointer to the variant run by bpf_main, set by bpf_isa_init() of the runtime
+#define ISA_MAIN_SYM "bpf_isa_main"
+
+// { const char *extensions; void *main; } of each variant, in order of preference, NULL terminated
+#define ISA_VARIANTS_SYM "bpf_isa_variants"
+
+namespace ebpf_llvm_jit::jit {
+
+    /**
+     * @brief variant of bpf_main compiled for a set of RISC-V extensions
+     */
+    typedef struct isa_variant {
+        std::string name;                       // extensions joined by '_'
+        std::vector<std::string> extensions;    // lowercase ISA names (c, v, zbb, ...), also the LLVM features
+    } isa_variant;
+
+    /**
+     * @brief parses a comma separated list of extensions (e.g. "zbb,v")
+     *
+     * @return false (with error set) if an extension is not a lowercase ISA name
+     */
+    bool parseIsaVariant(const std::string &spec, isa_variant &variant, std::string &error);
+
+    /**
+     * @brief compiles bpf_main once per variant and makes bpf_main jump to the one selected at boot
+     *
+     * Each variant is a clone of bpf_main with the extensions of the variant added to baseFeatures, optimized
+     * again with them (tm is the target machine of the module, its cost model follows the features of each
+     * function). bpf_main becomes a tail call through ISA_MAIN_SYM, which starts on the code of the target
+     * (bpf_main_isa_base). The runtime reads the ISA of the boot hart once, before the other harts start, and
+     * points ISA_MAIN_SYM to the first entry of ISA_VARIANTS_SYM whose extensions are all there. The other
+     * entry points call bpf_main.
+     */
+    void emitIsaVariants(llvm::Module &module, const std::vector<isa_variant> &variants, llvm::TargetMachine &tm,
+                         const std::string &cpu, const std::string &baseFeatures);
+}
+
+#endif //EBPF_LLVM_JIT_ISA_VARIANTS_H
@@ -0,0 +1,67 @@
+//
+// Created by Davide Collovigh on 19/10/26.
+//
+
+#include "layout.h"
+
+#include <algorithm>
+#include <sstream>
+
+#include "tail_call.h"
+
+namespace ebpf_llvm_jit::jit {
+
+    static uint64_t alignTo(uint64_t value, uint64_t alignment)
+    {
+        return alignment > 1 ? (value + alignment - 1) / alignment * alignment : value;
+    }
+
+    memory_layout buildLayout(const codegen_stats &stats, const std::vector<passthrough_section> &sections,
+                              const std::map<std::string, static_map> &staticMaps, bool tailCalls)
+    {
+        memory_layout layout;
+
+        for (const auto &[function, size] : stats.stack_sizes) {
+            layout.stack_size += size;
+        }
+        if (tailCalls) {
+            layout.stack_size *= MAX_TAIL_CALL_CNT + 1;
+        }
+
+        for (const auto &section : sections) {
+            layout.alignment = std::max(layout.alignment, section.alignment);
+            layout.data_size = alignTo(layout.data_size, section.alignment) + section.size;
+        }
+        for (const auto &[name, map] : staticMaps) {
+            layout.alignment = std::max<uint64_t>(layout.alignment, STATIC_MAP_ALIGN);
+            layout.data_size = alignTo(layout.data_size, STATIC_MAP_ALIGN) + staticMapDataSize(map);
+        }
+
+        return layout;
+    }
+
+    // sym = MAX(sym of the fragments before this one, value)
+    static void emitMax(std::ostringstream &out, const char *sym, uint64_t value, const char *comment)
+    {
+        out << sym << " = MAX(DEFINED(" << sym << ") ? " << sym << " : 0, " << value << ");"
+            << "    /* " << comment << " */\n";
+    }
+
+    std::string layoutToLinkerScript(const memory_layout &layout)
+    {
+        std::ostringstream out;
+        out << "/* Memory needs of program " << layout.program << ": pass this file to ld before -T baremetal.ld */\n";
+        emitMax(out, "BPF_LAYOUT_STACK", layout.stack_size, "bytes of stack");
+        emitMax(out, "BPF_LAYOUT_DATA", layout.data_size, "bytes of injected sections and map storage");
+        emitMax(out, "BPF_LAYOUT_ALIGN", layout.alignment, "alignment of the data");
+        emitMax(out, "BPF_LAYOUT_HARTS", layout.harts, "harts running the program");
+
+        if (layout.sandbox_window) {
+            out << "ASSERT(!DEFINED(BPF_SANDBOX_WINDOW) || BPF_SANDBOX_WINDOW == " << layout.sandbox_window
+                << ", \"" << layout.program << " was built with another --sandbox-window\")\n";
+            out << "BPF_SANDBOX_WINDOW = " << layout.sandbox_window << ";\n";
+        }
+
+        return out.str();
+    }
+}
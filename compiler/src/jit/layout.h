@@ -0,0 +1,50 @@
+//
+// Created by Davide Collovigh on 19/10/26.
+//
+
+#ifndef EBPF_LLVM_JIT_LAYOUT_H
+#define EBPF_LLVM_JIT_LAYOUT_H
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "manifest.h"
+#include "passthrough_section.h"
+#include "static_map.h"
+
+namespace ebpf_llvm_jit::jit {
+
+    /**
+     * @brief memory an object needs from the runtime, written as a linker script fragment
+     */
+    typedef struct memory_layout {
+        std::string program;
+        uint64_t stack_size = 0;        // bytes of stack of the deepest call chain of the object
+        uint64_t data_size = 0;         // injected sections and map storage, each aligned
+        uint64_t alignment = 1;         // strictest alignment of the data
+        unsigned harts = 1;             // harts running the program, each one on its own stack
+        uint64_t sandbox_window = 0;    // --sandbox-window the object was built with (0 = no sandbox)
+    } memory_layout;
+
+    /**
+     * @brief layout of an object from the frames reported by the code generator
+     *
+     * No function of an object is recursive, so the frames added together bound any chain of calls
+     * inside it. Tail calls from local functions are nested calls: with prog arrays the bound is
+     * multiplied by the length of the longest chain.
+     */
+    memory_layout buildLayout(const codegen_stats &stats, const std::vector<passthrough_section> &sections,
+                              const std::map<std::string, static_map> &staticMaps, bool tailCalls);
+
+    /**
+     * @brief linker script fragment (symbol assignments only) to pass to ld before -T baremetal.ld
+     *
+     * Defines BPF_LAYOUT_STACK, BPF_LAYOUT_DATA, BPF_LAYOUT_ALIGN and BPF_LAYOUT_HARTS as the maximum over
+     * the fragments of the link, and BPF_SANDBOX_WINDOW for sandboxed objects (all of them must agree).
+     */
+    std::string layoutToLinkerScript(const memory_layout &layout);
+}
+
+#endif //EBPF_LLVM_JIT_LAYOUT_H
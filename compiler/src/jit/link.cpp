@@ -0,0 +1,150 @@
+//
+// Created by Davide Collovigh on 19/10/26.
+//
+
+#include "link.h"
+
+#include <llvm/Bitcode/BitcodeReader.h>
+#include <llvm/IR/Constants.h>
+#include <llvm/IR/GlobalAlias.h>
+#include <llvm/IR/LegacyPassManager.h>
+#include <llvm/Linker/Linker.h>
+#include <llvm/Pass.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Transforms/IPO.h>
+
+#include "batch.h"
+#include "memo.h"
+#include "spmd.h"
+#include "tail_call.h"
+#include "spdlog/spdlog.h"
+
+using namespace llvm;
+
+namespace ebpf_llvm_jit::jit {
+
+    void renameEntryPoints(Module &module, const std::string &name)
+    {
+        const std::string progName = PROG_SYM_PREFIX + name;
+
+        // bpf_prog_<name> is the program itself, not an alias of bpf_main
+        if (auto alias = module.getNamedAlias(progName)) {
+            alias->replaceAllUsesWith(alias->getAliasee());
+            alias->eraseFromParent();
+        }
+
+        const std::pair<const char *, std::string> entryPoints[] = {
+                { "bpf_main", progName },
+                { BATCH_ENTRY_SYM, progName + PROG_BATCH_SUFFIX },
+                { SPMD_ENTRY_SYM, progName + PROG_SPMD_SUFFIX },
+                { MEMO_DESC_SYM, progName + PROG_MEMO_SUFFIX },
+                { MEMO_KEY_SYM, progName + PROG_MEMO_KEY_SUFFIX },
+        };
+        for (const auto &[sym, newName] : entryPoints) {
+            if (auto gv = module.getNamedValue(sym)) {
+                gv->setName(newName);
+            }
+        }
+    }
+
+    // { const char *name; bpf_prog_t prog; batch; spmd } for each program
+    static void emitProgTable(Module &module, const std::vector<linked_program> &programs)
+    {
+        auto &ctx = module.getContext();
+        auto ptrTy = PointerType::getUnqual(Type::getInt8Ty(ctx));
+        auto descTy = StructType::get(ctx, { ptrTy, ptrTy, ptrTy, ptrTy });
+
+        auto entryPoint = [&](const std::string &sym) -> Constant * {
+            // after MergeFunctions, the entry point may be an alias of an identical program
+            if (auto gv = module.getNamedValue(sym)) {
+                return ConstantExpr::getPointerCast(gv, ptrTy);
+            }
+            return ConstantPointerNull::get(ptrTy);
+        };
+
+        std::vector<Constant *> descs;
+        for (const auto &program : programs) {
+            auto nameInit = ConstantDataArray::getString(ctx, program.name);
+            auto nameGV = new GlobalVariable(module, nameInit->getType(), true, GlobalValue::PrivateLinkage,
+                                             nameInit, ".bpf_prog_name." + program.name);
+            nameGV->setUnnamedAddr(GlobalValue::UnnamedAddr::Global);
+
+            const std::string progName = PROG_SYM_PREFIX + program.name;
+            descs.push_back(ConstantStruct::get(
+                    descTy, { ConstantExpr::getPointerCast(nameGV, ptrTy),
+                              entryPoint(progName),
+                              entryPoint(progName + PROG_BATCH_SUFFIX),
+                              entryPoint(progName + PROG_SPMD_SUFFIX) }));
+        }
+
+        auto tableTy = ArrayType::get(descTy, descs.size());
+        auto table = new GlobalVariable(module, tableTy, true, GlobalValue::ExternalLinkage,
+                                        ConstantArray::get(tableTy, descs), PROG_TABLE_SYM);
+        table->setAlignment(Align(8));
+
+        new GlobalVariable(module, Type::getInt64Ty(ctx), true, GlobalValue::ExternalLinkage,
+                           ConstantInt::get(Type::getInt64Ty(ctx), descs.size()), PROG_TABLE_CNT_SYM);
+    }
+
+    std::unique_ptr<Module> linkPrograms(LLVMContext &ctx, const std::vector<linked_program> &programs,
+                                         const std::string &entry)
+    {
+        auto module = std::make_unique<Module>("bpf-jit", ctx);
+        Linker linker(*module);
+
+        for (const auto &program : programs) {
+            MemoryBufferRef buffer(
+                    StringRef((const char *)program.bitcode.data(), program.bitcode.size()), program.name);
+
+            auto programModule = parseBitcodeFile(buffer, ctx);
+            if (!programModule) {
+                SPDLOG_ERROR("Unable to read the module of program {}: {}", program.name,
+                             toString(programModule.takeError()));
+                return nullptr;
+            }
+
+            if (linker.linkInModule(std::move(*programModule))) {
+                SPDLOG_ERROR("Unable to link program {}", program.name);
+                return nullptr;
+            }
+        }
+
+        // Data sections were shared between the programs only to be merged
+        size_t shared = 0;
+        for (auto &gv : module->globals()) {
+            if (gv.hasLinkOnceODRLinkage()) {
+                gv.setLinkage(GlobalValue::PrivateLinkage);
+                shared++;
+            }
+        }
+
+        // Same subprograms, cold regions and lookups compiled in several programs
+        legacy::PassManager pm;
+        pm.add(createMergeFunctionsPass());
+        pm.run(*module);
+
+        emitProgTable(*module, programs);
+
+        // Single program entry points of the runtime (a chain defines its own)
+        if (entry.empty()) {
+            SPDLOG_INFO("Linked {} programs [shared sections: {}]", programs.size(), shared);
+            return module;
+        }
+
+        const std::string progName = PROG_SYM_PREFIX + entry;
+        const std::pair<const char *, std::string> entryPoints[] = {
+                { "bpf_main", progName },
+                { BATCH_ENTRY_SYM, progName + PROG_BATCH_SUFFIX },
+                { SPMD_ENTRY_SYM, progName + PROG_SPMD_SUFFIX },
+                { MEMO_DESC_SYM, progName + PROG_MEMO_SUFFIX },
+        };
+        for (const auto &[sym, target] : entryPoints) {
+            if (auto gv = module->getNamedValue(target)) {
+                GlobalAlias::create(GlobalValue::ExternalLinkage, sym, gv);
+            }
+        }
+
+        SPDLOG_INFO("Linked {} programs [entry: {}, shared sections: {}]", programs.size(), entry, shared);
+        return module;
+    }
+}
@@ -0,0 +1,53 @@
+//
+// Created by Davide Collovigh on 19/10/26.
+//
+
+#ifndef EBPF_LLVM_JIT_LINK_H
+#define EBPF_LLVM_JIT_LINK_H
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <llvm/IR/LLVMContext.h>
+#include <llvm/IR/Module.h>
+
+// const struct bpf_prog_desc bpf_progs[], with bpf_progs_cnt entries
+#define PROG_TABLE_SYM "bpf_progs"
+#define PROG_TABLE_CNT_SYM "bpf_progs_cnt"
+
+// Per-program names of the batch and SPMD entry points: bpf_prog_<name>_batch, bpf_prog_<name>_spmd
+#define PROG_BATCH_SUFFIX "_batch"
+#define PROG_SPMD_SUFFIX "_spmd"
+#define PROG_MEMO_SUFFIX "_memo"
+#define PROG_MEMO_KEY_SUFFIX "_memo_key"
+
+namespace ebpf_llvm_jit::jit {
+
+    // Optimized module of one program, as bitcode
+    typedef struct linked_program {
+        std::string name;
+        std::vector<uint8_t> bitcode;
+    } linked_program;
+
+    /**
+     * @brief renames the entry points of a program (bpf_main, bpf_main_batch, ...) to bpf_prog_<name>[_batch|...]
+     */
+    void renameEntryPoints(llvm::Module &module, const std::string &name);
+
+    /**
+     * @brief links the programs of an ELF into one module
+     *
+     * - the data sections (linkonce_odr in each program) are merged and become private again
+     * - identical functions (local functions, outlined cold regions, map lookups) are emitted once
+     * - bpf_progs[] maps the name of each program to its entry points, for the runtime lookup
+     * - bpf_main, bpf_main_batch, bpf_main_spmd and bpf_main_memo are aliases of the entry program, if any
+     *
+     * @return nullptr if the programs cannot be linked
+     */
+    std::unique_ptr<llvm::Module> linkPrograms(llvm::LLVMContext &ctx, const std::vector<linked_program> &programs,
+                                               const std::string &entry);
+}
+
+#endif //EBPF_LLVM_JIT_LINK_H
@@ -0,0 +1,213 @@
+//
+// Created by Davide Collovigh on 19/10/26.
+//
+
+#include "manifest.h"
+
+#include <iomanip>
+#include <regex>
+#include <sstream>
+
+#include <llvm/IR/DiagnosticInfo.h>
+
+#include "native_code.h"
+
+using namespace llvm;
+
+namespace ebpf_llvm_jit::jit {
+
+    // Names of the eBPF opcode classes, by EBPF_CLS_*
+    static const char *CLASS_NAMES[] = { "ld", "ldx", "st", "stx", "alu", "jmp", "jmp32", "alu64" };
+
+    class CodegenStatsHandler : public DiagnosticHandler {
+        codegen_stats &stats;
+
+    public:
+        explicit CodegenStatsHandler(codegen_stats &stats) : stats(stats)
+        {
+        }
+
+        // Remarks are only built when some are enabled
+        bool isAnyRemarkEnabled() const override
+        {
+            return true;
+        }
+
+        // "StackSize" of PrologEpilogInserter
+        bool isAnalysisRemarkEnabled(StringRef passName) const override
+        {
+            return passName == "prologepilog";
+        }
+
+        // "SpillReloadCopies" of the greedy register allocator
+        bool isMissedOptRemarkEnabled(StringRef passName) const override
+        {
+            return passName == "regalloc";
+        }
+
+        bool handleDiagnostics(const DiagnosticInfo &info) override
+        {
+            auto remark = dyn_cast<DiagnosticInfoOptimizationBase>(&info);
+            if (!remark) {
+                return false;
+            }
+
+            // Loops are reported again in the summary of their function
+            if (remark->getRemarkName() != "SpillReloadCopies" && remark->getRemarkName() != "StackSize") {
+                return true;
+            }
+
+            for (const auto &arg : remark->getArgs()) {
+                uint64_t value = strtoull(arg.Val.c_str(), nullptr, 10);
+                if (arg.Key == "NumSpills" || arg.Key == "NumFoldedSpills") {
+                    stats.spills += value;
+                } else if (arg.Key == "NumReloads" || arg.Key == "NumFoldedReloads") {
+                    stats.reloads += value;
+                } else if (arg.Key == "NumStackBytes") {
+                    stats.stack_sizes[remark->getFunction().getName().str()] = value;
+                }
+            }
+            return true;
+        }
+    };
+
+    std::unique_ptr<DiagnosticHandler> createCodegenStatsHandler(codegen_stats &stats)
+    {
+        return std::make_unique<CodegenStatsHandler>(stats);
+    }
+
+    std::optional<program_manifest> buildManifest(const std::vector<uint8_t> &object, const std::vector<ebpf_inst> &insts,
+                                                  const aot_target &target, const std::string &extraFeatures,
+                                                  const codegen_stats &stats, const std::set<int32_t> &inlinedHelpers,
+                                                  const std::vector<passthrough_section> &sections, std::string &error)
+    {
+        program_manifest manifest;
+        manifest.target = target.triple;
+        manifest.ebpf_insns = insts.size();
+
+        NativeCode code;
+        if (!code.open(object, target, targetFeatures(target, extraFeatures), target.cpu, error)) {
+            return std::nullopt;
+        }
+        manifest.text_size = code.textSize();
+
+        for (const char *cls : CLASS_NAMES) {
+            manifest.native_insns_by_class[cls] = 0;
+        }
+        manifest.native_insns_by_class["none"] = 0;
+
+        bool visited = code.visit(isBpfMainCode, [&](const MCInst &, uint64_t, std::optional<uint32_t> pc) {
+            manifest.native_insns++;
+            if (pc && *pc < insts.size()) {
+                manifest.native_insns_by_class[CLASS_NAMES[insts[*pc].code & EBPF_CLS_MASK]]++;
+            } else {
+                manifest.native_insns_by_class["none"]++;
+            }
+        }, error);
+        if (!visited) {
+            return std::nullopt;
+        }
+
+        manifest.spills = stats.spills;
+        manifest.reloads = stats.reloads;
+        if (auto it = stats.stack_sizes.find("bpf_main"); it != stats.stack_sizes.end()) {
+            manifest.stack_size = it->second;
+        }
+
+        for (const auto &inst : insts) {
+            bool call = inst.code == EBPF_OP_CALL || inst.code == (EBPF_OP_CALL | EBPF_SRC_REG);
+            if (call && inst.src_reg != 0x1 && !inlinedHelpers.count(inst.imm)) {
+                manifest.helpers.insert(inst.imm);
+            }
+        }
+
+        for (const auto &section : sections) {
+            manifest.sections[section.name] = section.size;
+        }
+
+        return manifest;
+    }
+
+    static std::string quote(const std::string &str)
+    {
+        std::string out = "\"";
+        for (char c : str) {
+            if (c == '"' || c == '\\') {
+                out += '\\';
+            }
+            out += c;
+        }
+        return out + "\"";
+    }
+
+    std::string manifestToJson(const program_manifest &manifest)
+    {
+        std::ostringstream out;
+        out << "{\n";
+        out << "  \"program\": " << quote(manifest.program) << ",\n";
+        out << "  \"target\": " << quote(manifest.target) << ",\n";
+        out << "  \"ebpf_insns\": " << manifest.ebpf_insns << ",\n";
+        out << "  \"native_insns\": " << manifest.native_insns << ",\n";
+        out << "  \"native_per_ebpf\": " << std::fixed << std::setprecision(2)
+            << (manifest.ebpf_insns ? (double)manifest.native_insns / manifest.ebpf_insns : 0.0) << ",\n";
+        out << "  \"text_size\": " << manifest.text_size << ",\n";
+
+        out << "  \"native_insns_by_class\": {";
+        const char *sep = "\n";
+        for (const auto &[cls, count] : manifest.native_insns_by_class) {
+            out << sep << "    " << quote(cls) << ": " << count;
+            sep = ",\n";
+        }
+        out << "\n  },\n";
+
+        out << "  \"spills\": " << manifest.spills << ",\n";
+        out << "  \"reloads\": " << manifest.reloads << ",\n";
+        out << "  \"stack_size\": " << manifest.stack_size << ",\n";
+
+        out << "  \"helpers\": [";
+        sep = "";
+        for (auto helper : manifest.helpers) {
+            out << sep << helper;
+            sep = ", ";
+        }
+        out << "],\n";
+
+        out << "  \"sections\": {";
+        sep = "\n";
+        for (const auto &[name, size] : manifest.sections) {
+            out << sep << "    " << quote(name) << ": " << size;
+            sep = ",\n";
+        }
+        out << (manifest.sections.empty() ? "}\n" : "\n  }\n");
+        out << "}\n";
+
+        return out.str();
+    }
+
+    std::vector<std::string> findRegressions(const program_manifest &manifest, const std::string &baseline,
+                                             double tolerance)
+    {
+        const std::pair<const char *, uint64_t> metrics[] = {
+            { "native_insns", manifest.native_insns },
+            { "text_size", manifest.text_size },
+            { "spills", manifest.spills },
+            { "reloads", manifest.reloads },
+            { "stack_size", manifest.stack_size },
+        };
+
+        std::vector<std::string> regressions;
+        for (const auto &[name, value] : metrics) {
+            std::smatch match;
+            std::regex field("\"" + std::string(name) + "\"\\s*:\\s*([0-9]+)");
+            if (!std::regex_search(baseline, match, field)) {
+                continue;
+            }
+
+            uint64_t old = std::stoull(match[1].str());
+            if ((double)value > (double)old * (1.0 + tolerance / 100.0)) {
+                regressions.push_back(std::string(name) + ": " + std::to_string(old) + " -> " + std::to_string(value));
+            }
+        }
+        return regressions;
+    }
+}
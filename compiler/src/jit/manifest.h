@@ -0,0 +1,81 @@
+//
+// Created by Davide Collovigh on 19/10/26.
+//
+
+#ifndef EBPF_LLVM_JIT_MANIFEST_H
+#define EBPF_LLVM_JIT_MANIFEST_H
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <optional>
+#include <set>
+#include <string>
+#include <vector>
+
+#include <llvm/IR/DiagnosticHandler.h>
+
+#include "../ebpf_inst.h"
+#include "passthrough_section.h"
+#include "target.h"
+
+namespace ebpf_llvm_jit::jit {
+
+    /**
+     * @brief what the code generator reports about an object (register allocation and frame remarks)
+     */
+    typedef struct codegen_stats {
+        uint64_t spills = 0;                            // folded ones included
+        uint64_t reloads = 0;                           // folded ones included
+        std::map<std::string, uint64_t> stack_sizes;    // bytes of the frame, by function
+    } codegen_stats;
+
+    typedef struct program_manifest {
+        std::string program;
+        std::string target;
+
+        uint64_t ebpf_insns = 0;
+        uint64_t native_insns = 0;                      // of bpf_main and the blocks outlined from it
+        uint64_t text_size = 0;                         // bytes of the executable sections
+
+        // Native instructions by eBPF opcode class ("none" for code of no instruction)
+        std::map<std::string, uint64_t> native_insns_by_class;
+
+        uint64_t spills = 0;
+        uint64_t reloads = 0;
+        uint64_t stack_size = 0;                        // frame of bpf_main
+
+        std::set<int32_t> helpers;                      // called out of line
+        std::map<std::string, uint64_t> sections;       // passthrough sections, by native name
+    } program_manifest;
+
+    /**
+     * @brief diagnostic handler collecting the spill/reload and stack size remarks of the code generator
+     * into stats (other diagnostics go to the default handler)
+     */
+    std::unique_ptr<llvm::DiagnosticHandler> createCodegenStatsHandler(codegen_stats &stats);
+
+    /**
+     * @brief manifest of the object of a program, which must carry the line table of emitDebugLocations()
+     *
+     * @return nullopt (with error set) if the object cannot be disassembled
+     */
+    std::optional<program_manifest> buildManifest(const std::vector<uint8_t> &object, const std::vector<ebpf_inst> &insts,
+                                                  const aot_target &target, const std::string &extraFeatures,
+                                                  const codegen_stats &stats, const std::set<int32_t> &inlinedHelpers,
+                                                  const std::vector<passthrough_section> &sections, std::string &error);
+
+    std::string manifestToJson(const program_manifest &manifest);
+
+    /**
+     * @brief compares the metrics of a manifest (native_insns, text_size, spills, reloads, stack_size)
+     * with the ones of a baseline manifest (JSON), metrics missing from the baseline are skipped
+     *
+     * @param tolerance growth allowed, in percent of the baseline
+     * @return one message per metric that grew more than tolerance
+     */
+    std::vector<std::string> findRegressions(const program_manifest &manifest, const std::string &baseline,
+                                             double tolerance);
+}
+
+#endif //EBPF_LLVM_JIT_MANIFEST_H
@@ -0,0 +1,408 @@
+//
+// Created by Davide Collovigh on 19/10/26.
+//
+
+#include "memo.h"
+
+#include <algorithm>
+#include <map>
+#include <set>
+
+#include <llvm/IR/Constants.h>
+#include <llvm/IR/InstIterator.h>
+#include <llvm/IR/IRBuilder.h>
+#include <llvm/IR/Instructions.h>
+#include <llvm/IR/IntrinsicInst.h>
+#include <llvm/IR/Operator.h>
+
+#include "xdp_md.h"
+#include "spdlog/spdlog.h"
+
+using namespace llvm;
+
+namespace ebpf_llvm_jit::jit {
+
+    // Packet address: data or data_end + offset, as an u32 of xdp_md (no base) or as a pointer (base added)
+    typedef struct packet_value {
+        bool end;
+        int64_t offset;
+        bool based;
+    } packet_value;
+
+    // Strips constant offsets, pointer casts and int/ptr round trips
+    static Value *decompose(Value *v, int64_t &offset, const DataLayout &DL)
+    {
+        offset = 0;
+        while (true) {
+            if (auto gep = dyn_cast<GEPOperator>(v)) {
+                APInt off(DL.getIndexTypeSizeInBits(gep->getType()), 0);
+                if (!gep->accumulateConstantOffset(DL, off)) {
+                    return v;
+                }
+                offset += off.getSExtValue();
+                v = gep->getPointerOperand();
+            } else if (auto op = dyn_cast<Operator>(v); op && (op->getOpcode() == Instruction::IntToPtr ||
+                                                               op->getOpcode() == Instruction::PtrToInt ||
+                                                               op->getOpcode() == Instruction::BitCast)) {
+                v = op->getOperand(0);
+            } else if (auto bin = dyn_cast<BinaryOperator>(v); bin && bin->getOpcode() == Instruction::Add &&
+                                                                isa<ConstantInt>(bin->getOperand(1))) {
+                offset += cast<ConstantInt>(bin->getOperand(1))->getSExtValue();
+                v = bin->getOperand(0);
+            } else {
+                return v;
+            }
+        }
+    }
+
+    static bool isPktMemBase(Value *v)
+    {
+        auto load = dyn_cast<LoadInst>(v);
+        auto gv = load ? dyn_cast<GlobalVariable>(load->getPointerOperand()) : nullptr;
+        return gv && gv->getName() == PKT_MEM_BASE_SYM;
+    }
+
+    // Follows the packet addresses from the loads of ctx->data and ctx->data_end
+    class PacketTracker {
+        const DataLayout &DL;
+        std::map<Value *, packet_value> values;
+        std::vector<Value *> worklist;
+
+    public:
+        std::set<LoadInst *> packetLoads;
+        std::vector<memo_range> ranges;
+        uint64_t lenLimit = 1;
+        bool wholeLen = false;
+        std::string reason;
+
+        explicit PacketTracker(const DataLayout &DL) : DL(DL) {}
+
+        bool track(Value *v, const packet_value &pv)
+        {
+            auto [it, inserted] = values.emplace(v, pv);
+            if (!inserted) {
+                if (it->second.end != pv.end || it->second.offset != pv.offset || it->second.based != pv.based) {
+                    reason = "the same value holds different packet addresses";
+                    return false;
+                }
+                return true;
+            }
+            worklist.push_back(v);
+            return true;
+        }
+
+        bool compare(const packet_value &a, const packet_value &b)
+        {
+            if (a.based != b.based) {
+                reason = "compares packet addresses of different kinds";
+                return false;
+            }
+
+            // data + a <=> data_end + b depends on len <=> a - b only
+            if (a.end != b.end) {
+                int64_t threshold = a.end ? b.offset - a.offset : a.offset - b.offset;
+                if (threshold >= 0) {
+                    lenLimit = std::max(lenLimit, (uint64_t)threshold + 1);
+                }
+            }
+            return true;
+        }
+
+        bool visitUser(User *user, Value *v, const packet_value &pv)
+        {
+            auto inst = dyn_cast<Instruction>(user);
+            if (!inst) {
+                reason = "packet address used by a constant";
+                return false;
+            }
+
+            switch (inst->getOpcode()) {
+                case Instruction::ZExt:
+                case Instruction::IntToPtr:
+                case Instruction::PtrToInt:
+                case Instruction::BitCast:
+                    return track(inst, pv);
+
+                case Instruction::Add: {
+                    Value *other = inst->getOperand(0) == v ? inst->getOperand(1) : inst->getOperand(0);
+                    if (auto c = dyn_cast<ConstantInt>(other)) {
+                        return track(inst, { pv.end, pv.offset + c->getSExtValue(), pv.based });
+                    }
+                    if (!pv.based && isPktMemBase(other)) {
+                        return track(inst, { pv.end, pv.offset, true });
+                    }
+                    reason = "packet address at a variable offset";
+                    return false;
+                }
+
+                case Instruction::Sub: {
+                    if (inst->getOperand(0) == v) {
+                        if (auto c = dyn_cast<ConstantInt>(inst->getOperand(1))) {
+                            return track(inst, { pv.end, pv.offset - c->getSExtValue(), pv.based });
+                        }
+                    }
+                    // data_end - data: the verdict may depend on the whole length
+                    auto other = values.find(inst->getOperand(0) == v ? inst->getOperand(1) : inst->getOperand(0));
+                    if (other != values.end() && other->second.based == pv.based) {
+                        if (other->second.end != pv.end) {
+                            wholeLen = true;
+                        }
+                        return true;
+                    }
+                    if (other != values.end()) {
+                        reason = "subtracts packet addresses of different kinds";
+                        return false;
+                    }
+                    // the other operand may not be tracked yet, checked by run()
+                    return true;
+                }
+
+                case Instruction::GetElementPtr: {
+                    auto gep = cast<GEPOperator>(inst);
+                    APInt offset(DL.getIndexTypeSizeInBits(gep->getType()), 0);
+                    if (gep->getPointerOperand() != v || !gep->accumulateConstantOffset(DL, offset)) {
+                        reason = "packet address at a variable offset";
+                        return false;
+                    }
+                    return track(inst, { pv.end, pv.offset + offset.getSExtValue(), pv.based });
+                }
+
+                case Instruction::Load: {
+                    auto load = cast<LoadInst>(inst);
+                    if (pv.end || !pv.based || pv.offset < 0 || load->isVolatile()) {
+                        reason = "reads memory around the packet";
+                        return false;
+                    }
+                    packetLoads.insert(load);
+                    ranges.push_back({ (uint32_t)pv.offset, (uint32_t)DL.getTypeStoreSize(load->getType()) });
+                    return true;
+                }
+
+                case Instruction::ICmp: {
+                    Value *other = inst->getOperand(0) == v ? inst->getOperand(1) : inst->getOperand(0);
+                    if (auto it = values.find(other); it != values.end()) {
+                        return compare(pv, it->second);
+                    }
+                    // checked when the other operand is reached
+                    if (!isa<Constant>(other)) {
+                        return true;
+                    }
+                    reason = "compares a packet address with a constant";
+                    return false;
+                }
+
+                default:
+                    reason = std::string("packet address used by ") + inst->getOpcodeName();
+                    return false;
+            }
+        }
+
+        bool run()
+        {
+            while (!worklist.empty()) {
+                Value *v = worklist.back();
+                worklist.pop_back();
+                packet_value pv = values.at(v);
+
+                for (auto user : v->users()) {
+                    if (!visitUser(user, v, pv)) {
+                        return false;
+                    }
+                }
+            }
+
+            // Subtractions and compares whose other operand never became a packet address
+            for (auto &[v, pv] : values) {
+                for (auto user : v->users()) {
+                    auto inst = dyn_cast<Instruction>(user);
+                    if (inst && (inst->getOpcode() == Instruction::Sub || inst->getOpcode() == Instruction::ICmp) &&
+                        (!values.count(inst->getOperand(0)) || !values.count(inst->getOperand(1))) &&
+                        !isa<Constant>(inst->getOperand(1))) {
+                        reason = "packet address combined with an unknown value";
+                        return false;
+                    }
+                }
+            }
+            return true;
+        }
+    };
+
+    static bool isHarmlessCall(CallBase *call)
+    {
+        auto intrinsic = dyn_cast<IntrinsicInst>(call);
+        if (!intrinsic) {
+            return false;
+        }
+        return intrinsic->doesNotAccessMemory() || intrinsic->isLifetimeStartOrEnd() ||
+               isa<DbgInfoIntrinsic>(intrinsic) || intrinsic->getIntrinsicID() == Intrinsic::assume;
+    }
+
+    std::optional<memo_info> analyzeMemoization(Function &bpfMain, std::string &reason)
+    {
+        const DataLayout &DL = bpfMain.getParent()->getDataLayout();
+        Argument *ctx = bpfMain.getArg(0);
+        PacketTracker tracker(DL);
+
+        // Seeds: ctx->data and ctx->data_end, no other field of ctx is read
+        for (auto &inst : instructions(bpfMain)) {
+            auto load = dyn_cast<LoadInst>(&inst);
+            int64_t offset;
+            if (!load || decompose(load->getPointerOperand(), offset, DL) != ctx) {
+                continue;
+            }
+            if (offset != XDP_MD_DATA && offset != XDP_MD_DATA_END) {
+                reason = "reads ctx at offset " + std::to_string(offset);
+                return std::nullopt;
+            }
+            tracker.packetLoads.insert(load);
+            tracker.track(load, { offset == XDP_MD_DATA_END, 0, false });
+        }
+
+        if (!tracker.run()) {
+            reason = tracker.reason;
+            return std::nullopt;
+        }
+
+        // No side effects, no state
+        for (auto &inst : instructions(bpfMain)) {
+            if (auto call = dyn_cast<CallBase>(&inst); call && !isHarmlessCall(call)) {
+                auto callee = call->getCalledFunction();
+                reason = "calls " + (callee ? callee->getName().str() : std::string("a function pointer"));
+                return std::nullopt;
+            }
+
+            if (isa<AtomicRMWInst>(inst) || isa<AtomicCmpXchgInst>(inst) || isa<FenceInst>(inst)) {
+                reason = "uses atomics";
+                return std::nullopt;
+            }
+
+            if (auto store = dyn_cast<StoreInst>(&inst)) {
+                int64_t offset;
+                if (!isa<AllocaInst>(decompose(store->getPointerOperand(), offset, DL))) {
+                    reason = "writes memory other than its stack";
+                    return std::nullopt;
+                }
+            }
+
+            if (auto load = dyn_cast<LoadInst>(&inst); load && !tracker.packetLoads.count(load)) {
+                int64_t offset;
+                Value *obj = decompose(load->getPointerOperand(), offset, DL);
+                auto gv = dyn_cast<GlobalVariable>(obj);
+                if (gv && !gv->isConstant()) {
+                    reason = "reads " + gv->getName().str();
+                    return std::nullopt;
+                }
+                if (!gv && !isa<AllocaInst>(obj)) {
+                    reason = "reads through an unknown pointer";
+                    return std::nullopt;
+                }
+            }
+        }
+
+        // Bytes read, merged
+        memo_info info;
+        std::sort(tracker.ranges.begin(), tracker.ranges.end(),
+                  [](const memo_range &a, const memo_range &b) { return a.offset < b.offset; });
+        for (const auto &range : tracker.ranges) {
+            if (!info.ranges.empty() && range.offset <= info.ranges.back().offset + info.ranges.back().size) {
+                auto &last = info.ranges.back();
+                last.size = std::max(last.offset + last.size, range.offset + range.size) - last.offset;
+            } else {
+                info.ranges.push_back(range);
+            }
+        }
+
+        info.len_limit = tracker.wholeLen ? 0 : tracker.lenLimit;
+        info.key_size = sizeof(uint64_t);
+        for (const auto &range : info.ranges) {
+            info.key_size += range.size;
+        }
+        info.key_size = (info.key_size + 7) & ~7u;
+
+        if (info.key_size > MEMO_MAX_KEY_SIZE) {
+            reason = "key of " + std::to_string(info.key_size) + " bytes";
+            return std::nullopt;
+        }
+
+        return info;
+    }
+
+    GlobalVariable *emitMemoization(Module &module, const memo_info &info)
+    {
+        auto &ctx = module.getContext();
+        IRBuilder<> builder(ctx);
+
+        auto keyFunc = Function::Create(
+                FunctionType::get(builder.getVoidTy(), { builder.getPtrTy(), builder.getPtrTy() }, false),
+                Function::ExternalLinkage, MEMO_KEY_SYM, module);
+        Value *xdpMd = keyFunc->getArg(0);
+        Value *key = keyFunc->getArg(1);
+
+        builder.SetInsertPoint(BasicBlock::Create(ctx, "entry", keyFunc));
+
+        auto pktMemBase = module.getOrInsertGlobal(PKT_MEM_BASE_SYM, builder.getInt64Ty());
+        Value *base = builder.CreateLoad(builder.getInt64Ty(), pktMemBase);
+        auto field = [&](int64_t offset) {
+            return builder.CreateAdd(
+                    base, builder.CreateZExt(builder.CreateLoad(builder.getInt32Ty(),
+                                                                builder.CreateConstInBoundsGEP1_64(
+                                                                        builder.getInt8Ty(), xdpMd, offset)),
+                                             builder.getInt64Ty()));
+        };
+        Value *data = field(XDP_MD_DATA);
+        Value *len = builder.CreateSub(field(XDP_MD_DATA_END), data);
+
+        builder.CreateMemSet(key, builder.getInt8(0), info.key_size, MaybeAlign(8));
+
+        Value *keyLen = len;
+        if (info.len_limit) {
+            keyLen = builder.CreateSelect(builder.CreateICmpULT(len, builder.getInt64(info.len_limit)),
+                                          len, builder.getInt64(info.len_limit));
+        }
+        builder.CreateStore(keyLen, key);
+
+        // Bytes out of the packet stay zero
+        uint64_t pos = sizeof(uint64_t);
+        for (const auto &range : info.ranges) {
+            auto copyBlk = BasicBlock::Create(ctx, "copy", keyFunc);
+            auto nextBlk = BasicBlock::Create(ctx, "next", keyFunc);
+            builder.CreateCondBr(builder.CreateICmpULE(builder.getInt64(range.offset + range.size), len),
+                                 copyBlk, nextBlk);
+
+            builder.SetInsertPoint(copyBlk);
+            builder.CreateMemCpy(builder.CreateConstInBoundsGEP1_64(builder.getInt8Ty(), key, pos), MaybeAlign(1),
+                                 builder.CreateIntToPtr(builder.CreateAdd(data, builder.getInt64(range.offset)),
+                                                        builder.getPtrTy()),
+                                 MaybeAlign(1), range.size);
+            builder.CreateBr(nextBlk);
+
+            builder.SetInsertPoint(nextBlk);
+            pos += range.size;
+        }
+        builder.CreateRetVoid();
+
+        // { uint32_t key_size, nr_ranges; uint64_t len_limit; key(); struct { uint32_t offset, size; } ranges[] }
+        auto i32Ty = builder.getInt32Ty();
+        auto rangeTy = StructType::get(ctx, { i32Ty, i32Ty });
+        auto rangesTy = ArrayType::get(rangeTy, info.ranges.size());
+        std::vector<Constant *> ranges;
+        for (const auto &range : info.ranges) {
+            ranges.push_back(ConstantStruct::get(rangeTy, { builder.getInt32(range.offset),
+                                                            builder.getInt32(range.size) }));
+        }
+
+        auto descTy = StructType::get(ctx, { i32Ty, i32Ty, builder.getInt64Ty(), builder.getPtrTy(), rangesTy });
+        auto descInit = ConstantStruct::get(
+                descTy, { builder.getInt32(info.key_size), builder.getInt32(info.ranges.size()),
+                          builder.getInt64(info.len_limit),
+                          ConstantExpr::getPointerCast(keyFunc, builder.getPtrTy()),
+                          ConstantArray::get(rangesTy, ranges) });
+
+        auto desc = new GlobalVariable(module, descTy, true, GlobalValue::ExternalLinkage, descInit, MEMO_DESC_SYM);
+        desc->setAlignment(Align(8));
+
+        SPDLOG_INFO("Memoizable program [key: {} bytes, ranges: {}, length limit: {}]",
+                    info.key_size, info.ranges.size(), info.len_limit);
+        return desc;
+    }
+}
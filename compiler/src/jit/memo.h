@@ -0,0 +1,68 @@
+//
+// Created by Davide Collovigh on 19/10/26.
+//
+
+#ifndef EBPF_LLVM_JIT_MEMO_H
+#define EBPF_LLVM_JIT_MEMO_H
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include <llvm/IR/Function.h>
+#include <llvm/IR/GlobalVariable.h>
+#include <llvm/IR/Module.h>
+
+// const struct bpf_memo_desc bpf_main_memo, only defined if the program is stateless
+#define MEMO_DESC_SYM "bpf_main_memo"
+
+// void bpf_main_memo_key(const struct xdp_md *ctx, uint64_t key[])
+#define MEMO_KEY_SYM "bpf_main_memo_key"
+
+// Keys larger than this are not worth caching (u64 length + packet bytes)
+#define MEMO_MAX_KEY_SIZE 64
+
+namespace ebpf_llvm_jit::jit {
+
+    // Bytes [offset, offset + size) of the packet read by the program
+    typedef struct memo_range {
+        uint32_t offset;
+        uint32_t size;
+    } memo_range;
+
+    /**
+     * @brief what the verdict of a stateless program depends on
+     *
+     * The verdict is a function of the packet bytes in ranges and of the packet length,
+     * clamped to len_limit: the length is only compared with constants smaller than it.
+     */
+    typedef struct memo_info {
+        std::vector<memo_range> ranges;     // sorted and merged
+        uint64_t len_limit;                 // 0: the whole length matters
+        uint32_t key_size;                  // bytes of the key, multiple of 8
+    } memo_info;
+
+    /**
+     * @brief proves that bpf_main is a pure function of a few packet bytes
+     *
+     * The program must not call helpers or functions, write anything but its stack,
+     * read writable globals, ctx fields other than data/data_end, or packet bytes at a
+     * variable offset, and must not use the packet addresses other than to load at a
+     * constant offset or to compare them. Must run on the simplified module, before
+     * the cold regions are outlined.
+     *
+     * @return nullopt (with reason set) if the verdict may depend on anything else
+     */
+    std::optional<memo_info> analyzeMemoization(llvm::Function &bpfMain, std::string &reason);
+
+    /**
+     * @brief emits bpf_main_memo_key() and the bpf_main_memo descriptor (struct bpf_memo_desc of bpf_memo.h)
+     *
+     * key[0] is the clamped length, followed by the bytes of the ranges (zero when out of the packet).
+     * Packets with the same key get the same verdict.
+     */
+    llvm::GlobalVariable *emitMemoization(llvm::Module &module, const memo_info &info);
+}
+
+#endif //EBPF_LLVM_JIT_MEMO_H
@@ -0,0 +1,133 @@
+//
+// Created by Davide Collovigh on 19/10/26.
+//
+
+#include "native_code.h"
+
+#include <llvm/MC/TargetRegistry.h>
+#include <llvm/Object/ELFObjectFile.h>
+
+#include "debug_info.h"
+
+using namespace llvm;
+
+namespace ebpf_llvm_jit::jit {
+
+    bool isBpfMainCode(StringRef name)
+    {
+        return name == "bpf_main" || name.startswith("bpf_main.");
+    }
+
+    bool NativeCode::open(const std::vector<uint8_t> &object, const aot_target &target, const std::string &features,
+                          const std::string &cpu, std::string &error)
+    {
+        auto objOrErr = object::ObjectFile::createObjectFile(
+                MemoryBufferRef(StringRef((const char *)object.data(), object.size()), "native"));
+        if (!objOrErr) {
+            error = "unable to read the object: " + toString(objOrErr.takeError());
+            return false;
+        }
+        obj = std::move(*objOrErr);
+        if (!isa<object::ELFObjectFileBase>(obj.get())) {
+            error = "the object is not an ELF";
+            return false;
+        }
+        dwarf = DWARFContext::create(*obj);
+
+        std::string lookupError;
+        auto llvmTarget = TargetRegistry::lookupTarget(target.triple, lookupError);
+        if (!llvmTarget) {
+            error = lookupError;
+            return false;
+        }
+
+        MCTargetOptions mcOptions;
+        mri.reset(llvmTarget->createMCRegInfo(target.triple));
+        mai.reset(llvmTarget->createMCAsmInfo(*mri, target.triple, mcOptions));
+        sti.reset(llvmTarget->createMCSubtargetInfo(target.triple, cpu, features));
+        mii.reset(llvmTarget->createMCInstrInfo());
+        if (!sti->isCPUStringValid(cpu)) {
+            error = "CPU " + cpu + " is unknown to " + target.triple;
+            return false;
+        }
+
+        mctx = std::make_unique<MCContext>(Triple(target.triple), mai.get(), mri.get(), sti.get());
+        disassembler.reset(llvmTarget->createMCDisassembler(*sti, *mctx));
+        if (!disassembler) {
+            error = "no disassembler for " + target.triple;
+            return false;
+        }
+
+        return true;
+    }
+
+    bool NativeCode::visit(const std::function<bool(StringRef)> &filter, const visitor &fn, std::string &error) const
+    {
+        auto elf = cast<object::ELFObjectFileBase>(obj.get());
+
+        bool found = false;
+        for (const auto &symbol : elf->symbols()) {
+            auto type = symbol.getType();
+            auto name = symbol.getName();
+            auto address = symbol.getAddress();
+            auto section = symbol.getSection();
+            if (!type || !name || !address || !section) {
+                consumeError(type.takeError());
+                consumeError(name.takeError());
+                consumeError(address.takeError());
+                consumeError(section.takeError());
+                error = "unable to read the symbols of the object";
+                return false;
+            }
+            if (*type != object::SymbolRef::ST_Function || *section == elf->section_end() || !filter(*name)) {
+                continue;
+            }
+
+            auto contents = (*section)->getContents();
+            if (!contents) {
+                error = "unable to read the code of " + name->str() + ": " + toString(contents.takeError());
+                return false;
+            }
+            ArrayRef<uint8_t> bytes(contents->bytes_begin(), contents->size());
+            uint64_t base = (*section)->getAddress();
+            uint64_t end = std::min<uint64_t>(*address + symbol.getSize(), base + bytes.size());
+            found = true;
+
+            for (uint64_t addr = *address; addr < end;) {
+                MCInst inst;
+                uint64_t length = 0;
+                if (disassembler->getInstruction(inst, length, bytes.slice(addr - base), addr, nulls()) !=
+                    MCDisassembler::Success) {
+                    error = "unable to decode the instruction at " + name->str() + "+" + std::to_string(addr - *address);
+                    return false;
+                }
+
+                std::optional<uint32_t> pc;
+                auto column = dwarf->getLineInfoForAddress({ addr, (*section)->getIndex() }).Column;
+                if (column > 0) {
+                    pc = COLUMN_PC(column);
+                }
+
+                fn(inst, length, pc);
+                addr += length;
+            }
+        }
+
+        if (!found) {
+            error = "no function to analyze in the object";
+            return false;
+        }
+        return true;
+    }
+
+    uint64_t NativeCode::textSize() const
+    {
+        uint64_t size = 0;
+        for (const auto &section : obj->sections()) {
+            if (section.isText()) {
+                size += section.getSize();
+            }
+        }
+        return size;
+    }
+}
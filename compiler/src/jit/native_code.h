@@ -0,0 +1,74 @@
+//
+// Created by Davide Collovigh on 19/10/26.
+//
+
+#ifndef EBPF_LLVM_JIT_NATIVE_CODE_H
+#define EBPF_LLVM_JIT_NATIVE_CODE_H
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include <llvm/DebugInfo/DWARF/DWARFContext.h>
+#include <llvm/MC/MCAsmInfo.h>
+#include <llvm/MC/MCContext.h>
+#include <llvm/MC/MCDisassembler/MCDisassembler.h>
+#include <llvm/MC/MCInst.h>
+#include <llvm/MC/MCInstrInfo.h>
+#include <llvm/MC/MCRegisterInfo.h>
+#include <llvm/MC/MCSubtargetInfo.h>
+#include <llvm/Object/ObjectFile.h>
+
+#include "target.h"
+
+namespace ebpf_llvm_jit::jit {
+
+    // Functions holding the code of bpf_main: itself and the blocks outlined from it (bpf_main.cold.N)
+    bool isBpfMainCode(llvm::StringRef name);
+
+    /**
+     * @brief walks the machine code of an object emitted for target, one instruction at a time
+     *
+     * The eBPF pc of an instruction is read from the column of the line table of emitDebugLocations()
+     * (nullopt for code of no pc, or objects without line table).
+     */
+    class NativeCode {
+        std::unique_ptr<llvm::object::ObjectFile> obj;
+        std::unique_ptr<llvm::DWARFContext> dwarf;
+        std::unique_ptr<llvm::MCRegisterInfo> mri;
+        std::unique_ptr<llvm::MCAsmInfo> mai;
+        std::unique_ptr<llvm::MCSubtargetInfo> sti;
+        std::unique_ptr<llvm::MCInstrInfo> mii;
+        std::unique_ptr<llvm::MCContext> mctx;
+        std::unique_ptr<llvm::MCDisassembler> disassembler;
+
+    public:
+        typedef std::function<void(const llvm::MCInst &inst, uint64_t size, std::optional<uint32_t> pc)> visitor;
+
+        /**
+         * @brief reads the object (which must outlive this) and sets up the disassembler for cpu
+         *
+         * @return false (with error set) if the object cannot be read or cpu is unknown to the target
+         */
+        bool open(const std::vector<uint8_t> &object, const aot_target &target, const std::string &features,
+                  const std::string &cpu, std::string &error);
+
+        /**
+         * @brief visits the instructions of the functions whose name is accepted by filter
+         *
+         * @return false (with error set) if no function is accepted or an instruction cannot be decoded
+         */
+        bool visit(const std::function<bool(llvm::StringRef)> &filter, const visitor &fn, std::string &error) const;
+
+        // Bytes of the executable sections
+        uint64_t textSize() const;
+
+        const llvm::MCSubtargetInfo &subtarget() const { return *sti; }
+        const llvm::MCInstrInfo &instrInfo() const { return *mii; }
+    };
+}
+
+#endif //EBPF_LLVM_JIT_NATIVE_CODE_H
@@ -5,13 +5,18 @@
 #ifndef EBPF_LLVM_JIT_PASSTHROUGH_SECTION_H
 #define EBPF_LLVM_JIT_PASSTHROUGH_SECTION_H
 
-#include<string>
+#include <cstdint>
+#include <string>
 
 namespace ebpf_llvm_jit::jit {
 
     typedef struct passthrough_section {
-        std::string name;
-        std::string str_content;
+        std::string name;           // section of the native ELF
+        std::string str_content;    // initial content (empty for NOBITS sections like .bss)
+        std::string source;         // section of the eBPF ELF it is copied from
+        uint64_t size;              // size in bytes (may be larger than str_content for .bss)
+        uint64_t alignment;
+        bool read_only;
     } passthrough_section;
 
 }
@@ -0,0 +1,183 @@
+//
+// Created by Davide Collovigh on 19/10/26.
+//
+
+#include "profile.h"
+
+#include <fstream>
+#include <sstream>
+
+#include <llvm/IR/Instructions.h>
+#include <llvm/IR/MDBuilder.h>
+
+#include "spdlog/spdlog.h"
+
+using namespace llvm;
+
+namespace ebpf_llvm_jit::jit {
+
+    profile_key make_profile_key(const std::string &name, const ebpf_inst *insns, size_t insn_cnt)
+    {
+        auto bytes = reinterpret_cast<const uint8_t *>(insns);
+
+        uint32_t hash = 0x811c9dc5;
+        for (size_t i = 0; i < insn_cnt * sizeof(ebpf_inst); i++) {
+            hash = (hash ^ bytes[i]) * 0x01000193;
+        }
+
+        return { name, (uint32_t)insn_cnt, hash };
+    }
+
+    void instrument_blocks(program_t &p, Module &module, const std::string &name)
+    {
+        auto &ctx = module.getContext();
+        const size_t count = p.instBlocks.size();
+
+        auto countersTy = ArrayType::get(Type::getInt64Ty(ctx), count);
+        auto counters = new GlobalVariable(module, countersTy, false, GlobalValue::ExternalLinkage,
+                                           ConstantAggregateZero::get(countersTy), PROF_COUNTERS_SYM);
+        counters->setSection(PROF_SECTION);
+        counters->setAlignment(Align(8));
+
+        // pc of the block of each counter
+        std::vector<uint32_t> pcs;
+        for (const auto &[pc, bb] : p.instBlocks) {
+            pcs.push_back(pc);
+        }
+
+        auto pcsInit = ConstantDataArray::get(ctx, pcs);
+        new GlobalVariable(module, pcsInit->getType(), true, GlobalValue::ExternalLinkage,
+                           pcsInit, PROF_PCS_SYM);
+        new GlobalVariable(module, Type::getInt32Ty(ctx), true, GlobalValue::ExternalLinkage,
+                           ConstantInt::get(Type::getInt32Ty(ctx), count), PROF_NR_COUNTERS_SYM);
+
+        auto key = make_profile_key(name, p.insns.data(), p.insns.size());
+        auto keyInit = ConstantDataArray::getString(ctx, fmt::format("{} {} {}", key.name, key.insn_cnt, key.hash));
+        new GlobalVariable(module, keyInit->getType(), true, GlobalValue::ExternalLinkage, keyInit, PROF_KEY_SYM);
+
+        size_t idx = 0;
+        for (const auto &[pc, bb] : p.instBlocks) {
+            IRBuilder<> builder(bb, bb->getFirstInsertionPt());
+
+            auto counter = builder.CreateInBoundsGEP(countersTy, counters,
+                                                     { builder.getInt64(0), builder.getInt64(idx++) });
+            builder.CreateStore(
+                    builder.CreateAdd(builder.CreateLoad(builder.getInt64Ty(), counter), builder.getInt64(1)),
+                    counter);
+        }
+
+        SPDLOG_INFO("Instrumented {} blocks", count);
+    }
+
+    std::optional<block_profile> read_profile(const std::string &path, const profile_key &key)
+    {
+        std::ifstream ifs(path);
+        if (!ifs) {
+            SPDLOG_ERROR("Unable to open profile {}", path);
+            return std::nullopt;
+        }
+
+        block_profile profile;
+        std::string line;
+        while (std::getline(ifs, line)) {
+            std::istringstream iss(line);
+            std::string prefix, name;
+            uint32_t insn_cnt, hash, pc;
+            uint64_t count;
+
+            // BPF_PROF <name> <insn_cnt> <hash> <pc> <count>
+            if (!(iss >> prefix) || prefix != PROF_LINE_PREFIX) {
+                continue;
+            }
+            if (!(iss >> name >> insn_cnt >> hash >> pc >> count)) {
+                SPDLOG_ERROR("Malformed profile line (expected BPF_PROF <name> <insn_cnt> <hash> <pc> <count>, "
+                             "collect the profile again): {}", line);
+                return std::nullopt;
+            }
+
+            if (name != key.name) {
+                continue;
+            }
+            if (insn_cnt != key.insn_cnt || hash != key.hash) {
+                SPDLOG_ERROR("Profile {} of program {} was collected on other instructions ({} instructions, hash {}; "
+                             "program has {} instructions, hash {}), collect it again",
+                             path, name, insn_cnt, hash, key.insn_cnt, key.hash);
+                return std::nullopt;
+            }
+
+            profile[pc] += count;
+        }
+
+        if (profile.empty()) {
+            SPDLOG_WARN("No profile of program {} in {}, using the static heuristics", key.name, path);
+        } else {
+            SPDLOG_INFO("Loaded profile of {} blocks of program {} from {}", profile.size(), key.name, path);
+        }
+        return profile;
+    }
+
+    std::vector<bool> cold_blocks_from_profile(const program_t &p, const block_profile &profile)
+    {
+        std::vector<bool> cold(p.insns.size(), false);
+
+        auto entry = profile.find(0);
+        if (entry == profile.end() || entry->second == 0) {
+            SPDLOG_WARN("Program never executed during profiling, profile ignored");
+            return cold;
+        }
+
+        for (const auto &[pc, count] : profile) {
+            if (pc != 0 && pc < cold.size() && count == 0) {
+                cold[pc] = true;
+            }
+        }
+
+        return cold;
+    }
+
+    void apply_profile(program_t &p, const block_profile &profile)
+    {
+        std::map<BasicBlock *, uint64_t> counts;
+        for (const auto &[pc, bb] : p.instBlocks) {
+            if (auto itr = profile.find(pc); itr != profile.end()) {
+                counts[bb] = itr->second;
+            }
+        }
+
+        if (auto entry = profile.find(0); entry != profile.end()) {
+            p.bpf_main->setEntryCount(entry->second);
+        }
+
+        MDBuilder mdBuilder(p.bpf_main->getContext());
+
+        for (auto &bb : *p.bpf_main) {
+            auto br = dyn_cast<BranchInst>(bb.getTerminator());
+            if (!br || !br->isConditional() || !counts.count(&bb)) {
+                continue;
+            }
+
+            auto taken = br->getSuccessor(0), fallthrough = br->getSuccessor(1);
+            if (!counts.count(taken) || !counts.count(fallthrough)) {
+                continue;
+            }
+
+            // Block counts are exact edge counts when the successor has a single predecessor
+            uint64_t total = counts[&bb];
+            uint64_t takenCnt = counts[taken], fallthroughCnt = counts[fallthrough];
+            if (!taken->getSinglePredecessor() && fallthrough->getSinglePredecessor()) {
+                takenCnt = total > fallthroughCnt ? total - fallthroughCnt : 0;
+            } else if (taken->getSinglePredecessor() && !fallthrough->getSinglePredecessor()) {
+                fallthroughCnt = total > takenCnt ? total - takenCnt : 0;
+            }
+
+            // Weights are 32 bit and must not be both zero
+            while (takenCnt > UINT32_MAX - 1 || fallthroughCnt > UINT32_MAX - 1) {
+                takenCnt >>= 1;
+                fallthroughCnt >>= 1;
+            }
+
+            br->setMetadata(LLVMContext::MD_prof,
+                            mdBuilder.createBranchWeights(takenCnt + 1, fallthroughCnt + 1));
+        }
+    }
+}
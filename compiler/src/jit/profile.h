@@ -0,0 +1,70 @@
+//
+// Created by Davide Collovigh on 19/10/26.
+//
+
+#ifndef EBPF_LLVM_JIT_PROFILE_H
+#define EBPF_LLVM_JIT_PROFILE_H
+
+#include <cstdint>
+#include <map>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "program.h"
+
+// Symbols of the counters emitted by --instrument, read by the runtime (bpf_prof.c)
+#define PROF_COUNTERS_SYM "__bpf_prof_counters"
+#define PROF_PCS_SYM "__bpf_prof_pcs"
+#define PROF_NR_COUNTERS_SYM "__bpf_prof_nr_counters"
+#define PROF_KEY_SYM "__bpf_prof_key"
+#define PROF_SECTION ".data.bpf_prof"
+
+// Prefix of the lines of a profile dump
+#define PROF_LINE_PREFIX "BPF_PROF"
+
+namespace ebpf_llvm_jit::jit {
+
+    // Execution count of each block, indexed by the pc of its first instruction
+    typedef std::map<uint32_t, uint64_t> block_profile;
+
+    // Program a profile was collected on: its name and the count and FNV-1a hash of its instructions
+    typedef struct profile_key {
+        std::string name;
+        uint32_t insn_cnt;
+        uint32_t hash;
+    } profile_key;
+
+    profile_key make_profile_key(const std::string &name, const ebpf_inst *insns, size_t insn_cnt);
+
+    /**
+     * @brief adds a counter at the beginning of each eBPF block
+     *
+     * The key of the program is exported as "<name> <insn_cnt> <hash>" for the dump of the runtime.
+     */
+    void instrument_blocks(program_t &p, llvm::Module &module, const std::string &name);
+
+    /**
+     * @brief reads the blocks of a program from a profile dumped by the runtime
+     *
+     * Lines not starting with BPF_PROF are ignored, so the whole output of the
+     * instrumented runs (e.g. the QEMU serial logs of each program) can be used as is.
+     * Lines of other programs are skipped: the result is empty if the profile has none of key.name.
+     *
+     * @return nothing if the profile cannot be read or has counts of a program named key.name
+     * with other instructions (collected on another build)
+     */
+    std::optional<block_profile> read_profile(const std::string &path, const profile_key &key);
+
+    /**
+     * @brief blocks never executed during the profiled run
+     */
+    std::vector<bool> cold_blocks_from_profile(const program_t &p, const block_profile &profile);
+
+    /**
+     * @brief sets the entry count of the program and the branch weights from the block counts
+     */
+    void apply_profile(program_t &p, const block_profile &profile);
+}
+
+#endif //EBPF_LLVM_JIT_PROFILE_H
@@ -60,6 +60,23 @@ typedef struct program {
 
     std::map<std::string, llvm::Function *> lddwHelper;
     std::map<std::string, llvm::Function *> extFunc;
+
+
+    /********************************
+     * Data sections
+     ********************************/
+
+    // Globals holding the injected sections, indexed by the eBPF ELF section name (e.g. ".rodata")
+    std::map<std::string, llvm::GlobalVariable *> sectionGlobals;
+
+    // Constant tables of the frozen maps, indexed by map name
+    std::map<std::string, llvm::GlobalVariable *> frozenMaps;
+
+    // Descriptors of the static maps, indexed by map name
+    std::map<std::string, llvm::GlobalVariable *> staticMaps;
+
+    // Tables of the prog arrays, indexed by map name
+    std::map<std::string, llvm::GlobalVariable *> progArrays;
 } program_t;
 
 
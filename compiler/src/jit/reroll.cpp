@@ -0,0 +1,626 @@
+//
+// Created by Davide Collovigh on 19/10/26.
+//
+
+#include "reroll.h"
+
+#include <algorithm>
+#include <map>
+#include <optional>
+#include <tuple>
+#include <vector>
+
+#include <llvm/Analysis/AliasAnalysis.h>
+#include <llvm/Analysis/ValueTracking.h>
+#include <llvm/IR/IRBuilder.h>
+#include <llvm/IR/Instructions.h>
+#include <llvm/IR/IntrinsicInst.h>
+#include <llvm/Transforms/Utils/Local.h>
+
+#include "spdlog/spdlog.h"
+
+using namespace llvm;
+
+namespace ebpf_llvm_jit::jit {
+
+    // Elements of <vscale x N x i8> holding REROLL_VECTOR_CHUNK bytes at the minimum VLEN (vscale = 2)
+    static const unsigned VECTOR_CHUNK_ELEMENTS = REROLL_VECTOR_CHUNK / 2;
+
+    // Longest range lowered to RVV, longer ones are left to LLVM
+    static const uint64_t VECTOR_MAX_BYTES = 4 * REROLL_VECTOR_CHUNK;
+
+    typedef struct mem_access {
+        Instruction *inst;
+        Value *base;
+        int64_t off;
+        uint64_t size;
+        Align align;
+        size_t pos;
+    } mem_access;
+
+    // A contiguous run of stores (and of the loads they copy)
+    typedef struct mem_run {
+        std::vector<mem_access> stores;
+        std::vector<mem_access> loads;
+        int64_t byte = -1;
+    } mem_run;
+
+    static std::optional<mem_access> decomposeAccess(Instruction *inst, size_t pos, const DataLayout &DL)
+    {
+        Value *ptr;
+        Type *ty;
+        Align align;
+
+        if (auto load = dyn_cast<LoadInst>(inst); load && load->isSimple()) {
+            ptr = load->getPointerOperand();
+            ty = load->getType();
+            align = load->getAlign();
+        } else if (auto store = dyn_cast<StoreInst>(inst); store && store->isSimple()) {
+            ptr = store->getPointerOperand();
+            ty = store->getValueOperand()->getType();
+            align = store->getAlign();
+        } else {
+            return std::nullopt;
+        }
+
+        if (!ty->isIntegerTy()) {
+            return std::nullopt;
+        }
+
+        int64_t off = 0;
+        Value *base = GetPointerBaseWithConstantOffset(ptr, off, DL);
+        return mem_access{ inst, base, off, DL.getTypeStoreSize(ty), align, pos };
+    }
+
+    static bool mayOverlap(Value *baseA, int64_t offA, uint64_t sizeA, Value *baseB, int64_t offB, uint64_t sizeB)
+    {
+        if (baseA == baseB) {
+            return offA < offB + (int64_t)sizeB && offB < offA + (int64_t)sizeA;
+        }
+
+        const Value *objA = getUnderlyingObject(baseA);
+        const Value *objB = getUnderlyingObject(baseB);
+        return objA == objB || !isIdentifiedObject(objA) || !isIdentifiedObject(objB);
+    }
+
+    // Byte repeated by all the bytes of c, -1 if the bytes differ
+    static int64_t repeatedByte(const ConstantInt *c)
+    {
+        const APInt &v = c->getValue();
+        if (v.getBitWidth() % 8) {
+            return -1;
+        }
+
+        uint64_t byte = v.getLoBits(8).getZExtValue();
+        for (unsigned i = 8; i < v.getBitWidth(); i += 8) {
+            if (v.extractBitsAsZExtValue(8, i) != byte) {
+                return -1;
+            }
+        }
+        return byte;
+    }
+
+    // Calls, atomics, volatile accesses and the accesses that are not alias checked (not integers) end a segment
+    static bool isBarrier(Instruction *inst, const DataLayout &DL)
+    {
+        if (isa<LoadInst>(inst) || isa<StoreInst>(inst)) {
+            return !decomposeAccess(inst, 0, DL);
+        }
+        return inst->mayReadOrWriteMemory();
+    }
+
+    // Alignment of the first byte of the run, from the alignment of each access
+    static Align runAlign(const std::vector<mem_access> &accesses)
+    {
+        Align result(1);
+        for (const auto &a : accesses) {
+            result = std::max(result, commonAlignment(a.align, a.off - accesses.front().off));
+        }
+        return result;
+    }
+
+    static uint64_t runSize(const std::vector<mem_access> &accesses)
+    {
+        return accesses.back().off + accesses.back().size - accesses.front().off;
+    }
+
+    // Splits the accesses (sorted by offset) into contiguous runs
+    static std::vector<std::vector<size_t>> contiguousRuns(const std::vector<mem_access> &sorted)
+    {
+        std::vector<std::vector<size_t>> runs;
+
+        for (size_t i = 0; i < sorted.size(); i++) {
+            if (runs.empty() ||
+                sorted[i].off != sorted[runs.back().back()].off + (int64_t)sorted[runs.back().back()].size) {
+                runs.emplace_back();
+            }
+            runs.back().push_back(i);
+        }
+        return runs;
+    }
+
+    static Value *rangeAddr(IRBuilder<> &builder, Value *base, int64_t off)
+    {
+        return off ? builder.CreateConstGEP1_64(builder.getInt8Ty(), base, off) : base;
+    }
+
+    /*****************************************************
+     * RVV lowering
+     *****************************************************/
+
+    static VectorType *chunkTy(IRBuilder<> &builder)
+    {
+        return ScalableVectorType::get(builder.getInt8Ty(), VECTOR_CHUNK_ELEMENTS);
+    }
+
+    static Value *allLanes(IRBuilder<> &builder)
+    {
+        return ConstantInt::getTrue(ScalableVectorType::get(builder.getInt1Ty(), VECTOR_CHUNK_ELEMENTS));
+    }
+
+    static Value *emitVPLoad(IRBuilder<> &builder, Value *ptr, uint64_t len)
+    {
+        Value *params[] = { ptr, allLanes(builder), builder.getInt32(len) };
+        auto decl = VPIntrinsic::getDeclarationForParams(builder.GetInsertBlock()->getModule(), Intrinsic::vp_load,
+                                                         chunkTy(builder), params);
+        return builder.CreateCall(decl, params);
+    }
+
+    static void emitVPStore(IRBuilder<> &builder, Value *val, Value *ptr, uint64_t len)
+    {
+        Value *params[] = { val, ptr, allLanes(builder), builder.getInt32(len) };
+        auto decl = VPIntrinsic::getDeclarationForParams(builder.GetInsertBlock()->getModule(), Intrinsic::vp_store,
+                                                         builder.getVoidTy(), params);
+        builder.CreateCall(decl, params);
+    }
+
+    // memcpy and memmove: all the chunks are loaded before the first store
+    static void emitVectorCopy(IRBuilder<> &builder, Value *dst, Value *src, uint64_t size)
+    {
+        std::vector<Value *> chunks;
+        for (uint64_t off = 0; off < size; off += REROLL_VECTOR_CHUNK) {
+            chunks.push_back(emitVPLoad(builder, rangeAddr(builder, src, off), std::min<uint64_t>(REROLL_VECTOR_CHUNK, size - off)));
+        }
+        for (uint64_t off = 0, i = 0; off < size; off += REROLL_VECTOR_CHUNK, i++) {
+            emitVPStore(builder, chunks[i], rangeAddr(builder, dst, off), std::min<uint64_t>(REROLL_VECTOR_CHUNK, size - off));
+        }
+    }
+
+    static void emitVectorSet(IRBuilder<> &builder, Value *dst, uint8_t byte, uint64_t size)
+    {
+        Value *val = ConstantVector::getSplat(chunkTy(builder)->getElementCount(), builder.getInt8(byte));
+        for (uint64_t off = 0; off < size; off += REROLL_VECTOR_CHUNK) {
+            emitVPStore(builder, val, rangeAddr(builder, dst, off), std::min<uint64_t>(REROLL_VECTOR_CHUNK, size - off));
+        }
+    }
+
+    // true if the ranges differ (are equal if !differ)
+    static Value *emitVectorCompare(IRBuilder<> &builder, Value *a, Value *b, uint64_t size, bool differ)
+    {
+        Value *diff = nullptr;
+
+        for (uint64_t off = 0; off < size; off += REROLL_VECTOR_CHUNK) {
+            uint64_t len = std::min<uint64_t>(REROLL_VECTOR_CHUNK, size - off);
+            Value *x = builder.CreateXor(emitVPLoad(builder, rangeAddr(builder, a, off), len),
+                                         emitVPLoad(builder, rangeAddr(builder, b, off), len));
+
+            Value *params[] = { builder.getInt8(0), x, allLanes(builder), builder.getInt32(len) };
+            auto decl = VPIntrinsic::getDeclarationForParams(builder.GetInsertBlock()->getModule(), Intrinsic::vp_reduce_or,
+                                                             builder.getInt8Ty(), params);
+            Value *chunkDiff = builder.CreateCall(decl, params);
+            diff = diff ? builder.CreateOr(diff, chunkDiff) : chunkDiff;
+        }
+
+        return builder.CreateICmp(differ ? ICmpInst::ICMP_NE : ICmpInst::ICMP_EQ, diff, builder.getInt8(0));
+    }
+
+    // true if the ranges differ (are equal if !differ), by the word loop of the runtime bcmp (mem_ops.c)
+    static Value *emitScalarCompare(IRBuilder<> &builder, Value *a, Value *b, uint64_t size, bool differ)
+    {
+        auto bcmp = builder.GetInsertBlock()->getModule()->getOrInsertFunction(
+                "bcmp", builder.getInt32Ty(), builder.getPtrTy(), builder.getPtrTy(), builder.getInt64Ty());
+        Value *diff = builder.CreateCall(bcmp, { a, b, builder.getInt64(size) });
+
+        return builder.CreateICmp(differ ? ICmpInst::ICMP_NE : ICmpInst::ICMP_EQ, diff, builder.getInt32(0));
+    }
+
+    /*****************************************************
+     * memcpy / memset
+     *****************************************************/
+
+    static void rewriteRun(const mem_run &run, bool vector)
+    {
+        const auto &first = run.stores.front();
+        uint64_t size = runSize(run.stores);
+
+        // All the values are available at the last store
+        auto last = std::max_element(run.stores.begin(), run.stores.end(),
+                                     [](const auto &a, const auto &b) { return a.pos < b.pos; });
+        IRBuilder<> builder(last->inst);
+        Value *dst = rangeAddr(builder, first.base, first.off);
+
+        if (run.loads.empty()) {
+            if (vector && size <= VECTOR_MAX_BYTES) {
+                emitVectorSet(builder, dst, run.byte, size);
+            } else {
+                builder.CreateMemSet(dst, builder.getInt8(run.byte), size, MaybeAlign(runAlign(run.stores)));
+            }
+            SPDLOG_DEBUG("Re-rolled {} stores into a {} bytes memset", run.stores.size(), size);
+        } else {
+            Value *src = rangeAddr(builder, run.loads.front().base, run.loads.front().off);
+            bool overlap = mayOverlap(first.base, first.off, size, run.loads.front().base, run.loads.front().off, size);
+
+            if (vector && size <= VECTOR_MAX_BYTES) {
+                emitVectorCopy(builder, dst, src, size);
+            } else if (overlap) {
+                builder.CreateMemMove(dst, runAlign(run.stores), src, runAlign(run.loads), size);
+            } else {
+                builder.CreateMemCpy(dst, runAlign(run.stores), src, runAlign(run.loads), size);
+            }
+            SPDLOG_DEBUG("Re-rolled {} load/store pairs into a {} bytes {}", run.stores.size(), size, overlap ? "memmove" : "memcpy");
+        }
+
+        // Loads still used elsewhere are kept
+        SmallVector<WeakTrackingVH, 16> dead;
+        for (const auto &s : run.stores) {
+            dead.emplace_back(cast<StoreInst>(s.inst)->getPointerOperand());
+            s.inst->eraseFromParent();
+        }
+        for (const auto &l : run.loads) {
+            dead.emplace_back(l.inst);
+        }
+        RecursivelyDeleteTriviallyDeadInstructionsPermissive(dead);
+    }
+
+    // Moving the run to its last store must not change what other accesses see
+    static bool isRunMovable(const mem_run &run, const std::vector<mem_access> &segment)
+    {
+        const auto &dst = run.stores.front();
+        uint64_t size = runSize(run.stores);
+
+        size_t firstPos = SIZE_MAX, lastPos = 0;
+        std::vector<const Instruction *> members;
+        for (const auto &a : run.stores) {
+            firstPos = std::min(firstPos, a.pos);
+            lastPos = std::max(lastPos, a.pos);
+            members.push_back(a.inst);
+        }
+        for (const auto &a : run.loads) {
+            firstPos = std::min(firstPos, a.pos);
+            members.push_back(a.inst);
+        }
+
+        for (const auto &m : segment) {
+            if (m.pos <= firstPos || m.pos >= lastPos ||
+                std::find(members.begin(), members.end(), m.inst) != members.end()) {
+                continue;
+            }
+
+            if (mayOverlap(m.base, m.off, m.size, dst.base, dst.off, size)) {
+                return false;
+            }
+
+            // loads are moved after the stores in between
+            if (!run.loads.empty() && isa<StoreInst>(m.inst) &&
+                mayOverlap(m.base, m.off, m.size, run.loads.front().base, run.loads.front().off, size)) {
+                return false;
+            }
+        }
+
+        if (run.loads.empty()) {
+            return true;
+        }
+
+        // The run loads must not see the run stores, unless all the loads come first (memmove)
+        const auto &src = run.loads.front();
+        if (!mayOverlap(dst.base, dst.off, size, src.base, src.off, size)) {
+            return true;
+        }
+
+        size_t lastLoad = 0, firstStore = SIZE_MAX;
+        for (const auto &a : run.loads) {
+            lastLoad = std::max(lastLoad, a.pos);
+        }
+        for (const auto &a : run.stores) {
+            firstStore = std::min(firstStore, a.pos);
+        }
+        return lastLoad < firstStore;
+    }
+
+    // Re-rolls the first valid run of the segment
+    static bool rerollSegment(const std::vector<Instruction *> &insts, size_t begin, size_t end, const DataLayout &DL, bool vector)
+    {
+        std::vector<mem_access> segment;
+        std::map<Instruction *, mem_access> loads;
+
+        // (dst base, src base or byte, dst - src offset) -> stores
+        std::map<std::tuple<Value *, Value *, int64_t>, std::vector<mem_access>> groups;
+
+        for (size_t i = begin; i < end; i++) {
+            auto access = decomposeAccess(insts[i], i, DL);
+            if (!access) {
+                continue;
+            }
+            segment.push_back(*access);
+
+            if (isa<LoadInst>(insts[i])) {
+                loads[insts[i]] = *access;
+                continue;
+            }
+
+            Value *val = cast<StoreInst>(insts[i])->getValueOperand();
+            if (auto c = dyn_cast<ConstantInt>(val)) {
+                int64_t byte = repeatedByte(c);
+                if (byte >= 0) {
+                    groups[{ access->base, nullptr, byte }].push_back(*access);
+                }
+            } else if (auto load = dyn_cast<LoadInst>(val); load && loads.count(load)) {
+                const auto &src = loads[load];
+                if (src.size == access->size) {
+                    groups[{ access->base, src.base, access->off - src.off }].push_back(*access);
+                }
+            }
+        }
+
+        for (auto &[key, stores] : groups) {
+            std::sort(stores.begin(), stores.end(), [](const auto &a, const auto &b) { return a.off < b.off; });
+
+            for (const auto &idx : contiguousRuns(stores)) {
+                if (idx.size() < REROLL_MIN_ACCESSES) {
+                    continue;
+                }
+
+                mem_run run;
+                for (auto i : idx) {
+                    run.stores.push_back(stores[i]);
+                    if (std::get<1>(key)) {
+                        run.loads.push_back(loads[cast<Instruction>(cast<StoreInst>(stores[i].inst)->getValueOperand())]);
+                    }
+                }
+                if (!std::get<1>(key)) {
+                    run.byte = std::get<2>(key);
+                }
+
+                if (isRunMovable(run, segment)) {
+                    rewriteRun(run, vector);
+                    return true;
+                }
+            }
+        }
+
+        return false;
+    }
+
+    static bool rerollBlock(BasicBlock &bb, const DataLayout &DL, bool vector)
+    {
+        std::vector<Instruction *> insts;
+        for (auto &inst : bb) {
+            insts.push_back(&inst);
+        }
+
+        size_t begin = 0;
+        for (size_t i = 0; i <= insts.size(); i++) {
+            if (i == insts.size() || isBarrier(insts[i], DL)) {
+                if (rerollSegment(insts, begin, i, DL, vector)) {
+                    return true;
+                }
+                begin = i + 1;
+            }
+        }
+        return false;
+    }
+
+    /*****************************************************
+     * bcmp
+     *****************************************************/
+
+    static LoadInst *stripZExtLoad(Value *v)
+    {
+        if (auto zext = dyn_cast<ZExtInst>(v)) {
+            v = zext->getOperand(0);
+        }
+        auto load = dyn_cast<LoadInst>(v);
+        return load && load->isSimple() ? load : nullptr;
+    }
+
+    // Leaves of or(xor(load a, load b), ...)
+    static bool collectXorLeaves(Value *v, std::vector<std::pair<LoadInst *, LoadInst *>> &leaves)
+    {
+        if (auto zext = dyn_cast<ZExtInst>(v)) {
+            return collectXorLeaves(zext->getOperand(0), leaves);
+        }
+
+        auto op = dyn_cast<BinaryOperator>(v);
+        if (!op) {
+            return false;
+        }
+
+        if (op->getOpcode() == Instruction::Or) {
+            return collectXorLeaves(op->getOperand(0), leaves) && collectXorLeaves(op->getOperand(1), leaves);
+        }
+
+        if (op->getOpcode() == Instruction::Xor) {
+            auto a = stripZExtLoad(op->getOperand(0));
+            auto b = stripZExtLoad(op->getOperand(1));
+            if (!a || !b || a->getType() != b->getType()) {
+                return false;
+            }
+            leaves.emplace_back(a, b);
+            return true;
+        }
+
+        return false;
+    }
+
+    // Leaves of a tree which is true if the ranges differ (and(eq, ...) if negated, or(ne, ...) otherwise)
+    static bool collectCompareLeaves(Value *v, bool differ, std::vector<std::pair<LoadInst *, LoadInst *>> &leaves)
+    {
+        if (auto cmp = dyn_cast<ICmpInst>(v)) {
+            if (!cmp->isEquality() || (cmp->getPredicate() == ICmpInst::ICMP_NE) != differ) {
+                return false;
+            }
+
+            // icmp eq (or (xor a, b), ...), 0
+            if (auto zero = dyn_cast<ConstantInt>(cmp->getOperand(1)); zero && zero->isZero()) {
+                return collectXorLeaves(cmp->getOperand(0), leaves);
+            }
+
+            // icmp eq a, b
+            auto a = stripZExtLoad(cmp->getOperand(0));
+            auto b = stripZExtLoad(cmp->getOperand(1));
+            if (!a || !b || a->getType() != b->getType()) {
+                return false;
+            }
+            leaves.emplace_back(a, b);
+            return true;
+        }
+
+        auto op = dyn_cast<BinaryOperator>(v);
+        if (!op || op->getOpcode() != (differ ? Instruction::Or : Instruction::And)) {
+            return false;
+        }
+        return collectCompareLeaves(op->getOperand(0), differ, leaves) &&
+               collectCompareLeaves(op->getOperand(1), differ, leaves);
+    }
+
+    static bool rerollCompare(Instruction *root, const DataLayout &DL, bool vector)
+    {
+        if (!root->getType()->isIntegerTy(1)) {
+            return false;
+        }
+
+        // Only the whole tree is lowered
+        if (root->hasOneUse()) {
+            auto user = dyn_cast<BinaryOperator>(root->user_back());
+            if (user && (user->getOpcode() == Instruction::And || user->getOpcode() == Instruction::Or)) {
+                return false;
+            }
+        }
+
+        bool differ;
+        if (auto cmp = dyn_cast<ICmpInst>(root)) {
+            differ = cmp->getPredicate() == ICmpInst::ICMP_NE;
+        } else if (auto op = dyn_cast<BinaryOperator>(root)) {
+            differ = op->getOpcode() == Instruction::Or;
+        } else {
+            return false;
+        }
+
+        std::vector<std::pair<LoadInst *, LoadInst *>> leaves;
+        if (!collectCompareLeaves(root, differ, leaves) || leaves.size() < 2) {
+            return false;
+        }
+
+        // Positions in the block, nothing may write memory between the first load and the compare
+        BasicBlock *bb = root->getParent();
+        std::map<const Instruction *, size_t> pos;
+        for (auto &inst : *bb) {
+            pos[&inst] = pos.size();
+        }
+
+        std::vector<std::pair<mem_access, mem_access>> pairs;
+        size_t firstPos = pos[root];
+        for (auto [a, b] : leaves) {
+            if (a->getParent() != bb || b->getParent() != bb) {
+                return false;
+            }
+            auto accA = decomposeAccess(a, pos[a], DL);
+            auto accB = decomposeAccess(b, pos[b], DL);
+            if (!accA || !accB) {
+                return false;
+            }
+            firstPos = std::min({ firstPos, accA->pos, accB->pos });
+            pairs.emplace_back(*accA, *accB);
+        }
+
+        // The compares are commutative: put the same range on the same side
+        const auto ref = pairs.front();
+        auto sameSides = [&ref](const mem_access &a, const mem_access &b) {
+            return a.base == ref.first.base && b.base == ref.second.base &&
+                   b.off - a.off == ref.second.off - ref.first.off;
+        };
+        for (auto &[a, b] : pairs) {
+            if (!sameSides(a, b)) {
+                std::swap(a, b);
+            }
+            if (!sameSides(a, b)) {
+                return false;
+            }
+        }
+
+        for (auto &inst : *bb) {
+            if (pos[&inst] > firstPos && pos[&inst] < pos[root] && inst.mayWriteToMemory()) {
+                return false;
+            }
+        }
+
+        std::sort(pairs.begin(), pairs.end(), [](const auto &x, const auto &y) { return x.first.off < y.first.off; });
+        std::vector<mem_access> sorted;
+        for (const auto &p : pairs) {
+            sorted.push_back(p.first);
+        }
+        if (contiguousRuns(sorted).size() != 1) {
+            return false;
+        }
+
+        // Without vector, a call only pays off for trees of many (narrow) loads
+        uint64_t size = runSize(sorted);
+        if (size < REROLL_MIN_BCMP_BYTES || (vector && size > VECTOR_MAX_BYTES) ||
+            (!vector && pairs.size() < REROLL_MIN_SCALAR_BCMP_PAIRS)) {
+            return false;
+        }
+
+        IRBuilder<> builder(root);
+        Value *a = rangeAddr(builder, ref.first.base, sorted.front().off);
+        Value *b = rangeAddr(builder, ref.second.base, sorted.front().off + ref.second.off - ref.first.off);
+        Value *result = vector ? emitVectorCompare(builder, a, b, size, differ) : emitScalarCompare(builder, a, b, size, differ);
+
+        root->replaceAllUsesWith(result);
+        RecursivelyDeleteTriviallyDeadInstructions(root);
+
+        SPDLOG_DEBUG("Re-rolled a {} bytes compare into a {}", size, vector ? "vector compare" : "bcmp call");
+        return true;
+    }
+
+    static bool rerollCompares(Function &F, const DataLayout &DL, bool vector)
+    {
+        // Outermost trees first, the inner ones are deleted with them
+        std::vector<WeakVH> roots;
+        for (auto &bb : F) {
+            for (auto &inst : bb) {
+                roots.emplace_back(&inst);
+            }
+        }
+
+        bool changed = false;
+        for (auto it = roots.rbegin(); it != roots.rend(); it++) {
+            if (auto inst = dyn_cast_or_null<Instruction>(*it)) {
+                changed |= rerollCompare(inst, DL, vector);
+            }
+        }
+        return changed;
+    }
+
+    bool rerollMemoryOps(Module &M, bool vector)
+    {
+        const DataLayout &DL = M.getDataLayout();
+        bool changed = false;
+
+        for (auto &F : M) {
+            if (F.isDeclaration()) {
+                continue;
+            }
+
+            for (auto &bb : F) {
+                // every rewrite invalidates the positions of the block
+                while (rerollBlock(bb, DL, vector)) {
+                    changed = true;
+                }
+            }
+
+            changed |= rerollCompares(F, DL, vector);
+        }
+
+        return changed;
+    }
+}
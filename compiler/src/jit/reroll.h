@@ -0,0 +1,43 @@
+//
+// Created by Davide Collovigh on 19/10/26.
+//
+
+#ifndef EBPF_LLVM_JIT_REROLL_H
+#define EBPF_LLVM_JIT_REROLL_H
+
+#include <llvm/IR/Module.h>
+
+// Shortest run of loads/stores turned into a memory intrinsic
+#define REROLL_MIN_ACCESSES 4
+
+// Shortest compare turned into a vector compare or a bcmp call
+#define REROLL_MIN_BCMP_BYTES 16
+
+// Fewest load pairs of a compare turned into a bcmp call (without vector)
+#define REROLL_MIN_SCALAR_BCMP_PAIRS 8
+
+// Bytes moved by each RVV load/store (e8, LMUL 4: VLMAX >= 64 as VLEN >= 128)
+#define REROLL_VECTOR_CHUNK 64
+
+namespace ebpf_llvm_jit::jit {
+
+    /**
+     * @brief re-rolls the memcpy/memset/memcmp expanded by clang's BPF backend
+     *
+     * Runs of 1-8 byte accesses covering a contiguous range, in the same block and with no
+     * other write in between, are replaced by:
+     * - llvm.memset, for stores of the same repeated byte
+     * - llvm.memcpy (llvm.memmove if source and destination may overlap), for stores of loaded values
+     *
+     * Without vector, the intrinsics are lowered by LLVM (word sized accesses, or a call to the
+     * runtime memcpy/memset for long runs), and the xor/or reductions comparing two ranges with at
+     * least REROLL_MIN_SCALAR_BCMP_PAIRS load pairs become a call to the word loop of the runtime
+     * bcmp. With vector, the intrinsics and the compares are lowered to RVV loads/stores of up to
+     * REROLL_VECTOR_CHUNK bytes.
+     *
+     * @return true if the module was changed
+     */
+    bool rerollMemoryOps(llvm::Module &M, bool vector);
+}
+
+#endif //EBPF_LLVM_JIT_REROLL_H
@@ -0,0 +1,398 @@
+//
+// Created by Davide Collovigh on 19/10/26.
+//
+
+#include "sandbox.h"
+
+#include <algorithm>
+#include <map>
+#include <optional>
+#include <vector>
+
+#include <llvm/ADT/SmallPtrSet.h>
+#include <llvm/ADT/SmallVector.h>
+#include <llvm/Analysis/ValueTracking.h>
+#include <llvm/IR/IRBuilder.h>
+#include <llvm/IR/Instructions.h>
+#include <llvm/IR/IntrinsicInst.h>
+#include <llvm/Support/MathExtras.h>
+
+#include "batch.h"
+#include "xdp_md.h"
+#include "spdlog/spdlog.h"
+
+using namespace llvm;
+
+namespace ebpf_llvm_jit::jit {
+
+    // Pointer operand of a memory access and the bytes it touches (nullopt = not a constant)
+    typedef struct pointer_use {
+        Instruction *inst;
+        unsigned operand;
+        std::optional<uint64_t> size;
+    } pointer_use;
+
+    static std::optional<uint64_t> constantLength(Value *len, uint64_t scale)
+    {
+        if (auto c = dyn_cast<ConstantInt>(len)) {
+            return c->getZExtValue() * scale;
+        }
+        return std::nullopt;
+    }
+
+    static void collectPointerUses(Instruction &inst, const DataLayout &DL, std::vector<pointer_use> &uses)
+    {
+        if (auto load = dyn_cast<LoadInst>(&inst)) {
+            uses.push_back({ load, load->getPointerOperandIndex(), DL.getTypeStoreSize(load->getType()) });
+        } else if (auto store = dyn_cast<StoreInst>(&inst)) {
+            uses.push_back({ store, store->getPointerOperandIndex(), DL.getTypeStoreSize(store->getValueOperand()->getType()) });
+        } else if (auto rmw = dyn_cast<AtomicRMWInst>(&inst)) {
+            uses.push_back({ rmw, rmw->getPointerOperandIndex(), DL.getTypeStoreSize(rmw->getValOperand()->getType()) });
+        } else if (auto cas = dyn_cast<AtomicCmpXchgInst>(&inst)) {
+            uses.push_back({ cas, cas->getPointerOperandIndex(), DL.getTypeStoreSize(cas->getCompareOperand()->getType()) });
+        } else if (auto mem = dyn_cast<MemIntrinsic>(&inst)) {
+            auto len = constantLength(mem->getLength(), 1);
+            uses.push_back({ mem, 0, len });
+            if (isa<MemTransferInst>(mem)) {
+                uses.push_back({ mem, 1, len });
+            }
+        } else if (auto vp = dyn_cast<VPIntrinsic>(&inst)) {
+            // vp.load/vp.store emitted by the re-rolling of memory operations
+            if (auto pos = VPIntrinsic::getMemoryPointerParamPos(vp->getIntrinsicID())) {
+                Type *vecTy = vp->getType()->isVoidTy() ? vp->getArgOperand(0)->getType() : vp->getType();
+                uint64_t elemSize = DL.getTypeStoreSize(cast<VectorType>(vecTy)->getElementType());
+                uses.push_back({ vp, *pos, constantLength(vp->getVectorLengthParam(), elemSize) });
+            }
+        }
+    }
+
+    // Size of the objects whose bounds are known at compile time
+    static std::optional<uint64_t> objectSize(const Value *obj, const DataLayout &DL)
+    {
+        if (auto gv = dyn_cast<GlobalVariable>(obj); gv && gv->getValueType()->isSized()) {
+            return DL.getTypeAllocSize(gv->getValueType());
+        }
+
+        if (auto alloca = dyn_cast<AllocaInst>(obj)) {
+            if (auto bits = alloca->getAllocationSizeInBits(DL)) {
+                return bits->getFixedSize() / 8;
+            }
+        }
+
+        // ctx of bpf_main
+        if (auto arg = dyn_cast<Argument>(obj); arg && arg->getArgNo() == 0 && arg->getParent()->getName() == "bpf_main") {
+            return XDP_MD_SIZE;
+        }
+
+        return std::nullopt;
+    }
+
+    // Globals placed in the data window by baremetal.ld: pointers to them may be masked into the window
+    static bool inDataWindow(const GlobalVariable *gv)
+    {
+        StringRef section = gv->getSection();
+        return section == ".data.bpf" || section == ".bss.bpf" || section == ".rodata.bpf" ||
+               section == ".rodata.str1.1" || section.startswith(".bss.bpf_map.");
+    }
+
+    static std::string describeObject(const Value *obj)
+    {
+        return isa<AllocaInst>(obj) ? "the eBPF stack" : obj->getName().str();
+    }
+
+    // Objects that masking into the data window would miss: the eBPF stack and the globals outside the window
+    static bool outsideDataWindow(const Value *obj)
+    {
+        auto gv = dyn_cast<GlobalVariable>(obj);
+        return isa<AllocaInst>(obj) || (gv && !inDataWindow(gv));
+    }
+
+    // Object outside the data window reached from an integer (ptrtoint(stack) + offsets from r10,
+    // ptrtoint(gep(frozen table)) returned by the inlined lookups), mixed set if only some of the
+    // incoming values of a phi/select resolve to it
+    static Value *outsideObjectOf(Value *v, SmallPtrSetImpl<Value *> &visited, bool &mixed)
+    {
+        if (!visited.insert(v).second) {
+            return nullptr;
+        }
+
+        if (auto p2i = dyn_cast<PtrToIntOperator>(v)) {
+            auto obj = const_cast<Value *>(getUnderlyingObject(p2i->getPointerOperand()));
+            return outsideDataWindow(obj) ? obj : nullptr;
+        }
+
+        if (auto bin = dyn_cast<BinaryOperator>(v)) {
+            if (bin->getOpcode() == Instruction::Sub) {
+                return outsideObjectOf(bin->getOperand(0), visited, mixed);
+            }
+            if (bin->getOpcode() == Instruction::Add || bin->getOpcode() == Instruction::Or) {
+                auto lhs = outsideObjectOf(bin->getOperand(0), visited, mixed);
+                return lhs ? lhs : outsideObjectOf(bin->getOperand(1), visited, mixed);
+            }
+            return nullptr;
+        }
+
+        SmallVector<Value *, 4> incoming;
+        if (auto phi = dyn_cast<PHINode>(v)) {
+            incoming.append(phi->incoming_values().begin(), phi->incoming_values().end());
+        } else if (auto select = dyn_cast<SelectInst>(v)) {
+            incoming = { select->getTrueValue(), select->getFalseValue() };
+        }
+
+        Value *found = nullptr;
+        bool other = false;
+        for (auto value : incoming) {
+            if ((isa<Constant>(value) && !isa<ConstantExpr>(value)) || visited.count(value)) {
+                continue;
+            }
+            auto obj = outsideObjectOf(value, visited, mixed);
+            if (obj && found && obj != found) {
+                mixed = true;
+            }
+            found = obj ? obj : found;
+            other |= !obj;
+        }
+        mixed |= found && other;
+        return found;
+    }
+
+    /**
+     * @brief object accessed by ptr when it is a single known one
+     *
+     * Pointers held in eBPF registers go through ptrtoint/inttoptr (registers are integers): the
+     * ones built from r10 or returned by the inlined frozen map lookups are resolved to the stack
+     * alloca or to the table, which are outside the data window.
+     *
+     * @return nullptr for a pointer into the data window, error set if ptr may be outside of it or elsewhere
+     */
+    static Value *accessedObject(Value *ptr, std::string &error)
+    {
+        SmallVector<const Value *, 4> objects;
+        getUnderlyingObjects(ptr, objects);
+
+        SmallPtrSet<Value *, 4> resolved;
+        bool outside = false;
+        for (auto obj : objects) {
+            auto *value = const_cast<Value *>(obj);
+            if (auto i2p = dyn_cast<IntToPtrInst>(value)) {
+                SmallPtrSet<Value *, 8> visited;
+                bool mixed = false;
+                if (auto target = outsideObjectOf(i2p->getOperand(0), visited, mixed)) {
+                    if (mixed) {
+                        error = "pointer to " + describeObject(target) + " or to other memory";
+                        return nullptr;
+                    }
+                    value = target;
+                }
+            }
+            outside |= outsideDataWindow(value);
+            resolved.insert(value);
+        }
+
+        if (resolved.size() == 1) {
+            return *resolved.begin();
+        }
+        if (outside) {
+            error = "pointer to an object outside the data window or to other memory";
+        }
+        return nullptr;
+    }
+
+    // Known object accessed at an offset not proven in bounds
+    static bool variableOffset(const pointer_use &use, Value *obj, uint64_t size)
+    {
+        const DataLayout &DL = use.inst->getModule()->getDataLayout();
+        Value *ptr = use.inst->getOperand(use.operand);
+
+        int64_t off = 0;
+        Value *base = GetPointerBaseWithConstantOffset(ptr, off, DL);
+        return !(base->stripPointerCasts() == obj && use.size && off >= 0 && off + *use.size <= size);
+    }
+
+    /**
+     * @brief grows the objects accessed at variable offsets to a power of two, plus the largest access
+     *
+     * Masking the offset with the power of two size minus one then keeps every in bounds offset as it is,
+     * and the accesses past the end of the original object land in the padding.
+     *
+     * @return mask of each (padded) object, nothing (with error set) if an object cannot be padded
+     */
+    static std::optional<std::map<Value *, uint64_t>> padObjects(Module &M, const std::vector<pointer_use> &uses, std::string &error)
+    {
+        const DataLayout &DL = M.getDataLayout();
+        auto &ctx = M.getContext();
+
+        // object -> largest access at a variable offset
+        std::map<Value *, uint64_t> accesses;
+        for (const auto &use : uses) {
+            Value *obj = accessedObject(use.inst->getOperand(use.operand), error);
+            if (!error.empty()) {
+                return std::nullopt;
+            }
+
+            auto size = obj ? objectSize(obj, DL) : std::nullopt;
+            if (!size || !variableOffset(use, obj, *size)) {
+                continue;
+            }
+
+            if (!use.size) {
+                error = "memory access of unknown size on an object of " + std::to_string(*size) + " bytes";
+                return std::nullopt;
+            }
+            accesses[obj] = std::max(accesses[obj], *use.size);
+        }
+
+        std::map<Value *, uint64_t> masks;
+        for (const auto &[obj, access] : accesses) {
+            uint64_t size = *objectSize(obj, DL);
+            uint64_t limit = PowerOf2Ceil(size);
+            auto padTy = ArrayType::get(Type::getInt8Ty(ctx), limit - size + access);
+
+            if (auto alloca = dyn_cast<AllocaInst>(obj)) {
+                auto padded = new AllocaInst(ArrayType::get(Type::getInt8Ty(ctx), limit + access),
+                                             alloca->getAddressSpace(), nullptr, alloca->getAlign(), "", alloca);
+                padded->takeName(alloca);
+                alloca->replaceAllUsesWith(padded);
+                alloca->eraseFromParent();
+                masks[padded] = limit;
+            } else if (auto gv = dyn_cast<GlobalVariable>(obj); gv && gv->hasInitializer()) {
+                auto paddedTy = StructType::get(ctx, { gv->getValueType(), padTy }, true);
+                auto init = ConstantStruct::get(paddedTy, { gv->getInitializer(), ConstantAggregateZero::get(padTy) });
+                auto padded = new GlobalVariable(M, paddedTy, gv->isConstant(), gv->getLinkage(), init, "", gv,
+                                                 gv->getThreadLocalMode(), gv->getAddressSpace());
+                padded->copyAttributesFrom(gv);
+                padded->takeName(gv);
+                gv->replaceAllUsesWith(padded);
+                gv->eraseFromParent();
+                masks[padded] = limit;
+            } else {
+                // ctx, objects defined by the runtime
+                error = "memory access at a variable offset into an object of " + std::to_string(size) +
+                        " bytes that cannot be padded (" + obj->getName().str() + ")";
+                return std::nullopt;
+            }
+
+            SPDLOG_DEBUG("Sandbox: object of {} bytes padded to {} bytes", size, limit + access);
+        }
+
+        return masks;
+    }
+
+    static bool sandboxPointer(const pointer_use &use, GlobalVariable *windowBase, uint64_t window,
+                               const std::map<Value *, uint64_t> &masks, std::map<Value *, Value *> &maskedBases,
+                               std::string &error)
+    {
+        const DataLayout &DL = use.inst->getModule()->getDataLayout();
+        Value *ptr = use.inst->getOperand(use.operand);
+
+        Value *obj = accessedObject(ptr, error);
+        if (!error.empty()) {
+            return false;
+        }
+
+        IRBuilder<> builder(use.inst);
+
+        if (auto size = obj ? objectSize(obj, DL) : std::nullopt) {
+            // In bounds at a constant offset: nothing to do
+            if (!variableOffset(use, obj, *size)) {
+                return false;
+            }
+
+            // Mask the offset: padObjects() made room for the access after any offset below the mask
+            uint64_t limit = masks.at(obj);
+            Value *offset = builder.CreateSub(builder.CreatePtrToInt(ptr, builder.getInt64Ty()),
+                                              builder.CreatePtrToInt(obj, builder.getInt64Ty()));
+            offset = builder.CreateAnd(offset, builder.getInt64(limit - 1));
+            Value *masked = builder.CreateGEP(builder.getInt8Ty(), obj, offset);
+            use.inst->setOperand(use.operand, builder.CreatePointerCast(masked, ptr->getType()));
+            return true;
+        }
+
+        if (!use.size || *use.size > SANDBOX_GUARD) {
+            error = "memory access of unknown or too large size (guard is " + std::to_string(SANDBOX_GUARD) + " bytes)";
+            return false;
+        }
+
+        // Small constant offsets stay in the guard: the base is masked once and shared by the accesses
+        int64_t off = 0;
+        Value *base = GetPointerBaseWithConstantOffset(ptr, off, DL);
+        if (off < 0 || off + *use.size > SANDBOX_GUARD) {
+            base = ptr;
+            off = 0;
+        }
+
+        auto cached = maskedBases.find(base);
+        if (cached == maskedBases.end()) {
+            IRBuilder<> baseBuilder(use.inst);
+            if (auto inst = dyn_cast<Instruction>(base)) {
+                baseBuilder.SetInsertPoint(inst->getParent(), inst->getParent()->getFirstInsertionPt());
+                if (!isa<PHINode>(inst)) {
+                    baseBuilder.SetInsertPoint(inst->getNextNode());
+                }
+            } else {
+                baseBuilder.SetInsertPoint(&*use.inst->getFunction()->getEntryBlock().getFirstInsertionPt());
+            }
+
+            // base | (addr & (window - 1))
+            Value *addr = baseBuilder.CreatePtrToInt(base, baseBuilder.getInt64Ty());
+            addr = baseBuilder.CreateAnd(addr, baseBuilder.getInt64(window - 1));
+            addr = baseBuilder.CreateOr(addr, baseBuilder.CreatePtrToInt(windowBase, baseBuilder.getInt64Ty()));
+            cached = maskedBases.emplace(base, baseBuilder.CreateIntToPtr(addr, base->getType())).first;
+        }
+
+        Value *masked = off ? builder.CreateConstGEP1_64(builder.getInt8Ty(), cached->second, off) : cached->second;
+        use.inst->setOperand(use.operand, builder.CreatePointerCast(masked, ptr->getType()));
+        return true;
+    }
+
+    bool sandboxMemoryAccesses(Module &M, uint64_t window, std::string &error)
+    {
+        if (!isPowerOf2_64(window)) {
+            error = "sandbox window size must be a power of two";
+            return false;
+        }
+
+        const DataLayout &DL = M.getDataLayout();
+
+        auto *windowBase = cast<GlobalVariable>(M.getOrInsertGlobal(SANDBOX_BASE_SYM, Type::getInt8Ty(M.getContext())));
+        windowBase->setDSOLocal(true);
+
+        // the batch entry only reads the trusted ctx array
+        std::vector<pointer_use> uses;
+        for (auto &F : M) {
+            if (F.isDeclaration() || F.getName() == BATCH_ENTRY_SYM) {
+                continue;
+            }
+            for (auto &bb : F) {
+                for (auto &inst : bb) {
+                    collectPointerUses(inst, DL, uses);
+                }
+            }
+        }
+
+        // globals are shared by the functions: all of them are padded before the accesses are masked
+        auto masks = padObjects(M, uses, error);
+        if (!masks) {
+            return false;
+        }
+
+        size_t masked = 0;
+        std::map<Function *, std::map<Value *, Value *>> maskedBases;
+        for (const auto &use : uses) {
+            auto F = use.inst->getFunction();
+            if (sandboxPointer(use, windowBase, window, *masks, maskedBases[F], error)) {
+                masked++;
+            } else if (!error.empty()) {
+                std::string inst;
+                raw_string_ostream os(inst);
+                use.inst->print(os);
+                error = F->getName().str() + ":" + os.str() + ": " + error;
+                return false;
+            }
+        }
+        size_t total = uses.size();
+
+        SPDLOG_INFO("Sandbox: masked {} of {} memory accesses [window: {:#x}]", masked, total, window);
+        return true;
+    }
+}
@@ -0,0 +1,45 @@
+//
+// Created by Davide Collovigh on 19/10/26.
+//
+
+#ifndef EBPF_LLVM_JIT_SANDBOX_H
+#define EBPF_LLVM_JIT_SANDBOX_H
+
+#include <string>
+
+#include <llvm/IR/Module.h>
+
+// Start of the data window, defined by the linker script and aligned to the window size
+#define SANDBOX_BASE_SYM "__bpf_sandbox_start"
+
+// Default size of the data window (packets, .data/.bss/.rodata of the programs)
+#define SANDBOX_DEFAULT_WINDOW 0x100000
+
+// Bytes after the window that a masked access may touch (the linker script reserves them)
+#define SANDBOX_GUARD 256
+
+namespace ebpf_llvm_jit::jit {
+
+    /**
+     * @brief confines the memory accesses of the programs without a compare and branch per access
+     *
+     * - accesses at a constant offset inside a known object (eBPF stack, injected sections,
+     *   frozen tables, ctx) are left as they are
+     * - accesses at a variable offset inside a single known object get the offset masked to
+     *   the object size rounded up to a power of two; the object is padded to that size plus the
+     *   largest such access. Pointers computed from r10 are bounded to the eBPF stack and the
+     *   values of the inlined frozen map lookups to their table (both are outside the window).
+     * - any other pointer (packet, map values returned by helpers, ...) is masked into the
+     *   data window: base | (addr & (window - 1)). Constant offsets below SANDBOX_GUARD are
+     *   added after masking, so the accesses to the same packet share one mask
+     *
+     * Accesses larger than SANDBOX_GUARD that cannot be proven in bounds are rejected.
+     * The batch entry point is trusted and not rewritten.
+     *
+     * @param window size of the data window, a power of two
+     * @return false (with error set) if the program cannot be sandboxed
+     */
+    bool sandboxMemoryAccesses(llvm::Module &M, uint64_t window, std::string &error);
+}
+
+#endif //EBPF_LLVM_JIT_SANDBOX_H
@@ -0,0 +1,522 @@
+//
+// Created by Davide Collovigh on 19/10/26.
+//
+
+#include "shape.h"
+
+#include <algorithm>
+#include <map>
+#include <optional>
+#include <set>
+
+#include <llvm/IR/ConstantRange.h>
+#include <llvm/IR/Constants.h>
+#include <llvm/IR/InstIterator.h>
+#include <llvm/IR/IRBuilder.h>
+#include <llvm/IR/Instructions.h>
+#include <llvm/IR/IntrinsicInst.h>
+#include <llvm/IR/MDBuilder.h>
+#include <llvm/IR/Operator.h>
+#include <llvm/Transforms/Utils/Cloning.h>
+
+#include "../utils/bo.h"
+#include "cold_blocks.h"
+#include "ir_passes.h"
+#include "xdp_md.h"
+#include "spdlog/spdlog.h"
+
+using namespace llvm;
+
+namespace ebpf_llvm_jit::jit {
+
+    // Headers
+    static const uint32_t ETH_HEADER_LEN = 14;
+    static const uint32_t VLAN_TAG_LEN = 4;
+    static const uint32_t ETH_TYPE_VLAN = 0x8100;
+    static const uint32_t ETH_TYPE_IPV4 = 0x0800;
+    static const uint32_t ETH_TYPE_IPV6 = 0x86dd;
+    static const uint32_t IPV6_HEADER_LEN = 40;
+    static const uint32_t IPV4_PROTO_OFFSET = 9;
+    static const uint32_t IPV6_NEXT_HEADER_OFFSET = 6;
+    static const uint32_t IP_PROTO_TCP = 6;
+    static const uint32_t IP_PROTO_UDP = 17;
+    static const uint32_t TCP_HEADER_LEN = 20;
+    static const uint32_t UDP_HEADER_LEN = 8;
+
+    // Helpers moving data or data_end: bpf_xdp_adjust_head, bpf_xdp_adjust_meta, bpf_xdp_adjust_tail
+    static const uint32_t MOVING_HELPERS[] = { 44, 54, 65 };
+
+    // Helpers only reading the packet or ctx they are passed: map lookup/update/delete, trace_printk,
+    // perf_event_output, csum_diff, xdp_load_bytes
+    static const uint32_t READ_ONLY_HELPERS[] = { 1, 2, 3, 6, 25, 28, 189 };
+
+    // Specialize and simplify until nothing folds, each round may turn header offsets into constants
+    static const int SHAPE_MAX_ROUNDS = 8;
+
+    static void pushField(packet_shape &shape, uint32_t offset, uint64_t value, unsigned size)
+    {
+        shape_field field = { offset, {} };
+        for (unsigned i = 0; i < size; i++) {
+            field.bytes.push_back((value >> (8 * (size - 1 - i))) & 0xff);
+        }
+        shape.fields.push_back(field);
+    }
+
+    bool parsePacketShape(const std::string &spec, packet_shape &shape, std::string &error)
+    {
+        shape = {};
+        shape.spec = spec;
+
+        std::map<std::string, uint64_t> values;
+        SmallVector<StringRef, 4> items;
+        StringRef(spec).split(items, ',', -1, false);
+        for (auto item : items) {
+            auto [key, text] = item.trim().split('=');
+            key = key.trim();
+
+            static const std::map<std::string, std::pair<uint64_t, uint64_t>> ranges = {
+                    { "vlan", { 0, 1 } },
+                    { "ethertype", { 0, 0xffff } },
+                    { "ihl", { 5, 15 } },
+                    { "proto", { 0, 0xff } },
+            };
+            auto range = ranges.find(key.str());
+            if (range == ranges.end()) {
+                error = "unknown field \"" + key.str() + "\" (expected vlan, ethertype, ihl or proto)";
+                return false;
+            }
+
+            uint64_t value;
+            if (text.trim().getAsInteger(0, value) || value < range->second.first || value > range->second.second) {
+                error = "invalid " + key.str() + " \"" + text.str() + "\"";
+                return false;
+            }
+            if (!values.emplace(key.str(), value).second) {
+                error = "duplicated field " + key.str();
+                return false;
+            }
+        }
+
+        uint32_t l3 = ETH_HEADER_LEN + (values.count("vlan") ? values["vlan"] * VLAN_TAG_LEN : 0);
+        bool ipv4 = values.count("ethertype") && values["ethertype"] == ETH_TYPE_IPV4;
+        bool ipv6 = values.count("ethertype") && values["ethertype"] == ETH_TYPE_IPV6;
+        if (values.count("ihl") && !ipv4) {
+            error = "ihl needs ethertype=0x0800";
+            return false;
+        }
+        if (values.count("proto") && !ipv4 && !ipv6) {
+            error = "proto needs ethertype=0x0800 or ethertype=0x86dd";
+            return false;
+        }
+
+        if (values.count("vlan") && values["vlan"]) {
+            pushField(shape, ETH_HEADER_LEN - 2, ETH_TYPE_VLAN, 2);
+        }
+        if (values.count("ethertype")) {
+            pushField(shape, l3 - 2, values["ethertype"], 2);
+            shape.min_len = l3;
+        }
+        if (values.count("ihl")) {
+            // version 4 in the same byte
+            pushField(shape, l3, 0x40 | values["ihl"], 1);
+        }
+
+        // The L4 header is at a known offset with IPv6 or an IPv4 ihl
+        std::optional<uint32_t> l4;
+        if (ipv4) {
+            shape.min_len = l3 + (values.count("ihl") ? values["ihl"] * 4 : 20);
+            if (values.count("ihl")) {
+                l4 = shape.min_len;
+            }
+        } else if (ipv6) {
+            shape.min_len = l3 + IPV6_HEADER_LEN;
+            l4 = shape.min_len;
+        }
+        if (values.count("proto")) {
+            pushField(shape, l3 + (ipv4 ? IPV4_PROTO_OFFSET : IPV6_NEXT_HEADER_OFFSET), values["proto"], 1);
+            if (l4 && values["proto"] == IP_PROTO_TCP) {
+                shape.min_len = *l4 + TCP_HEADER_LEN;
+            } else if (l4 && values["proto"] == IP_PROTO_UDP) {
+                shape.min_len = *l4 + UDP_HEADER_LEN;
+            }
+        }
+
+        if (shape.fields.empty()) {
+            error = "the shape fixes no byte of the packet";
+            return false;
+        }
+        for (const auto &field : shape.fields) {
+            shape.min_len = std::max<uint32_t>(shape.min_len, field.offset + field.bytes.size());
+        }
+        return true;
+    }
+
+    // Strips constant offsets, pointer casts and int/ptr round trips
+    static Value *decompose(Value *v, int64_t &offset, const DataLayout &DL)
+    {
+        offset = 0;
+        while (true) {
+            if (auto gep = dyn_cast<GEPOperator>(v)) {
+                APInt off(DL.getIndexTypeSizeInBits(gep->getType()), 0);
+                if (!gep->accumulateConstantOffset(DL, off)) {
+                    return v;
+                }
+                offset += off.getSExtValue();
+                v = gep->getPointerOperand();
+            } else if (auto op = dyn_cast<Operator>(v); op && (op->getOpcode() == Instruction::IntToPtr ||
+                                                               op->getOpcode() == Instruction::PtrToInt ||
+                                                               op->getOpcode() == Instruction::BitCast)) {
+                v = op->getOperand(0);
+            } else if (auto bin = dyn_cast<BinaryOperator>(v); bin && bin->getOpcode() == Instruction::Add &&
+                                                                isa<ConstantInt>(bin->getOperand(1))) {
+                offset += cast<ConstantInt>(bin->getOperand(1))->getSExtValue();
+                v = bin->getOperand(0);
+            } else {
+                return v;
+            }
+        }
+    }
+
+    static bool isPktMemBase(Value *v)
+    {
+        auto load = dyn_cast<LoadInst>(v);
+        auto gv = load ? dyn_cast<GlobalVariable>(load->getPointerOperand()) : nullptr;
+        return gv && gv->getName() == PKT_MEM_BASE_SYM;
+    }
+
+    // ebpf_pkt_mem_base + ctx->data (0) or ebpf_pkt_mem_base + ctx->data_end (1), -1 for any other value
+    static int packetRoot(Value *v, Argument *ctx, const DataLayout &DL)
+    {
+        auto add = dyn_cast<BinaryOperator>(v);
+        if (!add || add->getOpcode() != Instruction::Add) {
+            return -1;
+        }
+
+        for (unsigned i = 0; i < 2; i++) {
+            auto zext = dyn_cast<ZExtInst>(add->getOperand(1 - i));
+            auto load = zext ? dyn_cast<LoadInst>(zext->getOperand(0)) : nullptr;
+            int64_t offset;
+            if (!isPktMemBase(add->getOperand(i)) || !load ||
+                decompose(load->getPointerOperand(), offset, DL) != ctx) {
+                continue;
+            }
+            if (offset == XDP_MD_DATA || offset == XDP_MD_DATA_END) {
+                return offset == XDP_MD_DATA_END;
+            }
+        }
+        return -1;
+    }
+
+    // v is computed from data or data_end (or from roots, arguments of a callee holding them)
+    static bool derivesFromPacket(Value *v, Argument *ctx, const std::set<Value *> &roots, const DataLayout &DL,
+                                  std::set<Value *> &visited)
+    {
+        if (!visited.insert(v).second) {
+            return false;
+        }
+        if (roots.count(v) || (ctx && packetRoot(v, ctx, DL) >= 0)) {
+            return true;
+        }
+
+        auto inst = dyn_cast<Instruction>(v);
+        if (!inst || isa<LoadInst>(inst) || isa<CallBase>(inst) || isa<AllocaInst>(inst)) {
+            return false;
+        }
+        return llvm::any_of(inst->operands(), [&](Value *op) { return derivesFromPacket(op, ctx, roots, DL, visited); });
+    }
+
+    static bool isHelper(const Function *callee, uint32_t id)
+    {
+        return callee && callee->getName() == utils::ext_func_sym(id);
+    }
+
+    /*
+     * The bytes of the shape are constants only if no one writes the packet or moves it.
+     * ctx is the argument of F holding the xdp_md (NULL if none), roots the ones holding packet pointers;
+     * the functions called with them are checked in turn.
+     */
+    static bool readsPacketOnly(Function &F, Argument *ctx, const std::set<Value *> &roots,
+                                std::set<Function *> &callers, std::string &reason)
+    {
+        const DataLayout &DL = F.getParent()->getDataLayout();
+        callers.insert(&F);
+
+        auto passesPacket = [&](Value *v) {
+            std::set<Value *> visited;
+            int64_t offset;
+            return derivesFromPacket(v, ctx, roots, DL, visited) || (ctx && decompose(v, offset, DL) == ctx);
+        };
+
+        for (auto &inst : instructions(F)) {
+            Value *ptr = nullptr;
+            Value *stored = nullptr;
+            if (auto store = dyn_cast<StoreInst>(&inst)) {
+                ptr = store->getPointerOperand();
+                stored = store->getValueOperand();
+            } else if (auto rmw = dyn_cast<AtomicRMWInst>(&inst)) {
+                ptr = rmw->getPointerOperand();
+                stored = rmw->getValOperand();
+            } else if (auto cmpxchg = dyn_cast<AtomicCmpXchgInst>(&inst)) {
+                ptr = cmpxchg->getPointerOperand();
+                stored = cmpxchg->getNewValOperand();
+            } else if (auto call = dyn_cast<CallBase>(&inst)) {
+                auto callee = call->getCalledFunction();
+                for (auto id : MOVING_HELPERS) {
+                    if (isHelper(callee, id)) {
+                        reason = "the program moves the packet (helper " + std::to_string(id) + ")";
+                        return false;
+                    }
+                }
+
+                if (auto memIntrinsic = dyn_cast<AnyMemIntrinsic>(call)) {
+                    ptr = memIntrinsic->getRawDest();
+                } else if (isa<IntrinsicInst>(call) && !call->mayWriteToMemory()) {
+                    continue;
+                } else if (callee && !callee->isDeclaration()) {
+                    // subprograms and outlined regions, checked with the arguments they get the packet from
+                    Argument *calleeCtx = nullptr;
+                    std::set<Value *> calleeRoots;
+                    for (unsigned i = 0; i < call->arg_size() && i < callee->arg_size(); i++) {
+                        int64_t offset;
+                        std::set<Value *> visited;
+                        if (ctx && decompose(call->getArgOperand(i), offset, DL) == ctx && !offset) {
+                            calleeCtx = callee->getArg(i);
+                        } else if (derivesFromPacket(call->getArgOperand(i), ctx, roots, DL, visited)) {
+                            calleeRoots.insert(callee->getArg(i));
+                        }
+                    }
+                    if ((calleeCtx || !calleeRoots.empty()) && !callers.count(callee) &&
+                        !readsPacketOnly(*callee, calleeCtx, calleeRoots, callers, reason)) {
+                        return false;
+                    }
+                    continue;
+                } else if (llvm::any_of(call->args(), passesPacket) &&
+                           std::none_of(std::begin(READ_ONLY_HELPERS), std::end(READ_ONLY_HELPERS),
+                                        [&](uint32_t id) { return isHelper(callee, id); })) {
+                    reason = "the program passes the packet to " +
+                             (callee ? callee->getName().str() : std::string("an indirect call"));
+                    return false;
+                }
+            }
+
+            if (ptr && passesPacket(ptr)) {
+                reason = "the program writes the packet";
+                return false;
+            }
+
+            // a pointer saved to memory (e.g. a stack slot left by SROA) is no longer followed once reloaded
+            if (stored && passesPacket(stored)) {
+                reason = "the program saves a packet or ctx pointer to memory";
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // len * scale + offset: an address relative to data (pointer) or a length
+    typedef struct len_term {
+        bool pointer;
+        bool scale;
+        int64_t offset;
+    } len_term;
+
+    static std::optional<len_term> lenTerm(Value *v, Argument *ctx, const DataLayout &DL)
+    {
+        if (auto c = dyn_cast<ConstantInt>(v)) {
+            return len_term{ false, false, c->getSExtValue() };
+        }
+
+        int64_t offset;
+        Value *root = decompose(v, offset, DL);
+        if (int kind = packetRoot(root, ctx, DL); kind >= 0) {
+            return len_term{ true, kind == 1, offset };
+        }
+
+        // data_end - data
+        auto sub = dyn_cast<BinaryOperator>(root);
+        int64_t endOffset, dataOffset;
+        if (sub && sub->getOpcode() == Instruction::Sub &&
+            packetRoot(decompose(sub->getOperand(0), endOffset, DL), ctx, DL) == 1 &&
+            packetRoot(decompose(sub->getOperand(1), dataOffset, DL), ctx, DL) == 0) {
+            return len_term{ false, true, offset + endOffset - dataOffset };
+        }
+        return std::nullopt;
+    }
+
+    // Bounds checks decided by the minimum length: data + off <=> data_end, len <=> N
+    static std::optional<bool> foldCompare(ICmpInst *cmp, uint32_t minLen, Argument *ctx, const DataLayout &DL)
+    {
+        Type *type = cmp->getOperand(0)->getType();
+        if (cmp->isSigned() || DL.getTypeSizeInBits(type) != 64) {
+            return std::nullopt;
+        }
+
+        auto lhs = lenTerm(cmp->getOperand(0), ctx, DL);
+        auto rhs = lenTerm(cmp->getOperand(1), ctx, DL);
+        if (!lhs || !rhs || lhs->pointer != rhs->pointer || lhs->offset < 0 || rhs->offset < 0 ||
+            (!lhs->pointer && !lhs->scale && !rhs->scale)) {
+            return std::nullopt;
+        }
+        if (lhs->scale == rhs->scale) {
+            lhs->scale = rhs->scale = false;
+        }
+
+        // The packet is in the u32 address space of xdp_md, nothing wraps in 64 bits
+        auto range = [&](const len_term &term) {
+            if (!term.scale) {
+                return ConstantRange(APInt(64, term.offset));
+            }
+            return ConstantRange(APInt(64, minLen + term.offset), APInt(64, (1ull << 32) + term.offset));
+        };
+
+        if (range(*lhs).icmp(cmp->getPredicate(), range(*rhs))) {
+            return true;
+        }
+        if (range(*lhs).icmp(cmp->getInversePredicate(), range(*rhs))) {
+            return false;
+        }
+        return std::nullopt;
+    }
+
+    // Value of an integer made of bytes of the shape, in the byte order of the target
+    static std::optional<APInt> shapeBytes(const std::map<uint32_t, uint8_t> &bytes, int64_t offset, unsigned size,
+                                           const DataLayout &DL)
+    {
+        APInt value(size * 8, 0);
+        for (unsigned i = 0; i < size; i++) {
+            auto it = bytes.find(offset + i);
+            if (offset < 0 || it == bytes.end()) {
+                return std::nullopt;
+            }
+            value |= APInt(size * 8, it->second) << (DL.isLittleEndian() ? i * 8 : (size - 1 - i) * 8);
+        }
+        return value;
+    }
+
+    // Loads of the bytes of the shape become constants and the bounds checks within min_len are dropped
+    static size_t specializeOnce(Function &F, const packet_shape &shape, const std::map<uint32_t, uint8_t> &bytes,
+                                 size_t &loads, size_t &checks)
+    {
+        const DataLayout &DL = F.getParent()->getDataLayout();
+        Argument *ctx = F.getArg(0);
+        std::vector<std::pair<Instruction *, Constant *>> folds;
+
+        for (auto &inst : instructions(F)) {
+            if (auto load = dyn_cast<LoadInst>(&inst); load && !load->isVolatile() &&
+                                                       load->getType()->isIntegerTy()) {
+                int64_t offset;
+                unsigned size = DL.getTypeStoreSize(load->getType());
+                if (load->getType()->getIntegerBitWidth() != size * 8 ||
+                    packetRoot(decompose(load->getPointerOperand(), offset, DL), ctx, DL) != 0) {
+                    continue;
+                }
+                if (auto value = shapeBytes(bytes, offset, size, DL)) {
+                    folds.emplace_back(load, ConstantInt::get(load->getType(), *value));
+                    loads++;
+                }
+            } else if (auto cmp = dyn_cast<ICmpInst>(&inst)) {
+                if (auto result = foldCompare(cmp, shape.min_len, ctx, DL)) {
+                    folds.emplace_back(cmp, ConstantInt::getBool(cmp->getType(), *result));
+                    checks++;
+                }
+            }
+        }
+
+        for (auto &[inst, value] : folds) {
+            inst->replaceAllUsesWith(value);
+        }
+        return folds.size();
+    }
+
+    bool emitShapeSpecialization(Module &module, const packet_shape &shape, std::string &reason)
+    {
+        auto &ctx = module.getContext();
+        const DataLayout &DL = module.getDataLayout();
+        Function *generic = module.getFunction("bpf_main");
+        GlobalVariable *pktMemBase = module.getNamedGlobal(PKT_MEM_BASE_SYM);
+        if (!pktMemBase) {
+            reason = "the program does not read the packet";
+            return false;
+        }
+
+        std::set<Function *> callers;
+        if (!readsPacketOnly(*generic, generic->getArg(0), {}, callers, reason)) {
+            return false;
+        }
+
+        std::map<uint32_t, uint8_t> bytes;
+        for (const auto &field : shape.fields) {
+            for (size_t i = 0; i < field.bytes.size(); i++) {
+                bytes[field.offset + i] = field.bytes[i];
+            }
+        }
+
+        ValueToValueMapTy vmap;
+        Function *fast = CloneFunction(generic, vmap);
+        fast->setName(SHAPE_FAST_SYM);
+        fast->setLinkage(GlobalValue::InternalLinkage);
+
+        size_t loads = 0, checks = 0;
+        for (int round = 0; round < SHAPE_MAX_ROUNDS && specializeOnce(*fast, shape, bytes, loads, checks); round++) {
+            simplifyFunction(*fast);
+        }
+        if (!loads) {
+            fast->eraseFromParent();
+            reason = "the program reads none of the fields of the shape";
+            return false;
+        }
+        SPDLOG_INFO("AOT: shape {}: {} loads and {} bounds checks folded", shape.spec, loads, checks);
+
+        // bpf_main checks the shape, its callers (batch, aliases) go through it
+        auto dispatch = Function::Create(generic->getFunctionType(), GlobalValue::ExternalLinkage, "", module);
+        generic->replaceAllUsesWith(dispatch);
+        dispatch->takeName(generic);
+        generic->setName(SHAPE_GENERIC_SYM);
+        generic->setLinkage(GlobalValue::InternalLinkage);
+
+        auto checkBB = BasicBlock::Create(ctx, "shape_len", dispatch);
+        auto fieldsBB = BasicBlock::Create(ctx, "shape_fields", dispatch);
+        auto fastBB = BasicBlock::Create(ctx, "shape_fast", dispatch);
+        auto genericBB = BasicBlock::Create(ctx, "shape_generic", dispatch);
+        MDBuilder mdBuilder(ctx);
+        IRBuilder<> builder(checkBB);
+
+        // data + min_len <= data_end
+        Value *base = builder.CreateLoad(builder.getInt64Ty(), pktMemBase);
+        auto ctxField = [&](int64_t offset) {
+            Value *field = builder.CreateLoad(builder.getInt32Ty(),
+                                              builder.CreateConstGEP1_64(builder.getInt8Ty(), dispatch->getArg(0), offset));
+            return builder.CreateAdd(base, builder.CreateZExt(field, builder.getInt64Ty()));
+        };
+        Value *data = ctxField(XDP_MD_DATA);
+        Value *dataEnd = ctxField(XDP_MD_DATA_END);
+        builder.CreateCondBr(builder.CreateICmpULE(builder.CreateAdd(data, builder.getInt64(shape.min_len)), dataEnd),
+                             fieldsBB, genericBB, mdBuilder.createBranchWeights(HOT_BRANCH_WEIGHT, COLD_BRANCH_WEIGHT));
+
+        // the bytes of the shape, packets have no alignment
+        builder.SetInsertPoint(fieldsBB);
+        Value *match = nullptr;
+        for (const auto &field : shape.fields) {
+            auto type = builder.getIntNTy(field.bytes.size() * 8);
+            Value *addr = builder.CreateIntToPtr(builder.CreateAdd(data, builder.getInt64(field.offset)),
+                                                 PointerType::getUnqual(ctx));
+            Value *value = builder.CreateAlignedLoad(type, addr, Align(1));
+            auto expected = shapeBytes(bytes, field.offset, field.bytes.size(), DL);
+            Value *equal = builder.CreateICmpEQ(value, ConstantInt::get(type, *expected));
+            match = match ? builder.CreateAnd(match, equal) : equal;
+        }
+        builder.CreateCondBr(match, fastBB, genericBB, mdBuilder.createBranchWeights(HOT_BRANCH_WEIGHT, COLD_BRANCH_WEIGHT));
+
+        std::vector<Value *> args;
+        for (auto &arg : dispatch->args()) {
+            args.push_back(&arg);
+        }
+        for (auto [bb, target] : { std::make_pair(fastBB, fast), std::make_pair(genericBB, generic) }) {
+            builder.SetInsertPoint(bb);
+            auto call = builder.CreateCall(target, args);
+            call->setTailCall();
+            builder.CreateRet(call);
+        }
+        return true;
+    }
+}
@@ -0,0 +1,61 @@
+//
+// Created by Davide Collovigh on 19/10/26.
+//
+
+#ifndef EBPF_LLVM_JIT_SHAPE_H
+#define EBPF_LLVM_JIT_SHAPE_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <llvm/IR/Module.h>
+
+// bpf_main specialized for the packets of the shape
+#define SHAPE_FAST_SYM "bpf_main_shape"
+
+// bpf_main as compiled without a shape, run by the packets failing the shape check
+#define SHAPE_GENERIC_SYM "bpf_main_generic"
+
+namespace ebpf_llvm_jit::jit {
+
+    // Bytes [offset, offset + bytes.size()) of every packet of the shape
+    typedef struct shape_field {
+        uint32_t offset;
+        std::vector<uint8_t> bytes;     // in packet (network) order
+    } shape_field;
+
+    /**
+     * @brief headers of the dominant packets (e.g. IPv4 without options in untagged Ethernet)
+     */
+    typedef struct packet_shape {
+        std::string spec;
+        std::vector<shape_field> fields;
+        uint32_t min_len = 0;           // the headers of the shape are all in the packet
+    } packet_shape;
+
+    /**
+     * @brief parses a comma separated list of header fields
+     *
+     * vlan=0|1 (802.1Q tags), ethertype=N, ihl=N (IPv4 only), proto=N (IPv4 or IPv6 next header),
+     * e.g. "vlan=0,ethertype=0x0800,ihl=5,proto=6" for TCP in IPv4 without options.
+     *
+     * @return false (with error set) for an unknown field, a value out of range or a field of a missing header
+     */
+    bool parsePacketShape(const std::string &spec, packet_shape &shape, std::string &error);
+
+    /**
+     * @brief compiles bpf_main once more for the packets of the shape, behind a check of the shape
+     *
+     * The copy loads the bytes of the shape as constants and drops the bounds checks the minimum
+     * length satisfies, then is simplified again, until the header offsets depending on those bytes
+     * are constants too. bpf_main checks the length and the bytes of the shape, and jumps to
+     * SHAPE_FAST_SYM or to SHAPE_GENERIC_SYM (the original code). Must run on the simplified module.
+     *
+     * @return false (with reason set, module unchanged) if the program writes or moves the packet, saves a packet
+     *         or ctx pointer to memory, or reads none of the fields of the shape
+     */
+    bool emitShapeSpecialization(llvm::Module &module, const packet_shape &shape, std::string &reason);
+}
+
+#endif //EBPF_LLVM_JIT_SHAPE_H
@@ -0,0 +1,26 @@
+//
+// Created by Davide Collovigh on 19/10/26.
+//
+
+#ifndef EBPF_LLVM_JIT_SOURCE_LINE_H
+#define EBPF_LLVM_JIT_SOURCE_LINE_H
+
+#include <cstdint>
+#include <string>
+
+namespace ebpf_llvm_jit::jit {
+
+    /**
+     * @brief BTF line info record of a program: the instructions from pc up to the
+     * next record were compiled from line of file
+     */
+    typedef struct source_line {
+        uint32_t pc;            // index of the first instruction inside the program
+        std::string file;       // path of the C source, as recorded by clang
+        uint32_t line;
+        uint32_t column;
+    } source_line;
+
+}
+
+#endif //EBPF_LLVM_JIT_SOURCE_LINE_H
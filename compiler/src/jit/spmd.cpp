@@ -0,0 +1,452 @@
+//
+// Created by Davide Collovigh on 19/10/26.
+//
+
+#include "spmd.h"
+
+#include <map>
+#include <utility>
+
+#include <llvm/ADT/PostOrderIterator.h>
+#include <llvm/IR/CFG.h>
+#include <llvm/IR/IRBuilder.h>
+#include <llvm/IR/Instructions.h>
+#include <llvm/IR/IntrinsicInst.h>
+
+#include "xdp_md.h"
+#include "spdlog/spdlog.h"
+
+using namespace llvm;
+
+namespace ebpf_llvm_jit::jit {
+
+    // Intrinsics widened to their vector version, all operands are lane values
+    static bool isWidenableIntrinsic(Intrinsic::ID id)
+    {
+        switch (id) {
+            case Intrinsic::bswap:
+            case Intrinsic::ctpop:
+            case Intrinsic::umin:
+            case Intrinsic::umax:
+            case Intrinsic::smin:
+            case Intrinsic::smax:
+                return true;
+            default:
+                return false;
+        }
+    }
+
+    // Intrinsics without effect on the lane values
+    static bool isDroppableIntrinsic(Intrinsic::ID id)
+    {
+        switch (id) {
+            case Intrinsic::assume:
+            case Intrinsic::lifetime_start:
+            case Intrinsic::lifetime_end:
+            case Intrinsic::dbg_declare:
+            case Intrinsic::dbg_value:
+                return true;
+            default:
+                return false;
+        }
+    }
+
+    // If-converts bpf_main into a single block of vector code, one packet per lane
+    class SpmdWidener {
+        Function *func;
+        IRBuilder<> &builder;
+        ElementCount lanes;
+
+        std::map<Value *, Value *> values;
+        std::map<std::pair<BasicBlock *, BasicBlock *>, Value *> edgeMasks;
+
+    public:
+        // Lanes that reached a block that cannot be widened
+        Value *fallback;
+        bool hasFallback = false;
+
+        // Return value of each lane
+        Value *result;
+
+        SpmdWidener(Function *func, IRBuilder<> &builder)
+            : func(func), builder(builder), lanes(ElementCount::getScalable(SPMD_LANES_PER_VSCALE))
+        {
+            fallback = ConstantAggregateZero::get(maskTy());
+            result = ConstantAggregateZero::get(VectorType::get(func->getReturnType(), lanes));
+        }
+
+        VectorType *maskTy()
+        {
+            return VectorType::get(builder.getInt1Ty(), lanes);
+        }
+
+        static bool isLaneType(Type *ty)
+        {
+            return ty->isIntegerTy() || ty->isPointerTy();
+        }
+
+        VectorType *widen(Type *ty)
+        {
+            return VectorType::get(ty, lanes);
+        }
+
+        void bind(Value *scalar, Value *vector)
+        {
+            values[scalar] = vector;
+        }
+
+        Value *get(Value *v)
+        {
+            if (auto it = values.find(v); it != values.end()) {
+                return it->second;
+            }
+
+            if (auto c = dyn_cast<Constant>(v)) {
+                return ConstantVector::getSplat(lanes, c);
+            }
+
+            // Defined in a block only reached by fallback lanes: the value is never selected
+            return PoisonValue::get(widen(v->getType()));
+        }
+
+        bool isSupported(const Instruction &inst)
+        {
+            if (!inst.getType()->isVoidTy() && !isLaneType(inst.getType())) {
+                return false;
+            }
+
+            if (auto intr = dyn_cast<IntrinsicInst>(&inst)) {
+                return isWidenableIntrinsic(intr->getIntrinsicID()) || isDroppableIntrinsic(intr->getIntrinsicID());
+            }
+
+            if (auto load = dyn_cast<LoadInst>(&inst)) {
+                return load->isSimple();
+            }
+
+            return isa<BranchInst>(inst) || isa<BinaryOperator>(inst) || isa<ICmpInst>(inst) || isa<SelectInst>(inst) ||
+                   isa<CastInst>(inst) || isa<GetElementPtrInst>(inst) || isa<PHINode>(inst) ||
+                   isa<FreezeInst>(inst) || isa<ReturnInst>(inst) || isa<UnreachableInst>(inst);
+        }
+
+        bool isSupported(const BasicBlock &bb)
+        {
+            for (const auto &inst : bb) {
+                if (!isSupported(inst)) {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        void addEdge(BasicBlock *from, BasicBlock *to, Value *mask)
+        {
+            auto key = std::make_pair(from, to);
+            if (auto it = edgeMasks.find(key); it != edgeMasks.end()) {
+                mask = builder.CreateLogicalOr(it->second, mask);
+            }
+            edgeMasks[key] = mask;
+        }
+
+        // Lanes entering bb, false for lanes that are not active
+        Value *blockMask(BasicBlock *bb, Value *entryMask)
+        {
+            if (bb == &func->getEntryBlock()) {
+                return entryMask;
+            }
+
+            Value *mask = nullptr;
+            for (auto pred : predecessors(bb)) {
+                if (auto it = edgeMasks.find({pred, bb}); it != edgeMasks.end()) {
+                    mask = mask ? builder.CreateLogicalOr(mask, it->second) : it->second;
+                }
+            }
+
+            return mask ? mask : ConstantAggregateZero::get(maskTy());
+        }
+
+        Value *widenPhi(PHINode *phi, BasicBlock *bb)
+        {
+            Value *v = PoisonValue::get(widen(phi->getType()));
+
+            for (unsigned i = 0; i < phi->getNumIncomingValues(); i++) {
+                auto it = edgeMasks.find({phi->getIncomingBlock(i), bb});
+                if (it != edgeMasks.end()) {
+                    v = builder.CreateSelect(it->second, get(phi->getIncomingValue(i)), v);
+                }
+            }
+            return v;
+        }
+
+        Value *widenInst(Instruction &inst, Value *mask)
+        {
+            if (auto binOp = dyn_cast<BinaryOperator>(&inst)) {
+                Value *rhs = get(binOp->getOperand(1));
+
+                // Inactive lanes must not divide by 0
+                if (binOp->isIntDivRem()) {
+                    rhs = builder.CreateSelect(mask, rhs, ConstantVector::getSplat(lanes, ConstantInt::get(binOp->getType(), 1)));
+                }
+
+                auto v = builder.CreateBinOp(binOp->getOpcode(), get(binOp->getOperand(0)), rhs);
+                if (auto vInst = dyn_cast<Instruction>(v)) {
+                    vInst->copyIRFlags(binOp);
+                }
+                return v;
+            }
+
+            if (auto cmp = dyn_cast<ICmpInst>(&inst)) {
+                return builder.CreateICmp(cmp->getPredicate(), get(cmp->getOperand(0)), get(cmp->getOperand(1)));
+            }
+
+            if (auto sel = dyn_cast<SelectInst>(&inst)) {
+                return builder.CreateSelect(get(sel->getCondition()), get(sel->getTrueValue()), get(sel->getFalseValue()));
+            }
+
+            if (auto cast = dyn_cast<CastInst>(&inst)) {
+                return builder.CreateCast(cast->getOpcode(), get(cast->getOperand(0)), widen(cast->getDestTy()));
+            }
+
+            if (auto freeze = dyn_cast<FreezeInst>(&inst)) {
+                return builder.CreateFreeze(get(freeze->getOperand(0)));
+            }
+
+            if (auto gep = dyn_cast<GetElementPtrInst>(&inst)) {
+                // Constant indices stay scalar (required for struct fields)
+                std::vector<Value *> indices;
+                for (auto &idx : gep->indices()) {
+                    indices.push_back(isa<ConstantInt>(idx) ? idx.get() : get(idx));
+                }
+
+                Value *base = get(gep->getPointerOperand());
+                return gep->isInBounds()
+                       ? builder.CreateInBoundsGEP(gep->getSourceElementType(), base, indices)
+                       : builder.CreateGEP(gep->getSourceElementType(), base, indices);
+            }
+
+            if (auto load = dyn_cast<LoadInst>(&inst)) {
+                // Globals (e.g. ebpf_pkt_mem_base) are the same for every lane and always valid
+                if (isa<Constant>(load->getPointerOperand())) {
+                    auto v = builder.CreateAlignedLoad(load->getType(), load->getPointerOperand(), load->getAlign());
+                    return builder.CreateVectorSplat(lanes, v);
+                }
+
+                return builder.CreateMaskedGather(widen(load->getType()), get(load->getPointerOperand()),
+                                                  load->getAlign(), mask);
+            }
+
+            auto intr = cast<IntrinsicInst>(&inst);
+            if (isDroppableIntrinsic(intr->getIntrinsicID())) {
+                return nullptr;
+            }
+
+            std::vector<Value *> args;
+            for (auto &arg : intr->args()) {
+                args.push_back(get(arg));
+            }
+            return builder.CreateIntrinsic(intr->getIntrinsicID(), { widen(intr->getType()) }, args);
+        }
+
+        void widenTerminator(BasicBlock *bb, Value *mask)
+        {
+            auto term = bb->getTerminator();
+
+            if (auto br = dyn_cast<BranchInst>(term)) {
+                if (br->isUnconditional()) {
+                    addEdge(bb, br->getSuccessor(0), mask);
+                    return;
+                }
+
+                Value *cond = get(br->getCondition());
+                addEdge(bb, br->getSuccessor(0), builder.CreateLogicalAnd(mask, cond));
+                addEdge(bb, br->getSuccessor(1), builder.CreateLogicalAnd(mask, builder.CreateNot(cond)));
+                return;
+            }
+
+            if (auto ret = dyn_cast<ReturnInst>(term)) {
+                result = builder.CreateSelect(mask, get(ret->getReturnValue()), result);
+            }
+        }
+
+        /**
+         * @return false if the function cannot be widened at all
+         */
+        bool check()
+        {
+            ReversePostOrderTraversal<Function *> rpo(func);
+
+            // An acyclic CFG is required: in reverse post order every edge must go forward
+            std::map<BasicBlock *, size_t> order;
+            for (auto bb : rpo) {
+                order[bb] = order.size();
+            }
+            for (auto bb : rpo) {
+                for (auto succ : successors(bb)) {
+                    if (order[succ] <= order[bb]) {
+                        SPDLOG_WARN("SPMD: {} has loops, only the scalar path is emitted", func->getName().str());
+                        return false;
+                    }
+                }
+            }
+
+            if (!isSupported(func->getEntryBlock())) {
+                SPDLOG_WARN("SPMD: entry block of {} cannot be vectorized, only the scalar path is emitted", func->getName().str());
+                return false;
+            }
+
+            return true;
+        }
+
+        void run(Value *entryMask)
+        {
+            ReversePostOrderTraversal<Function *> rpo(func);
+
+            for (auto bb : rpo) {
+                Value *mask = blockMask(bb, entryMask);
+
+                if (!isSupported(*bb)) {
+                    SPDLOG_DEBUG("SPMD: block {} falls back to the scalar path", bb->getName().str());
+                    fallback = builder.CreateLogicalOr(fallback, mask);
+                    hasFallback = true;
+                    continue;
+                }
+
+                for (auto &inst : *bb) {
+                    if (inst.isTerminator()) {
+                        break;
+                    }
+
+                    Value *v = isa<PHINode>(inst) ? widenPhi(cast<PHINode>(&inst), bb) : widenInst(inst, mask);
+                    if (v) {
+                        bind(&inst, v);
+                    }
+                }
+
+                widenTerminator(bb, mask);
+            }
+        }
+    };
+
+    static Value *emitCtxAddr(IRBuilder<> &builder, Value *ctxArr, Value *idx)
+    {
+        return builder.CreateInBoundsGEP(builder.getPtrTy(), ctxArr, idx);
+    }
+
+    // verdicts[idx] = bpf_main(ctx[idx], sizeof(struct xdp_md))
+    static void emitScalarCall(IRBuilder<> &builder, Function *bpfMain, Value *ctxArr, Value *verdicts, Value *idx)
+    {
+        Value *ctx = builder.CreateLoad(builder.getPtrTy(), emitCtxAddr(builder, ctxArr, idx));
+        Value *ret = builder.CreateCall(bpfMain, { ctx, builder.getInt64(XDP_MD_SIZE) });
+        builder.CreateStore(builder.CreateTrunc(ret, builder.getInt32Ty()),
+                            builder.CreateInBoundsGEP(builder.getInt32Ty(), verdicts, idx));
+    }
+
+    Function *emitSpmdEntry(Module &module, Function *bpfMain)
+    {
+        auto &ctx = module.getContext();
+        IRBuilder<> builder(ctx);
+
+        auto func = Function::Create(
+                FunctionType::get(builder.getVoidTy(),
+                                  { builder.getPtrTy(), builder.getInt64Ty(), builder.getPtrTy() },
+                                  false),
+                Function::ExternalLinkage, SPMD_ENTRY_SYM, module);
+
+        Value *ctxArr = func->getArg(0);
+        Value *n = func->getArg(1);
+        Value *verdicts = func->getArg(2);
+
+        auto entryBlk = BasicBlock::Create(ctx, "entry", func);
+        auto scalarCheckBlk = BasicBlock::Create(ctx, "scalar_check", func);
+        auto scalarBodyBlk = BasicBlock::Create(ctx, "scalar_body", func);
+        auto exitBlk = BasicBlock::Create(ctx, "exit", func);
+
+        auto lanes = ElementCount::getScalable(SPMD_LANES_PER_VSCALE);
+        builder.SetInsertPoint(entryBlk);
+
+        SpmdWidener widener(bpfMain, builder);
+        bool vectorized = widener.check();
+
+        // First packet of the scalar loop
+        Value *scalarStart = builder.getInt64(0);
+        BasicBlock *scalarPred = entryBlk;
+
+        if (vectorized) {
+            auto vecCheckBlk = BasicBlock::Create(ctx, "vec_check", func, scalarCheckBlk);
+            auto vecBodyBlk = BasicBlock::Create(ctx, "vec_body", func, scalarCheckBlk);
+            auto vecLatchBlk = BasicBlock::Create(ctx, "vec_latch", func, scalarCheckBlk);
+
+            // vl = VLEN / 32
+            Value *vl = builder.CreateMul(builder.CreateVScale(builder.getInt64(1)), builder.getInt64(SPMD_LANES_PER_VSCALE), "vl");
+            builder.CreateBr(vecCheckBlk);
+
+            // while (n - i >= vl)
+            builder.SetInsertPoint(vecCheckBlk);
+            auto i = builder.CreatePHI(builder.getInt64Ty(), 2, "i");
+            i->addIncoming(builder.getInt64(0), entryBlk);
+            builder.CreateCondBr(builder.CreateICmpUGE(builder.CreateSub(n, i), vl), vecBodyBlk, scalarCheckBlk);
+
+            // vector path on ctx[i, i + vl)
+            builder.SetInsertPoint(vecBodyBlk);
+            Value *ctxVec = builder.CreateAlignedLoad(VectorType::get(builder.getPtrTy(), lanes),
+                                                      emitCtxAddr(builder, ctxArr, i), Align(8));
+
+            widener.bind(bpfMain->getArg(0), ctxVec);
+            widener.bind(bpfMain->getArg(1), ConstantVector::getSplat(lanes, builder.getInt64(XDP_MD_SIZE)));
+            widener.run(ConstantInt::getTrue(VectorType::get(builder.getInt1Ty(), lanes)));
+
+            builder.CreateAlignedStore(builder.CreateTrunc(widener.result, VectorType::get(builder.getInt32Ty(), lanes)),
+                                       builder.CreateInBoundsGEP(builder.getInt32Ty(), verdicts, i), Align(4));
+
+            if (widener.hasFallback) {
+                // re-run the lanes that reached a block not vectorized
+                auto fallbackBlk = BasicBlock::Create(ctx, "fallback", func, vecLatchBlk);
+                auto fallbackCallBlk = BasicBlock::Create(ctx, "fallback_call", func, vecLatchBlk);
+                auto fallbackNextBlk = BasicBlock::Create(ctx, "fallback_next", func, vecLatchBlk);
+                Value *fallbackMask = widener.fallback;
+                builder.CreateCondBr(builder.CreateOrReduce(fallbackMask), fallbackBlk, vecLatchBlk);
+
+                builder.SetInsertPoint(fallbackBlk);
+                auto lane = builder.CreatePHI(builder.getInt64Ty(), 2, "lane");
+                lane->addIncoming(builder.getInt64(0), vecBodyBlk);
+                builder.CreateCondBr(builder.CreateExtractElement(fallbackMask, lane), fallbackCallBlk, fallbackNextBlk);
+
+                builder.SetInsertPoint(fallbackCallBlk);
+                emitScalarCall(builder, bpfMain, ctxArr, verdicts, builder.CreateAdd(i, lane));
+                builder.CreateBr(fallbackNextBlk);
+
+                builder.SetInsertPoint(fallbackNextBlk);
+                Value *nextLane = builder.CreateAdd(lane, builder.getInt64(1));
+                lane->addIncoming(nextLane, fallbackNextBlk);
+                builder.CreateCondBr(builder.CreateICmpULT(nextLane, vl), fallbackBlk, vecLatchBlk);
+            } else {
+                builder.CreateBr(vecLatchBlk);
+            }
+
+            builder.SetInsertPoint(vecLatchBlk);
+            i->addIncoming(builder.CreateAdd(i, vl), vecLatchBlk);
+            builder.CreateBr(vecCheckBlk);
+
+            scalarStart = i;
+            scalarPred = vecCheckBlk;
+        } else {
+            builder.CreateBr(scalarCheckBlk);
+        }
+
+        // scalar loop on the remaining packets
+        builder.SetInsertPoint(scalarCheckBlk);
+        auto j = builder.CreatePHI(builder.getInt64Ty(), 2, "j");
+        j->addIncoming(scalarStart, scalarPred);
+        builder.CreateCondBr(builder.CreateICmpULT(j, n), scalarBodyBlk, exitBlk);
+
+        builder.SetInsertPoint(scalarBodyBlk);
+        emitScalarCall(builder, bpfMain, ctxArr, verdicts, j);
+        j->addIncoming(builder.CreateAdd(j, builder.getInt64(1)), scalarBodyBlk);
+        builder.CreateBr(scalarCheckBlk);
+
+        builder.SetInsertPoint(exitBlk);
+        builder.CreateRetVoid();
+
+        SPDLOG_INFO("Emitted {} [vectorized: {}, scalar fallback: {}]", SPMD_ENTRY_SYM, vectorized, widener.hasFallback);
+        return func;
+    }
+}
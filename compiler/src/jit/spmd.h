@@ -0,0 +1,33 @@
+//
+// Created by Davide Collovigh on 19/10/26.
+//
+
+#ifndef EBPF_LLVM_JIT_SPMD_H
+#define EBPF_LLVM_JIT_SPMD_H
+
+#include <llvm/IR/Function.h>
+#include <llvm/IR/Module.h>
+
+// void bpf_main_spmd(struct xdp_md *ctx[], uint64_t n, int verdicts[])
+#define SPMD_ENTRY_SYM "bpf_main_spmd"
+
+// One packet per 64 bit lane with LMUL 2: vscale * 2 = VLEN / 32 packets per iteration
+#define SPMD_LANES_PER_VSCALE 2
+
+namespace ebpf_llvm_jit::jit {
+
+    /**
+     * @brief emits bpf_main_spmd(), running bpf_main on VLEN / 32 packets at a time with RVV
+     *
+     * The (already simplified) bpf_main is if-converted and widened: each packet is a lane,
+     * branches become lane masks and loads become masked gathers, so lanes that
+     * failed a bounds check never touch memory.
+     * Lanes reaching a block that cannot be widened (helper calls, stores, ...) are re-run
+     * by the scalar bpf_main, since the vector path has no side effects.
+     * Programs with loops or local calls are only run by the scalar loop.
+     * The module must be compiled with +v.
+     */
+    llvm::Function *emitSpmdEntry(llvm::Module &module, llvm::Function *bpfMain);
+}
+
+#endif //EBPF_LLVM_JIT_SPMD_H
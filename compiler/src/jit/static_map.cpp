@@ -0,0 +1,114 @@
+//
+// Created by Davide Collovigh on 19/10/26.
+//
+
+#include "static_map.h"
+
+#include <llvm/IR/Constants.h>
+#include <llvm/IR/IRBuilder.h>
+
+#include "spdlog/spdlog.h"
+
+using namespace llvm;
+
+namespace ebpf_llvm_jit::jit {
+
+    static uint64_t roundUp8(uint64_t size)
+    {
+        return (size + 7) & ~7ull;
+    }
+
+    uint64_t staticMapDataSize(const static_map &map)
+    {
+        if (map.type == STATIC_MAP_TYPE_ARRAY) {
+            return roundUp8(map.value_size) * map.max_entries;
+        }
+        // lock word, then { uint64_t state; key; value } slots
+        return 8 + (8 + roundUp8(map.key_size) + roundUp8(map.value_size)) * map.max_entries;
+    }
+
+    GlobalVariable *emitStaticMap(Module &module, const static_map &map)
+    {
+        auto &ctx = module.getContext();
+        auto i32Ty = Type::getInt32Ty(ctx);
+
+        auto dataTy = ArrayType::get(Type::getInt8Ty(ctx), staticMapDataSize(map));
+        auto data = new GlobalVariable(module, dataTy, false, GlobalValue::WeakAnyLinkage,
+                                       ConstantAggregateZero::get(dataTy),
+                                       STATIC_MAP_SYM_PREFIX + map.name + STATIC_MAP_DATA_SUFFIX);
+        data->setSection(STATIC_MAP_SECTION_PREFIX + map.name);
+        data->setAlignment(Align(STATIC_MAP_ALIGN));
+
+        // { uint32_t type, key_size, value_size, max_entries; void *data }
+        auto descTy = StructType::get(ctx, { i32Ty, i32Ty, i32Ty, i32Ty, PointerType::getUnqual(Type::getInt8Ty(ctx)) });
+        auto descInit = ConstantStruct::get(
+                descTy, { ConstantInt::get(i32Ty, map.type),
+                          ConstantInt::get(i32Ty, map.key_size),
+                          ConstantInt::get(i32Ty, map.value_size),
+                          ConstantInt::get(i32Ty, map.max_entries),
+                          ConstantExpr::getPointerCast(data, PointerType::getUnqual(Type::getInt8Ty(ctx))) });
+
+        auto desc = new GlobalVariable(module, descTy, true, GlobalValue::WeakODRLinkage, descInit,
+                                       STATIC_MAP_SYM_PREFIX + map.name);
+        desc->setAlignment(Align(8));
+
+        SPDLOG_INFO("Static map {} [type: {}, key_size: {}, value_size: {}, max_entries: {}, storage: {} bytes]",
+                    map.name, map.type, map.key_size, map.value_size, map.max_entries, staticMapDataSize(map));
+        return desc;
+    }
+
+    Function *emitStaticMapLookup(Module &module, FunctionType *helperFuncTy, Function *fallback,
+                                  const std::map<std::string, static_map> &maps,
+                                  const std::map<std::string, GlobalVariable *> &descs)
+    {
+        auto &ctx = module.getContext();
+        auto func = Function::Create(helperFuncTy, Function::InternalLinkage, "__static_map_lookup_elem", module);
+        func->addFnAttr(Attribute::AlwaysInline);
+
+        Value *mapArg = func->getArg(0);
+        Value *keyArg = func->getArg(1);
+
+        auto currBlk = BasicBlock::Create(ctx, "entry", func);
+        IRBuilder<> builder(currBlk);
+
+        for (const auto &[name, map] : maps) {
+            if (map.type != STATIC_MAP_TYPE_ARRAY) {
+                continue;
+            }
+
+            auto data = module.getGlobalVariable(STATIC_MAP_SYM_PREFIX + name + STATIC_MAP_DATA_SUFFIX);
+            auto foundBlk = BasicBlock::Create(ctx, "found_" + name, func);
+            auto nextBlk = BasicBlock::Create(ctx, "next_" + name, func);
+
+            builder.CreateCondBr(
+                    builder.CreateICmpEQ(mapArg, builder.CreatePtrToInt(descs.at(name), builder.getInt64Ty())),
+                    foundBlk, nextBlk);
+
+            // key is an u32 index, out of bound keys return NULL
+            builder.SetInsertPoint(foundBlk);
+            auto key = builder.CreateLoad(builder.getInt32Ty(), builder.CreateIntToPtr(keyArg, builder.getPtrTy()));
+            auto elem = builder.CreateInBoundsGEP(
+                    builder.getInt8Ty(), data,
+                    { builder.CreateMul(builder.CreateZExt(key, builder.getInt64Ty()),
+                                        builder.getInt64(roundUp8(map.value_size))) });
+            builder.CreateRet(builder.CreateSelect(
+                    builder.CreateICmpULT(key, builder.getInt32(map.max_entries)),
+                    builder.CreatePtrToInt(elem, builder.getInt64Ty()),
+                    builder.getInt64(0)));
+
+            builder.SetInsertPoint(nextBlk);
+        }
+
+        if (fallback) {
+            std::vector<Value *> args;
+            for (auto &arg : func->args()) {
+                args.push_back(&arg);
+            }
+            builder.CreateRet(builder.CreateCall(helperFuncTy, fallback, args));
+        } else {
+            builder.CreateRet(builder.getInt64(0));
+        }
+
+        return func;
+    }
+}
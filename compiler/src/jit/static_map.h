@@ -0,0 +1,74 @@
+//
+// Created by Davide Collovigh on 19/10/26.
+//
+
+#ifndef EBPF_LLVM_JIT_STATIC_MAP_H
+#define EBPF_LLVM_JIT_STATIC_MAP_H
+
+#include <cstdint>
+#include <map>
+#include <string>
+
+#include <llvm/IR/Function.h>
+#include <llvm/IR/GlobalVariable.h>
+#include <llvm/IR/Module.h>
+
+// Map types with static storage (see enum bpf_map_type in linux/bpf.h)
+#define STATIC_MAP_TYPE_HASH 1
+#define STATIC_MAP_TYPE_ARRAY 2
+#define STATIC_MAP_TYPE_LRU_HASH 9
+
+// const struct bpf_map bpf_map_<map>, the address held by the map pointers of the programs
+#define STATIC_MAP_SYM_PREFIX "bpf_map_"
+
+// Storage of the elements, bpf_map_<map>_data in .bss.bpf_map.<map>
+#define STATIC_MAP_DATA_SUFFIX "_data"
+#define STATIC_MAP_SECTION_PREFIX ".bss.bpf_map."
+
+// Elements start on a cache line
+#define STATIC_MAP_ALIGN 64
+
+namespace ebpf_llvm_jit::jit {
+
+    /**
+     * @brief map of the eBPF ELF (from its .maps BTF) with storage allocated at build time
+     *
+     * Each object using the map defines the same descriptor and storage as weak symbols, so the
+     * programs of a build share them. ARRAY elements are value_size rounded up to 8 bytes, as in
+     * the kernel; HASH and LRU_HASH maps get a lock word and max_entries slots of a state word,
+     * key and value (rounded up to 8 bytes), the layout of the helpers of the runtime (bpf_maps.c).
+     */
+    typedef struct static_map {
+        std::string name;       // name of the map symbol in the eBPF ELF
+        uint32_t type;
+        uint32_t key_size;
+        uint32_t value_size;
+        uint32_t max_entries;
+    } static_map;
+
+    /**
+     * @brief bytes of storage of the elements of a map
+     */
+    uint64_t staticMapDataSize(const static_map &map);
+
+    /**
+     * @brief defines the storage and the descriptor (struct bpf_map of bpf_helpers.h) of a map
+     *
+     * @return the descriptor, whose address is the map pointer passed to the helpers
+     */
+    llvm::GlobalVariable *emitStaticMap(llvm::Module &module, const static_map &map);
+
+    /**
+     * @brief bpf_map_lookup_elem() on the ARRAY maps as index arithmetic on their storage
+     *
+     * Out of bound keys return NULL, other maps are passed to fallback (the helper of the runtime).
+     * The function is always inlined: with a constant map pointer the compare folds and
+     * with a bounded key the lookup is a multiply and add.
+     */
+    llvm::Function *emitStaticMapLookup(llvm::Module &module, llvm::FunctionType *helperFuncTy,
+                                        llvm::Function *fallback,
+                                        const std::map<std::string, static_map> &maps,
+                                        const std::map<std::string, llvm::GlobalVariable *> &descs);
+}
+
+#endif //EBPF_LLVM_JIT_STATIC_MAP_H
@@ -0,0 +1,156 @@
+//
+// Created by Davide Collovigh on 19/10/26.
+//
+
+#include "tail_call.h"
+
+#include <vector>
+
+#include <llvm/IR/Constants.h>
+#include <llvm/IR/Instructions.h>
+
+#include "target.h"
+#include "spdlog/spdlog.h"
+
+using namespace llvm;
+
+namespace ebpf_llvm_jit::jit {
+
+    // Offset of progs[] in struct bpf_prog_array
+    static const uint64_t PROG_ARRAY_HEADER_SIZE = 8;
+
+    // One counter per hart, shared by all the objects of the build
+    static Value *tailCallCntSlot(IRBuilder<> &builder, const intrinsics_config &config)
+    {
+        Module &module = *builder.GetInsertBlock()->getModule();
+
+        // No hart id outside RISC-V: one counter per thread of the pipeline
+        if (!isRiscvModule(module)) {
+            auto cnt = module.getGlobalVariable(TAIL_CALL_CNT_SYM);
+            if (!cnt) {
+                cnt = new GlobalVariable(module, builder.getInt64Ty(), false, GlobalValue::WeakAnyLinkage,
+                                         builder.getInt64(0), TAIL_CALL_CNT_SYM, nullptr,
+                                         GlobalValue::GeneralDynamicTLSModel);
+                cnt->setAlignment(Align(8));
+            }
+            return cnt;
+        }
+
+        auto cntTy = ArrayType::get(builder.getInt64Ty(), INTRINSICS_MAX_HARTS);
+
+        auto cnt = module.getGlobalVariable(TAIL_CALL_CNT_SYM);
+        if (!cnt) {
+            cnt = new GlobalVariable(module, cntTy, false, GlobalValue::WeakAnyLinkage,
+                                     ConstantAggregateZero::get(cntTy), TAIL_CALL_CNT_SYM);
+            cnt->setAlignment(Align(8));
+        }
+
+        return builder.CreateInBoundsGEP(
+                cntTy, cnt,
+                { builder.getInt64(0),
+                  builder.CreateAnd(emitHartId(builder, config), builder.getInt64(INTRINSICS_MAX_HARTS - 1)) });
+    }
+
+    GlobalVariable *emitProgArray(Module &module, FunctionType *progTy, const prog_array &array)
+    {
+        auto &ctx = module.getContext();
+        auto progPtrTy = PointerType::getUnqual(progTy);
+        auto progsTy = ArrayType::get(progPtrTy, array.max_entries);
+        auto tableTy = StructType::get(ctx, { Type::getInt64Ty(ctx), progsTy });
+
+        std::vector<Constant *> progs(array.max_entries, ConstantPointerNull::get(progPtrTy));
+        for (const auto &[slot, name] : array.slots) {
+            auto prog = module.getOrInsertFunction(PROG_SYM_PREFIX + name, progTy).getCallee();
+            progs[slot] = cast<Constant>(prog);
+        }
+
+        auto tableInit = ConstantStruct::get(
+                tableTy, { ConstantInt::get(Type::getInt64Ty(ctx), array.max_entries),
+                           ConstantArray::get(progsTy, progs) });
+
+        // Every object defines the same table: with the slots known at build time it is
+        // constant (weak_odr keeps the loads foldable), otherwise the runtime fills it
+        bool isConstant = !array.slots.empty();
+        auto table = new GlobalVariable(module, tableTy, isConstant,
+                                        isConstant ? GlobalValue::WeakODRLinkage : GlobalValue::WeakAnyLinkage,
+                                        tableInit, PROG_ARRAY_SYM_PREFIX + array.name);
+        table->setAlignment(Align(8));
+
+        SPDLOG_INFO("Prog array {} [max_entries: {}, slots: {}]", array.name, array.max_entries, array.slots.size());
+        return table;
+    }
+
+    BasicBlock *emitTailCall(IRBuilder<> &builder, Function *bpfMain, Value **regs,
+                             Value *callItemCnt, BasicBlock *localRetBlock,
+                             const intrinsics_config &config)
+    {
+        auto &ctx = builder.getContext();
+        auto checkCnt = BasicBlock::Create(ctx, "tail_call_cnt", bpfMain);
+        auto loadProg = BasicBlock::Create(ctx, "tail_call_prog", bpfMain);
+        auto doCall = BasicBlock::Create(ctx, "tail_call", bpfMain);
+        auto tailCall = BasicBlock::Create(ctx, "tail_call_jmp", bpfMain);
+        auto nestedCall = BasicBlock::Create(ctx, "tail_call_nested", bpfMain);
+        auto fail = BasicBlock::Create(ctx, "tail_call_fail", bpfMain);
+
+        // index is a u32, as in the kernel
+        Value *table = builder.CreateIntToPtr(builder.CreateLoad(builder.getInt64Ty(), regs[2]), builder.getPtrTy());
+        Value *index = builder.CreateZExt(
+                builder.CreateTrunc(builder.CreateLoad(builder.getInt64Ty(), regs[3]), builder.getInt32Ty()),
+                builder.getInt64Ty());
+        Value *maxEntries = builder.CreateLoad(builder.getInt64Ty(), table);
+        builder.CreateCondBr(builder.CreateICmpULT(index, maxEntries), checkCnt, fail);
+
+        // if (cnt++ >= MAX_TAIL_CALL_CNT) fail
+        builder.SetInsertPoint(checkCnt);
+        Value *cntSlot = tailCallCntSlot(builder, config);
+        Value *cnt = builder.CreateLoad(builder.getInt64Ty(), cntSlot);
+        Value *nextCnt = builder.CreateAdd(cnt, builder.getInt64(1));
+        builder.CreateCondBr(builder.CreateICmpULT(cnt, builder.getInt64(MAX_TAIL_CALL_CNT)), loadProg, fail);
+
+        // Empty slot
+        builder.SetInsertPoint(loadProg);
+        builder.CreateStore(nextCnt, cntSlot);
+        Value *prog = builder.CreateLoad(
+                builder.getPtrTy(),
+                builder.CreateInBoundsGEP(
+                        builder.getPtrTy(),
+                        builder.CreateConstInBoundsGEP1_64(builder.getInt8Ty(), table, PROG_ARRAY_HEADER_SIZE),
+                        index));
+        builder.CreateCondBr(builder.CreateIsNotNull(prog), doCall, fail);
+
+        builder.SetInsertPoint(doCall);
+        builder.CreateCondBr(
+                builder.CreateICmpEQ(builder.CreateLoad(builder.getInt64Ty(), callItemCnt), builder.getInt64(0)),
+                tailCall, nestedCall);
+
+        std::vector<Value *> args;
+        auto emitArgs = [&](IRBuilder<> &b) {
+            args = { b.CreateIntToPtr(b.CreateLoad(b.getInt64Ty(), regs[1]), bpfMain->getArg(0)->getType()),
+                     bpfMain->getArg(1) };
+        };
+
+        // Same prototype as bpf_main: the frame is reused and the call is a jump
+        builder.SetInsertPoint(tailCall);
+        emitArgs(builder);
+        auto call = builder.CreateCall(bpfMain->getFunctionType(), prog, args);
+        call->setTailCallKind(CallInst::TCK_MustTail);
+        builder.CreateRet(call);
+
+        // From a local function: the chain returns to the caller of the local function,
+        // the count of the chain is kept (the called program resets it when it exits)
+        builder.SetInsertPoint(nestedCall);
+        emitArgs(builder);
+        Value *verdict = builder.CreateCall(bpfMain->getFunctionType(), prog, args);
+        builder.CreateStore(nextCnt, tailCallCntSlot(builder, config));
+        builder.CreateStore(verdict, regs[0]);
+        builder.CreateBr(localRetBlock);
+
+        builder.SetInsertPoint(fail);
+        return fail;
+    }
+
+    void emitTailCallCountReset(IRBuilder<> &builder, const intrinsics_config &config)
+    {
+        builder.CreateStore(builder.getInt64(0), tailCallCntSlot(builder, config));
+    }
+}
@@ -0,0 +1,77 @@
+//
+// Created by Davide Collovigh on 19/10/26.
+//
+
+#ifndef EBPF_LLVM_JIT_TAIL_CALL_H
+#define EBPF_LLVM_JIT_TAIL_CALL_H
+
+#include <cstdint>
+#include <map>
+#include <string>
+
+#include <llvm/IR/BasicBlock.h>
+#include <llvm/IR/GlobalVariable.h>
+#include <llvm/IR/IRBuilder.h>
+#include <llvm/IR/Module.h>
+
+#include "intrinsics.h"
+
+// helper id of bpf_tail_call() (see enum bpf_func_id in linux/bpf.h)
+#define BPF_FUNC_TAIL_CALL 12
+
+// Tail calls allowed in a chain, as in the kernel
+#define MAX_TAIL_CALL_CNT 33
+
+// Per-hart count of the tail calls done by the running chain
+#define TAIL_CALL_CNT_SYM "__bpf_tail_call_cnt"
+
+// struct bpf_prog_array bpf_prog_array_<map>
+#define PROG_ARRAY_SYM_PREFIX "bpf_prog_array_"
+
+// int bpf_prog_<name>(void *ctx, uint64_t size), alias of bpf_main of each program
+#define PROG_SYM_PREFIX "bpf_prog_"
+
+namespace ebpf_llvm_jit::jit {
+
+    /**
+     * @brief BPF_MAP_TYPE_PROG_ARRAY shared by the programs of a build
+     *
+     * The map becomes a table of program entry points (struct bpf_prog_array of bpf_helpers.h),
+     * defined as a weak symbol by each object using it. Slots known at build time make the
+     * table constant, otherwise it is zeroed and filled by the runtime.
+     */
+    typedef struct prog_array {
+        std::string name;                       // name of the map symbol in the eBPF ELF
+        uint32_t max_entries;
+        std::map<uint32_t, std::string> slots;  // slot -> program name
+    } prog_array;
+
+    /**
+     * @brief defines the table of a prog array, { uint64_t max_entries; prog_t progs[max_entries] }
+     *
+     * @param progTy type of bpf_main, the programs of the slots are referenced as bpf_prog_<name>
+     */
+    llvm::GlobalVariable *emitProgArray(llvm::Module &module, llvm::FunctionType *progTy, const prog_array &array);
+
+    /**
+     * @brief lowers bpf_tail_call(ctx, r2 = table, r3 = index) inside bpf_main
+     *
+     * The index is bounds checked against the table, the chain is limited to MAX_TAIL_CALL_CNT
+     * calls, then the entry is called with musttail: the frame of the running program is reused
+     * and its caller gets the verdict of the last program of the chain. From a local function
+     * (call stack not empty) the program is called normally and the verdict is returned to the
+     * caller of the local function, as the kernel does. On failure the program continues.
+     *
+     * @return block where the program continues when the tail call fails
+     */
+    llvm::BasicBlock *emitTailCall(llvm::IRBuilder<> &builder, llvm::Function *bpfMain, llvm::Value **regs,
+                                   llvm::Value *callItemCnt, llvm::BasicBlock *localRetBlock,
+                                   const intrinsics_config &config);
+
+    /**
+     * @brief ends the chain when the program returns normally (to be added to the exit block)
+     */
+    void emitTailCallCountReset(llvm::IRBuilder<> &builder, const intrinsics_config &config);
+}
+
+#endif //EBPF_LLVM_JIT_TAIL_CALL_H
@@ -0,0 +1,162 @@
+//
+// Created by Davide Collovigh on 19/10/26.
+//
+
+#include "target.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+#include <llvm/IRReader/IRReader.h>
+#include <llvm/MC/TargetRegistry.h>
+#include <llvm/Support/SourceMgr.h>
+#if LLVM_VERSION_MAJOR >= 17
+#include <llvm/TargetParser/Triple.h>
+#else
+#include <llvm/ADT/Triple.h>
+#endif
+
+#include "spdlog/spdlog.h"
+
+using namespace llvm;
+
+namespace ebpf_llvm_jit::jit {
+
+    bool resolveTarget(const std::string &triple, aot_target &target, std::string &error)
+    {
+        Triple parsed(triple);
+
+        if (!TargetRegistry::lookupTarget(parsed.str(), error)) {
+            return false;
+        }
+        // bpf_main takes and returns 64-bit values, the data sections are ELF sections
+        if (!parsed.isArch64Bit()) {
+            error = "target " + triple + " is not 64-bit";
+            return false;
+        }
+        if (!parsed.isOSBinFormatELF()) {
+            error = "target " + triple + " does not emit ELF objects";
+            return false;
+        }
+
+        target.triple = triple;
+        switch (parsed.getArch()) {
+            case Triple::riscv64:
+                target.cpu = "generic";
+                target.features = "+m,+a";
+                target.abi = "lp64";
+                break;
+            case Triple::x86_64:
+                target.cpu = "x86-64";
+                target.features = "";
+                target.abi = "";
+                break;
+            default:
+                // aarch64 and the others: baseline CPU of the architecture
+                target.cpu = "generic";
+                target.features = "";
+                target.abi = "";
+                break;
+        }
+
+        return true;
+    }
+
+    std::string targetFeatures(const aot_target &target, const std::string &extraFeatures)
+    {
+        std::string features = target.features;
+        if (!extraFeatures.empty()) {
+            features += (features.empty() ? "" : ",") + extraFeatures;
+        }
+        return features;
+    }
+
+    std::unique_ptr<TargetMachine> createTargetMachine(const aot_target &target, const std::string &extraFeatures)
+    {
+        std::string error;
+        auto llvmTarget = TargetRegistry::lookupTarget(target.triple, error);
+
+        if (!llvmTarget) {
+            SPDLOG_ERROR("AOT: Failed to get target {}: {}", target.triple, error);
+            throw std::runtime_error("Unable to get target");
+        }
+
+        std::string features = targetFeatures(target, extraFeatures);
+
+        TargetOptions options;
+        options.MCOptions.ABIName = target.abi;
+
+#if LLVM_VERSION_MAJOR >= 18
+        static const CodeGenOptLevel optLevels[] = { CodeGenOptLevel::None, CodeGenOptLevel::Less,
+                                                     CodeGenOptLevel::Default, CodeGenOptLevel::Aggressive };
+#else
+        static const CodeGenOpt::Level optLevels[] = { CodeGenOpt::None, CodeGenOpt::Less,
+                                                       CodeGenOpt::Default, CodeGenOpt::Aggressive };
+#endif
+
+        std::unique_ptr<TargetMachine> targetMachine(llvmTarget->createTargetMachine(
+                target.triple, target.cpu, features, options, Reloc::PIC_, {}, optLevels[std::min(target.opt_level, 3u)]));
+
+        SPDLOG_INFO("Creating LLVM target machine using [target_machine={}, cpu={}, features={}, opt_level={}]",
+                    target.triple, target.cpu, features, target.opt_level);
+
+        if (!targetMachine) {
+            SPDLOG_ERROR("Unable to create target machine");
+            throw std::runtime_error("Unable to create target machine");
+        }
+
+        return targetMachine;
+    }
+
+    void setLtoTarget(Module &module, const aot_target &target, const std::string &cpu, const std::string &features)
+    {
+        for (auto &function : module) {
+            if (function.isDeclaration()) {
+                continue;
+            }
+            function.addFnAttr("target-cpu", cpu);
+            if (!features.empty()) {
+                function.addFnAttr("target-features", features);
+            }
+        }
+
+        if (!target.abi.empty()) {
+            module.addModuleFlag(Module::Error, "target-abi", MDString::get(module.getContext(), target.abi));
+        }
+        if (isRiscvModule(module)) {
+            module.setCodeModel(CodeModel::Medium);
+        }
+    }
+
+    bool readTargetAttributes(const std::string &bitcodeFile, std::string &cpu, std::string &features, std::string &error)
+    {
+        LLVMContext ctx;
+        SMDiagnostic diag;
+        auto module = parseIRFile(bitcodeFile, diag, ctx);
+        if (!module) {
+            error = "unable to read " + bitcodeFile + ": " + diag.getMessage().str();
+            return false;
+        }
+
+        for (const auto &function : *module) {
+            if (!function.isDeclaration() && function.hasFnAttribute("target-features")) {
+                cpu = function.getFnAttribute("target-cpu").getValueAsString().str();
+                features = function.getFnAttribute("target-features").getValueAsString().str();
+                return true;
+            }
+        }
+
+        error = "no function of " + bitcodeFile + " has target features (not built with -flto?)";
+        return false;
+    }
+
+    bool isRiscvTarget(const std::string &triple)
+    {
+        return Triple(triple).isRISCV();
+    }
+
+    bool isRiscvModule(const Module &module)
+    {
+        return isRiscvTarget(module.getTargetTriple());
+    }
+}
@@ -0,0 +1,79 @@
+//
+// Created by Davide Collovigh on 19/10/26.
+//
+
+#ifndef EBPF_LLVM_JIT_TARGET_H
+#define EBPF_LLVM_JIT_TARGET_H
+
+#include <memory>
+#include <string>
+
+#include <llvm/IR/Module.h>
+#include <llvm/Target/TargetMachine.h>
+
+// Bare-metal RV64 runtime
+#define AOT_DEFAULT_TRIPLE "riscv64-unknown-elf"
+
+namespace ebpf_llvm_jit::jit {
+
+    /**
+     * @brief target of the native objects
+     *
+     * Every target gets the same bpf_main/bpf_main_batch entry points, injected sections and
+     * _bpf_helper_ext_* calls. Objects are position independent.
+     */
+    typedef struct aot_target {
+        std::string triple = AOT_DEFAULT_TRIPLE;
+        std::string cpu = "generic";
+
+        // Same base ISA as the runtime (rv64g): atomics become amo*/lr/sc instead of __atomic_* calls
+        std::string features = "+m,+a";
+
+        // Empty for the default of the triple
+        std::string abi = "lp64";
+
+        // Optimization level of the code generator (0-3, as llc -O)
+        unsigned opt_level = 2;
+    } aot_target;
+
+    /**
+     * @brief fills target with the defaults (CPU, features, ABI) of triple
+     *
+     * @return false (with error set) if LLVM has no backend for triple or it is not a 64-bit ELF target
+     */
+    bool resolveTarget(const std::string &triple, aot_target &target, std::string &error);
+
+    // Features of target with extraFeatures (e.g. +v) appended
+    std::string targetFeatures(const aot_target &target, const std::string &extraFeatures);
+
+    /**
+     * @brief target machine of target, with extra features (e.g. +v) appended to the default ones
+     */
+    std::unique_ptr<llvm::TargetMachine> createTargetMachine(const aot_target &target, const std::string &extraFeatures);
+
+    /**
+     * @brief records the ABI of target and the CPU and features of the code in module (function attributes
+     * and module flags), for a link time optimizer
+     *
+     * LLVM only inlines between functions with the same target-cpu and target-features: to inline the
+     * program into the runtime they must be the ones of the runtime (see readTargetAttributes()).
+     * RISC-V modules get the medany code model of the runtime: the image is linked at 0x80000000.
+     */
+    void setLtoTarget(llvm::Module &module, const aot_target &target, const std::string &cpu, const std::string &features);
+
+    /**
+     * @brief target-cpu and target-features of the first function defined in a bitcode file (e.g. clang -flto)
+     *
+     * @return false (with error set) if the file cannot be read or no function has them
+     */
+    bool readTargetAttributes(const std::string &bitcodeFile, std::string &cpu, std::string &features, std::string &error);
+
+    /**
+     * @brief the triple (or the triple of the module) is RISC-V: CSRs (rdtime, mhartid) and RISC-V inline
+     * asm are available
+     */
+    bool isRiscvTarget(const std::string &triple);
+    bool isRiscvModule(const llvm::Module &module);
+}
+
+#endif //EBPF_LLVM_JIT_TARGET_H
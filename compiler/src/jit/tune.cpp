@@ -0,0 +1,329 @@
+//
+// Created by Davide Collovigh on 19/10/26.
+//
+
+#include "tune.h"
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "spdlog/spdlog.h"
+
+namespace ebpf_llvm_jit::jit {
+
+    // Objects of the runtime linked with the harness, bpf_tune.o has the main()
+    static const char *RUNTIME_OBJECTS[] = {
+            "start.o", "load_pkt_from_mem.o", "qemu_rv_uart.o", "bpf_printk.o", "qemu_rv_exit.o",
+            "mem_ops.o", "bpf_sandbox.o", "bpf_isa.o", "bpf_maps.o", "bpf_tune.o",
+    };
+
+    static bool parseUnsigned(const std::string &value, unsigned &result)
+    {
+        try {
+            size_t end;
+            unsigned long parsed = std::stoul(value, &end, 0);
+            if (end != value.size() || parsed > UINT32_MAX) {
+                return false;
+            }
+            result = (unsigned)parsed;
+            return true;
+        } catch (const std::exception &) {
+            return false;
+        }
+    }
+
+    static bool parseBool(const std::string &value, bool &result)
+    {
+        if (value == "1" || value == "true") {
+            result = true;
+        } else if (value == "0" || value == "false") {
+            result = false;
+        } else {
+            return false;
+        }
+        return true;
+    }
+
+    bool setTuneKey(tune_config &config, const std::string &key, const std::string &value, std::string &error)
+    {
+        bool valid;
+        if (key == "opt-level") {
+            valid = parseUnsigned(value, config.opt_level) && config.opt_level <= 3;
+        } else if (key == "target-features") {
+            std::stringstream features(value);
+            valid = true;
+            for (std::string feature; std::getline(features, feature, ',');) {
+                valid &= feature.size() >= 2 && (feature[0] == '+' || feature[0] == '-');
+            }
+            config.target_features = value;
+        } else if (key == "unroll") {
+            valid = parseUnsigned(value, config.unroll);
+        } else if (key == "hot-cold") {
+            valid = parseBool(value, config.hot_cold_splitting);
+        } else if (key == "reroll") {
+            valid = parseBool(value, config.reroll);
+        } else {
+            error = "unknown key " + key + " (expected opt-level, target-features, unroll, hot-cold or reroll)";
+            return false;
+        }
+
+        if (!valid) {
+            error = "invalid " + key + " \"" + value + "\"";
+        }
+        return valid;
+    }
+
+    bool parseTuneSpace(const std::string &spec, tune_space &space, std::string &error)
+    {
+        auto eq = spec.find('=');
+        if (eq == std::string::npos || eq == 0) {
+            error = "expected KEY=V1|V2|...";
+            return false;
+        }
+
+        std::string key = spec.substr(0, eq);
+        std::vector<tune_config> values;
+        // empty alternatives are kept (no target features)
+        for (size_t start = eq + 1;;) {
+            auto bar = spec.find('|', start);
+            tune_config config;
+            if (!setTuneKey(config, key, spec.substr(start, bar - start), error)) {
+                return false;
+            }
+            values.push_back(config);
+
+            if (bar == std::string::npos) {
+                break;
+            }
+            start = bar + 1;
+        }
+
+        if (key == "opt-level") {
+            space.opt_levels.clear();
+            for (const auto &config : values) space.opt_levels.push_back(config.opt_level);
+        } else if (key == "target-features") {
+            space.target_features.clear();
+            for (const auto &config : values) space.target_features.push_back(config.target_features);
+        } else if (key == "unroll") {
+            space.unroll.clear();
+            for (const auto &config : values) space.unroll.push_back(config.unroll);
+        } else if (key == "hot-cold") {
+            space.hot_cold_splitting.clear();
+            for (const auto &config : values) space.hot_cold_splitting.push_back(config.hot_cold_splitting);
+        } else {
+            space.reroll.clear();
+            for (const auto &config : values) space.reroll.push_back(config.reroll);
+        }
+
+        return true;
+    }
+
+    std::string tuneConfigToString(const tune_config &config)
+    {
+        return "opt-level=" + std::to_string(config.opt_level) +
+               ",target-features=" + config.target_features +
+               ",unroll=" + std::to_string(config.unroll) +
+               ",hot-cold=" + std::to_string(config.hot_cold_splitting) +
+               ",reroll=" + std::to_string(config.reroll);
+    }
+
+    std::vector<tune_config> expandTuneSpace(const tune_space &space)
+    {
+        std::vector<tune_config> configs = { tune_config() };
+        std::set<std::string> seen = { tuneConfigToString(configs.front()) };
+
+        for (auto opt_level : space.opt_levels) {
+            for (const auto &features : space.target_features) {
+                for (auto unroll : space.unroll) {
+                    for (bool hot_cold : space.hot_cold_splitting) {
+                        for (bool reroll : space.reroll) {
+                            tune_config config = { opt_level, features, unroll, hot_cold, reroll };
+                            if (seen.insert(tuneConfigToString(config)).second) {
+                                configs.push_back(config);
+                            }
+                        }
+                    }
+                }
+            }
+        }
+
+        return configs;
+    }
+
+    bool readTuneProfile(const std::string &path, tune_config &config, const std::set<std::string> &keep, std::string &error)
+    {
+        std::ifstream ifs(path);
+        if (!ifs) {
+            error = "unable to open " + path;
+            return false;
+        }
+
+        std::string line;
+        while (std::getline(ifs, line)) {
+            if (line.empty() || line[0] == '#') {
+                continue;
+            }
+
+            auto eq = line.find('=');
+            if (eq == std::string::npos) {
+                error = "malformed line \"" + line + "\", expected KEY=VALUE";
+                return false;
+            }
+
+            std::string key = line.substr(0, eq);
+            tune_config parsed = config;
+            if (!setTuneKey(parsed, key, line.substr(eq + 1), error)) {
+                return false;
+            }
+            if (!keep.count(key)) {
+                config = parsed;
+            }
+        }
+
+        return true;
+    }
+
+    bool writeTuneProfile(const std::string &path, const tune_config &config, const std::string &comment)
+    {
+        std::ofstream ofs(path);
+        if (!ofs) {
+            return false;
+        }
+
+        ofs << "# " << comment << "\n"
+            << "opt-level=" << config.opt_level << "\n"
+            << "target-features=" << config.target_features << "\n"
+            << "unroll=" << config.unroll << "\n"
+            << "hot-cold=" << config.hot_cold_splitting << "\n"
+            << "reroll=" << config.reroll << "\n";
+        return (bool)ofs;
+    }
+
+    // Runs argv without a shell, its output (stdout and stderr) in output, false if it does not exit with 0
+    static bool runCommand(const std::vector<std::string> &argv, std::string &output)
+    {
+        std::string command;
+        for (const auto &arg : argv) {
+            command += (command.empty() ? "" : " ") + arg;
+        }
+        SPDLOG_DEBUG("Running {}", command);
+
+        output.clear();
+        if (argv.empty()) {
+            output = "empty command";
+            return false;
+        }
+        int fds[2];
+        if (pipe(fds) != 0) {
+            output = "unable to run " + command + ": " + strerror(errno);
+            return false;
+        }
+
+        pid_t pid = fork();
+        if (pid < 0) {
+            output = "unable to run " + command + ": " + strerror(errno);
+            close(fds[0]);
+            close(fds[1]);
+            return false;
+        }
+        if (pid == 0) {
+            std::vector<char *> args;
+            for (const auto &arg : argv) {
+                args.push_back(const_cast<char *>(arg.c_str()));
+            }
+            args.push_back(nullptr);
+
+            dup2(fds[1], STDOUT_FILENO);
+            dup2(fds[1], STDERR_FILENO);
+            close(fds[0]);
+            close(fds[1]);
+            execvp(args[0], args.data());
+            dprintf(STDERR_FILENO, "unable to run %s: %s\n", args[0], strerror(errno));
+            _exit(127);
+        }
+
+        close(fds[1]);
+        char buffer[256];
+        ssize_t n;
+        while ((n = read(fds[0], buffer, sizeof(buffer))) != 0) {
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n < 0) {
+                break;
+            }
+            output.append(buffer, n);
+        }
+        close(fds[0]);
+
+        int status;
+        while (waitpid(pid, &status, 0) < 0) {
+            if (errno != EINTR) {
+                return false;
+            }
+        }
+        return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+    }
+
+    // Splits a tool command line (e.g. --qemu) on whitespace, no shell quoting
+    static std::vector<std::string> splitCommand(const std::string &command)
+    {
+        std::istringstream iss(command);
+        std::vector<std::string> argv;
+        for (std::string arg; iss >> arg;) {
+            argv.push_back(arg);
+        }
+        return argv;
+    }
+
+    std::optional<tune_result> measureObject(const tune_runner &runner, const std::string &object,
+                                             const std::string &image, std::string &error)
+    {
+        std::vector<std::string> link = splitCommand(runner.ld);
+        link.insert(link.end(), { "-T", runner.runtime + "/baremetal.ld", "-m", "elf64lriscv", "-o", image });
+        for (const auto *runtimeObject : RUNTIME_OBJECTS) {
+            link.push_back(runner.runtime + "/.output/" + runtimeObject);
+        }
+        link.push_back(runner.trace);
+        link.push_back(object);
+
+        std::string output;
+        if (!runCommand(link, output)) {
+            error = "link failed: " + output;
+            return std::nullopt;
+        }
+
+        // the harness exits QEMU with 0 after the BPF_TUNE line
+        std::vector<std::string> run = { "timeout", std::to_string(runner.timeout) };
+        for (auto &arg : splitCommand(runner.qemu)) {
+            run.push_back(std::move(arg));
+        }
+        run.insert(run.end(), { "-icount", "shift=0", "-bios", image });
+        bool exited = runCommand(run, output);
+
+        std::istringstream lines(output);
+        for (std::string line; std::getline(lines, line);) {
+            std::istringstream iss(line);
+            std::string prefix;
+            tune_result result;
+
+            // BPF_TUNE <packets> <instructions> <hash of the verdicts>
+            if (!(iss >> prefix) || prefix != TUNE_LINE_PREFIX) {
+                continue;
+            }
+            if (!(iss >> result.packets >> result.instructions >> result.verdict_hash) || !result.packets) {
+                error = "malformed line: " + line;
+                return std::nullopt;
+            }
+            return result;
+        }
+
+        error = std::string(exited ? "no " TUNE_LINE_PREFIX " line" : "QEMU failed or timed out") + " in the output: " + output;
+        return std::nullopt;
+    }
+}
@@ -0,0 +1,107 @@
+//
+// Created by Davide Collovigh on 19/10/26.
+//
+
+#ifndef EBPF_LLVM_JIT_TUNE_H
+#define EBPF_LLVM_JIT_TUNE_H
+
+#include <cstdint>
+#include <optional>
+#include <set>
+#include <string>
+#include <vector>
+
+// Extension of the profile of a program, <name>.tune next to the eBPF ELF
+#define TUNE_PROFILE_EXT ".tune"
+
+// Prefix of the line printed by the tuning harness of the runtime (bpf_tune.c)
+#define TUNE_LINE_PREFIX "BPF_TUNE"
+
+namespace ebpf_llvm_jit::jit {
+
+    /**
+     * @brief build options chosen by the tuner, the defaults are the ones of build
+     *
+     * Keys of the profile and of the search space: opt-level, target-features, unroll, hot-cold, reroll.
+     */
+    typedef struct tune_config {
+        unsigned opt_level = 2;             // code generator level (0-3)
+        std::string target_features;        // added to the ones of the target, e.g. +zbb
+        unsigned unroll = 0;                // full unroll of the loops up to this trip count
+        bool hot_cold_splitting = true;
+        bool reroll = true;
+    } tune_config;
+
+    // Values tried for each key, the variants are all their combinations
+    typedef struct tune_space {
+        std::vector<unsigned> opt_levels = { 1, 2, 3 };
+        std::vector<std::string> target_features = { "" };
+        std::vector<unsigned> unroll = { 0, 4, 16 };
+        std::vector<bool> hot_cold_splitting = { false, true };
+        std::vector<bool> reroll = { false, true };
+    } tune_space;
+
+    // Instructions of a run of the harness over the trace
+    typedef struct tune_result {
+        uint64_t packets = 0;
+        uint64_t instructions = 0;
+        uint64_t verdict_hash = 0;
+
+        double per_packet() const { return packets ? (double)instructions / packets : 0; }
+    } tune_result;
+
+    // Tools and inputs of a measurement
+    typedef struct tune_runner {
+        std::string runtime;                // built rv64_baremetal_runtime (.output/*.o, baremetal.ld)
+        std::string trace;                  // object with pkts_start/pkts_end (pkts.S)
+        std::string ld = "riscv64-unknown-elf-ld";
+        std::string qemu = "qemu-system-riscv64 -nographic -machine virt";
+        unsigned timeout = 60;              // seconds of a QEMU run
+    } tune_runner;
+
+    /**
+     * @brief sets one key of config, value as in the profile (e.g. opt-level=3, hot-cold=0)
+     *
+     * @return false (with error set) for an unknown key or an invalid value
+     */
+    bool setTuneKey(tune_config &config, const std::string &key, const std::string &value, std::string &error);
+
+    /**
+     * @brief replaces the values of a key of the search space, spec is KEY=V1|V2|...
+     *
+     * Alternatives are separated by '|' since target features are comma separated (e.g. target-features=|+zbb).
+     *
+     * @return false (with error set) if spec is malformed or a value is invalid for the key
+     */
+    bool parseTuneSpace(const std::string &spec, tune_space &space, std::string &error);
+
+    // Combinations of the values of space, the default configuration first (also when not in space)
+    std::vector<tune_config> expandTuneSpace(const tune_space &space);
+
+    // key=value,... of the keys of config
+    std::string tuneConfigToString(const tune_config &config);
+
+    /**
+     * @brief applies the keys of a profile to config, but the ones in keep (set on the command line)
+     *
+     * Lines starting with '#' and empty lines are ignored.
+     *
+     * @return false (with error set) if the profile cannot be read or a line is invalid
+     */
+    bool readTuneProfile(const std::string &path, tune_config &config, const std::set<std::string> &keep, std::string &error);
+
+    // Writes the keys of config to path, with the measurement as a comment
+    bool writeTuneProfile(const std::string &path, const tune_config &config, const std::string &comment);
+
+    /**
+     * @brief links object (the program) with the harness of the runtime and the trace, runs it in QEMU
+     * with -icount and reads the BPF_TUNE line
+     *
+     * @param image path of the linked image
+     * @return nothing (with error set) if the link or the run fails or the output has no BPF_TUNE line
+     */
+    std::optional<tune_result> measureObject(const tune_runner &runner, const std::string &object,
+                                             const std::string &image, std::string &error);
+}
+
+#endif //EBPF_LLVM_JIT_TUNE_H
@@ -0,0 +1,415 @@
+//
+// Created by Davide Collovigh on 19/10/26.
+//
+
+#include "wcet.h"
+
+#include <algorithm>
+
+#include <llvm/MC/MCSchedule.h>
+
+#include "native_code.h"
+
+using namespace llvm;
+
+namespace ebpf_llvm_jit::jit {
+
+    static uint64_t satAdd(uint64_t a, uint64_t b)
+    {
+        return a > UINT64_MAX - b ? UINT64_MAX : a + b;
+    }
+
+    static uint64_t satMul(uint64_t a, uint64_t b)
+    {
+        return b && a > UINT64_MAX / b ? UINT64_MAX : a * b;
+    }
+
+    static bool isCall(const ebpf_inst &inst)
+    {
+        return inst.code == EBPF_OP_CALL || inst.code == (EBPF_OP_CALL | EBPF_SRC_REG);
+    }
+
+    static bool isLocalCall(const ebpf_inst &inst)
+    {
+        return isCall(inst) && inst.src_reg == 0x1;
+    }
+
+    // Latency of the instruction in the scheduling model, plus the mispredict penalty of conditional branches
+    static uint64_t instructionCycles(const MCInst &inst, const MCSubtargetInfo &sti, const MCInstrInfo &mii)
+    {
+        const MCSchedModel &sched = sti.getSchedModel();
+        const MCInstrDesc &desc = mii.get(inst.getOpcode());
+
+        int latency;
+        if (sched.hasInstrSchedModel()) {
+            latency = sched.computeInstrLatency(sti, mii, inst);
+        } else if (desc.mayLoad()) {
+            latency = sched.LoadLatency;
+        } else {
+            // Without a model only divisions are known to be slow
+            StringRef name = mii.getName(inst.getOpcode());
+            latency = name.contains("DIV") || name.startswith("REM") ? sched.HighLatency : 1;
+        }
+
+        uint64_t cycles = std::max(latency, 1);
+        if (desc.isConditionalBranch()) {
+            cycles += sched.MispredictPenalty;
+        }
+        return cycles;
+    }
+
+    // Cycles of the native code of every pc, the ones of code of no pc go to unattributed
+    static bool machineCycles(const std::vector<uint8_t> &object, const aot_target &target, const std::string &features,
+                              const std::string &cpu, std::vector<uint64_t> &pcCycles, uint64_t &unattributed,
+                              std::string &error)
+    {
+        NativeCode code;
+        if (!code.open(object, target, features, cpu, error)) {
+            return false;
+        }
+
+        return code.visit(isBpfMainCode, [&](const MCInst &inst, uint64_t, std::optional<uint32_t> pc) {
+            uint64_t cycles = instructionCycles(inst, code.subtarget(), code.instrInfo());
+            if (pc && *pc < pcCycles.size()) {
+                pcCycles[*pc] += cycles;
+            } else {
+                unattributed += cycles;
+            }
+        }, error);
+    }
+
+    class WcetAnalysis {
+        typedef struct bound {
+            uint64_t cycles;
+            std::vector<uint32_t> path;
+        } bound;
+
+        const std::vector<ebpf_inst> &insts;
+        const std::vector<uint64_t> &pcCycles;
+        const std::set<int32_t> &inlinedHelpers;
+        const wcet_config &config;
+
+        // Bounds of the subprograms, by first pc
+        std::map<uint32_t, bound> subprograms;
+
+        // Subprograms being analyzed (a call to one of them is a recursion)
+        std::set<uint32_t> active;
+
+        bool successors(uint32_t pc, std::vector<uint32_t> &out)
+        {
+            const auto &inst = insts[pc];
+            uint8_t cls = inst.code & EBPF_CLS_MASK;
+
+            std::vector<int64_t> targets;
+            if (inst.code == EBPF_OP_LDDW) {
+                targets = { (int64_t)pc + 2 };
+            } else if (cls == EBPF_CLS_JMP || cls == EBPF_CLS_JMP32) {
+                if (inst.code == EBPF_OP_EXIT) {
+                    targets = {};
+                } else if (inst.code == EBPF_OP_JA) {
+                    targets = { (int64_t)pc + 1 + inst.off };
+                } else if (isCall(inst)) {
+                    targets = { (int64_t)pc + 1 };
+                } else {
+                    targets = { (int64_t)pc + 1, (int64_t)pc + 1 + inst.off };
+                }
+            } else {
+                targets = { (int64_t)pc + 1 };
+            }
+
+            for (auto target : targets) {
+                if (target < 0 || target >= (int64_t)insts.size()) {
+                    error = "jump out of the program at pc " + std::to_string(pc);
+                    return false;
+                }
+                out.push_back(target);
+            }
+            return true;
+        }
+
+        // Cycles of the instruction at pc, with the ones of the subprogram or helper it calls
+        bool nodeCycles(uint32_t pc, uint64_t &cycles, const std::vector<uint32_t> *&calleePath)
+        {
+            const auto &inst = insts[pc];
+            cycles = pcCycles[pc];
+            calleePath = nullptr;
+
+            if (inst.code == EBPF_OP_LDDW && pc + 1 < insts.size()) {
+                cycles = satAdd(cycles, pcCycles[pc + 1]);
+            } else if (isLocalCall(inst)) {
+                auto callee = analyze(pc + 1 + inst.imm);
+                if (!callee) {
+                    return false;
+                }
+                cycles = satAdd(cycles, callee->cycles);
+                calleePath = &subprograms[pc + 1 + inst.imm].path;
+            } else if (isCall(inst) && !inlinedHelpers.count(inst.imm)) {
+                auto it = config.helper_cycles.find(inst.imm);
+                if (it != config.helper_cycles.end()) {
+                    cycles = satAdd(cycles, it->second);
+                } else {
+                    undeclaredHelpers.insert(inst.imm);
+                }
+            }
+            return true;
+        }
+
+        // Longest paths over the components of a region of the CFG of a subprogram
+        typedef struct region {
+            std::vector<int64_t> component;             // by node, -1 outside the region or unreachable
+            std::vector<std::vector<uint32_t>> members; // by component, numbered from the sinks
+            std::vector<uint64_t> best;                 // longest path from the component to an exit
+            std::vector<int64_t> next;                  // successor component on that path
+        } region;
+
+        /**
+         * Strongly connected components (Tarjan) of the nodes in scope reachable from root, edges leaving
+         * the scope or going to skip (the header of the loop whose iteration is bounded) are ignored.
+         * Each component that is a loop costs loop_bound times its longest iteration, computed by
+         * recursing into the component without the edges back to its header: a loop nested d levels
+         * deep runs loop_bound^d times.
+         */
+        region regionBound(const std::vector<std::vector<uint32_t>> &succs, const std::vector<uint64_t> &cycles,
+                           const std::vector<bool> &scope, uint32_t root, int64_t skip, unsigned depth)
+        {
+            auto edge = [&](uint32_t w) { return scope[w] && (int64_t)w != skip; };
+
+            region r;
+            size_t n = succs.size();
+            std::vector<int64_t> index(n, -1), low(n);
+            r.component.assign(n, -1);
+            std::vector<uint32_t> stack;
+            std::vector<std::pair<uint32_t, size_t>> work = { { root, 0 } };
+            int64_t counter = 0, components = 0;
+            index[root] = low[root] = counter++;
+            stack.push_back(root);
+
+            while (!work.empty()) {
+                auto &[v, e] = work.back();
+                if (e < succs[v].size()) {
+                    uint32_t w = succs[v][e++];
+                    if (!edge(w)) {
+                        continue;
+                    }
+                    if (index[w] < 0) {
+                        index[w] = low[w] = counter++;
+                        stack.push_back(w);
+                        work.emplace_back(w, 0);
+                    } else if (r.component[w] < 0) {
+                        low[v] = std::min(low[v], index[w]);
+                    }
+                    continue;
+                }
+
+                uint32_t done = v;
+                if (low[done] == index[done]) {
+                    uint32_t w;
+                    do {
+                        w = stack.back();
+                        stack.pop_back();
+                        r.component[w] = components;
+                    } while (w != done);
+                    components++;
+                }
+                work.pop_back();
+                if (!work.empty()) {
+                    low[work.back().first] = std::min(low[work.back().first], low[done]);
+                }
+            }
+
+            r.members.resize(components);
+            for (size_t i = 0; i < n; i++) {
+                if (r.component[i] >= 0) {
+                    r.members[r.component[i]].push_back(i);
+                }
+            }
+
+            // Longest path over the components, the successors of one are numbered before it
+            r.best.assign(components, 0);
+            r.next.assign(components, -1);
+            for (int64_t c = 0; c < components && error.empty(); c++) {
+                bool loop = r.members[c].size() > 1;
+                uint64_t body = 0;
+                uint32_t header = r.members[c].front();
+                for (auto i : r.members[c]) {
+                    body = satAdd(body, cycles[i]);
+                    header = index[i] < index[header] ? i : header;
+                    for (auto w : succs[i]) {
+                        if (!edge(w)) {
+                            continue;
+                        }
+                        if (r.component[w] == c) {
+                            loop = true;
+                        } else if (r.next[c] < 0 || r.best[r.component[w]] > r.best[r.next[c]]) {
+                            r.next[c] = r.component[w];
+                        }
+                    }
+                }
+
+                if (loop) {
+                    if (!config.loop_bound) {
+                        std::vector<uint32_t> pcs;
+                        for (auto i : r.members[c]) {
+                            pcs.push_back(nodePcs[i]);
+                        }
+                        std::sort(pcs.begin(), pcs.end());
+                        error = "the loop over pcs " + formatPcRanges(pcs) + " has no bound";
+                        return r;
+                    }
+
+                    // Longest iteration: from the header, without the edges back to it
+                    std::vector<bool> inner(n, false);
+                    for (auto i : r.members[c]) {
+                        inner[i] = true;
+                    }
+                    region iteration = regionBound(succs, cycles, inner, header, header, depth + 1);
+                    body = satMul(iteration.best[iteration.component[header]], config.loop_bound);
+                    loopDepth = std::max(loopDepth, depth);
+                }
+
+                r.best[c] = satAdd(body, r.next[c] < 0 ? 0 : r.best[r.next[c]]);
+            }
+
+            return r;
+        }
+
+        // pcs of the nodes of the subprogram being analyzed
+        std::vector<uint32_t> nodePcs;
+
+    public:
+        std::set<int32_t> undeclaredHelpers;
+        // Nesting of the deepest loop (0 = no loops)
+        unsigned loopDepth = 0;
+        std::string error;
+
+        WcetAnalysis(const std::vector<ebpf_inst> &insts, const std::vector<uint64_t> &pcCycles,
+                     const std::set<int32_t> &inlinedHelpers, const wcet_config &config)
+            : insts(insts), pcCycles(pcCycles), inlinedHelpers(inlinedHelpers), config(config)
+        {
+        }
+
+        // Longest path from start to an exit of the subprogram starting at start
+        std::optional<bound> analyze(uint32_t start)
+        {
+            if (start >= insts.size()) {
+                error = "call out of the program";
+                return std::nullopt;
+            }
+            if (auto it = subprograms.find(start); it != subprograms.end()) {
+                return it->second;
+            }
+            if (active.count(start)) {
+                error = "recursive call to the subprogram at pc " + std::to_string(start);
+                return std::nullopt;
+            }
+            active.insert(start);
+
+            // Instructions of the subprogram, with their successors
+            std::vector<uint32_t> nodes = { start };
+            std::map<uint32_t, uint32_t> nodeOf = { { start, 0 } };
+            std::vector<std::vector<uint32_t>> succs;
+            for (size_t i = 0; i < nodes.size(); i++) {
+                std::vector<uint32_t> pcs;
+                if (!successors(nodes[i], pcs)) {
+                    return std::nullopt;
+                }
+                succs.emplace_back();
+                for (auto pc : pcs) {
+                    auto [it, added] = nodeOf.emplace(pc, nodes.size());
+                    if (added) {
+                        nodes.push_back(pc);
+                    }
+                    succs[i].push_back(it->second);
+                }
+            }
+
+            std::vector<uint64_t> cycles(nodes.size());
+            std::vector<const std::vector<uint32_t> *> calleePaths(nodes.size());
+            for (size_t i = 0; i < nodes.size(); i++) {
+                if (!nodeCycles(nodes[i], cycles[i], calleePaths[i])) {
+                    return std::nullopt;
+                }
+            }
+
+            // after nodeCycles(), which analyzes the callees
+            nodePcs = nodes;
+            region top = regionBound(succs, cycles, std::vector<bool>(nodes.size(), true), 0, -1, 1);
+            if (!error.empty()) {
+                return std::nullopt;
+            }
+
+            bound result = { top.best[top.component[0]], {} };
+            for (int64_t c = top.component[0]; c >= 0; c = top.next[c]) {
+                std::sort(top.members[c].begin(), top.members[c].end(),
+                          [&](uint32_t a, uint32_t b) { return nodes[a] < nodes[b]; });
+                for (auto i : top.members[c]) {
+                    result.path.push_back(nodes[i]);
+                    if (calleePaths[i]) {
+                        result.path.insert(result.path.end(), calleePaths[i]->begin(), calleePaths[i]->end());
+                    }
+                }
+            }
+
+            active.erase(start);
+            subprograms[start] = result;
+            return result;
+        }
+    };
+
+    std::optional<wcet_result> analyzeWcet(const std::vector<uint8_t> &object, const std::vector<ebpf_inst> &insts,
+                                           const aot_target &target, const std::string &extraFeatures,
+                                           const std::set<int32_t> &inlinedHelpers, const wcet_config &config,
+                                           std::string &error)
+    {
+        if (insts.empty()) {
+            error = "empty program";
+            return std::nullopt;
+        }
+
+        std::vector<uint64_t> pcCycles(insts.size(), 0);
+        uint64_t unattributed = 0;
+        if (!machineCycles(object, target, targetFeatures(target, extraFeatures),
+                           config.cpu.empty() ? target.cpu : config.cpu, pcCycles, unattributed, error)) {
+            return std::nullopt;
+        }
+
+        WcetAnalysis analysis(insts, pcCycles, inlinedHelpers, config);
+        auto bound = analysis.analyze(0);
+        if (!bound) {
+            error = analysis.error;
+            return std::nullopt;
+        }
+
+        // Code of no pc may sit in the deepest loop as well
+        for (unsigned d = 0; d < analysis.loopDepth; d++) {
+            unattributed = satMul(unattributed, config.loop_bound);
+        }
+
+        wcet_result result;
+        result.cycles = satAdd(bound->cycles, unattributed);
+        result.path = bound->path;
+        result.undeclared_helpers = analysis.undeclaredHelpers;
+        return result;
+    }
+
+    std::string formatPcRanges(const std::vector<uint32_t> &pcs)
+    {
+        std::string out;
+        for (size_t i = 0; i < pcs.size();) {
+            size_t j = i;
+            while (j + 1 < pcs.size() && pcs[j + 1] == pcs[j] + 1) {
+                j++;
+            }
+
+            if (!out.empty()) {
+                out += ",";
+            }
+            out += std::to_string(pcs[i]);
+            if (j > i) {
+                out += "-" + std::to_string(pcs[j]);
+            }
+            i = j + 1;
+        }
+        return out;
+    }
+}
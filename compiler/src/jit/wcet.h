@@ -0,0 +1,71 @@
+//
+// Created by Davide Collovigh on 19/10/26.
+//
+
+#ifndef EBPF_LLVM_JIT_WCET_H
+#define EBPF_LLVM_JIT_WCET_H
+
+#include <cstdint>
+#include <map>
+#include <optional>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "../ebpf_inst.h"
+#include "target.h"
+
+namespace ebpf_llvm_jit::jit {
+
+    typedef struct wcet_config {
+        bool enabled = false;
+
+        // Budget of one run of the program, 0 only reports the bound
+        uint64_t max_cycles = 0;
+
+        // Declared cost of the helpers called out of line, by helper id
+        std::map<int32_t, uint64_t> helper_cycles;
+
+        // Iterations of every loop of the program, 0 rejects programs with loops
+        uint64_t loop_bound = 0;
+
+        // Scheduling model of this CPU instead of the one of the target (e.g. sifive-u74)
+        std::string cpu;
+    } wcet_config;
+
+    typedef struct wcet_result {
+        uint64_t cycles = 0;
+
+        // eBPF pcs of the worst path, the ones of a called subprogram follow the call
+        std::vector<uint32_t> path;
+
+        // Helpers reachable from bpf_main without a declared cost (counted as 0 cycles)
+        std::set<int32_t> undeclared_helpers;
+    } wcet_result;
+
+    /**
+     * @brief static bound of the cycles of one run of bpf_main
+     *
+     * The object must carry the line table of emitDebugLocations(): every instruction of bpf_main
+     * (and of the blocks outlined from it) is disassembled, costed with the scheduling model of
+     * the CPU (latency, plus the mispredict penalty for conditional branches) and charged to the
+     * eBPF pc of its column. The bound is the longest path over the eBPF CFG with these costs, where
+     * calls to subprograms cost their own bound, calls to helpers their declared cost (0 for the
+     * ones in inlinedHelpers) and loops loop_bound times their longest iteration (a loop nested in
+     * another runs loop_bound^2 times). Code of no pc (prologue, epilogue, stack setup) is added
+     * once, or loop_bound^depth times with loops. Calls to memcpy/memset are not costed: the rerolling
+     * of memory operations is off when the bound is computed.
+     *
+     * @return the bound, nullopt (with error set) if the program has an unbounded loop or the
+     * object cannot be analyzed
+     */
+    std::optional<wcet_result> analyzeWcet(const std::vector<uint8_t> &object, const std::vector<ebpf_inst> &insts,
+                                           const aot_target &target, const std::string &extraFeatures,
+                                           const std::set<int32_t> &inlinedHelpers, const wcet_config &config,
+                                           std::string &error);
+
+    // pcs as comma separated ranges (e.g. 0-4,9,12-15)
+    std::string formatPcRanges(const std::vector<uint32_t> &pcs);
+}
+
+#endif //EBPF_LLVM_JIT_WCET_H
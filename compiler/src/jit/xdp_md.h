@@ -0,0 +1,22 @@
+//
+// Created by Davide Collovigh on 19/10/26.
+//
+
+#ifndef EBPF_LLVM_JIT_XDP_MD_H
+#define EBPF_LLVM_JIT_XDP_MD_H
+
+// Global added by the compiler to the u32 addresses of xdp_md (defined by the runtime)
+#define PKT_MEM_BASE_SYM "ebpf_pkt_mem_base"
+
+// sizeof(struct xdp_md), passed to bpf_main as mem_len
+#define XDP_MD_SIZE 24
+
+// Offsets of the u32 fields of struct xdp_md
+#define XDP_MD_DATA 0
+#define XDP_MD_DATA_END 4
+#define XDP_MD_DATA_META 8
+#define XDP_MD_INGRESS_IFINDEX 12
+#define XDP_MD_RX_QUEUE_INDEX 16
+#define XDP_MD_EGRESS_IFINDEX 20
+
+#endif //EBPF_LLVM_JIT_XDP_MD_H
@@ -8,6 +8,9 @@
 #include <cstddef>
 #include <cstdint>
 
+// Symbols of the helpers, followed by the 4 digits of their id
+#define EXT_FUNC_SYM_PREFIX "_bpf_helper_ext_"
+
 namespace ebpf_llvm_jit::utils {
 
     typedef uint64_t(*precompiled_ebpf_function)(void *mem, size_t mem_len);
@@ -15,7 +18,7 @@ namespace ebpf_llvm_jit::utils {
     static inline std::string ext_func_sym(uint32_t idx)
     {
         char buf[32];
-        sprintf(buf, "_bpf_helper_ext_%04" PRIu32, idx);
+        sprintf(buf, EXT_FUNC_SYM_PREFIX "%04" PRIu32, idx);
         return buf;
     }
 }
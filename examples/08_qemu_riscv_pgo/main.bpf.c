@@ -0,0 +1,118 @@
+#include <linux/bpf.h>
+#include <bpf/bpf_helpers.h>
+#include <stddef.h>
+#include <linux/if_ether.h>
+#include <linux/ip.h>
+#include <linux/tcp.h>
+#include <linux/udp.h>
+#include <bpf/bpf_endian.h>
+#include <stdint.h>
+
+#define ETH_P_IP 0x0800
+#define SSH_PORT 22
+
+/*
+ * Small parser used to collect a profile on the recorded traffic:
+ * - ssh traffic is passed
+ * - other TCP/UDP traffic is dropped
+ * - malformed packets are reported with bpf_printk (never taken on the capture)
+ */
+SEC("xdp")
+int xdp_parse(struct xdp_md *ctx) {
+
+    void *data = (void *)(long)ctx->data;
+    void *data_end = (void *)(long)ctx->data_end;
+
+    struct ethhdr *eth = data;
+    if ((void *)(eth + 1) > data_end) {
+
+        bpf_printk("not big enough for ethhdr\n");
+        return XDP_ABORTED;
+    }
+
+    if (eth->h_proto != bpf_htons(ETH_P_IP)) {
+        return XDP_PASS;
+    }
+
+    struct iphdr *ip = (void *)(eth + 1);
+    if ((void *)(ip + 1) > data_end) {
+
+        bpf_printk("not big enough for iphdr\n");
+        return XDP_ABORTED;
+    }
+
+    int hdr_size = ip->ihl * 4;
+    if (hdr_size < sizeof(*ip) || (void *)ip + hdr_size > data_end) {
+
+        bpf_printk("invalid ihl: %d\n", ip->ihl);
+        return XDP_ABORTED;
+    }
+
+    void *l4 = (void *)ip + hdr_size;
+
+    if (ip->protocol == IPPROTO_TCP) {
+
+        struct tcphdr *tcp = l4;
+        if ((void *)(tcp + 1) > data_end) {
+
+            bpf_printk("not big enough for tcphdr\n");
+            return XDP_ABORTED;
+        }
+
+        if (tcp->source == bpf_htons(SSH_PORT) || tcp->dest == bpf_htons(SSH_PORT)) {
+            return XDP_PASS;
+        }
+
+        return XDP_DROP;
+    }
+
+    if (ip->protocol == IPPROTO_UDP) {
+
+        struct udphdr *udp = l4;
+        if ((void *)(udp + 1) > data_end) {
+
+            bpf_printk("not big enough for udphdr\n");
+            return XDP_ABORTED;
+        }
+
+        return XDP_DROP;
+    }
+
+    return XDP_PASS;
+}
+
+#define MIN_TTL 32
+
+/*
+ * Second program of the object, with other blocks: its profile is keyed by its own name
+ * - IPv4 packets with a TTL below MIN_TTL are dropped
+ * - malformed packets are reported with bpf_printk (never taken on the capture)
+ */
+SEC("xdp")
+int xdp_ttl(struct xdp_md *ctx) {
+
+    void *data = (void *)(long)ctx->data;
+    void *data_end = (void *)(long)ctx->data_end;
+
+    struct ethhdr *eth = data;
+    struct iphdr *ip = (void *)(eth + 1);
+    if ((void *)(ip + 1) > data_end) {
+
+        bpf_printk("not big enough for ethhdr + iphdr\n");
+        return XDP_ABORTED;
+    }
+
+    if (eth->h_proto != bpf_htons(ETH_P_IP)) {
+        return XDP_PASS;
+    }
+
+    if (ip->ttl < MIN_TTL) {
+
+        bpf_printk("ttl %d below %d\n", ip->ttl, MIN_TTL);
+        return XDP_DROP;
+    }
+
+    return XDP_PASS;
+}
+
+char LICENSE[] SEC("license") = "Dual BSD/GPL";
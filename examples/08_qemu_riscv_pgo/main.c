@@ -0,0 +1,73 @@
+//
+// Created by Davide Collovigh on 19/10/26.
+//
+
+#include "../../rv64_baremetal_runtime/qemu_rv_uart.h"
+#include "../../rv64_baremetal_runtime/qemu_rv_exit.h"
+#include "../../rv64_baremetal_runtime/bpf_helpers.h"
+#include "../../rv64_baremetal_runtime/bpf_prof.h"
+#include "../../rv64_baremetal_runtime/load_pkt_from_mem.h"
+
+#include "pkts.h"
+
+// defined in pkts.S
+extern const char pkts_start;
+extern const char pkts_end;
+
+// specific for RV64 qemu
+volatile char *uart_base = (volatile char *) UART0_BASE;
+
+// same as get_next_pkt_end(), without dumping the packet on the UART
+static const uint16_t *next_pkt_end(const uint16_t *curr, const void *region_end)
+{
+    int end_seq_cnt = 0;
+
+    while (end_seq_cnt < STOP_SEQ_NO) {
+
+        if ((const void *) curr == region_end) {
+            return NULL;
+        }
+
+        end_seq_cnt = (*curr == STOP_SEQ) ? end_seq_cnt + 1 : 0;
+        curr++;
+    }
+
+    return curr;
+}
+
+int main() {
+    UART0_FCR = UARTFCR_FFENA;    // Set the FIFO for polled operation
+    uart_puts("Started runtime\n");
+
+    int verdicts[XDP_REDIRECT + 1] = {0};
+    const uint16_t *curr = (const uint16_t *) &pkts_start;
+
+    for (int p = 0; p < PKT_COUNT; p++) {
+
+        const uint16_t *end = next_pkt_end(curr, &pkts_end);
+        if (end == NULL) {
+            printf("ERROR: packet %d not terminated\n", p);
+            qemu_exit(1);
+        }
+
+        // the stop sequence is not part of the packet
+        struct xdp_md packet = {
+            .data = (__u32) ((uint64_t) curr - ebpf_pkt_mem_base),
+            .data_end = (__u32) ((uint64_t) (end - STOP_SEQ_NO) - ebpf_pkt_mem_base),
+            .ingress_ifindex = 99,
+        };
+
+        int ret = bpf_main(&packet, sizeof(struct xdp_md));
+        if (ret >= 0 && ret <= XDP_REDIRECT) {
+            verdicts[ret]++;
+        }
+
+        curr = end;
+    }
+
+    printf("Processed %d packets\n", PKT_COUNT);
+    printf("XDP_ABORTED: %d, XDP_DROP: %d, XDP_PASS: %d\n", verdicts[XDP_ABORTED], verdicts[XDP_DROP], verdicts[XDP_PASS]);
+
+    bpf_prof_dump();
+    qemu_exit(0);
+}
@@ -0,0 +1,56 @@
+#include <linux/bpf.h>
+#include <bpf/bpf_helpers.h>
+#include <stddef.h>
+#include <linux/if_ether.h>
+#include <linux/ip.h>
+#include <linux/tcp.h>
+#include <bpf/bpf_endian.h>
+#include <stdint.h>
+
+#define ETH_P_IP 0x0800
+
+// 192.168.2.0/24
+#define ACL_NET 0xC0A80200
+#define ACL_MASK 0xFFFFFF00
+
+#define SSH_PORT 22
+
+/*
+ * Stateless ACL on fixed header fields: no helpers, no maps and no writes,
+ * so the verdict only depends on a few bytes of the packet.
+ * - non IPv4 traffic is passed
+ * - TCP from ACL_NET is passed only towards SSH_PORT
+ * - everything else is dropped
+ */
+SEC("xdp")
+int xdp_acl(struct xdp_md *ctx) {
+
+    void *data = (void *)(long)ctx->data;
+    void *data_end = (void *)(long)ctx->data_end;
+
+    struct ethhdr *eth = data;
+    struct iphdr *ip = (void *)(eth + 1);
+
+    // fixed 20 bytes IPv4 header
+    struct tcphdr *tcp = (void *)(ip + 1);
+
+    if ((void *)(tcp + 1) > data_end) {
+        return XDP_PASS;
+    }
+
+    if (eth->h_proto != bpf_htons(ETH_P_IP)) {
+        return XDP_PASS;
+    }
+
+    if ((bpf_ntohl(ip->saddr) & ACL_MASK) != ACL_NET || ip->protocol != IPPROTO_TCP) {
+        return XDP_DROP;
+    }
+
+    if (tcp->dest != bpf_htons(SSH_PORT) && tcp->source != bpf_htons(SSH_PORT)) {
+        return XDP_DROP;
+    }
+
+    return XDP_PASS;
+}
+
+char LICENSE[] SEC("license") = "Dual BSD/GPL";
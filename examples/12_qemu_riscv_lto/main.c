@@ -0,0 +1,95 @@
+//
+// Created by Davide Collovigh on 19/10/26.
+//
+
+#include "../../rv64_baremetal_runtime/qemu_rv_uart.h"
+#include "../../rv64_baremetal_runtime/qemu_rv_exit.h"
+#include "../../rv64_baremetal_runtime/bpf_helpers.h"
+#include "../../rv64_baremetal_runtime/load_pkt_from_mem.h"
+
+#include "pkts.h"
+
+// Times the whole trace is processed
+#define REPEAT 20
+
+// defined in pkts.S
+extern const char pkts_start;
+extern const char pkts_end;
+
+// specific for RV64 qemu
+volatile char *uart_base = (volatile char *) UART0_BASE;
+
+static struct xdp_md packets[PKT_COUNT];
+static struct xdp_md *ctx[PKT_COUNT];
+
+static inline uint64_t rdtime(void)
+{
+    uint64_t t;
+    asm volatile ("rdtime %0" : "=r"(t));
+    return t;
+}
+
+// same as get_next_pkt_end(), without dumping the packet on the UART
+static const uint16_t *next_pkt_end(const uint16_t *curr, const void *region_end)
+{
+    int end_seq_cnt = 0;
+
+    while (end_seq_cnt < STOP_SEQ_NO) {
+
+        if ((const void *) curr == region_end) {
+            return NULL;
+        }
+
+        end_seq_cnt = (*curr == STOP_SEQ) ? end_seq_cnt + 1 : 0;
+        curr++;
+    }
+
+    return curr;
+}
+
+static void load_packets(void)
+{
+    const uint16_t *curr = (const uint16_t *) &pkts_start;
+
+    for (int p = 0; p < PKT_COUNT; p++) {
+
+        const uint16_t *end = next_pkt_end(curr, &pkts_end);
+        if (end == NULL) {
+            printf("ERROR: packet %d not terminated\n", p);
+            qemu_exit(1);
+        }
+
+        packets[p].data = (__u32) ((uint64_t) curr - ebpf_pkt_mem_base);
+        packets[p].data_end = (__u32) ((uint64_t) (end - STOP_SEQ_NO) - ebpf_pkt_mem_base);
+        packets[p].ingress_ifindex = 99;
+        ctx[p] = &packets[p];
+
+        curr = end;
+    }
+}
+
+int main() {
+    UART0_FCR = UARTFCR_FFENA;    // Set the FIFO for polled operation
+    uart_puts("Started runtime\n");
+
+    load_packets();
+
+    int verdicts[XDP_REDIRECT + 1] = { 0 };
+
+    uint64_t start = rdtime();
+    for (int r = 0; r < REPEAT; r++) {
+        for (int p = 0; p < PKT_COUNT; p++) {
+            int verdict = bpf_main(ctx[p], sizeof(struct xdp_md));
+            if (r == 0 && verdict >= 0 && verdict <= XDP_REDIRECT) {
+                verdicts[verdict]++;
+            }
+        }
+    }
+    uint64_t ticks = rdtime() - start;
+
+    printf("Packets: %d x %d\n", PKT_COUNT, REPEAT);
+    printf("XDP_PASS: %d XDP_DROP: %d\n", verdicts[XDP_PASS], verdicts[XDP_DROP]);
+    printf("bpf_main: %d ticks, %d per packet\n", (int) ticks, (int) (ticks / (PKT_COUNT * REPEAT)));
+
+    qemu_exit(0);
+}
@@ -0,0 +1,85 @@
+#include <linux/bpf.h>
+#include <bpf/bpf_helpers.h>
+#include <stddef.h>
+#include <linux/if_ether.h>
+#include <linux/ip.h>
+#include <linux/tcp.h>
+#include <bpf/bpf_endian.h>
+#include <stdint.h>
+
+#define ETH_P_IP 0x0800
+
+// Flows are spread over BUCKETS buckets, the ones in DROP_BUCKETS are dropped
+#define BUCKETS 16
+#define DROP_BUCKETS 0x8421
+
+// Bytes of a packet counted in its bucket
+#define MAX_COUNTED_LEN 1500
+
+#define JHASH_INITVAL 0xdeadbeef
+
+// Bytes of the IPv4 packets seen by each bucket, in .bss
+__u64 bucket_bytes[BUCKETS] = { 0 };
+
+// rori with Zbb, two shifts and an or without
+static __always_inline __u32 rol32(__u32 word, unsigned int shift)
+{
+    return (word << shift) | (word >> ((-shift) & 31));
+}
+
+// jhash_3words() of include/linux/jhash.h
+static __always_inline __u32 jhash_3words(__u32 a, __u32 b, __u32 c, __u32 initval)
+{
+    a += initval + JHASH_INITVAL;
+    b += initval + JHASH_INITVAL;
+    c += initval + JHASH_INITVAL;
+
+    c ^= b; c -= rol32(b, 14);
+    a ^= c; a -= rol32(c, 11);
+    b ^= a; b -= rol32(a, 25);
+    c ^= b; c -= rol32(b, 16);
+    a ^= c; a -= rol32(c, 4);
+    b ^= a; b -= rol32(a, 14);
+    c ^= b; c -= rol32(b, 24);
+
+    return c;
+}
+
+/*
+ * Flow steering, built around the instructions of Zbb:
+ * - the addresses and ports are byte swapped to host order (rev8)
+ * - the 5-tuple is hashed with the rotates of jhash (rori)
+ * - the length counted in the bucket is clamped to the MTU (minu)
+ * Non IPv4/TCP traffic is passed, flows hashed to one of DROP_BUCKETS are dropped.
+ */
+SEC("xdp")
+int xdp_flow_hash(struct xdp_md *ctx) {
+
+    void *data = (void *)(long)ctx->data;
+    void *data_end = (void *)(long)ctx->data_end;
+
+    struct ethhdr *eth = data;
+    struct iphdr *ip = (void *)(eth + 1);
+
+    // fixed 20 bytes IPv4 header
+    struct tcphdr *tcp = (void *)(ip + 1);
+
+    if ((void *)(tcp + 1) > data_end) {
+        return XDP_PASS;
+    }
+
+    if (eth->h_proto != bpf_htons(ETH_P_IP) || ip->protocol != IPPROTO_TCP) {
+        return XDP_PASS;
+    }
+
+    __u32 ports = ((__u32)bpf_ntohs(tcp->source) << 16) | bpf_ntohs(tcp->dest);
+    __u32 hash = jhash_3words(bpf_ntohl(ip->saddr), bpf_ntohl(ip->daddr), ports, ip->protocol);
+    __u32 bucket = hash % BUCKETS;
+
+    __u32 len = bpf_ntohs(ip->tot_len);
+    bucket_bytes[bucket] += len < MAX_COUNTED_LEN ? len : MAX_COUNTED_LEN;
+
+    return (DROP_BUCKETS >> bucket) & 1 ? XDP_DROP : XDP_PASS;
+}
+
+char LICENSE[] SEC("license") = "Dual BSD/GPL";
@@ -0,0 +1,104 @@
+#include <linux/bpf.h>
+#include <bpf/bpf_helpers.h>
+#include <stddef.h>
+#include <linux/if_ether.h>
+#include <linux/ip.h>
+#include <linux/tcp.h>
+#include <linux/udp.h>
+#include <bpf/bpf_endian.h>
+#include <stdint.h>
+
+#define ETH_P_IP 0x0800
+#define ETH_P_8021Q 0x8100
+
+// 192.168.2.0/24
+#define ACL_NET 0xC0A80200
+#define ACL_MASK 0xFFFFFF00
+
+#define SSH_PORT 22
+#define DNS_PORT 53
+
+// 802.1Q tag, after the MAC addresses
+struct vlan_hdr {
+    __be16 h_vlan_TCI;
+    __be16 h_vlan_encapsulated_proto;
+};
+
+// Packets dropped, in .bss
+__u64 dropped = 0;
+
+/*
+ * ACL parsing every header variant it may meet:
+ * - an optional 802.1Q tag
+ * - IPv4 with options (the L4 header is at ihl * 4)
+ * - TCP and UDP
+ * Non IPv4 traffic and truncated headers are passed. From ACL_NET, TCP is passed only towards SSH_PORT and UDP only
+ * towards DNS_PORT; everything else is dropped and counted.
+ */
+SEC("xdp")
+int xdp_acl(struct xdp_md *ctx) {
+
+    void *data = (void *)(long)ctx->data;
+    void *data_end = (void *)(long)ctx->data_end;
+
+    struct ethhdr *eth = data;
+    __u64 offset = sizeof(*eth);
+
+    if ((void *)(eth + 1) > data_end) {
+        return XDP_PASS;
+    }
+
+    __be16 proto = eth->h_proto;
+    if (proto == bpf_htons(ETH_P_8021Q)) {
+        struct vlan_hdr *vlan = data + offset;
+
+        if ((void *)(vlan + 1) > data_end) {
+            return XDP_PASS;
+        }
+        proto = vlan->h_vlan_encapsulated_proto;
+        offset += sizeof(*vlan);
+    }
+
+    if (proto != bpf_htons(ETH_P_IP)) {
+        return XDP_PASS;
+    }
+
+    struct iphdr *ip = data + offset;
+    if ((void *)(ip + 1) > data_end) {
+        return XDP_PASS;
+    }
+    if (ip->ihl < 5) {
+        goto drop;
+    }
+    offset += ip->ihl * 4;
+
+    if ((bpf_ntohl(ip->saddr) & ACL_MASK) != ACL_NET) {
+        goto drop;
+    }
+
+    if (ip->protocol == IPPROTO_TCP) {
+        struct tcphdr *tcp = data + offset;
+
+        if ((void *)(tcp + 1) > data_end) {
+            return XDP_PASS;
+        }
+        if (tcp->dest == bpf_htons(SSH_PORT) || tcp->source == bpf_htons(SSH_PORT)) {
+            return XDP_PASS;
+        }
+    } else if (ip->protocol == IPPROTO_UDP) {
+        struct udphdr *udp = data + offset;
+
+        if ((void *)(udp + 1) > data_end) {
+            return XDP_PASS;
+        }
+        if (udp->dest == bpf_htons(DNS_PORT) || udp->source == bpf_htons(DNS_PORT)) {
+            return XDP_PASS;
+        }
+    }
+
+drop:
+    __sync_fetch_and_add(&dropped, 1);
+    return XDP_DROP;
+}
+
+char LICENSE[] SEC("license") = "Dual BSD/GPL";
@@ -0,0 +1,118 @@
+#include <linux/bpf.h>
+#include <bpf/bpf_helpers.h>
+#include <stddef.h>
+#include <linux/if_ether.h>
+#include <linux/ip.h>
+#include <linux/tcp.h>
+#include <bpf/bpf_endian.h>
+#include <stdint.h>
+
+#define ETH_P_IP 0x0800
+
+// TCP options walked before giving up (NOPs included)
+#define MAX_TCP_OPTS 8
+
+#define TCPOPT_EOL 0
+#define TCPOPT_NOP 1
+#define TCPOPT_TIMESTAMP 8
+#define TCPOLEN_TIMESTAMP 10
+
+// Packets with a bad IPv4 checksum and TCP segments without timestamps, in .bss
+__u64 bad_csum = 0;
+__u64 no_timestamp = 0;
+
+// IPv4 header checksum, 0 if the header (without options) is valid
+static __always_inline __u16 ip_checksum(const __u16 *words)
+{
+    __u32 sum = 0;
+
+    // kept as a loop in the eBPF object, unrolled or not by the build
+#pragma clang loop unroll(disable)
+    for (unsigned int i = 0; i < sizeof(struct iphdr) / 2; i++) {
+        sum += words[i];
+    }
+
+    sum = (sum & 0xFFFF) + (sum >> 16);
+    sum = (sum & 0xFFFF) + (sum >> 16);
+    return ~sum & 0xFFFF;
+}
+
+// 1 if the options of the segment have a timestamp, 0 if they do not, -1 if they are truncated
+static __always_inline int has_timestamp(const __u8 *opt, const __u8 *opts_end, void *data_end)
+{
+#pragma clang loop unroll(disable)
+    for (int i = 0; i < MAX_TCP_OPTS; i++) {
+        if (opt >= opts_end) {
+            return 0;
+        }
+        if ((void *)(opt + 2) > data_end) {
+            return -1;
+        }
+
+        if (opt[0] == TCPOPT_EOL) {
+            return 0;
+        }
+        if (opt[0] == TCPOPT_NOP) {
+            opt++;
+            continue;
+        }
+        if (opt[0] == TCPOPT_TIMESTAMP && opt[1] == TCPOLEN_TIMESTAMP) {
+            return 1;
+        }
+        if (opt[1] < 2) {
+            return -1;
+        }
+        opt += opt[1];
+    }
+
+    return 0;
+}
+
+/*
+ * Sanity checks of the TCP traffic, with the code the knobs of tune act on:
+ * - the IPv4 checksum and the walk of the TCP options are loops (--unroll)
+ * - packets with a bad checksum are rare and counted on a cold path (hot/cold splitting)
+ * Non IPv4/TCP traffic is passed. Packets with a bad checksum or truncated options are dropped, and so are TCP
+ * segments carrying data without timestamps (PAWS, RFC 7323).
+ */
+SEC("xdp")
+int xdp_check(struct xdp_md *ctx) {
+
+    void *data = (void *)(long)ctx->data;
+    void *data_end = (void *)(long)ctx->data_end;
+
+    struct ethhdr *eth = data;
+    struct iphdr *ip = (void *)(eth + 1);
+
+    // fixed 20 bytes IPv4 header
+    struct tcphdr *tcp = (void *)(ip + 1);
+
+    if ((void *)(tcp + 1) > data_end) {
+        return XDP_PASS;
+    }
+
+    if (eth->h_proto != bpf_htons(ETH_P_IP) || ip->ihl != 5 || ip->protocol != IPPROTO_TCP) {
+        return XDP_PASS;
+    }
+
+    if (ip_checksum((const __u16 *)ip) != 0) {
+        __sync_fetch_and_add(&bad_csum, 1);
+        return XDP_DROP;
+    }
+
+    const __u8 *opts = (const __u8 *)(tcp + 1);
+    int timestamp = has_timestamp(opts, (const __u8 *)tcp + tcp->doff * 4, data_end);
+    if (timestamp < 0) {
+        return XDP_DROP;
+    }
+
+    int payload = bpf_ntohs(ip->tot_len) - (int)sizeof(*ip) - tcp->doff * 4;
+    if (!timestamp && payload > 0) {
+        __sync_fetch_and_add(&no_timestamp, 1);
+        return XDP_DROP;
+    }
+
+    return XDP_PASS;
+}
+
+char LICENSE[] SEC("license") = "Dual BSD/GPL";
@@ -0,0 +1,54 @@
+#include <linux/bpf.h>
+#include <bpf/bpf_helpers.h>
+#include <stddef.h>
+#include <linux/if_ether.h>
+#include <linux/ip.h>
+#include <linux/udp.h>
+#include <bpf/bpf_endian.h>
+#include <stdint.h>
+
+#define ETH_P_IP 0x0800
+
+// Verdict of each destination port (low byte), frozen at build time from ports.bin
+struct {
+    __uint(type, BPF_MAP_TYPE_ARRAY);
+    __uint(max_entries, 256);
+    __type(key, __u32);
+    __type(value, __u32);
+} port_verdicts SEC(".maps");
+
+/*
+ * Port filter reading a frozen table at a key taken from the packet:
+ * - non IPv4, non TCP/UDP traffic is passed
+ * - TCP and UDP get the verdict of port_verdicts[dest & 0xff]
+ */
+SEC("xdp")
+int xdp_ports(struct xdp_md *ctx) {
+
+    void *data = (void *)(long)ctx->data;
+    void *data_end = (void *)(long)ctx->data_end;
+
+    struct ethhdr *eth = data;
+    struct iphdr *ip = (void *)(eth + 1);
+
+    // fixed 20 bytes IPv4 header, the destination port is at the same offset for TCP and UDP
+    struct udphdr *l4 = (void *)(ip + 1);
+
+    if ((void *)(l4 + 1) > data_end) {
+        return XDP_PASS;
+    }
+
+    if (eth->h_proto != bpf_htons(ETH_P_IP) || (ip->protocol != IPPROTO_TCP && ip->protocol != IPPROTO_UDP)) {
+        return XDP_PASS;
+    }
+
+    __u32 key = bpf_ntohs(l4->dest) & 0xff;
+    __u32 *verdict = bpf_map_lookup_elem(&port_verdicts, &key);
+    if (!verdict) {
+        return XDP_ABORTED;
+    }
+
+    return *verdict;
+}
+
+char LICENSE[] SEC("license") = "Dual BSD/GPL";
@@ -0,0 +1,111 @@
+//
+// Created by Davide Collovigh on 19/10/26.
+//
+
+#include "../../rv64_baremetal_runtime/qemu_rv_uart.h"
+#include "../../rv64_baremetal_runtime/qemu_rv_exit.h"
+#include "../../rv64_baremetal_runtime/bpf_helpers.h"
+#include "../../rv64_baremetal_runtime/load_pkt_from_mem.h"
+
+#include "pkts.h"
+
+#define ETH_HLEN 14
+#define IP_HLEN 20
+#define ETH_P_IP 0x0800
+#define IPPROTO_TCP 6
+#define IPPROTO_UDP 17
+
+// defined in pkts.S
+extern const char pkts_start;
+extern const char pkts_end;
+
+// defined in ports.S, the table frozen into the program
+extern const uint32_t ports_start[256];
+
+// specific for RV64 qemu
+volatile char *uart_base = (volatile char *) UART0_BASE;
+
+static struct xdp_md packets[PKT_COUNT];
+
+// same as get_next_pkt_end(), without dumping the packet on the UART
+static const uint16_t *next_pkt_end(const uint16_t *curr, const void *region_end)
+{
+    int end_seq_cnt = 0;
+
+    while (end_seq_cnt < STOP_SEQ_NO) {
+
+        if ((const void *) curr == region_end) {
+            return NULL;
+        }
+
+        end_seq_cnt = (*curr == STOP_SEQ) ? end_seq_cnt + 1 : 0;
+        curr++;
+    }
+
+    return curr;
+}
+
+static void load_packets(void)
+{
+    const uint16_t *curr = (const uint16_t *) &pkts_start;
+
+    for (int p = 0; p < PKT_COUNT; p++) {
+
+        const uint16_t *end = next_pkt_end(curr, &pkts_end);
+        if (end == NULL) {
+            printf("ERROR: packet %d not terminated\n", p);
+            qemu_exit(1);
+        }
+
+        packets[p].data = (__u32) ((uint64_t) curr - ebpf_pkt_mem_base);
+        packets[p].data_end = (__u32) ((uint64_t) (end - STOP_SEQ_NO) - ebpf_pkt_mem_base);
+        packets[p].ingress_ifindex = 99;
+
+        curr = end;
+    }
+}
+
+// verdict of xdp_ports, computed from the snapshot
+static int expected_verdict(const struct xdp_md *pkt)
+{
+    const uint8_t *data = (const uint8_t *) (ebpf_pkt_mem_base + pkt->data);
+
+    if (pkt->data_end - pkt->data < ETH_HLEN + IP_HLEN + 8) {
+        return XDP_PASS;
+    }
+
+    uint16_t proto = (data[12] << 8) | data[13];
+    uint8_t l4_proto = data[ETH_HLEN + 9];
+    if (proto != ETH_P_IP || (l4_proto != IPPROTO_TCP && l4_proto != IPPROTO_UDP)) {
+        return XDP_PASS;
+    }
+
+    return (int) ports_start[data[ETH_HLEN + IP_HLEN + 3]];
+}
+
+int main() {
+    UART0_FCR = UARTFCR_FFENA;    // Set the FIFO for polled operation
+    uart_puts("Started runtime\n");
+
+    load_packets();
+
+    int verdicts[XDP_REDIRECT + 1] = { 0 };
+    int mismatches = 0;
+
+    for (int p = 0; p < PKT_COUNT; p++) {
+        int verdict = bpf_main(&packets[p], sizeof(struct xdp_md));
+        if (verdict >= 0 && verdict <= XDP_REDIRECT) {
+            verdicts[verdict]++;
+        }
+        if (verdict != expected_verdict(&packets[p])) {
+            printf("packet %d: verdict %d, expected %d\n", p, verdict, expected_verdict(&packets[p]));
+            mismatches++;
+        }
+    }
+
+    printf("Packets: %d\n", PKT_COUNT);
+    printf("XDP_PASS: %d XDP_DROP: %d\n", verdicts[XDP_PASS], verdicts[XDP_DROP]);
+    printf("Mismatches: %d\n", mismatches);
+
+    qemu_exit(mismatches ? 1 : 0);
+}
@@ -0,0 +1,68 @@
+#!/usr/bin/env python3
+"""
+Converts a tcpdump -XX capture (see packet_capture_hex.txt) into the packet
+layout read by the runtime: each packet is followed by STOP_SEQ_NO (4) 0xFFFF
+half words. Packets with an odd length are padded with a zero byte.
+
+Usage: capture_to_bin.py CAPTURE OUT_BIN OUT_HEADER [--max N]
+"""
+
+import argparse
+import re
+
+STOP_SEQ = b"\xff\xff" * 4
+DATA_LINE = re.compile(r"^\s+0x[0-9a-fA-F]+:\s+")
+
+
+def parse(path):
+    packets = []
+    current = None
+
+    with open(path) as f:
+        for line in f:
+            match = DATA_LINE.match(line)
+
+            # header line -> new packet
+            if not match:
+                if current:
+                    packets.append(current)
+                current = bytearray()
+                continue
+
+            # 8 groups of 4 hex digits, followed by the ascii dump
+            hex_part = line[match.end():match.end() + 39]
+            current += bytes.fromhex(hex_part.replace(" ", ""))
+
+    if current:
+        packets.append(current)
+
+    return packets
+
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument("capture")
+    parser.add_argument("out_bin")
+    parser.add_argument("out_header")
+    parser.add_argument("--max", type=int, default=0, help="max number of packets (0 = all)")
+    args = parser.parse_args()
+
+    packets = parse(args.capture)
+    if args.max:
+        packets = packets[:args.max]
+
+    with open(args.out_bin, "wb") as f:
+        for pkt in packets:
+            if len(pkt) % 2:
+                pkt += b"\x00"
+            f.write(pkt + STOP_SEQ)
+
+    with open(args.out_header, "w") as f:
+        f.write("// Generated by capture_to_bin.py, do not edit\n")
+        f.write("#define PKT_COUNT %d\n" % len(packets))
+
+    print("%d packets written to %s" % (len(packets), args.out_bin))
+
+
+if __name__ == "__main__":
+    main()
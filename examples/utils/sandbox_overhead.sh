@@ -0,0 +1,38 @@
+#!/bin/bash
+# Compares the code of each example built unchecked and with --sandbox.
+# Run after building the examples (needs <example>/.output/main.bpf.o).
+#
+# usage: ./sandbox_overhead.sh [EXAMPLE_DIR...]
+
+EBPF_LLVM_JIT=${EBPF_LLVM_JIT:-$(dirname "$0")/../../ebpf_llvm_jit}
+OBJDUMP=${OBJDUMP:-riscv64-unknown-elf-objdump}
+EXAMPLES=${*:-$(dirname "$0")/../0*}
+
+TMP=$(mktemp -d)
+trap 'rm -rf $TMP' EXIT
+
+# instructions of bpf_main (and of the cold functions outlined from it)
+count_insts() {
+    $OBJDUMP -d "$1" | awk '/^[0-9a-f]+ <bpf_main(\.cold[.0-9]*)?>:/ { f = 1; next } /^[0-9a-f]+ <[^.].*>:/ { f = 0 } f && /^ +[0-9a-f]+:/ { n++ } END { print n + 0 }'
+}
+
+printf "%-40s %-16s %10s %10s %9s %s\n" "EXAMPLE" "PROGRAM" "UNCHECKED" "SANDBOX" "OVERHEAD" "MASKED ACCESSES"
+
+for dir in $EXAMPLES; do
+    bpf="$dir/.output/main.bpf.o"
+    [ -f "$bpf" ] || continue
+
+    mkdir -p "$TMP/plain" "$TMP/sandbox"
+    rm -f "$TMP"/plain/*.o "$TMP"/sandbox/*.o
+
+    $EBPF_LLVM_JIT build "$bpf" -o "$TMP/plain" > /dev/null 2>&1 || { echo "$(basename "$dir"): build failed"; continue; }
+    masked=$($EBPF_LLVM_JIT build --sandbox "$bpf" -o "$TMP/sandbox" 2>&1 | sed -n 's/.*Sandbox: masked \([0-9]* of [0-9]*\).*/\1/p' | paste -sd,)
+
+    for obj in "$TMP"/plain/*.o; do
+        prog=$(basename "$obj" .o)
+        plain=$(count_insts "$obj")
+        sandbox=$(count_insts "$TMP/sandbox/$prog.o")
+        overhead=$(awk -v a="$plain" -v b="$sandbox" 'BEGIN { if (a) printf "%+.1f%%", (b - a) * 100 / a; else print "-" }')
+        printf "%-40s %-16s %10s %10s %9s %s\n" "$(basename "$dir")" "$prog" "$plain" "$sandbox" "$overhead" "$masked"
+    done
+done
@@ -6,6 +6,7 @@
 #define BAREMETAL_RV_BPF_HELPERS_H
 
 #include <stdarg.h>
+#include <stddef.h>
 #include <stdint.h>
 #include "memory.h"
 
@@ -25,14 +26,107 @@ struct xdp_md {
     __u32 egress_ifindex;   /* txq->dev->ifindex */
 };
 
+/**
+ * @brief verdicts returned by XDP programs
+ *
+ */
+enum xdp_action {
+    XDP_ABORTED = 0,
+    XDP_DROP,
+    XDP_PASS,
+    XDP_TX,
+    XDP_REDIRECT,
+};
+
 /**
  * @brief bpf program
  * 
  * @param ctx 
  * @param size 
- * @return int
+ * @return verdict (same prototype as the compiled bpf_main, so that LTO can inline it)
+ */
+uint64_t bpf_main(void* ctx, uint64_t size);
+
+/**
+ * @brief runs bpf_main on n packets, loading the next packets while the current one runs (only built with --prefetch-batch)
+ *
+ * @param ctx array of n contexts
+ * @param n number of packets
+ * @param verdicts result of bpf_main for each packet
+ */
+void bpf_main_batch(struct xdp_md *ctx[], uint64_t n, int verdicts[]);
+
+/**
+ * @brief runs bpf_main on n packets, VLEN/32 packets at a time (only built with --spmd, requires RVV)
+ *
+ * @param ctx array of n contexts
+ * @param n number of packets
+ * @param verdicts result of bpf_main for each packet
+ */
+void bpf_main_spmd(struct xdp_md *ctx[], uint64_t n, int verdicts[]);
+
+/**
+ * @brief entry point of a program (same prototype as bpf_main), each object also exports bpf_main as bpf_prog_<name>
+ */
+typedef uint64_t (*bpf_prog_t)(void *ctx, uint64_t size);
+
+/**
+ * @brief table of a BPF_MAP_TYPE_PROG_ARRAY map, exported as bpf_prog_array_<map name>
+ *
+ * Slots not given with --prog-array at build time are NULL, the runtime can fill them
+ * before running the programs (e.g. bpf_prog_array_jmp_table.progs[1] = bpf_prog_stage1)
+ */
+struct bpf_prog_array {
+    uint64_t max_entries;
+    bpf_prog_t progs[];
+};
+
+/**
+ * @brief map of the eBPF ELF, exported as bpf_map_<map name> (ARRAY, HASH and LRU_HASH maps)
+ *
+ * Map pointers passed to the helpers point to the descriptor. ARRAY elements are value_size
+ * rounded up to 8 bytes; HASH and LRU_HASH maps get the storage of the helpers of bpf_maps.h.
+ */
+struct bpf_map {
+    uint32_t type;
+    uint32_t key_size;
+    uint32_t value_size;
+    uint32_t max_entries;
+    void *data;     // bpf_map_<map name>_data, zeroed, in .bss.bpf_map.<map name>
+};
+
+/**
+ * @brief entry points of a program of an object built with --single-object
+ */
+struct bpf_prog_desc {
+    const char *name;
+    bpf_prog_t prog;
+    void (*batch)(struct xdp_md *ctx[], uint64_t n, int verdicts[]);  // NULL if not built with --prefetch-batch
+    void (*spmd)(struct xdp_md *ctx[], uint64_t n, int verdicts[]);  // NULL if not built with --spmd
+};
+
+extern const struct bpf_prog_desc bpf_progs[];
+extern const uint64_t bpf_progs_cnt;
+
+/**
+ * @brief looks up a program of a --single-object build by name
+ *
+ * @return NULL if there is no program with that name
  */
-int bpf_main(void* ctx, uint64_t size);
+static inline const struct bpf_prog_desc *bpf_prog_find(const char *name)
+{
+    for (uint64_t i = 0; i < bpf_progs_cnt; i++) {
+        const char *a = bpf_progs[i].name, *b = name;
+        while (*a && *a == *b) {
+            a++;
+            b++;
+        }
+        if (*a == *b) {
+            return &bpf_progs[i];
+        }
+    }
+    return NULL;
+}
 
 /**
  * @brief bpf_printk - prints formatted text
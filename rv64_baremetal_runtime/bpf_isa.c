@@ -0,0 +1,174 @@
+//
+// Created by Davide Collovigh on 19/10/26.
+//
+
+#include "bpf_isa.h"
+
+#include <stddef.h>
+
+// Flattened device tree
+#define FDT_MAGIC 0xd00dfeed
+#define FDT_BEGIN_NODE 1
+#define FDT_END_NODE 2
+#define FDT_PROP 3
+#define FDT_NOP 4
+
+// Longest extension name of a variant
+#define ISA_EXT_MAX 32
+
+uint64_t bpf_boot_fdt = 0;
+
+static const char *selected = "";
+
+static uint32_t be32(const uint8_t *p)
+{
+    return (uint32_t) p[0] << 24 | (uint32_t) p[1] << 16 | (uint32_t) p[2] << 8 | p[3];
+}
+
+static int str_eq(const char *a, const char *b)
+{
+    while (*a && *a == *b) {
+        a++;
+        b++;
+    }
+    return *a == *b;
+}
+
+static uint32_t str_size(const char *s)
+{
+    uint32_t n = 0;
+    while (s[n]) {
+        n++;
+    }
+    return n + 1;
+}
+
+// riscv,isa property of the first cpu node (e.g. "rv64imafdc_zicsr_zbb"), NULL without device tree
+static const char *fdt_isa(void)
+{
+    const uint8_t *fdt = (const uint8_t *) bpf_boot_fdt;
+    if (fdt == NULL || be32(fdt) != FDT_MAGIC) {
+        return NULL;
+    }
+
+    const uint8_t *p = fdt + be32(fdt + 8);                 // off_dt_struct
+    const char *strings = (const char *) fdt + be32(fdt + 12);   // off_dt_strings
+
+    for (;;) {
+        uint32_t token = be32(p);
+        p += 4;
+
+        switch (token) {
+            case FDT_BEGIN_NODE:
+                p += (str_size((const char *) p) + 3) & ~3;
+                break;
+            case FDT_PROP: {
+                uint32_t len = be32(p);
+                const char *name = strings + be32(p + 4);
+                p += 8;
+                if (str_eq(name, "riscv,isa")) {
+                    return (const char *) p;
+                }
+                p += (len + 3) & ~3;
+                break;
+            }
+            case FDT_END_NODE:
+            case FDT_NOP:
+                break;
+            default:    // FDT_END
+                return NULL;
+        }
+    }
+}
+
+static uint64_t read_misa(void)
+{
+    uint64_t misa;
+    __asm__ volatile("csrr %0, misa" : "=r"(misa));
+    return misa;
+}
+
+int bpf_isa_has(const char *extension)
+{
+    // misa has a bit per single letter extension (0 if not implemented)
+    uint64_t misa = read_misa();
+    if (extension[0] >= 'a' && extension[0] <= 'z' && extension[1] == '\0' && misa) {
+        return (misa >> (extension[0] - 'a')) & 1;
+    }
+
+    const char *isa = fdt_isa();
+    if (isa == NULL) {
+        return 0;
+    }
+
+    // "rv64" + single letters, then "_" + multi-letter extensions
+    const char *s = isa + 4;
+    if (extension[1] == '\0') {
+        for (; *s && *s != '_'; s++) {
+            if (*s == extension[0]) {
+                return 1;
+            }
+        }
+        return 0;
+    }
+
+    while (*s) {
+        if (*s++ != '_') {
+            continue;
+        }
+        const char *e = extension;
+        while (*e && *e == *s) {
+            e++;
+            s++;
+        }
+        if (*e == '\0' && (*s == '_' || *s == '\0')) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// every extension of a comma separated list
+static int has_all(const char *extensions)
+{
+    char name[ISA_EXT_MAX];
+
+    while (*extensions) {
+        int n = 0;
+        while (*extensions && *extensions != ',') {
+            if (n < ISA_EXT_MAX - 1) {
+                name[n++] = *extensions;
+            }
+            extensions++;
+        }
+        name[n] = '\0';
+        if (*extensions == ',') {
+            extensions++;
+        }
+
+        if (!bpf_isa_has(name)) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+void bpf_isa_init(void)
+{
+    if (bpf_isa_variants == NULL || &bpf_isa_main == NULL) {
+        return;
+    }
+
+    for (const struct bpf_isa_variant *variant = bpf_isa_variants; variant->extensions; variant++) {
+        if (has_all(variant->extensions)) {
+            bpf_isa_main = variant->main;
+            selected = variant->extensions;
+            return;
+        }
+    }
+}
+
+const char *bpf_isa_selected(void)
+{
+    return selected;
+}
@@ -0,0 +1,49 @@
+//
+// Created by Davide Collovigh on 19/10/26.
+//
+
+#ifndef BAREMETAL_RV_BPF_ISA_H
+#define BAREMETAL_RV_BPF_ISA_H
+
+#include <stdint.h>
+
+/**************************
+ * ISA VARIANTS (--isa-variant)
+ **************************/
+
+// Variant of bpf_main emitted by the compiler
+struct bpf_isa_variant {
+    const char *extensions;     // comma separated ISA names, e.g. "zbb,v"
+    void *main;
+};
+
+// Emitted by the compiler, undefined (NULL) if the program has no variants.
+// The table is in order of preference and ends with { NULL, NULL }.
+extern const struct bpf_isa_variant bpf_isa_variants[] __attribute__((weak));
+extern void *bpf_isa_main __attribute__((weak));
+
+// Device tree passed by the boot loader in a1 (QEMU -bios), saved by start.S
+extern uint64_t bpf_boot_fdt;
+
+/**
+ * @brief makes bpf_main run the first variant whose extensions the hart has, called by start.S before main
+ *
+ * Called once, on hart 0, before the other harts are released: the harts are expected to have the same ISA.
+ * Does nothing if the program has no variants (bpf_main runs the code of the --target CPU).
+ */
+void bpf_isa_init(void);
+
+/**
+ * @brief 1 if the hart has an extension (lowercase ISA name, e.g. "c" or "zbb")
+ *
+ * Single letter extensions are read from misa, the others from the riscv,isa string of the
+ * device tree (unknown without one).
+ */
+int bpf_isa_has(const char *extension);
+
+/**
+ * @brief extensions of the variant run by bpf_main, "" for the code of the --target CPU
+ */
+const char *bpf_isa_selected(void);
+
+#endif //BAREMETAL_RV_BPF_ISA_H
@@ -0,0 +1,225 @@
+//
+// Created by Davide Collovigh on 19/10/26.
+//
+
+#include "bpf_maps.h"
+
+#include <stddef.h>
+
+#define SLOT_EMPTY 0
+#define SLOT_USED 1
+#define SLOT_DELETED 2
+
+static uint64_t round_up8(uint64_t size)
+{
+    return (size + 7) & ~7ull;
+}
+
+static int key_equal(const uint8_t *a, const uint8_t *b, uint32_t size)
+{
+    for (uint32_t i = 0; i < size; i++) {
+        if (a[i] != b[i]) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static void copy(uint8_t *dst, const uint8_t *src, uint32_t size)
+{
+    for (uint32_t i = 0; i < size; i++) {
+        dst[i] = src[i];
+    }
+}
+
+// FNV-1a
+static uint64_t key_hash(const uint8_t *key, uint32_t size)
+{
+    uint64_t hash = 0xcbf29ce484222325ull;
+    for (uint32_t i = 0; i < size; i++) {
+        hash = (hash ^ key[i]) * 0x100000001b3ull;
+    }
+    return hash;
+}
+
+/**************************
+ * HASH
+ **************************/
+
+static uint64_t *hash_lock(const struct bpf_map *map)
+{
+    return (uint64_t *) map->data;
+}
+
+// { uint64_t state; key; value } of slot i
+static uint64_t *hash_slot(const struct bpf_map *map, uint64_t i)
+{
+    uint64_t slot_size = 8 + round_up8(map->key_size) + round_up8(map->value_size);
+    return (uint64_t *) ((uint8_t *) map->data + 8 + i * slot_size);
+}
+
+static uint8_t *slot_key(uint64_t *slot)
+{
+    return (uint8_t *) (slot + 1);
+}
+
+static uint8_t *slot_value(const struct bpf_map *map, uint64_t *slot)
+{
+    return slot_key(slot) + round_up8(map->key_size);
+}
+
+/*
+ * Slot holding key, NULL if there is none. If free is not NULL it is set to the first slot
+ * an entry for key can be inserted in (NULL if the map is full).
+ */
+static uint64_t *hash_find(const struct bpf_map *map, const uint8_t *key, uint64_t **free)
+{
+    uint64_t home = key_hash(key, map->key_size) % map->max_entries;
+
+    if (free) {
+        *free = NULL;
+    }
+
+    for (uint64_t i = 0; i < map->max_entries; i++) {
+        uint64_t *slot = hash_slot(map, (home + i) % map->max_entries);
+        uint64_t state = __atomic_load_n(slot, __ATOMIC_ACQUIRE);
+
+        if (state != SLOT_USED) {
+            if (free && !*free) {
+                *free = slot;
+            }
+            if (state == SLOT_EMPTY) {
+                break;
+            }
+        } else if (key_equal(slot_key(slot), key, map->key_size)) {
+            return slot;
+        }
+    }
+
+    return NULL;
+}
+
+#ifdef BPF_SINGLE_HART
+
+// bpf_maps_single_hart.o: the image runs one hart, nothing to serialize (checked by baremetal.ld)
+const uint64_t bpf_maps_single_hart = 1;
+
+static void lock(uint64_t *l)
+{
+    (void) l;
+}
+
+static void unlock(uint64_t *l)
+{
+    (void) l;
+}
+
+#else
+
+static void lock(uint64_t *l)
+{
+    while (__atomic_exchange_n(l, 1, __ATOMIC_ACQUIRE)) {
+    }
+}
+
+static void unlock(uint64_t *l)
+{
+    __atomic_store_n(l, 0, __ATOMIC_RELEASE);
+}
+
+#endif
+
+static int64_t hash_update(struct bpf_map *map, const uint8_t *key, const uint8_t *value, uint64_t flags)
+{
+    uint64_t *free;
+    int64_t ret = 0;
+
+    lock(hash_lock(map));
+
+    uint64_t *slot = hash_find(map, key, &free);
+    if (slot) {
+        if (flags == BPF_NOEXIST) {
+            ret = -BPF_EEXIST;
+        } else {
+            copy(slot_value(map, slot), value, map->value_size);
+        }
+    } else if (flags == BPF_EXIST) {
+        ret = -BPF_ENOENT;
+    } else {
+        if (!free && map->type == BPF_MAP_TYPE_LRU_HASH) {
+            // evicts the entry in the first slot of key, hidden to the lookups while it is rewritten
+            free = hash_slot(map, key_hash(key, map->key_size) % map->max_entries);
+            __atomic_store_n(free, SLOT_DELETED, __ATOMIC_RELEASE);
+        }
+
+        if (free) {
+            copy(slot_key(free), key, map->key_size);
+            copy(slot_value(map, free), value, map->value_size);
+            __atomic_store_n(free, SLOT_USED, __ATOMIC_RELEASE);
+        } else {
+            ret = -BPF_E2BIG;
+        }
+    }
+
+    unlock(hash_lock(map));
+    return ret;
+}
+
+static int64_t hash_delete(struct bpf_map *map, const uint8_t *key)
+{
+    lock(hash_lock(map));
+
+    uint64_t *slot = hash_find(map, key, NULL);
+    if (slot) {
+        __atomic_store_n(slot, SLOT_DELETED, __ATOMIC_RELEASE);
+    }
+
+    unlock(hash_lock(map));
+    return slot ? 0 : -BPF_ENOENT;
+}
+
+/**************************
+ * HELPERS
+ **************************/
+
+void *_bpf_helper_ext_0001(struct bpf_map *map, const void *key)
+{
+    if (map->type == BPF_MAP_TYPE_ARRAY) {
+        uint32_t index = *(const uint32_t *) key;
+        return index < map->max_entries ? (uint8_t *) map->data + index * round_up8(map->value_size) : NULL;
+    }
+
+    uint64_t *slot = hash_find(map, key, NULL);
+    return slot ? slot_value(map, slot) : NULL;
+}
+
+int64_t _bpf_helper_ext_0002(struct bpf_map *map, const void *key, const void *value, uint64_t flags)
+{
+    if (flags > BPF_EXIST) {
+        return -BPF_EINVAL;
+    }
+
+    if (map->type == BPF_MAP_TYPE_ARRAY) {
+        uint32_t index = *(const uint32_t *) key;
+        if (index >= map->max_entries) {
+            return -BPF_E2BIG;
+        }
+        // ARRAY entries always exist
+        if (flags == BPF_NOEXIST) {
+            return -BPF_EEXIST;
+        }
+        copy((uint8_t *) map->data + index * round_up8(map->value_size), value, map->value_size);
+        return 0;
+    }
+
+    return hash_update(map, key, value, flags);
+}
+
+int64_t _bpf_helper_ext_0003(struct bpf_map *map, const void *key)
+{
+    if (map->type == BPF_MAP_TYPE_ARRAY) {
+        return -BPF_EINVAL;
+    }
+
+    return hash_delete(map, key);
+}
@@ -0,0 +1,67 @@
+//
+// Created by Davide Collovigh on 19/10/26.
+//
+
+#ifndef BAREMETAL_RV_BPF_MAPS_H
+#define BAREMETAL_RV_BPF_MAPS_H
+
+#include <stdint.h>
+#include "bpf_helpers.h"
+
+/**************************
+ * MAP HELPERS
+ **************************/
+
+// enum bpf_map_type of linux/bpf.h
+#define BPF_MAP_TYPE_HASH 1
+#define BPF_MAP_TYPE_ARRAY 2
+#define BPF_MAP_TYPE_LRU_HASH 9
+
+// Flags of bpf_map_update_elem()
+#define BPF_ANY 0
+#define BPF_NOEXIST 1
+#define BPF_EXIST 2
+
+// Errors returned by the helpers (negated)
+#define BPF_ENOENT 2
+#define BPF_E2BIG 7
+#define BPF_EEXIST 17
+#define BPF_EINVAL 22
+
+/*
+ * Storage of the HASH and LRU_HASH maps (struct bpf_map.data, sized by the compiler):
+ * a lock word, then max_entries slots of { uint64_t state; key; value } with key and value
+ * rounded up to 8 bytes. Slots are open addressed (linear probing from the hash of the key).
+ *
+ * Updates and deletes take the lock of the map, lookups do not: a pointer returned by a lookup
+ * is valid as long as its entry is not deleted, as with the RCU of the kernel, and it sees the
+ * later updates of the entry in place. bpf_maps_single_hart.o (built with -DBPF_SINGLE_HART), for
+ * the images running one hart (programs built with --harts 1), takes no lock.
+ * When full, an LRU_HASH map evicts the entry in the first slot of the new key (not the least
+ * recently used one).
+ */
+
+/**
+ * @brief bpf_map_lookup_elem, the ARRAY lookups with a known map are inlined by the compiler
+ *
+ * @return pointer to the value, NULL if there is no entry for key
+ */
+void *_bpf_helper_ext_0001(struct bpf_map *map, const void *key);
+
+/**
+ * @brief bpf_map_update_elem
+ *
+ * @param flags BPF_ANY, BPF_NOEXIST (only create) or BPF_EXIST (only update)
+ * @return 0, -BPF_EEXIST/-BPF_ENOENT if flags are not met, -BPF_E2BIG if the key is out of
+ * bound (ARRAY) or the map is full (HASH), -BPF_EINVAL for invalid flags
+ */
+int64_t _bpf_helper_ext_0002(struct bpf_map *map, const void *key, const void *value, uint64_t flags);
+
+/**
+ * @brief bpf_map_delete_elem
+ *
+ * @return 0, -BPF_ENOENT if there is no entry for key, -BPF_EINVAL on ARRAY maps
+ */
+int64_t _bpf_helper_ext_0003(struct bpf_map *map, const void *key);
+
+#endif //BAREMETAL_RV_BPF_MAPS_H
@@ -0,0 +1,114 @@
+//
+// Created by Davide Collovigh on 19/10/26.
+//
+
+#include "bpf_memo.h"
+#include "qemu_rv_uart.h"
+
+struct bpf_memo_entry {
+    uint64_t key[BPF_MEMO_MAX_KEY_WORDS];
+    int verdict;
+    int valid;
+};
+
+struct bpf_memo_cache {
+    struct bpf_memo_entry entries[BPF_MEMO_ENTRIES];
+    uint64_t hits;
+    uint64_t misses;
+};
+
+static struct bpf_memo_cache caches[BPF_MEMO_MAX_HARTS];
+
+static inline uint64_t hart_id(void)
+{
+    uint64_t id;
+    __asm__ volatile("csrr %0, mhartid" : "=r"(id));
+    return id & (BPF_MEMO_MAX_HARTS - 1);
+}
+
+// FNV-1a over the words of the key
+static uint64_t key_hash(const uint64_t key[], uint32_t words)
+{
+    uint64_t hash = 0xcbf29ce484222325ull;
+
+    for (uint32_t i = 0; i < words; i++) {
+        hash ^= key[i];
+        hash *= 0x100000001b3ull;
+    }
+
+    return hash ^ (hash >> 32);
+}
+
+int bpf_memo_run(struct xdp_md *ctx)
+{
+    if (&bpf_main_memo == NULL) {
+        return bpf_main(ctx, sizeof(struct xdp_md));
+    }
+
+    uint32_t words = bpf_main_memo.key_size / sizeof(uint64_t);
+    uint64_t key[BPF_MEMO_MAX_KEY_WORDS];
+    bpf_main_memo.key(ctx, key);
+
+    struct bpf_memo_cache *cache = &caches[hart_id()];
+    struct bpf_memo_entry *entry = &cache->entries[key_hash(key, words) & (BPF_MEMO_ENTRIES - 1)];
+
+    if (entry->valid) {
+        uint32_t i = 0;
+        while (i < words && entry->key[i] == key[i]) {
+            i++;
+        }
+        if (i == words) {
+            cache->hits++;
+            return entry->verdict;
+        }
+    }
+
+    cache->misses++;
+
+    int verdict = bpf_main(ctx, sizeof(struct xdp_md));
+    for (uint32_t i = 0; i < words; i++) {
+        entry->key[i] = key[i];
+    }
+    entry->verdict = verdict;
+    entry->valid = 1;
+
+    return verdict;
+}
+
+void bpf_memo_reset(void)
+{
+    for (int h = 0; h < BPF_MEMO_MAX_HARTS; h++) {
+        for (int i = 0; i < BPF_MEMO_ENTRIES; i++) {
+            caches[h].entries[i].valid = 0;
+        }
+        caches[h].hits = 0;
+        caches[h].misses = 0;
+    }
+}
+
+void bpf_memo_dump(void)
+{
+    char buffer[24];
+
+    if (&bpf_main_memo == NULL) {
+        uart_puts("BPF_MEMO_NONE: program not built with --memo or not stateless\n");
+        return;
+    }
+
+    for (int h = 0; h < BPF_MEMO_MAX_HARTS; h++) {
+        if (caches[h].hits + caches[h].misses == 0) {
+            continue;
+        }
+
+        uart_puts("BPF_MEMO hart ");
+        u64toa(h, buffer);
+        uart_puts(buffer);
+        uart_puts(" hits ");
+        u64toa(caches[h].hits, buffer);
+        uart_puts(buffer);
+        uart_puts(" misses ");
+        u64toa(caches[h].misses, buffer);
+        uart_puts(buffer);
+        uart_putc('\n');
+    }
+}
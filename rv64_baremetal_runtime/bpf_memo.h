@@ -0,0 +1,60 @@
+//
+// Created by Davide Collovigh on 19/10/26.
+//
+
+#ifndef BAREMETAL_RV_BPF_MEMO_H
+#define BAREMETAL_RV_BPF_MEMO_H
+
+#include <stdint.h>
+#include "bpf_helpers.h"
+
+/**************************
+ * VERDICT CACHE (--memo)
+ **************************/
+
+// Entries of the direct-mapped cache of each hart (power of two)
+#define BPF_MEMO_ENTRIES 256
+
+// Harts with their own cache, as __bpf_tail_call_cnt and the intrinsics state
+#define BPF_MEMO_MAX_HARTS 8
+
+// Largest key exported by the compiler (MEMO_MAX_KEY_SIZE)
+#define BPF_MEMO_MAX_KEY_WORDS 8
+
+/**
+ * @brief what the verdict of a stateless program depends on, exported by the compiler
+ *
+ * Packets with the same key (clamped length + the bytes of the ranges) get the same verdict.
+ */
+struct bpf_memo_desc {
+    uint32_t key_size;          // bytes, multiple of 8
+    uint32_t nr_ranges;
+    uint64_t len_limit;         // the length in the key is clamped to it (0: not clamped)
+    void (*key)(const struct xdp_md *ctx, uint64_t key[]);
+    struct {
+        uint32_t offset;
+        uint32_t size;
+    } ranges[];                 // packet bytes read by the program
+};
+
+// Undefined (NULL) if the program was not built with --memo or is not stateless
+extern const struct bpf_memo_desc bpf_main_memo __attribute__((weak));
+
+/**
+ * @brief runs bpf_main on a packet through the verdict cache of the hart
+ *
+ * On a hit bpf_main is not run. Without bpf_main_memo, bpf_main is always run.
+ */
+int bpf_memo_run(struct xdp_md *ctx);
+
+/**
+ * @brief empties the cache of every hart and resets the counters
+ */
+void bpf_memo_reset(void);
+
+/**
+ * @brief prints the hits and misses of each hart on the UART
+ */
+void bpf_memo_dump(void);
+
+#endif //BAREMETAL_RV_BPF_MEMO_H
@@ -7,54 +7,9 @@
 
 const int DEBUG_PRINTK = 0;
 
-void *get_or_rebase_arg(void *ptr, void *rebase_base)
-{
-    if (DEBUG_PRINTK) {
-        printf("\n\n");
-        printf("get_or_rebase_arg:\naddress: 0x%16x\nrebase_base: 0x%16x\n", ptr, rebase_base);
-        printf("\n");
-        printf("__stack_top:\t0x%16x\n", &__stack_top);
-        printf("__stack_bottom:\t0x%16x\n", &__stack_bottom);
-        printf("\n");
-        printf("rodata_bpf_start:\t0x%16x\n", &rodata_bpf_start);
-        printf("rodata_str1_bpf_start:\t0x%16x\n", &rodata_str1_bpf_start);
-        printf("rodata_bpf_end:\t0x%16x\n", &rodata_bpf_end);
-        printf("\n");
-        printf("rebase_base:\t0x%16x\n\n", rebase_base);
-
-        int rodata_str1_len = &rodata_bpf_end - &rodata_str1_bpf_start;
-        char * debug = (char *) &rodata_str1_bpf_start;
-
-        printf("%s\n", debug);
-
-        for(int k = 0; k < rodata_str1_len; k++) {
-            printf("0x%16x: %2x (%c)\n", &debug[k], debug[k], debug[k]);
-        }
-    }
-
-    // if address is not from stack -> rebase
-    if((ptr < (void *) &__stack_bottom) || (ptr > (void *) &__stack_top)) {
-
-        // rebase
-        char *string = (void *)(rebase_base) + (uint64_t) ptr;
-
-        if (DEBUG_PRINTK) {
-            printf("rebased: (0x%16x) %s", string, string);
-        }
-
-        return (void *) string;
-    }
-
-    return ptr;
-}
-
-
 uint64_t _bpf_helper_ext_0006(const char *fmt, uint64_t fmt_size, ...) {
     
-    /**********************************
-     * PRINTK args rebase
-     *********************************/
-
+    // fmt and %s args already point to the sections injected by the compiler
     const char *fmt_str = fmt;
 
     if (DEBUG_PRINTK) {
@@ -62,14 +17,6 @@ uint64_t _bpf_helper_ext_0006(const char *fmt, uint64_t fmt_size, ...) {
 
         printf("FMT:\t\t0x%16x\n", fmt);
         printf("fmt_size:\t%d\n", fmt_size);
-    }
-
-
-    // fmt string is always placed inside the .rodata, but I did not find any docs about it
-    // so I keep a check to make sure.
-    fmt_str = (char *) get_or_rebase_arg((void *) fmt, (void *) &rodata_bpf_start);
-
-    if (DEBUG_PRINTK) {
 
         for(int i = 0; i < fmt_size; i++) {
             printf("%2x", fmt_str[i]);
@@ -132,11 +79,10 @@ s2:
         uint32_t val = va_arg(args, uint32_t);
         hextoa(val, buffer, len);
         uart_puts(buffer);
-    } else if (format[i] == 's') { // String -> only type that is actually a pointer to what needs to be printed -> rebase if necessary
+    } else if (format[i] == 's') { // String
 
         const char* str = va_arg(args, const char*);
-        const char *str2 = (char *) get_or_rebase_arg((void *) str, (void *) &rodata_str1_bpf_start);
-        uart_puts(str2);
+        uart_puts(str);
     } else if (format[i] == 'c') { // Character
         char c = (char)va_arg(args, int);
         uart_putc(c);
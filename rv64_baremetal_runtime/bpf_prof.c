@@ -0,0 +1,32 @@
+//
+// Created by Davide Collovigh on 19/10/26.
+//
+
+#include "bpf_prof.h"
+#include "qemu_rv_uart.h"
+
+void bpf_prof_dump(void)
+{
+    char buffer[24];
+
+    if (&__bpf_prof_nr_counters == NULL) {
+        uart_puts("BPF_PROF_NONE: program not built with --instrument\n");
+        return;
+    }
+
+    uart_puts("BPF_PROF_BEGIN\n");
+
+    for (uint32_t i = 0; i < __bpf_prof_nr_counters; i++) {
+        uart_puts("BPF_PROF ");
+        uart_puts(__bpf_prof_key);
+        uart_putc(' ');
+        u64toa(__bpf_prof_pcs[i], buffer);
+        uart_puts(buffer);
+        uart_putc(' ');
+        u64toa(__bpf_prof_counters[i], buffer);
+        uart_puts(buffer);
+        uart_putc('\n');
+    }
+
+    uart_puts("BPF_PROF_END\n");
+}
@@ -0,0 +1,28 @@
+//
+// Created by Davide Collovigh on 19/10/26.
+//
+
+#ifndef BAREMETAL_RV_BPF_PROF_H
+#define BAREMETAL_RV_BPF_PROF_H
+
+#include <stdint.h>
+
+/**************************
+ * PROFILING (--instrument)
+ **************************/
+
+// Counters emitted by the compiler, undefined (NULL) if the program is not instrumented
+extern uint64_t __bpf_prof_counters[] __attribute__((weak));
+extern const uint32_t __bpf_prof_pcs[] __attribute__((weak));
+extern const uint32_t __bpf_prof_nr_counters __attribute__((weak));
+// "<program name> <instruction count> <hash of the instructions>"
+extern const char __bpf_prof_key[] __attribute__((weak));
+
+/**
+ * @brief prints the block counters on the UART, one "BPF_PROF <name> <insn_cnt> <hash> <pc> <count>" line per
+ * block. The output can be passed as is to `ebpf_llvm_jit build --profile-use`, which only uses the lines of
+ * the program it builds, and rejects them if its instructions changed since.
+ */
+void bpf_prof_dump(void);
+
+#endif //BAREMETAL_RV_BPF_PROF_H
@@ -0,0 +1,40 @@
+//
+// Created by Davide Collovigh on 19/10/26.
+//
+
+#include "bpf_sandbox.h"
+
+// Linker script
+extern const char __text_start;
+extern const char __text_end;
+extern const char __stack_top;
+
+#define CSR_WRITE(csr, val) __asm__ volatile ("csrw " #csr ", %0" :: "r"(val))
+
+void bpf_sandbox_init(void)
+{
+    if (!bpf_sandbox_enabled) {
+        return;
+    }
+
+    // 0: start of the code (lower bound of the TOR region 1)
+    CSR_WRITE(pmpaddr0, (uint64_t) &__text_start >> 2);
+    // 1: [__text_start, __text_end) code
+    CSR_WRITE(pmpaddr1, (uint64_t) &__text_end >> 2);
+    // 2: [__text_end, __stack_top) sandbox window, runtime data and stack
+    CSR_WRITE(pmpaddr2, (uint64_t) &__stack_top >> 2);
+    // 3, 4: MMIO
+    CSR_WRITE(pmpaddr3, PMP_NAPOT_ADDR(PMP_UART_BASE, PMP_UART_SIZE));
+    CSR_WRITE(pmpaddr4, PMP_NAPOT_ADDR(PMP_TEST_BASE, PMP_TEST_SIZE));
+    // 5: everything else
+    CSR_WRITE(pmpaddr5, ~0ULL);
+
+    // The addresses are written first: locking an entry also locks its address
+    uint64_t cfg = (uint64_t) 0 |
+                   (uint64_t) (PMP_L | PMP_TOR | PMP_R | PMP_X) << 8 |
+                   (uint64_t) (PMP_L | PMP_TOR | PMP_R | PMP_W) << 16 |
+                   (uint64_t) (PMP_L | PMP_NAPOT | PMP_R | PMP_W) << 24 |
+                   (uint64_t) (PMP_L | PMP_NAPOT | PMP_R | PMP_W) << 32 |
+                   (uint64_t) (PMP_L | PMP_NAPOT) << 40;
+    CSR_WRITE(pmpcfg0, cfg);
+}
@@ -0,0 +1,44 @@
+//
+// Created by Davide Collovigh on 19/10/26.
+//
+
+#ifndef BAREMETAL_RV_BPF_SANDBOX_H
+#define BAREMETAL_RV_BPF_SANDBOX_H
+
+#include <stdint.h>
+
+/**************************
+ * PMP
+ **************************/
+
+#define PMP_R 0x01
+#define PMP_W 0x02
+#define PMP_X 0x04
+#define PMP_TOR 0x08
+#define PMP_NAPOT 0x18
+#define PMP_L 0x80  // locked: the entry applies to M-mode too
+
+// NAPOT pmpaddr of a naturally aligned power of two region
+#define PMP_NAPOT_ADDR(base, size) (((base) >> 2) | (((size) >> 3) - 1))
+
+// MMIO used by the runtime
+#define PMP_UART_BASE 0x10000000
+#define PMP_UART_SIZE 0x1000
+#define PMP_TEST_BASE 0x100000
+#define PMP_TEST_SIZE 0x1000
+
+// Set by the linker script, 1 when linked with --defsym=BPF_SANDBOX=1
+extern const uint64_t bpf_sandbox_enabled;
+
+/**
+ * @brief locks the PMP regions of the sandbox, called by start.S before main
+ *
+ * The programs built with --sandbox confine their accesses by masking, the PMP catches what
+ * the masking missed (and the runtime bugs): code is R+X, RAM from the end of the code to
+ * the top of the stack is R+W, the UART and the QEMU test device are R+W, anything else traps.
+ * The entries are locked, so they apply to M-mode and cannot be changed until reset.
+ * Does nothing if the ELF was not linked with BPF_SANDBOX defined.
+ */
+void bpf_sandbox_init(void);
+
+#endif //BAREMETAL_RV_BPF_SANDBOX_H
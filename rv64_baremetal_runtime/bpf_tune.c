@@ -0,0 +1,92 @@
+//
+// Created by Davide Collovigh on 19/10/26.
+//
+
+#include "bpf_tune.h"
+#include "bpf_helpers.h"
+#include "load_pkt_from_mem.h"
+#include "qemu_rv_exit.h"
+#include "qemu_rv_uart.h"
+
+static struct xdp_md packets[BPF_TUNE_MAX_PKTS];
+
+// Instructions retired by the hart, exact under QEMU -icount
+static inline uint64_t rdinstret(void)
+{
+    uint64_t n;
+    asm volatile ("rdinstret %0" : "=r"(n));
+    return n;
+}
+
+// end of the packet starting at curr (after its STOP_SEQ), NULL if it is not terminated
+static const uint16_t *next_pkt_end(const uint16_t *curr, const void *region_end)
+{
+    int end_seq_cnt = 0;
+
+    while (end_seq_cnt < STOP_SEQ_NO) {
+
+        if ((const void *) curr == region_end) {
+            return NULL;
+        }
+
+        end_seq_cnt = (*curr == STOP_SEQ) ? end_seq_cnt + 1 : 0;
+        curr++;
+    }
+
+    return curr;
+}
+
+static int load_packets(void)
+{
+    const uint16_t *curr = (const uint16_t *) &pkts_start;
+    int count = 0;
+
+    while (count < BPF_TUNE_MAX_PKTS) {
+
+        const uint16_t *end = next_pkt_end(curr, &pkts_end);
+        if (end == NULL) {
+            break;
+        }
+
+        packets[count].data = (__u32) ((uint64_t) curr - ebpf_pkt_mem_base);
+        packets[count].data_end = (__u32) ((uint64_t) (end - STOP_SEQ_NO) - ebpf_pkt_mem_base);
+        packets[count].ingress_ifindex = 99;
+        count++;
+
+        curr = end;
+    }
+
+    return count;
+}
+
+int main() {
+    char buffer[24];
+
+    UART0_FCR = UARTFCR_FFENA;    // Set the FIFO for polled operation
+
+    int count = load_packets();
+    if (count == 0) {
+        uart_puts(BPF_TUNE_LINE_PREFIX "_NONE: empty trace\n");
+        qemu_exit(1);
+    }
+
+    uint64_t hash = 0;
+    uint64_t start = rdinstret();
+    for (int p = 0; p < count; p++) {
+        hash = hash * 31 + bpf_main(&packets[p], sizeof(struct xdp_md));
+    }
+    uint64_t instructions = rdinstret() - start;
+
+    uart_puts(BPF_TUNE_LINE_PREFIX " ");
+    u64toa(count, buffer);
+    uart_puts(buffer);
+    uart_putc(' ');
+    u64toa(instructions, buffer);
+    uart_puts(buffer);
+    uart_putc(' ');
+    u64toa(hash, buffer);
+    uart_puts(buffer);
+    uart_putc('\n');
+
+    qemu_exit(0);
+}
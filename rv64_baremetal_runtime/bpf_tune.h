@@ -0,0 +1,35 @@
+//
+// Created by Davide Collovigh on 19/10/26.
+//
+
+#ifndef BAREMETAL_RV_BPF_TUNE_H
+#define BAREMETAL_RV_BPF_TUNE_H
+
+#include <stdint.h>
+
+/**************************
+ * TUNING HARNESS (ebpf_llvm_jit tune)
+ **************************/
+
+// Packets of the trace run by the harness, the others are ignored
+#define BPF_TUNE_MAX_PKTS 4096
+
+// Prefix of the line with the result of the run
+#define BPF_TUNE_LINE_PREFIX "BPF_TUNE"
+
+// Trace linked with the harness: packets terminated by STOP_SEQ_NO STOP_SEQ (capture_to_bin.py + pkts.S)
+extern const char pkts_start;
+extern const char pkts_end;
+
+/*
+ * bpf_tune.o has its own main(): ebpf_llvm_jit tune links it with the trace, the program and the rest of
+ * the runtime, and runs the image in QEMU with -icount, where instret counts the executed instructions.
+ * main() runs bpf_main once on each packet of the trace and prints
+ *
+ *   BPF_TUNE <packets> <instructions> <hash of the verdicts>
+ *
+ * then exits QEMU. The instructions include the loop of main(), the same for every build. The hash tells
+ * apart the builds of a program that do not give the same verdicts.
+ */
+
+#endif //BAREMETAL_RV_BPF_TUNE_H
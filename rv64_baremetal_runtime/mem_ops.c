@@ -0,0 +1,99 @@
+//
+// Created by Davide Collovigh on 19/10/26.
+//
+
+#include <stdint.h>
+
+#include "mem_ops.h"
+
+#define WORD sizeof(uint64_t)
+#define IS_WORD_ALIGNED(x) (((uintptr_t)(x) & (WORD - 1)) == 0)
+
+void *memcpy(void *dst, const void *src, size_t n)
+{
+    uint8_t *d = dst;
+    const uint8_t *s = src;
+
+    if (IS_WORD_ALIGNED(d) && IS_WORD_ALIGNED(s)) {
+        for (; n >= WORD; n -= WORD, d += WORD, s += WORD) {
+            *(uint64_t *) d = *(const uint64_t *) s;
+        }
+    }
+
+    for (; n > 0; n--) {
+        *d++ = *s++;
+    }
+
+    return dst;
+}
+
+void *memmove(void *dst, const void *src, size_t n)
+{
+    uint8_t *d = dst;
+    const uint8_t *s = src;
+
+    // copying forward only overwrites bytes already read
+    if (d <= s || d >= s + n) {
+        return memcpy(dst, src, n);
+    }
+
+    // backward
+    d += n;
+    s += n;
+
+    if (IS_WORD_ALIGNED(d) && IS_WORD_ALIGNED(s)) {
+        for (; n >= WORD; n -= WORD) {
+            d -= WORD;
+            s -= WORD;
+            *(uint64_t *) d = *(const uint64_t *) s;
+        }
+    }
+
+    for (; n > 0; n--) {
+        *--d = *--s;
+    }
+
+    return dst;
+}
+
+void *memset(void *dst, int c, size_t n)
+{
+    uint8_t *d = dst;
+    uint64_t word = (uint8_t) c * 0x0101010101010101ULL;
+
+    for (; n > 0 && !IS_WORD_ALIGNED(d); n--) {
+        *d++ = (uint8_t) c;
+    }
+
+    for (; n >= WORD; n -= WORD, d += WORD) {
+        *(uint64_t *) d = word;
+    }
+
+    for (; n > 0; n--) {
+        *d++ = (uint8_t) c;
+    }
+
+    return dst;
+}
+
+int bcmp(const void *a, const void *b, size_t n)
+{
+    const uint8_t *x = a;
+    const uint8_t *y = b;
+
+    if (IS_WORD_ALIGNED(x) && IS_WORD_ALIGNED(y)) {
+        for (; n >= WORD; n -= WORD, x += WORD, y += WORD) {
+            if (*(const uint64_t *) x != *(const uint64_t *) y) {
+                return 1;
+            }
+        }
+    }
+
+    for (; n > 0; n--) {
+        if (*x++ != *y++) {
+            return 1;
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,24 @@
+//
+// Created by Davide Collovigh on 19/10/26.
+//
+
+#ifndef BAREMETAL_RV_MEM_OPS_H
+#define BAREMETAL_RV_MEM_OPS_H
+
+#include <stddef.h>
+
+/*
+ * Called by the compiled programs when LLVM does not expand a memcpy/memmove/memset inline
+ * (long runs re-rolled by the compiler without --rvv).
+ */
+
+void *memcpy(void *dst, const void *src, size_t n);
+void *memmove(void *dst, const void *src, size_t n);
+void *memset(void *dst, int c, size_t n);
+
+/*
+ * Compares re-rolled by the compiler without --rvv: 0 if the ranges are equal, 1 otherwise.
+ */
+int bcmp(const void *a, const void *b, size_t n);
+
+#endif //BAREMETAL_RV_MEM_OPS_H
@@ -0,0 +1,14 @@
+//
+// Created by Davide Collovigh on 19/10/26.
+//
+
+#include "qemu_rv_exit.h"
+
+void qemu_exit(uint16_t code)
+{
+    volatile uint32_t *test = (volatile uint32_t *) QEMU_TEST_BASE;
+
+    *test = code == 0 ? QEMU_TEST_PASS : ((uint32_t) code << 16) | QEMU_TEST_FAIL;
+
+    while (1);
+}
@@ -0,0 +1,20 @@
+//
+// Created by Davide Collovigh on 19/10/26.
+//
+
+#ifndef BAREMETAL_RV_QEMU_RV_EXIT_H
+#define BAREMETAL_RV_QEMU_RV_EXIT_H
+
+#include <stdint.h>
+
+// SiFive test device of the QEMU virt machine
+#define QEMU_TEST_BASE 0x100000
+#define QEMU_TEST_PASS 0x5555
+#define QEMU_TEST_FAIL 0x3333
+
+/**
+ * @brief terminates QEMU with the given exit code (0 = success)
+ */
+void qemu_exit(uint16_t code) __attribute__((noreturn));
+
+#endif //BAREMETAL_RV_QEMU_RV_EXIT_H
@@ -50,6 +50,18 @@ void itoa(int n, char* buffer)
     reverse_string(buffer, i);
 }
 
+void u64toa(uint64_t n, char* buffer)
+{
+    int i = 0;
+
+    do {
+        buffer[i++] = n % 10 + '0';
+    } while ((n /= 10) > 0);
+
+    buffer[i] = '\0';
+    reverse_string(buffer, i);
+}
+
 void hextoa(uint32_t n, char* buffer, int fixed_size)
 {
     const char digits[] = "0123456789ABCDEF";
@@ -39,6 +39,7 @@ int uart_puts(const char *str);
 
 void reverse_string(char str[], int length);
 void itoa(int n, char s[]);
+void u64toa(uint64_t n, char s[]);
 void hextoa(uint32_t n, char* buffer, int fixed_size);
 char *strcpy(char *dest, const char *src);
 uint64_t printf(const char *fmt, ...);